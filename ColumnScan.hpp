@@ -0,0 +1,400 @@
+/*
+ 
+ColumnScan.hpp ... Vectorized scans over the columns of exported sessions.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef COLUMNSCAN_HPP_t2bjd8hm1y2ge7ae
+#define COLUMNSCAN_HPP_t2bjd8hm1y2ge7ae 1
+
+#include "Gamepad.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+
+// SSE2 comes with every x86-64 processor. AVX2 does not, so its scans are
+// compiled for it alone and chosen when the processor has it; that takes
+// the target attribute of g++ 4.9, or of a clang with
+// __builtin_cpu_supports. Elsewhere the scans are plain loops, which
+// compilers vectorize as they can.
+#if __SSE2__ || _M_X64 || _M_IX86_FP >= 2
+#include <emmintrin.h>
+#define GP_SCAN_SSE2 1
+#endif
+#if defined(__clang__) && defined(__has_builtin)
+#if __has_builtin(__builtin_cpu_supports)
+#define GP_SCAN_TARGETS 1
+#endif
+#elif __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define GP_SCAN_TARGETS 1
+#endif
+#if GP_SCAN_TARGETS && (__x86_64__ || __i386__)
+#include <immintrin.h>
+#define GP_SCAN_AVX2 1
+#endif
+
+namespace GP {
+    /// A bit per row of a column group, set for the rows a scan selected.
+    class RowMask {
+    private:
+        std::vector<uint64_t> _words;
+        size_t _rows;
+        
+        void clear_tail() {
+            if (_rows % 64)
+                _words.back() &= (uint64_t(1) << _rows % 64) - 1;
+        }
+        
+    public:
+        RowMask() : _rows(0) {}
+        explicit RowMask(size_t rows) : _words((rows + 63) / 64), _rows(rows) {}
+        
+        /// Hold 'rows' rows, none selected.
+        void reset(size_t rows) {
+            _rows = rows;
+            _words.assign((rows + 63) / 64, 0);
+        }
+        
+        size_t size() const { return _rows; }
+        size_t word_count() const { return _words.size(); }
+        uint64_t* words() { return _words.data(); }
+        const uint64_t* words() const { return _words.data(); }
+        
+        bool test(size_t row) const { return _words[row / 64] >> row % 64 & 1; }
+        void set(size_t row) { _words[row / 64] |= uint64_t(1) << row % 64; }
+        
+        /// Select the rows from 'from' up to, not including, 'to'.
+        void set_range(size_t from, size_t to) {
+            for (; from < to && from % 64; ++ from)
+                this->set(from);
+            for (; from + 64 <= to; from += 64)
+                _words[from / 64] = ~uint64_t(0);
+            for (; from < to; ++ from)
+                this->set(from);
+        }
+        
+        size_t count() const {
+            size_t count = 0;
+            for (size_t i = 0; i < _words.size(); ++ i)
+                count += count_bits(_words[i]);
+            return count;
+        }
+        
+        /// Keep the rows both select; the masks must be of the same rows.
+        void intersect(const RowMask& other) {
+            for (size_t i = 0; i < _words.size(); ++ i)
+                _words[i] &= other._words[i];
+        }
+        
+        void unite(const RowMask& other) {
+            for (size_t i = 0; i < _words.size(); ++ i)
+                _words[i] |= other._words[i];
+        }
+        
+        void invert() {
+            for (size_t i = 0; i < _words.size(); ++ i)
+                _words[i] = ~_words[i];
+            if (!_words.empty())
+                this->clear_tail();
+        }
+        
+        /// Call f(size_t row) for every selected row, in order.
+        template <typename F>
+        void for_each(F f) const {
+            for (size_t i = 0; i < _words.size(); ++ i)
+                for (uint64_t word = _words[i]; word; word &= word - 1)
+                    f(i * 64 + count_trailing_zeros(word));
+        }
+    };
+    
+    ENUM_CLASS ScanIsa {
+        scalar,
+        sse2,
+        avx2,
+        scan_isa_count
+    };
+    
+    /// Scans of the columns of a ColumnGroup into RowMasks, and what the
+    /// rows they select add up to. A scan fills whole words of its mask at
+    /// a time, 4 or 8 rows to an instruction.
+    namespace ColumnScan {
+        inline bool supports(ScanIsa isa) {
+            switch (isa) {
+                case ScanIsa::scalar:
+                    return true;
+#if GP_SCAN_SSE2
+                case ScanIsa::sse2:
+                    return true;
+#endif
+#if GP_SCAN_AVX2
+                case ScanIsa::avx2:
+                    return __builtin_cpu_supports("avx2");
+#endif
+                default:
+                    return false;
+            }
+        }
+        
+        inline ScanIsa best_isa() {
+            if (supports(ScanIsa::avx2))
+                return ScanIsa::avx2;
+            return supports(ScanIsa::sse2) ? ScanIsa::sse2 : ScanIsa::scalar;
+        }
+        
+        namespace Detail {
+            inline ScanIsa& selected() {
+                static ScanIsa isa = best_isa();
+                return isa;
+            }
+            
+            // A word of the mask, of 'count' rows from 'values'.
+            inline uint64_t between_scalar(const int32_t* values, size_t count, int32_t low, int32_t high) {
+                uint64_t word = 0;
+                for (size_t i = 0; i < count; ++ i)
+                    word |= uint64_t(values[i] >= low && values[i] <= high) << i;
+                return word;
+            }
+            
+            inline uint64_t buttons_scalar(const uint64_t* held, size_t count, uint64_t mask, uint64_t want) {
+                uint64_t word = 0;
+                for (size_t i = 0; i < count; ++ i)
+                    word |= uint64_t((held[i] & mask) == want) << i;
+                return word;
+            }
+            
+#if GP_SCAN_SSE2
+            // A row is out of range if below or above it: 4 rows compare
+            // into 4 lanes, and a movemask makes them 4 bits.
+            inline void between_sse2(const int32_t* values, size_t words, int32_t low, int32_t high, uint64_t* out) {
+                const __m128i lows = _mm_set1_epi32(low);
+                const __m128i highs = _mm_set1_epi32(high);
+                for (size_t w = 0; w < words; ++ w, values += 64) {
+                    uint64_t word = 0;
+                    for (int i = 0; i < 64; i += 4) {
+                        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+                        __m128i outside = _mm_or_si128(_mm_cmplt_epi32(x, lows), _mm_cmpgt_epi32(x, highs));
+                        word |= uint64_t(~_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xf) << i;
+                    }
+                    out[w] = word;
+                }
+            }
+            
+            // SSE2 compares 32 bits at most; a 64-bit lane is equal when
+            // both its halves are.
+            inline void buttons_sse2(const uint64_t* held, size_t words, uint64_t mask, uint64_t want, uint64_t* out) {
+                const __m128i masks = _mm_set1_epi64x(static_cast<long long>(mask));
+                const __m128i wants = _mm_set1_epi64x(static_cast<long long>(want));
+                for (size_t w = 0; w < words; ++ w, held += 64) {
+                    uint64_t word = 0;
+                    for (int i = 0; i < 64; i += 2) {
+                        __m128i x = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(held + i)), masks);
+                        __m128i equal = _mm_cmpeq_epi32(x, wants);
+                        equal = _mm_and_si128(equal, _mm_shuffle_epi32(equal, _MM_SHUFFLE(2, 3, 0, 1)));
+                        word |= uint64_t(_mm_movemask_pd(_mm_castsi128_pd(equal))) << i;
+                    }
+                    out[w] = word;
+                }
+            }
+#endif
+            
+#if GP_SCAN_AVX2
+            __attribute__((target("avx2")))
+            inline void between_avx2(const int32_t* values, size_t words, int32_t low, int32_t high, uint64_t* out) {
+                const __m256i lows = _mm256_set1_epi32(low);
+                const __m256i highs = _mm256_set1_epi32(high);
+                for (size_t w = 0; w < words; ++ w, values += 64) {
+                    uint64_t word = 0;
+                    for (int i = 0; i < 64; i += 8) {
+                        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+                        __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(lows, x), _mm256_cmpgt_epi32(x, highs));
+                        word |= uint64_t(~_mm256_movemask_ps(_mm256_castsi256_ps(outside)) & 0xff) << i;
+                    }
+                    out[w] = word;
+                }
+            }
+            
+            __attribute__((target("avx2")))
+            inline void buttons_avx2(const uint64_t* held, size_t words, uint64_t mask, uint64_t want, uint64_t* out) {
+                const __m256i masks = _mm256_set1_epi64x(static_cast<long long>(mask));
+                const __m256i wants = _mm256_set1_epi64x(static_cast<long long>(want));
+                for (size_t w = 0; w < words; ++ w, held += 64) {
+                    uint64_t word = 0;
+                    for (int i = 0; i < 64; i += 4) {
+                        __m256i x = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(held + i)), masks);
+                        __m256i equal = _mm256_cmpeq_epi64(x, wants);
+                        word |= uint64_t(_mm256_movemask_pd(_mm256_castsi256_pd(equal))) << i;
+                    }
+                    out[w] = word;
+                }
+            }
+#endif
+        }
+        
+        /// The instruction set the scans use: the best the processor has,
+        /// unless select() chose another.
+        inline ScanIsa isa() { return Detail::selected(); }
+        
+        /// Scan with 'isa', as to compare them; false if the processor
+        /// lacks it.
+        inline bool select(ScanIsa isa) {
+            if (!supports(isa))
+                return false;
+            Detail::selected() = isa;
+            return true;
+        }
+        
+        /// Select the rows whose value is from 'low' to 'high', both
+        /// included.
+        inline void between(const int32_t* values, size_t rows, int32_t low, int32_t high, RowMask& out) {
+            out.reset(rows);
+            uint64_t* words = out.words();
+            size_t full = rows / 64;
+            switch (isa()) {
+#if GP_SCAN_AVX2
+                case ScanIsa::avx2:
+                    Detail::between_avx2(values, full, low, high, words);
+                    break;
+#endif
+#if GP_SCAN_SSE2
+                case ScanIsa::sse2:
+                    Detail::between_sse2(values, full, low, high, words);
+                    break;
+#endif
+                default:
+                    for (size_t w = 0; w < full; ++ w)
+                        words[w] = Detail::between_scalar(values + w * 64, 64, low, high);
+                    break;
+            }
+            if (rows % 64)
+                words[full] = Detail::between_scalar(values + full * 64, rows % 64, low, high);
+        }
+        
+        /// Select the rows whose held buttons, of those in 'mask', are
+        /// exactly 'want'.
+        inline void buttons(const uint64_t* held, size_t rows, uint64_t mask, uint64_t want, RowMask& out) {
+            out.reset(rows);
+            uint64_t* words = out.words();
+            size_t full = rows / 64;
+            switch (isa()) {
+#if GP_SCAN_AVX2
+                case ScanIsa::avx2:
+                    Detail::buttons_avx2(held, full, mask, want, words);
+                    break;
+#endif
+#if GP_SCAN_SSE2
+                case ScanIsa::sse2:
+                    Detail::buttons_sse2(held, full, mask, want, words);
+                    break;
+#endif
+                default:
+                    for (size_t w = 0; w < full; ++ w)
+                        words[w] = Detail::buttons_scalar(held + w * 64, 64, mask, want);
+                    break;
+            }
+            if (rows % 64)
+                words[full] = Detail::buttons_scalar(held + full * 64, rows % 64, mask, want);
+        }
+        
+        /// Select the rows where 'button' is held.
+        inline void held(const uint64_t* held, size_t rows, Button button, RowMask& out) {
+            uint64_t bit = uint64_t(1) << ButtonSet::index(button);
+            buttons(held, rows, bit, bit, out);
+        }
+        
+        /// Select the rows of 'in' whose row before is not in it: where a
+        /// predicate becomes true. 'previous' is whether the row before the
+        /// first was in it, and becomes whether the last row is, so that the
+        /// groups of a device scan one after the other.
+        inline void rising(const RowMask& in, bool& previous, RowMask& out) {
+            out.reset(in.size());
+            const uint64_t* words = in.words();
+            uint64_t carry = previous;
+            for (size_t w = 0; w < in.word_count(); ++ w) {
+                out.words()[w] = words[w] & ~(words[w] << 1 | carry);
+                carry = words[w] >> 63;
+            }
+            if (in.size())
+                previous = in.test(in.size() - 1);
+        }
+        
+        /// Select the rows not in 'in' whose row before is: where a
+        /// predicate becomes false.
+        inline void falling(const RowMask& in, bool& previous, RowMask& out) {
+            out.reset(in.size());
+            const uint64_t* words = in.words();
+            uint64_t carry = previous;
+            for (size_t w = 0; w < in.word_count(); ++ w) {
+                out.words()[w] = ~words[w] & (words[w] << 1 | carry);
+                carry = words[w] >> 63;
+            }
+            if (in.size()) {
+                if (in.size() % 64)
+                    out.words()[in.word_count() - 1] &= (uint64_t(1) << in.size() % 64) - 1;
+                previous = in.test(in.size() - 1);
+            }
+        }
+        
+        /// Append the timestamps of the selected rows to 'out'.
+        inline void times(const uint64_t* timestamps, const RowMask& rows, std::vector<uint64_t>& out) {
+            rows.for_each([&](size_t row) { out.push_back(timestamps[row]); });
+        }
+        
+        /// Select the rows from 'from' to 'to', both included, of a
+        /// group's ascending timestamps.
+        inline void time_range(const uint64_t* timestamps, size_t rows, uint64_t from, uint64_t to, RowMask& out) {
+            out.reset(rows);
+            const uint64_t* first = std::lower_bound(timestamps, timestamps + rows, from);
+            const uint64_t* last = std::upper_bound(first, timestamps + rows, to);
+            out.set_range(first - timestamps, last - timestamps);
+        }
+        
+        /// Count the times of 'left' with a time of 'right' no more than
+        /// 'before' earlier or 'after' later, in one pass over both; both
+        /// must be ascending. The indices of the matching times of 'left'
+        /// go to 'matched' if given.
+        inline size_t join_within(const std::vector<uint64_t>& left, const std::vector<uint64_t>& right,
+                                  uint64_t before, uint64_t after, std::vector<size_t>* matched = NULL) {
+            size_t matches = 0;
+            size_t j = 0;
+            for (size_t i = 0; i < left.size(); ++ i) {
+                uint64_t earliest = left[i] > before ? left[i] - before : 0;
+                while (j < right.size() && right[j] < earliest)
+                    ++ j;
+                if (j < right.size() && right[j] <= left[i] + after) {
+                    ++ matches;
+                    if (matched)
+                        matched->push_back(i);
+                }
+            }
+            return matches;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,347 @@
+/*
+ 
+Columns.hpp ... Export of recorded sessions to columns, for analysis.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef COLUMNS_HPP_bjfseidwvy7l0xth
+#define COLUMNS_HPP_bjfseidwvy7l0xth 1
+
+#include "Session.hpp"
+#include "Exception.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <climits>
+#include <cstdio>
+#include <vector>
+
+namespace GP {
+    // A columns file, all integers little-endian:
+    //
+    //   ColumnFileHeader
+    //   groups: a ColumnGroupHeader, then its columns
+    //
+    // A group holds consecutive frames of one device: a column of their
+    // timestamps, one of their held buttons, and one per axis the device
+    // has. The header and each column start a multiple of 64 bytes into the
+    // file, so that a mapped file is scanned in place, with aligned loads.
+    // The groups of a device follow each other in time; a device starts a
+    // new group when it attaches again. Raw reports are not exported.
+    //
+    // A file cut short ends at its last whole group.
+    
+    namespace ColumnEncoding {
+        enum {
+            kVersion = 1,
+            kGroupMagic = 0x4c4f4347,           // "GCOL"
+            kAlignment = 64
+        };
+        
+        inline uint64_t aligned(uint64_t offset) {
+            return (offset + kAlignment - 1) & ~uint64_t(kAlignment - 1);
+        }
+    }
+    
+    struct ColumnFileHeader {
+        char magic[8];          // "GPCOLMN\0"
+        uint32_t version;
+        uint32_t group_rows;    // the most rows in a group.
+    };
+    
+    struct ColumnGroupHeader {
+        uint32_t magic;         // kGroupMagic
+        uint32_t device;        // its number in the session.
+        uint32_t row_count;
+        uint32_t axes;          // a bit per Axis with a column.
+        uint64_t size;          // of the group, with this header.
+        uint64_t first_timestamp;
+        uint64_t last_timestamp;
+        char name[64];
+        int64_t bounds[static_cast<int>(Axis::count)];
+        // of the columns, from this header.
+        uint64_t timestamps;    // uint64_t per row
+        uint64_t buttons;       // uint64_t per row, as ButtonSet::bits()
+        uint64_t axis_columns[static_cast<int>(Axis::count)];  // int32_t per row
+    };
+    
+    /// Exports the frames of a session to a columns file, a group of each
+    /// device at a time, so that a session of any length exports in the
+    /// memory of one group per device.
+    class ColumnExporter {
+    private:
+        struct Pending {
+            SessionDevice descriptor;
+            std::vector<uint64_t> timestamps;
+            std::vector<uint64_t> buttons;
+            std::vector<int32_t> axes[static_cast<int>(Axis::count)];
+        };
+        
+        FILE* _file;
+        size_t _group_rows;
+        std::vector<Pending> _pending;          // by device
+        uint64_t _rows;
+        uint64_t _groups;
+        
+        ColumnExporter(const ColumnExporter&);
+        ColumnExporter& operator=(const ColumnExporter&);
+        
+        ColumnExporter(FILE* file, size_t group_rows)
+            : _file(file), _group_rows(group_rows), _rows(0), _groups(0) {
+            this->pad(sizeof(ColumnFileHeader));
+        }
+        
+        void pad(uint64_t written) {
+            static const char zeros[ColumnEncoding::kAlignment] = {};
+            fwrite(zeros, 1, ColumnEncoding::aligned(written) - written, _file);
+        }
+        
+        template <typename T>
+        void write_column(const std::vector<T>& column) {
+            fwrite(column.data(), sizeof(T), column.size(), _file);
+            this->pad(column.size() * sizeof(T));
+        }
+        
+        void flush(size_t device) {
+            Pending& pending = _pending[device];
+            size_t rows = pending.timestamps.size();
+            if (!rows)
+                return;
+            
+            ColumnGroupHeader header = {};
+            header.magic = ColumnEncoding::kGroupMagic;
+            header.device = static_cast<uint32_t>(device);
+            header.row_count = static_cast<uint32_t>(rows);
+            header.axes = pending.descriptor.axes;
+            header.first_timestamp = pending.timestamps.front();
+            header.last_timestamp = pending.timestamps.back();
+            memcpy(header.name, pending.descriptor.name, sizeof(header.name));
+            
+            uint64_t offset = ColumnEncoding::aligned(sizeof(header));
+            header.timestamps = offset;
+            offset += ColumnEncoding::aligned(rows * sizeof(uint64_t));
+            header.buttons = offset;
+            offset += ColumnEncoding::aligned(rows * sizeof(uint64_t));
+            for (int i = 0; i < static_cast<int>(Axis::count); ++ i) {
+                header.bounds[i] = pending.descriptor.bounds[i];
+                if (header.axes >> i & 1) {
+                    header.axis_columns[i] = offset;
+                    offset += ColumnEncoding::aligned(rows * sizeof(int32_t));
+                }
+            }
+            header.size = offset;
+            
+            fwrite(&header, sizeof(header), 1, _file);
+            this->pad(sizeof(header));
+            this->write_column(pending.timestamps);
+            this->write_column(pending.buttons);
+            for (int i = 0; i < static_cast<int>(Axis::count); ++ i)
+                if (header.axes >> i & 1)
+                    this->write_column(pending.axes[i]);
+            
+            _rows += rows;
+            ++ _groups;
+            pending.timestamps.clear();
+            pending.buttons.clear();
+            for (int i = 0; i < static_cast<int>(Axis::count); ++ i)
+                pending.axes[i].clear();
+        }
+        
+        static int32_t clamp(long value) {
+            return value < INT32_MIN ? INT32_MIN : value > INT32_MAX ? INT32_MAX : static_cast<int32_t>(value);
+        }
+        
+    public:
+        /// Create 'path' for groups of at most 'group_rows' rows.
+        static ColumnExporter* create(const char* path, size_t group_rows = 65536) {
+            FILE* file = fopen(path, "wb");
+            if (!file)
+                throw ColumnFileException();
+            ColumnFileHeader header = {{'G', 'P', 'C', 'O', 'L', 'M', 'N', '\0'}, ColumnEncoding::kVersion, static_cast<uint32_t>(group_rows)};
+            if (fwrite(&header, sizeof(header), 1, file) != 1) {
+                fclose(file);
+                throw ColumnFileException();
+            }
+            return new ColumnExporter(file, std::max<size_t>(group_rows, 1));
+        }
+        
+        /// Write what is pending and close the file, unless close() did;
+        /// a failure is only reported by close().
+        ~ColumnExporter() {
+            if (_file) {
+                this->flush();
+                fclose(_file);
+            }
+        }
+        
+        /// Write the rows of every device as groups, however few, out to
+        /// the file. Return false if a write failed, now or before: the file
+        /// is incomplete.
+        bool flush() {
+            for (size_t device = 0; device < _pending.size(); ++ device)
+                this->flush(device);
+            return fflush(_file) == 0 && !ferror(_file);
+        }
+        
+        /// Write what is pending and close the file. Throw
+        /// ColumnFileException if any write failed, as on a full disk.
+        void close() {
+            bool ok = this->flush();
+            ok = fclose(_file) == 0 && ok;
+            _file = NULL;
+            if (!ok)
+                throw ColumnFileException();
+        }
+        
+        /// Export a record; only frames make rows. Call only before close().
+        void add(const SessionRecord& record) {
+            size_t device = static_cast<size_t>(record.device);
+            if (device >= _pending.size())
+                _pending.resize(device + 1);
+            Pending& pending = _pending[device];
+            
+            if (record.type != SessionRecordType::frame) {
+                if (record.type == SessionRecordType::attach || record.type == SessionRecordType::detach)
+                    this->flush(device);
+                return;
+            }
+            
+            const SessionDeviceState& state = *record.state;
+            if (pending.timestamps.empty())
+                pending.descriptor = state.descriptor;
+            pending.timestamps.push_back(record.timestamp);
+            pending.buttons.push_back(state.held.bits());
+            for (int i = 0; i < static_cast<int>(Axis::count); ++ i)
+                if (pending.descriptor.axes >> i & 1)
+                    pending.axes[i].push_back(clamp(state.axes[i]));
+            
+            if (pending.timestamps.size() >= _group_rows)
+                this->flush(device);
+        }
+        
+        /// Export every record of 'reader'; return false if it stopped at
+        /// a damaged one.
+        bool add(const SessionReader& reader) {
+            SessionReader::Cursor cursor = reader.begin();
+            SessionRecord record;
+            while (cursor.next(record))
+                this->add(record);
+            return !cursor.damaged();
+        }
+        
+        /// Rows and groups written so far.
+        uint64_t rows() const { return _rows; }
+        uint64_t groups() const { return _groups; }
+    };
+    
+    /// A group of a columns file, pointing into the file's memory.
+    struct ColumnGroup {
+        int device;
+        const char* name;
+        size_t rows;
+        unsigned axes;
+        uint64_t first_timestamp;
+        uint64_t last_timestamp;
+        const int64_t* bounds;
+        const uint64_t* timestamps;
+        const uint64_t* buttons;
+        const int32_t* axis_columns[static_cast<int>(Axis::count)];    // NULL without the axis.
+        
+        const int32_t* axis(Axis axis) const { return axis_columns[static_cast<int>(axis)]; }
+        
+        /// The value 'fraction' of the way from the center to the bound of
+        /// 'axis': 0.8 is 80% of the way to the positive end, -0.8 to the
+        /// negative end.
+        int32_t threshold(Axis axis, double fraction) const {
+            double value = fraction * double(bounds[static_cast<int>(axis)]);
+            return value >= INT32_MAX ? INT32_MAX : value <= INT32_MIN ? INT32_MIN : static_cast<int32_t>(value);
+        }
+    };
+    
+    /// Reads a columns file from memory, such as a mapped file, without
+    /// copying it.
+    class ColumnReader {
+    private:
+        std::vector<ColumnGroup> _groups;
+        uint64_t _row_count;
+        bool _complete;
+        
+    public:
+        /// Throw ColumnFormatException unless 'data' holds a columns file.
+        ColumnReader(const void* data, size_t size) : _row_count(0), _complete(true) {
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            const ColumnFileHeader* header = static_cast<const ColumnFileHeader*>(data);
+            if (size < sizeof(ColumnFileHeader) || memcmp(header->magic, "GPCOLMN", 8) || header->version != ColumnEncoding::kVersion)
+                throw ColumnFormatException();
+            
+            uint64_t offset = ColumnEncoding::aligned(sizeof(ColumnFileHeader));
+            while (offset < size) {
+                const ColumnGroupHeader* group = reinterpret_cast<const ColumnGroupHeader*>(bytes + offset);
+                if (size - offset < sizeof(ColumnGroupHeader) || group->magic != ColumnEncoding::kGroupMagic
+                 || group->size > size - offset || group->size < sizeof(ColumnGroupHeader)) {
+                    _complete = false;
+                    break;
+                }
+                
+                uint64_t rows = group->row_count;
+                bool ok = group->timestamps + rows * sizeof(uint64_t) <= group->size
+                       && group->buttons + rows * sizeof(uint64_t) <= group->size;
+                ColumnGroup view = {};
+                view.device = static_cast<int>(group->device);
+                view.name = group->name;
+                view.rows = static_cast<size_t>(rows);
+                view.axes = group->axes;
+                view.first_timestamp = group->first_timestamp;
+                view.last_timestamp = group->last_timestamp;
+                view.bounds = group->bounds;
+                view.timestamps = reinterpret_cast<const uint64_t*>(bytes + offset + group->timestamps);
+                view.buttons = reinterpret_cast<const uint64_t*>(bytes + offset + group->buttons);
+                for (int i = 0; i < static_cast<int>(Axis::count); ++ i) {
+                    if (group->axes >> i & 1) {
+                        ok = ok && group->axis_columns[i] + rows * sizeof(int32_t) <= group->size;
+                        view.axis_columns[i] = reinterpret_cast<const int32_t*>(bytes + offset + group->axis_columns[i]);
+                    }
+                }
+                if (!ok || memchr(group->name, '\0', sizeof(group->name)) == NULL)
+                    throw ColumnFormatException();
+                
+                _groups.push_back(view);
+                _row_count += rows;
+                offset += ColumnEncoding::aligned(group->size);
+            }
+        }
+        
+        size_t group_count() const { return _groups.size(); }
+        const ColumnGroup& group(size_t index) const { return _groups[index]; }
+        uint64_t row_count() const { return _row_count; }
+        /// Whether the file ends with a whole group, not cut short.
+        bool complete() const { return _complete; }
+    };
+}
+
+#endif
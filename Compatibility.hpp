@@ -49,4 +49,72 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define ENUM_CLASS enum
 #endif
 
+#if _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+// Keeps rarely run code, such as timeouts, from being inlined or from
+// changing how the report path is inlined.
+#if __GNUC__
+#define COLD __attribute__((cold))
+#else
+#define COLD
+#endif
+
+#if _MSC_VER
+#include <intrin.h>
+#endif
+
+// Index of the lowest set bit. The argument must not be zero.
+static inline int count_trailing_zeros(unsigned long long bits) {
+#if __GNUC__
+    return __builtin_ctzll(bits);
+#else
+    unsigned long index;
+    if (_BitScanForward(&index, static_cast<unsigned long>(bits)))
+        return static_cast<int>(index);
+    _BitScanForward(&index, static_cast<unsigned long>(bits >> 32));
+    return static_cast<int>(index) + 32;
+#endif
+}
+
+// Number of zero bits above the highest set one. The argument must not be zero.
+static inline int count_leading_zeros(unsigned long long bits) {
+#if __GNUC__
+    return __builtin_clzll(bits);
+#else
+    unsigned long index;
+    if (_BitScanReverse(&index, static_cast<unsigned long>(bits >> 32)))
+        return 31 - static_cast<int>(index);
+    _BitScanReverse(&index, static_cast<unsigned long>(bits));
+    return 63 - static_cast<int>(index);
+#endif
+}
+
+// Tell the processor it is in a spin-wait loop, which spares the other
+// hyperthread of the core and the pipeline flush on leaving the loop.
+static inline void spin_pause() {
+#if _MSC_VER
+    _mm_pause();
+#elif __GNUC__ && (__i386__ || __x86_64__)
+    __builtin_ia32_pause();
+#elif __GNUC__ && __aarch64__
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Number of set bits.
+static inline int count_bits(unsigned long long bits) {
+#if __GNUC__
+    return __builtin_popcountll(bits);
+#else
+    bits -= (bits >> 1) & 0x5555555555555555ull;
+    bits = (bits & 0x3333333333333333ull) + ((bits >> 2) & 0x3333333333333333ull);
+    bits = (bits + (bits >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return static_cast<int>((bits * 0x0101010101010101ull) >> 56);
+#endif
+}
+
 #endif
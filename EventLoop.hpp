@@ -0,0 +1,85 @@
+/*
+ 
+EventLoop.hpp ... Event loop driving the Linux backend.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef EVENT_LOOP_HPP_gcd47htjbga5eijr
+#define EVENT_LOOP_HPP_gcd47htjbga5eijr 1
+
+#include "Compatibility.hpp"
+
+namespace GP {
+    // The 'eventloop' passed to GamepadChangedObserver::create() and
+    // Timer::create() is a CFRunLoopRef on Darwin and an HWND on Windows. On
+    // Linux it is an EventLoop, which can be used in two ways:
+    //
+    //  - built-in: run() blocks and dispatches until quit() is called.
+    //  - embedded: add readiness_fd() to your own poll/select/epoll loop, and
+    //    call dispatch_pending() whenever it is readable. The library then
+    //    starts no thread and causes no wakeup except through that fd.
+    class EventLoop {
+    public:
+        typedef void (*Callback)(void* self, int fd);
+        typedef void (*Task)(void* self);
+        
+    private:
+        EventLoop(const EventLoop&);
+        EventLoop& operator=(const EventLoop&);
+        
+    protected:
+        EventLoop() {}
+        
+    public:
+        // Call the callback on the loop whenever fd is readable. Return false
+        // if the fd cannot be watched. A callback may add and remove watches,
+        // including its own.
+        virtual bool add_watch(int fd, void* self, Callback callback) = 0;
+        virtual void remove_watch(int fd) = 0;
+        
+        // Run the task once on the loop. Unlike every other method, this one
+        // may be called from any thread.
+        virtual void post(void* self, Task task) = 0;
+        
+        virtual void run() = 0;
+        virtual void quit() = 0;
+        
+        virtual int readiness_fd() const = 0;
+        // Run the callbacks of every ready fd without blocking, and return how
+        // many were run.
+        virtual int dispatch_pending() = 0;
+        
+        virtual ~EventLoop() {}
+        
+        // remember to use 'delete' to kill the event loop, after everything
+        // created on it.
+        static EXPORT EventLoop* create();
+    };
+}
+
+#endif
@@ -49,9 +49,41 @@ namespace GP {
         MultipleObserverException() : BaseException("Cannot attach more than one observer to the same event loop") {}
     };
     
+    struct GamepadSharedException : public BaseException {
+        GamepadSharedException() : BaseException("This gamepad is shared by several observers; subscribe to it instead.") {}
+    };
+    
     struct NoEventloopException : public BaseException {
         NoEventloopException() : BaseException("Cannot obtain a handle to the system event loop.") {}
     };
+    
+    struct SessionFileException : public BaseException {
+        SessionFileException() : BaseException("Cannot open or map the session file.") {}
+    };
+    
+    struct SessionFormatException : public BaseException {
+        SessionFormatException() : BaseException("Not a session recording, or a damaged one.") {}
+    };
+    
+    struct ColumnFileException : public BaseException {
+        ColumnFileException() : BaseException("Cannot create or write the columns file.") {}
+    };
+    
+    struct ColumnFormatException : public BaseException {
+        ColumnFormatException() : BaseException("Not a columns file, or a damaged one.") {}
+    };
+    
+    struct StreamSocketException : public BaseException {
+        StreamSocketException() : BaseException("Cannot bind or reach the stream address.") {}
+    };
+    
+    struct SharedStateException : public BaseException {
+        SharedStateException() : BaseException("Cannot create or map the shared state.") {}
+    };
+    
+    struct SharedStateFormatException : public BaseException {
+        SharedStateFormatException() : BaseException("Not a shared state, or one of another version.") {}
+    };
 }
 
 #endif
\ No newline at end of file
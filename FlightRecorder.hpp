@@ -0,0 +1,209 @@
+/*
+ 
+FlightRecorder.hpp ... A ring of the recent events of the input path.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef FLIGHTRECORDER_HPP_1bomeczpv9dp1q38
+#define FLIGHTRECORDER_HPP_1bomeczpv9dp1q38 1
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+#include "Compatibility.hpp"
+
+namespace GP {
+    ENUM_CLASS FlightEvent {
+        read,                   // argument: bytes read.
+        decode,                 // argument: events or bytes in the report.
+        dispatch,               // argument: the sequence number of the frame.
+        attach,                 // argument: the slot of the gamepad.
+        detach,
+        transaction,            // argument: values and buttons sent.
+        timer,
+        slow_callback,          // argument: the index of the subscriber, or 64.
+        stall,                  // the silence of a device; argument: its norm.
+        event_count
+    };
+    
+    struct FlightRecord {
+        uint64_t start;         // Timer::monotonic_nanoseconds().
+        uint64_t duration;      // 0 for an instant.
+        uint64_t subject;       // the address of the gamepad or timer.
+        uint64_t argument;
+        uint32_t thread;        // numbered from 1 in the order threads record.
+        uint32_t event;
+    };
+    
+    // What dump_on_crash() writes, followed by 'count' records.
+    struct FlightDumpHeader {
+        char magic[4];          // "GPFR"
+        uint32_t version;
+        uint32_t record_size;
+        uint32_t count;
+    };
+    
+    /// The last events of the input path, of every thread. Recording takes
+    /// no lock and allocates nothing, so it is never turned off.
+    class FlightRecorder {
+    public:
+        enum { kCapacity = 4096 };
+        
+    private:
+        // Each slot is a seqlock: odd while being written, so that a reader
+        // skips a record torn by a writer, or overwritten as it read it.
+        struct Slot {
+            std::atomic<uint64_t> sequence;
+            std::atomic<uint64_t> start, duration, subject, argument;
+            std::atomic<uint64_t> thread_and_event;
+        };
+        
+        std::atomic<uint64_t> _next;
+        Slot _slots[kCapacity];
+        
+        FlightRecorder() : _next(0) {
+            for (int i = 0; i < kCapacity; ++ i)
+                _slots[i].sequence.store(0, std::memory_order_relaxed);
+        }
+        
+        FlightRecorder(const FlightRecorder&);
+        FlightRecorder& operator=(const FlightRecorder&);
+        
+        static const char* name(uint32_t event) {
+            static const char* const names[] = {"read", "decode", "dispatch", "attach", "detach", "transaction", "timer", "slow_callback", "stall"};
+            return event < static_cast<uint32_t>(FlightEvent::event_count) ? names[event] : "unknown";
+        }
+        
+    public:
+        static FlightRecorder& instance() {
+            static FlightRecorder recorder;
+            return recorder;
+        }
+        
+        static uint32_t thread_id() {
+            static std::atomic<uint32_t> thread_count(0);
+            static THREAD_LOCAL uint32_t id = 0;
+            if (!id)
+                id = ++ thread_count;
+            return id;
+        }
+        
+        void record(FlightEvent event, const void* subject, uint64_t argument, uint64_t start, uint64_t duration = 0) {
+            uint64_t index = _next.fetch_add(1, std::memory_order_relaxed);
+            Slot& slot = _slots[index % kCapacity];
+            slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.start.store(start, std::memory_order_relaxed);
+            slot.duration.store(duration, std::memory_order_relaxed);
+            slot.subject.store(reinterpret_cast<uintptr_t>(subject), std::memory_order_relaxed);
+            slot.argument.store(argument, std::memory_order_relaxed);
+            slot.thread_and_event.store(static_cast<uint64_t>(thread_id()) << 32 | static_cast<uint32_t>(event), std::memory_order_relaxed);
+            slot.sequence.store(2 * index + 2, std::memory_order_release);
+        }
+        
+        // Copy the complete records, oldest first, and return their number.
+        // Only reads memory, so it is safe in a signal handler.
+        size_t snapshot(FlightRecord* records, size_t capacity) const {
+            uint64_t end = _next.load(std::memory_order_acquire);
+            uint64_t begin = end > kCapacity ? end - kCapacity : 0;
+            if (end - begin > capacity)
+                begin = end - capacity;
+            
+            size_t count = 0;
+            for (uint64_t index = begin; index < end; ++ index) {
+                const Slot& slot = _slots[index % kCapacity];
+                uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+                if (sequence != 2 * index + 2)
+                    continue;
+                FlightRecord& record = records[count];
+                record.start = slot.start.load(std::memory_order_relaxed);
+                record.duration = slot.duration.load(std::memory_order_relaxed);
+                record.subject = slot.subject.load(std::memory_order_relaxed);
+                record.argument = slot.argument.load(std::memory_order_relaxed);
+                uint64_t thread_and_event = slot.thread_and_event.load(std::memory_order_relaxed);
+                record.thread = static_cast<uint32_t>(thread_and_event >> 32);
+                record.event = static_cast<uint32_t>(thread_and_event);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.sequence.load(std::memory_order_relaxed) == sequence)
+                    ++ count;
+            }
+            return count;
+        }
+        
+        // Write the records as Chrome trace events, for chrome://tracing or
+        // Perfetto. Times are in microseconds of the monotonic clock.
+        static void write_chrome_trace(FILE* file, const FlightRecord* records, size_t count) {
+            fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", file);
+            for (size_t i = 0; i < count; ++ i) {
+                const FlightRecord& record = records[i];
+                fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"gamepad\",\"pid\":1,\"tid\":%u,\"ts\":%llu.%03u,",
+                        i ? "," : "", name(record.event), record.thread,
+                        (unsigned long long)(record.start / 1000), static_cast<unsigned>(record.start % 1000));
+                if (record.duration)
+                    fprintf(file, "\"ph\":\"X\",\"dur\":%llu.%03u,",
+                            (unsigned long long)(record.duration / 1000), static_cast<unsigned>(record.duration % 1000));
+                else
+                    fputs("\"ph\":\"i\",\"s\":\"t\",", file);
+                fprintf(file, "\"args\":{\"subject\":\"0x%llx\",\"argument\":%llu}}",
+                        (unsigned long long)record.subject, (unsigned long long)record.argument);
+            }
+            fputs("\n]}\n", file);
+        }
+        
+        void write_chrome_trace(FILE* file) const {
+            std::vector<FlightRecord> records(kCapacity);
+            write_chrome_trace(file, records.data(), this->snapshot(records.data(), records.size()));
+        }
+        
+        static void fill_dump_header(FlightDumpHeader& header, size_t count) {
+            memcpy(header.magic, "GPFR", 4);
+            header.version = 1;
+            header.record_size = sizeof(FlightRecord);
+            header.count = static_cast<uint32_t>(count);
+        }
+        
+        // Read what dump_on_crash() wrote. Return false if it is not a dump.
+        static bool read_dump(FILE* file, std::vector<FlightRecord>& records) {
+            FlightDumpHeader header;
+            if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, "GPFR", 4) != 0
+                    || header.version != 1 || header.record_size != sizeof(FlightRecord))
+                return false;
+            records.resize(header.count);
+            return header.count == 0 || fread(records.data(), sizeof(FlightRecord), header.count, file) == header.count;
+        }
+        
+        /// Write the records to 'path' if the process crashes: on a fatal
+        /// signal, or an unhandled exception on Windows. Convert the dump with
+        /// read_dump() and write_chrome_trace(), as linux/flight_trace does.
+        static EXPORT bool dump_on_crash(const char* path);
+    };
+}
+
+#endif
@@ -35,7 +35,21 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <utility>
 #include <climits>
+#include <cstddef>
+#include <stdint.h>
+#include <type_traits>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <condition_variable>
+#include <vector>
 #include "Compatibility.hpp"
+#include "Timer.hpp"
+#include "Statistics.hpp"
+#include "Latency.hpp"
+#include "ReportRate.hpp"
+#include "Exception.hpp"
 
 namespace GP {
     class Transaction;
@@ -83,6 +97,104 @@ namespace GP {
     template <typename T>
     static const T* name(AxisGroup);
 
+    class Gamepad;
+
+    /// A set of buttons stored as a 64-bit mask. Buttons _1 to _59 occupy bits
+    /// 1 to 59, and menu, play_pause, volume_increase and volume_decrease
+    /// occupy bits 60 to 63. Other buttons cannot be stored in the set.
+    class ButtonSet {
+    private:
+        uint64_t _bits;
+
+    public:
+        ButtonSet() : _bits(0) {}
+        explicit ButtonSet(uint64_t bits) : _bits(bits) {}
+
+        /// Return the bit index of the button, or -1 if it cannot be stored.
+        static int index(Button button);
+        static Button button_at(int index);
+
+        uint64_t bits() const { return _bits; }
+        bool empty() const { return _bits == 0; }
+        bool contains(Button button) const;
+        void insert(Button button);
+        void erase(Button button);
+        void clear() { _bits = 0; }
+
+        /// Call f(Button) for every button in the set, in index order.
+        template <typename F>
+        void for_each(F f) const;
+
+        bool operator==(const ButtonSet& other) const { return _bits == other._bits; }
+        bool operator!=(const ButtonSet& other) const { return _bits != other._bits; }
+    };
+
+    /// A snapshot of everything that happened in one input report.
+    struct Frame {
+        /// Index of this report, counting from 1.
+        uint64_t sequence;
+        /// Nanoseconds since the gamepad was attached, as the sum of all
+        /// nanoseconds_elapsed so far.
+        uint64_t timestamp;
+        unsigned nanoseconds_elapsed;
+
+        /// Axis values relative to the centroid, indexed by Axis.
+        long axes[static_cast<int>(Axis::count)];
+        /// Bit i is set if axes[i] differs from the previous frame.
+        unsigned changed_axes;
+        /// Bit i is set if axes[i] is not at the centroid.
+        unsigned moving_axes;
+
+        ButtonSet pressed;      // buttons which went down in this report.
+        ButtonSet released;     // buttons which went up in this report.
+        ButtonSet held;         // buttons which are down after this report.
+
+        /// Call f(Button, bool is_pressed) for every press and release in
+        /// the report, in index order. A button which went both down and
+        /// up gives both, ending in its held state.
+        template <typename F>
+        void for_each_button_change(F f) const;
+    };
+
+    /// Selects the events a subscriber receives. The masks are indexed by Axis,
+    /// AxisGroup, ButtonSet::index() and Gamepad::slot() respectively. Buttons
+    /// which ButtonSet cannot store are only sent if all buttons are selected.
+    struct Interest {
+        unsigned axes;
+        unsigned axis_groups;
+        ButtonSet buttons;
+        uint64_t devices;
+
+        static Interest everything();
+    };
+
+    /// Base class of listeners bound at compile time with Gamepad::listen().
+    /// Derive from it and redeclare only the handlers you need; the rest do
+    /// nothing and are compiled out of the dispatch loop.
+    struct Listener {
+        void axis_changed(Gamepad*, Axis, long, unsigned) {}
+        void axis_state_changed(Gamepad*, Axis, AxisState) {}
+        void axis_group_changed(Gamepad*, AxisGroup, long[], unsigned) {}
+        void axis_group_state_changed(Gamepad*, AxisGroup, AxisState) {}
+        void button_changed(Gamepad*, Button, bool) {}
+        void frame(Gamepad*, const Frame&) {}
+    };
+
+    /// Tells which handlers of Listener a listener type redeclares.
+    template <typename L>
+    struct ListenerTraits {
+#define GP_LISTENER_HANDLES(method) method = !std::is_same<decltype(&L::method), decltype(&Listener::method)>::value
+        enum {
+            GP_LISTENER_HANDLES(axis_changed),
+            GP_LISTENER_HANDLES(axis_state_changed),
+            GP_LISTENER_HANDLES(axis_group_changed),
+            GP_LISTENER_HANDLES(axis_group_state_changed),
+            GP_LISTENER_HANDLES(button_changed),
+            GP_LISTENER_HANDLES(frame)
+        };
+#undef GP_LISTENER_HANDLES
+    };
+
 
     class Gamepad {
     public:
@@ -93,32 +205,246 @@ namespace GP {
         typedef void (*AxisGroupChangedCallback)(void* self, Gamepad* gamepad, AxisGroup axis_group, long new_values[], unsigned nanoseconds_elapsed);
         typedef void (*AxisGroupStateChangedCallback)(void* self, Gamepad* gamepad, AxisGroup axis, AxisState state);
         
+        typedef void (*FrameCallback)(void* self, Gamepad* gamepad, const Frame& frame);
+        typedef void (*StallCallback)(void* self, Gamepad* gamepad, bool stalled, uint64_t silent_nanoseconds);
+        
+        /// A set of callbacks registered with subscribe(). Leave unused
+        /// callbacks NULL. A frame is sent when it changes any axis or button
+        /// of the interest.
+        struct Subscriber {
+            void* self;
+            AxisChangedCallback axis_changed;
+            AxisStateChangedCallback axis_state_changed;
+            AxisGroupChangedCallback axis_group_changed;
+            AxisGroupStateChangedCallback axis_group_state_changed;
+            ButtonChangedCallback button_changed;
+            FrameCallback frame;
+            Interest interest;
+        };
+        
+        static const int kMaxSubscribers = 64;
+        
+        /// How long the callbacks of a subscription took, with a budget set.
+        struct CallbackTiming {
+            uint64_t calls;
+            uint64_t slow_calls;        // calls longer than the budget.
+            uint64_t max_nanoseconds;
+            bool isolated;              // moved to a delivery thread.
+            uint64_t dropped_events;    // events its full queue turned away.
+        };
+        
     private:                
-        void* _axis_changed_self;
-        AxisChangedCallback _axis_changed_callback;
-        void* _button_changed_self;
-        ButtonChangedCallback _button_changed_callback;
-        void* _axis_state_self;
-        AxisStateChangedCallback _axis_state_callback;
-        void* _axis_group_changed_self;
-        AxisGroupChangedCallback _axis_group_changed_callback;
-        void* _axis_group_state_changed_self;
-        AxisGroupStateChangedCallback _axis_group_state_changed_callback;
+        struct Delivery;
+        
+        // Everything registered on the gamepad: the C-style callbacks, the
+        // bound listener and the subscribers. A published table is never
+        // modified. Registering copies the table, changes the copy and swaps
+        // the pointer, so a dispatch sees either the old or the new table as
+        // a whole, and only pays one load for it, after flagging the dispatch.
+        struct DispatchTable {
+            void* axis_changed_self;
+            AxisChangedCallback axis_changed_callback;
+            void* button_changed_self;
+            ButtonChangedCallback button_changed_callback;
+            void* axis_state_self;
+            AxisStateChangedCallback axis_state_callback;
+            void* axis_group_changed_self;
+            AxisGroupChangedCallback axis_group_changed_callback;
+            void* axis_group_state_changed_self;
+            AxisGroupStateChangedCallback axis_group_state_changed_callback;
+            void* frame_self;
+            FrameCallback frame_callback;
+            
+            // The listener bound by listen(), and its instantiation of dispatch().
+            void* listener;
+            void (*listener_dispatch)(Gamepad* gamepad, void* listener, unsigned previously_moving_axes);
+            
+            // The subscribers, and for each event type the mask of subscribers
+            // interested in it.
+            Subscriber subscribers[kMaxSubscribers];
+            int ids[kMaxSubscribers];
+            uint64_t used;
+            
+            uint64_t axis_changed[static_cast<int>(Axis::count)];
+            uint64_t axis_state_changed[static_cast<int>(Axis::count)];
+            uint64_t axis_group_changed[static_cast<int>(AxisGroup::group_count)];
+            uint64_t axis_group_state_changed[static_cast<int>(AxisGroup::group_count)];
+            uint64_t button_changed[64];
+            uint64_t other_button_changed;
+            uint64_t frame;
+            bool has_legacy_axis_events;
+            bool has_subscriber_axis_events;
+            
+            // The threads of the subscribers moved off the dispatching
+            // thread. The last table holding one tells it to stop when freed.
+            std::shared_ptr<Delivery> deliveries[kMaxSubscribers];
+            uint64_t isolated;
+            
+            DispatchTable* next_retired;
+            
+            void build_masks();
+        };
+        struct CallbackListener;
+        struct SubscriberListener;
+        
+        // The timing of each subscriber, by index, and of the callbacks and
+        // the listener together, at kMaxSubscribers.
+        struct TimingCounters {
+            Counter calls;
+            Counter slow_calls;
+            Counter max_nanoseconds;
+        };
+        TimingCounters _timing[kMaxSubscribers + 1];
+        std::atomic<uint64_t> _callback_budget;
+        std::atomic<unsigned> _isolate_after;
+        std::atomic<unsigned> _delivery_capacity;
+        // Subscribers found chronically slow during the report in flight.
+        uint64_t _pending_isolation;
+        
+        std::atomic<DispatchTable*> _table;
+        // Tables replaced by a writer, linked by next_retired. A gamepad is
+        // only dispatched from one thread, which holds a table only while
+        // _dispatching is set. So that thread frees them when a report ends,
+        // and a writer frees them itself when no dispatch is in progress, so
+        // that an idle gamepad does not pile them up.
+        std::atomic<DispatchTable*> _retired_tables;
+        std::atomic<bool> _dispatching;
+        // The delivery threads of the tables freed, told to stop but not
+        // joined, so that freeing a table never waits for a slow subscriber.
+        // Those finished are joined when tables are next freed.
+        std::vector<std::shared_ptr<Delivery> > _stopping_deliveries;
+        // Serializes the writers, and the freeing of the retired tables. The
+        // dispatching thread never takes it, but to move a slow subscriber to
+        // its own thread and to free the tables a writer retired.
+        mutable std::mutex _table_mutex;
+        int _next_subscription_id;
+        int _slot;
+        
+        // The callbacks, the listener, the associated object, the idle timeout
+        // and the stall watchdog have a single slot each. A hub sharing the
+        // gamepad sets _hub_shared, and _sole_observer while it has only one
+        // observer, which then owns that state: the hub clears it when the
+        // owner goes. While several observers share the gamepad, it has no
+        // owner, and the setters refuse to fill a slot.
+        std::atomic<bool> _hub_shared;
+        std::atomic<const void*> _sole_observer;
+        std::atomic<const void*> _state_owner;
         
         void* _associated_object;
         void (*_associated_deleter)(void* _object);
         
         long _centroid[static_cast<int>(Axis::count)];
         long _bounds[static_cast<int>(Axis::count)];
-        long _cached_axis_values[static_cast<int>(Axis::count)];
-        AxisState _old_axis_state[static_cast<int>(Axis::count)];
-        AxisState _old_axis_group_state[static_cast<int>(AxisGroup::group_count)];
+        Frame _frame;
+        unsigned _previous_moving_axes;
+        bool _frame_complete;
+        
+        // The clock of the timers and of the silence, or NULL for the system's.
+        ClockSource* _clock;
+        // The idle timer is a one-shot, armed only while axes are off
+        // center. When it fires before the timeout has passed since the last
+        // report, it is armed again for the rest. So a report costs a check,
+        // and only a report which starts or stops the axes touches the timer.
+        Timer* _idle_timer;
+        int _idle_timeout;
+        
+        static COLD void idle_timer_fired(void* self, Timer* timer);
+        Timer* create_timer(Timer::Callback callback, int milliseconds, void* eventloop);
+        
+        // The report intervals are learned from the elapsed times the
+        // backends give. The silence is measured on the clock of the gamepad,
+        // from the start of the callbacks of the last report.
+        ReportRateEstimator _report_rate;
+        uint64_t _last_report_time;
+        // Set while the idle timeout makes up a report, which is no activity.
+        bool _synthetic_frame;
+        Timer* _stall_timer;
+        void* _stall_self;
+        StallCallback _stall_callback;
+        bool _stalled;
+        
+        static COLD void stall_timer_fired(void* self, Timer* timer);
+        COLD void end_stall(uint64_t now);
+        
+        StatisticsCounters _statistics;
+        // When the callbacks of the report in flight started.
+        uint64_t _dispatch_start;
+#if GP_LATENCY_HISTOGRAMS
+        LatencyRecorder _latency;
+#endif
+        
+        // Reset the per-report part of the frame if the last one was dispatched.
+        void begin_frame();
+        
+        // The decode-and-dispatch loops, instantiated once per listener type.
+        template <typename L>
+        void dispatch_axes(L& listener, unsigned previously_moving_axes, unsigned nanoseconds_elapsed);
+        template <typename L>
+        void dispatch(L& listener, unsigned previously_moving_axes);
+        template <typename L>
+        static void dispatch_listener(Gamepad* gamepad, void* listener, unsigned previously_moving_axes);
+        
+        // Publish a modified copy of the table. modify(table) returns false to
+        // leave the table unchanged.
+        template <typename F>
+        bool update_table(F modify);
+        void reclaim_tables();
+        // Frees the retired tables, with _table_mutex held.
+        void free_retired_tables();
+        // Flag the dispatch, and return the table it holds until end_dispatch().
+        const DispatchTable* begin_dispatch();
+        void end_dispatch();
+        bool still_subscribed(const DispatchTable* table, int index) const;
+        // Throw GamepadSharedException if several observers share the
+        // gamepad, and otherwise give the single-slot state to its observer.
+        void claim_single_slot();
+        // Empty every single slot, for the hub when their owner goes.
+        void clear_single_slot();
+        
+        // Call 'call' and, with a budget, time it as the callback at 'index'.
+        template <typename F>
+        void timed_call(int index, uint64_t budget, F call);
+        void end_callback(int index, uint64_t start, uint64_t budget, bool dispatching);
+        COLD void isolate_subscribers();
+        
+        Gamepad(const Gamepad&);
+        Gamepad& operator=(const Gamepad&);
+        
+        friend class GamepadChangedObserver;
+        // gives each device it shares the one slot all its observers use.
+        friend class DeviceHub_Linux;
         
     protected:
         void set_bounds_for_axis(Axis axis, long minimum, long maximum);
         void handle_axes_change(unsigned nanoseconds_elapsed);
         void handle_button_change(Button button, bool is_pressed);
         void set_axis_value(Axis axis, long value);
+        // Call at the end of every report, after all axes and buttons are set
+        // and handle_axes_change() is called.
+        void handle_frame(unsigned nanoseconds_elapsed);
+        
+        // The reading and decoding counters are maintained by the backends.
+        StatisticsCounters& statistics_counters() { return _statistics; }
+        
+        // Stamp the report in flight, now or at a time of
+        // Timer::monotonic_nanoseconds(). Only the dispatching thread may
+        // stamp; a backend reading on another thread hands its stamps over
+        // with the report.
+        void stamp_latency(LatencyStamp stamp) {
+#if GP_LATENCY_HISTOGRAMS
+            _latency.stamp(stamp, Timer::monotonic_nanoseconds());
+#else
+            (void)stamp;
+#endif
+        }
+        void stamp_latency(LatencyStamp stamp, uint64_t nanoseconds) {
+#if GP_LATENCY_HISTOGRAMS
+            _latency.stamp(stamp, nanoseconds);
+#else
+            (void)stamp;
+            (void)nanoseconds;
+#endif
+        }
         
     public:
         Gamepad();
@@ -131,6 +457,102 @@ namespace GP {
         void set_axis_group_changed_callback(void* self, AxisGroupChangedCallback callback);
         void set_axis_group_state_changed_callback(void* self, AxisGroupStateChangedCallback callback);
         
+        // This event is called once per report with the whole state of the
+        // gamepad, instead of once per axis, group and button.
+        void set_frame_callback(void* self, FrameCallback callback);
+        
+        // Bind a listener whose handlers are resolved at compile time, so they
+        // can be inlined into the dispatch loop. The listener must derive from
+        // Listener and outlive the binding. Only one listener can be bound;
+        // it receives all events of a report when the report ends.
+        template <typename L>
+        void listen(L& listener);
+        void unlisten();
+        
+        // The setters above, associate(), set_idle_timeout() and
+        // set_stall_watchdog() fill slots the gamepad has one of. On Linux,
+        // where the observers of an event loop share each gamepad, they throw
+        // GamepadSharedException while it has more than one observer, and the
+        // slots are emptied when the observer which filled them is deleted.
+        // Subscriptions are the way to share a gamepad. Emptying a slot, with
+        // NULL or 0, is always allowed.
+        //
+        // Add a subscriber alongside the callbacks above, and return an id for
+        // unsubscribe(), or 0 if kMaxSubscribers are already registered. The
+        // devices mask of the interest is ignored here; it is used by
+        // GamepadChangedObserver::subscribe().
+        //
+        // All the registration methods are safe to call from any thread, and
+        // from inside any callback. A handler replaced or removed from another
+        // thread may still be called until the report being dispatched ends.
+        int subscribe(const Subscriber& subscriber);
+        void unsubscribe(int subscription);
+        // Wait until the handler being called on another thread, if any,
+        // returns: a handler removed before is then never called again. Never
+        // call it from a callback of the gamepad, which would wait for itself.
+        void wait_for_dispatch() const;
+        
+        /// Index of the gamepad among those attached to its observer, starting
+        /// from 0, or -1 if it is not known. On Linux, every observer of an
+        /// event loop sees a gamepad at the same slot.
+        int slot() const;
+        
+        /// Return the frame of the most recent report.
+        const Frame& last_frame() const;
+        
+        /// If no report arrives for 'milliseconds' while axes are off center,
+        /// as wireless pads do when they go idle, center them as if a report
+        /// said so: stop_moving is sent, and a frame with the axes zeroed.
+        /// The timer runs on 'eventloop', which must be the loop the gamepad
+        /// is dispatched on. 0 turns the timeout off.
+        void set_idle_timeout(int milliseconds, void* eventloop);
+        
+        /// Run the timers of the idle timeout and the stall watchdog, and
+        /// measure the silence, on 'clock' instead of the system's, as a
+        /// replay does on its virtual clock. NULL goes back to the system.
+        /// Set it before the timers, from the thread the gamepad dispatches
+        /// on; the clock must outlive the gamepad or be replaced.
+        void set_clock(ClockSource* clock);
+        /// Return the time on the clock of the gamepad.
+        uint64_t now() const { return _clock ? _clock->now() : Timer::monotonic_nanoseconds(); }
+        
+        /// Watch for the device falling silent for 'factor' times its learned
+        /// report interval, and at least 'minimum_milliseconds': 'callback'
+        /// is called with true when the silence is noticed, up to half the
+        /// minimum late, and with false by the first report after it. Pads
+        /// which only report changes are silent whenever left alone. The
+        /// timer runs on 'eventloop', as set_idle_timeout(). A NULL callback
+        /// turns the watchdog off; the stalls are still counted.
+        void set_stall_watchdog(void* self, StallCallback callback, unsigned factor, int minimum_milliseconds, void* eventloop);
+        
+        /// Return the learned report rate and jitter. Safe to call from any
+        /// thread.
+        ReportRate report_rate() const;
+        /// Return the learned report interval in nanoseconds, or 0 before
+        /// the second report, at the cost of one load.
+        uint64_t expected_report_interval() const { return _report_rate.expected_interval(); }
+        
+        /// Return the counters of the gamepad. Safe to call from any thread.
+        Statistics statistics() const;
+        /// Return the counters summed over every gamepad, past and present.
+        static Statistics total_statistics();
+        
+        /// Return the p50, p99 and maximum time the reports of the gamepad
+        /// spent in a stage, from the kernel to the return of the callbacks.
+        LatencySummary latency(LatencyStage stage) const;
+        /// Return the same over every gamepad, past and present.
+        static LatencySummary total_latency(LatencyStage stage);
+        
+        /// Time every callback, and count those longer than 'microseconds' as
+        /// slow. A subscriber slow 'isolate_after' times is moved to a thread
+        /// of its own, behind a queue of 'queue_capacity' events, so that it
+        /// no longer delays the other callbacks nor the reading; a full queue
+        /// drops new events. 0 turns the timing, or the moving, off.
+        void set_callback_budget(unsigned microseconds, unsigned isolate_after = 0, unsigned queue_capacity = 256);
+        /// Return the timing of a subscription, or with 0, of the callbacks
+        /// set with set_*_callback() and the listener together.
+        CallbackTiming callback_timing(int subscription) const;
+        
         /// Return the upper limit of value the axis can take.
         long axis_bound(Axis axis) const;
 
@@ -151,6 +573,36 @@ namespace GP {
         
         virtual ~Gamepad();
     };
+    
+    /// Subscribes to every frame of a gamepad on behalf of an owner which
+    /// mirrors it under a device number of its own, as a session, a stream
+    /// or a shared state does.
+    class FrameTap {
+    public:
+        typedef void (*Callback)(void* owner, int device, Gamepad* gamepad, const Frame& frame);
+        
+    private:
+        Gamepad* _gamepad;
+        int _device;
+        Callback _callback;
+        void* _owner;
+        int _subscription;
+        
+        FrameTap(const FrameTap&);
+        FrameTap& operator=(const FrameTap&);
+        
+        static void frame(void* self, Gamepad* gamepad, const Frame& frame);
+        
+    public:
+        FrameTap(Gamepad* gamepad, int device, Callback callback, void* owner);
+        
+        Gamepad* gamepad() const { return _gamepad; }
+        int device() const { return _device; }
+        
+        /// Stop the frames. The report in flight may still deliver one, so
+        /// keep the tap until the gamepad is done with it.
+        void unsubscribe();
+    };
 }
 
 #include "Gamepad.inc.cpp"
@@ -35,21 +35,30 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace std {
     template <>
-    struct hash<GP::Button> : public unary_function<GP::Button, size_t> {
+    struct hash<GP::Button> {
+        typedef GP::Button argument_type;
+        typedef size_t result_type;
+        
         size_t operator() (GP::Button button) const {
             return static_cast<size_t>(button);
         }
     };
 
     template <>
-    struct hash<GP::Axis> : public unary_function<GP::Axis, size_t> {
+    struct hash<GP::Axis> {
+        typedef GP::Axis argument_type;
+        typedef size_t result_type;
+        
         size_t operator() (GP::Axis axis) const {
             return static_cast<size_t>(axis);
         }
     };
     
     template <>
-    struct hash<GP::AxisGroup> : public unary_function<GP::AxisGroup, size_t> {
+    struct hash<GP::AxisGroup> {
+        typedef GP::AxisGroup argument_type;
+        typedef size_t result_type;
+        
         size_t operator() (GP::AxisGroup axis) const {
             return static_cast<size_t>(axis);
         }
@@ -82,17 +91,141 @@ namespace GP {
         return static_cast<Button>((usage_page - 9) << 16 | usage);
     }
     
-    inline Gamepad::Gamepad() : _axis_changed_self(NULL), _axis_changed_callback(NULL),
-                    _button_changed_self(NULL), _button_changed_callback(NULL),
-                    _axis_state_self(NULL), _axis_state_callback(NULL),
-                    _axis_group_changed_self(NULL), _axis_group_changed_callback(NULL),
-                    _axis_group_state_changed_self(NULL), _axis_group_state_changed_callback(NULL),
-                    _associated_object(NULL), _associated_deleter(NULL) {
+    inline int ButtonSet::index(Button button) {
+        int value = static_cast<int>(button);
+        if (1 <= value && value < 60)
+            return value;
+        switch (button) {
+            case Button::menu: return 60;
+            case Button::play_pause: return 61;
+            case Button::volume_increase: return 62;
+            case Button::volume_decrease: return 63;
+            default: return -1;
+        }
+    }
+    
+    inline Button ButtonSet::button_at(int index) {
+        const Button kConsumerButtons[] = {
+            Button::menu, Button::play_pause, Button::volume_increase, Button::volume_decrease
+        };
+        return index < 60 ? static_cast<Button>(index) : kConsumerButtons[index - 60];
+    }
+    
+    inline bool ButtonSet::contains(Button button) const {
+        int i = index(button);
+        return i >= 0 && (_bits >> i & 1);
+    }
+    
+    inline void ButtonSet::insert(Button button) {
+        int i = index(button);
+        if (i >= 0)
+            _bits |= uint64_t(1) << i;
+    }
+    
+    inline void ButtonSet::erase(Button button) {
+        int i = index(button);
+        if (i >= 0)
+            _bits &= ~(uint64_t(1) << i);
+    }
+    
+    template <typename F>
+    inline void ButtonSet::for_each(F f) const {
+        for (uint64_t bits = _bits; bits; bits &= bits - 1)
+            f(button_at(count_trailing_zeros(bits)));
+    }
+    
+    template <typename F>
+    inline void Frame::for_each_button_change(F f) const {
+        uint64_t down = pressed.bits(), up = released.bits(), now = held.bits();
+        for (uint64_t bits = down | up; bits; bits &= bits - 1) {
+            int i = count_trailing_zeros(bits);
+            Button button = ButtonSet::button_at(i);
+            uint64_t bit = uint64_t(1) << i;
+            if ((down & up & bit) != 0)
+                f(button, (now & bit) == 0);
+            f(button, (now & bit) != 0);
+        }
+    }
+    
+    inline Interest Interest::everything() {
+        Interest interest;
+        interest.axes = (1u << static_cast<int>(Axis::count)) - 1;
+        interest.axis_groups = (1u << static_cast<int>(AxisGroup::group_count)) - 1;
+        interest.buttons = ButtonSet(~uint64_t(0));
+        interest.devices = ~uint64_t(0);
+        return interest;
+    }
+    
+    inline void Gamepad::DispatchTable::build_masks() {
+        memset(axis_changed, 0, sizeof(axis_changed));
+        memset(axis_state_changed, 0, sizeof(axis_state_changed));
+        memset(axis_group_changed, 0, sizeof(axis_group_changed));
+        memset(axis_group_state_changed, 0, sizeof(axis_group_state_changed));
+        memset(button_changed, 0, sizeof(button_changed));
+        other_button_changed = 0;
+        frame = 0;
+        has_legacy_axis_events = axis_changed_callback || axis_state_callback
+                              || axis_group_changed_callback || axis_group_state_changed_callback;
+        has_subscriber_axis_events = false;
+        isolated = 0;
+        
+        for (uint64_t remaining = used; remaining; remaining &= remaining - 1) {
+            int index = count_trailing_zeros(remaining);
+            uint64_t bit = uint64_t(1) << index;
+            const Subscriber& subscriber = subscribers[index];
+            const Interest& interest = subscriber.interest;
+            if (deliveries[index])
+                isolated |= bit;
+            
+            for (int i = 0; i < static_cast<int>(Axis::count); ++ i) {
+                if (interest.axes >> i & 1) {
+                    if (subscriber.axis_changed)
+                        axis_changed[i] |= bit;
+                    if (subscriber.axis_state_changed)
+                        axis_state_changed[i] |= bit;
+                }
+            }
+            for (int i = 0; i < static_cast<int>(AxisGroup::group_count); ++ i) {
+                if (interest.axis_groups >> i & 1) {
+                    if (subscriber.axis_group_changed)
+                        axis_group_changed[i] |= bit;
+                    if (subscriber.axis_group_state_changed)
+                        axis_group_state_changed[i] |= bit;
+                }
+            }
+            if (subscriber.button_changed) {
+                for (uint64_t buttons = interest.buttons.bits(); buttons; buttons &= buttons - 1)
+                    button_changed[count_trailing_zeros(buttons)] |= bit;
+                if (~interest.buttons.bits() == 0)
+                    other_button_changed |= bit;
+            }
+            if (subscriber.frame)
+                frame |= bit;
+            
+            if ((subscriber.axis_changed || subscriber.axis_state_changed) && interest.axes)
+                has_subscriber_axis_events = true;
+            if ((subscriber.axis_group_changed || subscriber.axis_group_state_changed) && interest.axis_groups)
+                has_subscriber_axis_events = true;
+        }
+    }
+    
+    inline Gamepad::Gamepad() : _callback_budget(0), _isolate_after(0), _delivery_capacity(256), _pending_isolation(0),
+                    _table(new DispatchTable()), _retired_tables(NULL), _dispatching(false),
+                    _next_subscription_id(0), _slot(-1),
+                    _hub_shared(false), _sole_observer(NULL), _state_owner(NULL),
+                    _associated_object(NULL), _associated_deleter(NULL),
+                    _previous_moving_axes(0), _frame_complete(false),
+                    _clock(NULL), _idle_timer(NULL), _idle_timeout(0),
+                    _last_report_time(0), _synthetic_frame(false),
+                    _stall_timer(NULL), _stall_self(NULL), _stall_callback(NULL), _stalled(false),
+                    _dispatch_start(0) {
         memset(_centroid, 0, sizeof(_centroid));
         memset(_bounds, 0, sizeof(_bounds));
-        memset(_cached_axis_values, 0, sizeof(_cached_axis_values));
-        memset(_old_axis_state, 0, sizeof(_old_axis_state));
-        memset(_old_axis_group_state, 0, sizeof(_old_axis_group_state));
+        _frame = Frame();
+        StatisticsRegistry::instance().add(&_statistics);
+#if GP_LATENCY_HISTOGRAMS
+        LatencyRegistry::instance().add(&_latency);
+#endif
     }
 
     inline void Gamepad::set_bounds_for_axis(Axis axis, long minimum, long maximum) {
@@ -100,37 +233,304 @@ namespace GP {
             int index = static_cast<int>(axis);
             _centroid[index] = (maximum + minimum + 1) / 2;
             _bounds[index] = (maximum - minimum + 1) / 2;
-            _cached_axis_values[index] = 0;
+            _frame.axes[index] = 0;
+            _frame.moving_axes &= ~(1u << index);
+        }
+    }
+    
+    inline void Gamepad::begin_frame() {
+        if (_frame_complete) {
+            _frame_complete = false;
+            _frame.changed_axes = 0;
+            _frame.pressed.clear();
+            _frame.released.clear();
         }
     }
 
     inline void Gamepad::set_axis_value(Axis axis, long value) {
         if (valid(axis)) {
             int index = static_cast<int>(axis);
-            _cached_axis_values[index] = value - _centroid[index];
+            long relative_value = value - _centroid[index];
+            this->begin_frame();
+            if (_frame.axes[index] != relative_value) {
+                unsigned bit = 1u << index;
+                if (_frame.changed_axes & bit)
+                    _statistics.dispatch.conflated_events.add();
+                _frame.axes[index] = relative_value;
+                _frame.changed_axes |= bit;
+                if (relative_value != 0)
+                    _frame.moving_axes |= bit;
+                else
+                    _frame.moving_axes &= ~bit;
+            }
         }
     }
     
-    inline void Gamepad::handle_axes_change(unsigned nanoseconds_elapsed) {
-        if (_axis_changed_callback || _axis_state_callback) {
+    // A subscriber moved off the dispatching thread: the events are copied
+    // into a bounded queue, and its thread calls the subscriber with them.
+    struct Gamepad::Delivery {
+        enum Type {
+            axis_changed_event, axis_state_changed_event, axis_group_changed_event,
+            axis_group_state_changed_event, button_changed_event, frame_event
+        };
+        struct Event {
+            Type type;
+            int which;                  // the axis, axis group or button.
+            int state;                  // the AxisState, or whether pressed.
+            long values[4];
+            unsigned nanoseconds_elapsed;
+            Frame frame;
+        };
+        
+        Gamepad* gamepad;
+        int index;
+        Subscriber subscriber;
+        
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::vector<Event> events;
+        size_t head, count;
+        bool stopping;
+        std::atomic<bool> finished;
+        Counter dropped;
+        std::thread thread;
+        
+        Delivery(Gamepad* gamepad_, int index_, const Subscriber& subscriber_, unsigned capacity)
+            : gamepad(gamepad_), index(index_), subscriber(subscriber_),
+              events(capacity > 0 ? capacity : 1), head(0), count(0), stopping(false), finished(false) {
+            thread = std::thread(&Delivery::run, this);
+        }
+        
+        // Drops the events queued, and has the thread return once the
+        // callback being called does. Does not wait for it.
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            ready.notify_one();
+        }
+        
+        // Waits for the callback being called, and drops the events queued.
+        ~Delivery() {
+            this->stop();
+            thread.join();
+        }
+        
+        // Only the dispatching thread pushes.
+        void push(const Event& event) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (count == events.size()) {
+                    dropped.add();
+                    return;
+                }
+                events[(head + count) % events.size()] = event;
+                ++ count;
+            }
+            ready.notify_one();
+        }
+        
+        void run() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                while (!stopping && !count)
+                    ready.wait(lock);
+                if (stopping) {
+                    finished.store(true, std::memory_order_release);
+                    return;
+                }
+                Event event = events[head];
+                head = (head + 1) % events.size();
+                -- count;
+                lock.unlock();
+                
+                uint64_t budget = gamepad->_callback_budget.load(std::memory_order_relaxed);
+                uint64_t start = budget ? Timer::monotonic_nanoseconds() : 0;
+                this->deliver(event);
+                if (budget)
+                    gamepad->end_callback(index, start, budget, false);
+                lock.lock();
+            }
+        }
+        
+        void deliver(Event& event) {
+            void* self = subscriber.self;
+            switch (event.type) {
+                case axis_changed_event:
+                    subscriber.axis_changed(self, gamepad, static_cast<Axis>(event.which), event.values[0], event.nanoseconds_elapsed);
+                    break;
+                case axis_state_changed_event:
+                    subscriber.axis_state_changed(self, gamepad, static_cast<Axis>(event.which), static_cast<AxisState>(event.state));
+                    break;
+                case axis_group_changed_event:
+                    subscriber.axis_group_changed(self, gamepad, static_cast<AxisGroup>(event.which), event.values, event.nanoseconds_elapsed);
+                    break;
+                case axis_group_state_changed_event:
+                    subscriber.axis_group_state_changed(self, gamepad, static_cast<AxisGroup>(event.which), static_cast<AxisState>(event.state));
+                    break;
+                case button_changed_event:
+                    subscriber.button_changed(self, gamepad, static_cast<Button>(event.which), event.state != 0);
+                    break;
+                case frame_event:
+                    subscriber.frame(self, gamepad, event.frame);
+                    break;
+            }
+        }
+        
+        // The same handlers as Listener, to stand in for the subscriber.
+        void axis_changed(Axis axis, long value, unsigned nanoseconds_elapsed) {
+            Event event;
+            event.type = axis_changed_event;
+            event.which = static_cast<int>(axis);
+            event.values[0] = value;
+            event.nanoseconds_elapsed = nanoseconds_elapsed;
+            this->push(event);
+        }
+        void axis_state_changed(Axis axis, AxisState state) {
+            Event event;
+            event.type = axis_state_changed_event;
+            event.which = static_cast<int>(axis);
+            event.state = static_cast<int>(state);
+            this->push(event);
+        }
+        void axis_group_changed(AxisGroup axis_group, long values[], unsigned nanoseconds_elapsed) {
+            Event event;
+            event.type = axis_group_changed_event;
+            event.which = static_cast<int>(axis_group);
+            // the groups have at most 3 axes; the 4th slot is unused.
+            for (int i = 0; i < 3; ++ i)
+                event.values[i] = values[i];
+            event.nanoseconds_elapsed = nanoseconds_elapsed;
+            this->push(event);
+        }
+        void axis_group_state_changed(AxisGroup axis_group, AxisState state) {
+            Event event;
+            event.type = axis_group_state_changed_event;
+            event.which = static_cast<int>(axis_group);
+            event.state = static_cast<int>(state);
+            this->push(event);
+        }
+        void button_changed(Button button, bool is_pressed) {
+            Event event;
+            event.type = button_changed_event;
+            event.which = static_cast<int>(button);
+            event.state = is_pressed;
+            this->push(event);
+        }
+        void frame(const Frame& frame) {
+            Event event;
+            event.type = frame_event;
+            event.frame = frame;
+            this->push(event);
+        }
+    };
+    
+    struct Gamepad::CallbackListener : public Listener {
+        const DispatchTable* table;
+        uint64_t budget;
+        
+        CallbackListener(const DispatchTable* table_, uint64_t budget_) : table(table_), budget(budget_) {}
+        
+        void axis_changed(Gamepad* gamepad, Axis axis, long value, unsigned nanoseconds_elapsed) {
+            if (table->axis_changed_callback) {
+                gamepad->_statistics.dispatch.axis_changed_calls.add();
+                gamepad->timed_call(kMaxSubscribers, budget, [&]() {
+                    table->axis_changed_callback(table->axis_changed_self, gamepad, axis, value, nanoseconds_elapsed);
+                });
+            }
+        }
+        void axis_state_changed(Gamepad* gamepad, Axis axis, AxisState state) {
+            if (table->axis_state_callback) {
+                gamepad->_statistics.dispatch.axis_state_changed_calls.add();
+                gamepad->timed_call(kMaxSubscribers, budget, [&]() {
+                    table->axis_state_callback(table->axis_state_self, gamepad, axis, state);
+                });
+            }
+        }
+        void axis_group_changed(Gamepad* gamepad, AxisGroup axis_group, long values[], unsigned nanoseconds_elapsed) {
+            if (table->axis_group_changed_callback) {
+                gamepad->_statistics.dispatch.axis_group_changed_calls.add();
+                gamepad->timed_call(kMaxSubscribers, budget, [&]() {
+                    table->axis_group_changed_callback(table->axis_group_changed_self, gamepad, axis_group, values, nanoseconds_elapsed);
+                });
+            }
+        }
+        void axis_group_state_changed(Gamepad* gamepad, AxisGroup axis_group, AxisState state) {
+            if (table->axis_group_state_changed_callback) {
+                gamepad->_statistics.dispatch.axis_group_state_changed_calls.add();
+                gamepad->timed_call(kMaxSubscribers, budget, [&]() {
+                    table->axis_group_state_changed_callback(table->axis_group_state_changed_self, gamepad, axis_group, state);
+                });
+            }
+        }
+    };
+    
+    struct Gamepad::SubscriberListener : public Listener {
+        const DispatchTable* table;
+        uint64_t budget;
+        // Neither timed nor queued: the subscribers are called directly.
+        bool plain;
+        
+        SubscriberListener(const DispatchTable* table_, uint64_t budget_)
+            : table(table_), budget(budget_), plain(!budget_ && !table_->isolated) {}
+        
+#define GP_CALL_SUBSCRIBERS(mask, callback, ...) \
+        for (uint64_t remaining = (mask); remaining; remaining &= remaining - 1) { \
+            int index = count_trailing_zeros(remaining); \
+            if (gamepad->still_subscribed(table, index)) { \
+                const Subscriber& subscriber = table->subscribers[index]; \
+                gamepad->_statistics.dispatch.callback##_calls.add(); \
+                if (plain) \
+                    subscriber.callback(subscriber.self, gamepad, __VA_ARGS__); \
+                else if (table->isolated >> index & 1) \
+                    table->deliveries[index]->callback(__VA_ARGS__); \
+                else \
+                    gamepad->timed_call(index, budget, [&]() { subscriber.callback(subscriber.self, gamepad, __VA_ARGS__); }); \
+            } \
+        }
+        
+        void axis_changed(Gamepad* gamepad, Axis axis, long value, unsigned nanoseconds_elapsed) {
+            GP_CALL_SUBSCRIBERS(table->axis_changed[static_cast<int>(axis)], axis_changed, axis, value, nanoseconds_elapsed);
+        }
+        void axis_state_changed(Gamepad* gamepad, Axis axis, AxisState state) {
+            GP_CALL_SUBSCRIBERS(table->axis_state_changed[static_cast<int>(axis)], axis_state_changed, axis, state);
+        }
+        void axis_group_changed(Gamepad* gamepad, AxisGroup axis_group, long values[], unsigned nanoseconds_elapsed) {
+            GP_CALL_SUBSCRIBERS(table->axis_group_changed[static_cast<int>(axis_group)], axis_group_changed, axis_group, values, nanoseconds_elapsed);
+        }
+        void axis_group_state_changed(Gamepad* gamepad, AxisGroup axis_group, AxisState state) {
+            GP_CALL_SUBSCRIBERS(table->axis_group_state_changed[static_cast<int>(axis_group)], axis_group_state_changed, axis_group, state);
+        }
+        void button_changed(Gamepad* gamepad, Button button, bool is_pressed) {
+            int index = ButtonSet::index(button);
+            GP_CALL_SUBSCRIBERS(index >= 0 ? table->button_changed[index] : table->other_button_changed, button_changed, button, is_pressed);
+        }
+        
+#undef GP_CALL_SUBSCRIBERS
+    };
+    
+    template <typename L>
+    inline void Gamepad::dispatch_axes(L& listener, unsigned previously_moving_axes, unsigned nanoseconds_elapsed) {
+        typedef ListenerTraits<L> Traits;
+        unsigned moving_axes = _frame.moving_axes;
+        
+        if (Traits::axis_changed || Traits::axis_state_changed) {
             for (int i = 0; i < static_cast<int>(Axis::count); ++ i) {
-                long value = _cached_axis_values[i];
-                if (value != 0) {
-                    if (_axis_state_callback && _old_axis_state[i] != AxisState::start_moving) {
-                        _old_axis_state[i] = AxisState::start_moving;
-                        _axis_state_callback(_axis_state_self, this, static_cast<Axis>(i), AxisState::start_moving);
-                    }
-                    if (_axis_changed_callback)
-                        _axis_changed_callback(_axis_changed_self, this, static_cast<Axis>(i), value, nanoseconds_elapsed);
-                } else if (_axis_state_callback && _old_axis_state[i] != AxisState::stop_moving) {
-                    _old_axis_state[i] = AxisState::stop_moving;
-                    _axis_state_callback(_axis_state_self, this, static_cast<Axis>(i), AxisState::stop_moving);
+                unsigned bit = 1u << i;
+                if (moving_axes & bit) {
+                    if (Traits::axis_state_changed && !(previously_moving_axes & bit))
+                        listener.axis_state_changed(this, static_cast<Axis>(i), AxisState::start_moving);
+                    if (Traits::axis_changed)
+                        listener.axis_changed(this, static_cast<Axis>(i), _frame.axes[i], nanoseconds_elapsed);
+                } else if (Traits::axis_state_changed && (previously_moving_axes & bit)) {
+                    listener.axis_state_changed(this, static_cast<Axis>(i), AxisState::stop_moving);
                 }
             }
         }
         
-        if (_axis_group_changed_callback || _axis_group_state_changed_callback) {
-            Axis axis_groups[][4] = {
+        if (Traits::axis_group_changed || Traits::axis_group_state_changed) {
+            static const Axis axis_groups[][4] = {
                 {Axis::X, Axis::Y, Axis::Z, Axis::invalid},
                 {Axis::Rx, Axis::Ry, Axis::Rz, Axis::invalid},
                 {Axis::Vx, Axis::Vy, Axis::Vz, Axis::invalid},
@@ -140,55 +540,447 @@ namespace GP {
             
             for (int i = 0; i < static_cast<int>(AxisGroup::group_count); ++ i) {
                 long values[sizeof(*axis_groups)/sizeof(**axis_groups)];
-                bool modified = false;
+                unsigned group_mask = 0;
                 for (unsigned j = 0; j < sizeof(values)/sizeof(*values); ++ j) {
                     if (axis_groups[i][j] == Axis::invalid)
                         break;
                     
-                    values[j] = _cached_axis_values[static_cast<int>(axis_groups[i][j])];
-                    if (values[j])
-                        modified = true;
+                    int axis_index = static_cast<int>(axis_groups[i][j]);
+                    values[j] = _frame.axes[axis_index];
+                    group_mask |= 1u << axis_index;
                 }
                 
-                if (modified) {
-                    if (_axis_group_state_changed_callback && _old_axis_group_state[i] != AxisState::start_moving) {
-                        _old_axis_group_state[i] = AxisState::start_moving;
-                        _axis_group_state_changed_callback(_axis_group_state_changed_self, this, static_cast<AxisGroup>(i), AxisState::start_moving);
-                    }
-                    if (_axis_group_changed_callback)
-                        _axis_group_changed_callback(_axis_group_changed_self, this, static_cast<AxisGroup>(i), values, nanoseconds_elapsed);
-                } else if (_axis_group_state_changed_callback && _old_axis_group_state[i] != AxisState::stop_moving) {
-                    _old_axis_group_state[i] = AxisState::stop_moving;
-                    _axis_group_state_changed_callback(_axis_group_state_changed_self, this, static_cast<AxisGroup>(i), AxisState::stop_moving);
+                AxisGroup axis_group = static_cast<AxisGroup>(i);
+                if (moving_axes & group_mask) {
+                    if (Traits::axis_group_state_changed && !(previously_moving_axes & group_mask))
+                        listener.axis_group_state_changed(this, axis_group, AxisState::start_moving);
+                    if (Traits::axis_group_changed)
+                        listener.axis_group_changed(this, axis_group, values, nanoseconds_elapsed);
+                } else if (Traits::axis_group_state_changed && (previously_moving_axes & group_mask)) {
+                    listener.axis_group_state_changed(this, axis_group, AxisState::stop_moving);
                 }
             }
         }
     }
     
+    template <typename L>
+    inline void Gamepad::dispatch(L& listener, unsigned previously_moving_axes) {
+        typedef ListenerTraits<L> Traits;
+        
+        this->dispatch_axes(listener, previously_moving_axes, _frame.nanoseconds_elapsed);
+        
+        if (Traits::button_changed) {
+            _frame.pressed.for_each([this, &listener](Button button) {
+                listener.button_changed(this, button, true);
+            });
+            _frame.released.for_each([this, &listener](Button button) {
+                listener.button_changed(this, button, false);
+            });
+        }
+        
+        if (Traits::frame)
+            listener.frame(this, _frame);
+    }
+    
+    template <typename L>
+    inline void Gamepad::dispatch_listener(Gamepad* gamepad, void* listener, unsigned previously_moving_axes) {
+        gamepad->dispatch(*static_cast<L*>(listener), previously_moving_axes);
+    }
+    
+    inline void Gamepad::handle_axes_change(unsigned nanoseconds_elapsed) {
+        // Button changes reach their callbacks as they are decoded, so the
+        // callbacks of a report are timed from here.
+        _dispatch_start = Timer::monotonic_nanoseconds();
+        this->stamp_latency(LatencyStamp::callbacks_started, _dispatch_start);
+        
+        const DispatchTable* table = this->begin_dispatch();
+        
+        uint64_t budget = _callback_budget.load(std::memory_order_relaxed);
+        
+        if (table->has_legacy_axis_events) {
+            CallbackListener listener(table, budget);
+            this->dispatch_axes(listener, _previous_moving_axes, nanoseconds_elapsed);
+        }
+        
+        if (table->has_subscriber_axis_events) {
+            SubscriberListener listener(table, budget);
+            this->dispatch_axes(listener, _previous_moving_axes, nanoseconds_elapsed);
+        }
+        this->end_dispatch();
+    }
+    
     inline void Gamepad::handle_button_change(Button button, bool is_pressed) {
-        if (_button_changed_callback)
-            _button_changed_callback(_button_changed_self, this, button, is_pressed);
+        this->begin_frame();
+        if (is_pressed) {
+            _frame.pressed.insert(button);
+            _frame.held.insert(button);
+        } else {
+            _frame.released.insert(button);
+            _frame.held.erase(button);
+        }
+        
+        const DispatchTable* table = this->begin_dispatch();
+        uint64_t budget = _callback_budget.load(std::memory_order_relaxed);
+        if (table->button_changed_callback) {
+            _statistics.dispatch.button_changed_calls.add();
+            this->timed_call(kMaxSubscribers, budget, [&]() {
+                table->button_changed_callback(table->button_changed_self, this, button, is_pressed);
+            });
+        }
+        
+        if (table->used)
+            SubscriberListener(table, budget).button_changed(this, button, is_pressed);
+        this->end_dispatch();
+    }
+    
+    inline void Gamepad::handle_frame(unsigned nanoseconds_elapsed) {
+        this->begin_frame();
+        
+        _frame.nanoseconds_elapsed = nanoseconds_elapsed;
+        _frame.timestamp += nanoseconds_elapsed;
+        ++ _frame.sequence;
+        _frame_complete = true;
+        _statistics.dispatch.reports_dispatched.add();
+        
+        const DispatchTable* table = this->begin_dispatch();
+        uint64_t budget = _callback_budget.load(std::memory_order_relaxed);
+        
+        if (table->listener_dispatch) {
+            _statistics.dispatch.listener_calls.add();
+            this->timed_call(kMaxSubscribers, budget, [&]() {
+                table->listener_dispatch(this, table->listener, _previous_moving_axes);
+            });
+        }
+        
+        if (table->frame_callback) {
+            _statistics.dispatch.frame_calls.add();
+            this->timed_call(kMaxSubscribers, budget, [&]() {
+                table->frame_callback(table->frame_self, this, _frame);
+            });
+        }
+        
+        if (table->frame) {
+            bool plain = !budget && !table->isolated;
+            unsigned axes = _frame.changed_axes | _frame.moving_axes;
+            uint64_t buttons = _frame.pressed.bits() | _frame.released.bits();
+            for (uint64_t remaining = table->frame; remaining; remaining &= remaining - 1) {
+                int index = count_trailing_zeros(remaining);
+                const Subscriber& subscriber = table->subscribers[index];
+                const Interest& interest = subscriber.interest;
+                if (((axes & interest.axes) || (buttons & interest.buttons.bits())) && this->still_subscribed(table, index)) {
+                    _statistics.dispatch.frame_calls.add();
+                    if (plain)
+                        subscriber.frame(subscriber.self, this, _frame);
+                    else if (table->isolated >> index & 1)
+                        table->deliveries[index]->frame(_frame);
+                    else
+                        this->timed_call(index, budget, [&]() { subscriber.frame(subscriber.self, this, _frame); });
+                }
+            }
+        }
+        
+        _previous_moving_axes = _frame.moving_axes;
+        
+        uint64_t now = Timer::monotonic_nanoseconds();
+        uint64_t start = _dispatch_start ? _dispatch_start : now;
+        _dispatch_start = 0;
+        if (!_synthetic_frame) {
+            uint64_t report_time = _clock ? _clock->now() : start;
+            if (_report_rate.record(nanoseconds_elapsed) || _stalled)
+                this->end_stall(report_time);
+            _last_report_time = report_time;
+        }
+        if (_idle_timer && (_frame.moving_axes != 0) != _idle_timer->running()) {
+            if (_frame.moving_axes)
+                _idle_timer->restart(_idle_timeout);
+            else
+                _idle_timer->stop();
+        }
+        FlightRecorder::instance().record(FlightEvent::dispatch, this, _frame.sequence, start, now - start);
+#if GP_LATENCY_HISTOGRAMS
+        this->stamp_latency(LatencyStamp::callbacks_returned, now);
+        _latency.record();
+#endif
+        
+        if (_pending_isolation)
+            this->isolate_subscribers();
+        
+        // The report is over, so this thread holds no table any more.
+        this->end_dispatch();
+        this->reclaim_tables();
+    }
+    
+    inline const Gamepad::DispatchTable* Gamepad::begin_dispatch() {
+        // Sequentially consistent with the store and the check of
+        // update_table(): either the writer sees the flag, or the table
+        // loaded here is the writer's own. An acquire load could be ordered
+        // before the flag is stored. On x86 the store is an xchg, and the
+        // load a plain mov.
+        _dispatching.store(true, std::memory_order_seq_cst);
+        return _table.load(std::memory_order_seq_cst);
+    }
+    
+    inline void Gamepad::end_dispatch() {
+        _dispatching.store(false, std::memory_order_release);
+    }
+    
+    template <typename F>
+    inline bool Gamepad::update_table(F modify) {
+        std::lock_guard<std::mutex> lock(_table_mutex);
+        
+        DispatchTable* old_table = _table.load(std::memory_order_relaxed);
+        DispatchTable* table = new DispatchTable(*old_table);
+        if (!modify(*table)) {
+            delete table;
+            return false;
+        }
+        table->build_masks();
+        _table.store(table, std::memory_order_seq_cst);
+        
+        old_table->next_retired = _retired_tables.load(std::memory_order_relaxed);
+        while (!_retired_tables.compare_exchange_weak(old_table->next_retired, old_table, std::memory_order_release, std::memory_order_relaxed)) {}
+        
+        // Between two reports the dispatching thread holds no table, and the
+        // next one it loads is the new one, so the retired ones can go now.
+        if (!_dispatching.load(std::memory_order_seq_cst))
+            this->free_retired_tables();
+        return true;
+    }
+    
+    inline void Gamepad::reclaim_tables() {
+        if (!_retired_tables.load(std::memory_order_relaxed))
+            return;
+        
+        std::lock_guard<std::mutex> lock(_table_mutex);
+        this->free_retired_tables();
+    }
+    
+    inline void Gamepad::free_retired_tables() {
+        for (size_t i = 0; i < _stopping_deliveries.size(); ) {
+            if (_stopping_deliveries[i]->finished.load(std::memory_order_acquire)) {
+                _stopping_deliveries[i] = _stopping_deliveries.back();
+                _stopping_deliveries.pop_back();
+            } else {
+                ++ i;
+            }
+        }
+        
+        DispatchTable* table = _retired_tables.exchange(NULL, std::memory_order_acquire);
+        while (table) {
+            DispatchTable* next = table->next_retired;
+            // Tables are only copied from the current one, under the mutex, so
+            // a delivery no other table holds cannot be picked up again.
+            for (int i = 0; i < kMaxSubscribers; ++ i) {
+                if (table->deliveries[i] && table->deliveries[i].use_count() == 1) {
+                    table->deliveries[i]->stop();
+                    _stopping_deliveries.push_back(table->deliveries[i]);
+                }
+            }
+            delete table;
+            table = next;
+        }
+    }
+    
+    inline bool Gamepad::still_subscribed(const DispatchTable* table, int index) const {
+        const DispatchTable* current = _table.load(std::memory_order_acquire);
+        if (current == table)
+            return true;
+        return (current->used >> index & 1) && current->ids[index] == table->ids[index];
+    }
+    
+    template <typename F>
+    inline void Gamepad::timed_call(int index, uint64_t budget, F call) {
+        if (!budget) {
+            call();
+            return;
+        }
+        uint64_t start = Timer::monotonic_nanoseconds();
+        call();
+        this->end_callback(index, start, budget, true);
+    }
+    
+    inline void Gamepad::end_callback(int index, uint64_t start, uint64_t budget, bool dispatching) {
+        uint64_t elapsed = Timer::monotonic_nanoseconds() - start;
+        TimingCounters& timing = _timing[index];
+        timing.calls.add();
+        timing.max_nanoseconds.raise_to(elapsed);
+        if (elapsed <= budget)
+            return;
+        
+        timing.slow_calls.add();
+        FlightRecorder::instance().record(FlightEvent::slow_callback, this, index, start, elapsed);
+        unsigned isolate_after = _isolate_after.load(std::memory_order_relaxed);
+        if (dispatching && index < kMaxSubscribers && isolate_after && timing.slow_calls.get() >= isolate_after)
+            _pending_isolation |= uint64_t(1) << index;
+    }
+    
+    inline void Gamepad::isolate_subscribers() {
+        uint64_t pending = _pending_isolation;
+        _pending_isolation = 0;
+        unsigned capacity = _delivery_capacity.load(std::memory_order_relaxed);
+        unsigned isolate_after = _isolate_after.load(std::memory_order_relaxed);
+        this->update_table([=](DispatchTable& table) -> bool {
+            bool changed = false;
+            for (uint64_t remaining = pending & table.used; remaining; remaining &= remaining - 1) {
+                int index = count_trailing_zeros(remaining);
+                // the index may have been given to a new subscriber since.
+                if (table.deliveries[index] || _timing[index].slow_calls.get() < isolate_after)
+                    continue;
+                table.deliveries[index].reset(new Delivery(this, index, table.subscribers[index], capacity));
+                changed = true;
+            }
+            return changed;
+        });
     }
     
     inline void Gamepad::set_axis_changed_callback(void* self, AxisChangedCallback callback) {
-        _axis_changed_self = self;
-        _axis_changed_callback = callback;
+        if (callback)
+            this->claim_single_slot();
+        this->update_table([=](DispatchTable& table) -> bool {
+            table.axis_changed_self = self;
+            table.axis_changed_callback = callback;
+            return true;
+        });
     }
     inline void Gamepad::set_axis_state_changed_callback(void* self, AxisStateChangedCallback callback) {
-        _axis_state_self = self;
-        _axis_state_callback = callback;
+        if (callback)
+            this->claim_single_slot();
+        this->update_table([=](DispatchTable& table) -> bool {
+            table.axis_state_self = self;
+            table.axis_state_callback = callback;
+            return true;
+        });
     }
     inline void Gamepad::set_button_changed_callback(void* self, ButtonChangedCallback callback) {
-        _button_changed_self = self;
-        _button_changed_callback = callback;
+        if (callback)
+            this->claim_single_slot();
+        this->update_table([=](DispatchTable& table) -> bool {
+            table.button_changed_self = self;
+            table.button_changed_callback = callback;
+            return true;
+        });
     }
     inline void Gamepad::set_axis_group_changed_callback(void* self, AxisGroupChangedCallback callback) {
-        _axis_group_changed_self = self;
-        _axis_group_changed_callback = callback;
+        if (callback)
+            this->claim_single_slot();
+        this->update_table([=](DispatchTable& table) -> bool {
+            table.axis_group_changed_self = self;
+            table.axis_group_changed_callback = callback;
+            return true;
+        });
     }
     inline void Gamepad::set_axis_group_state_changed_callback(void* self, AxisGroupStateChangedCallback callback) {
-        _axis_group_state_changed_self = self;
-        _axis_group_state_changed_callback = callback;
+        if (callback)
+            this->claim_single_slot();
+        this->update_table([=](DispatchTable& table) -> bool {
+            table.axis_group_state_changed_self = self;
+            table.axis_group_state_changed_callback = callback;
+            return true;
+        });
+    }
+    inline void Gamepad::set_frame_callback(void* self, FrameCallback callback) {
+        if (callback)
+            this->claim_single_slot();
+        this->update_table([=](DispatchTable& table) -> bool {
+            table.frame_self = self;
+            table.frame_callback = callback;
+            return true;
+        });
+    }
+    
+    template <typename L>
+    inline void Gamepad::listen(L& listener) {
+        static_assert(std::is_base_of<Listener, L>::value, "The listener must derive from GP::Listener.");
+        this->claim_single_slot();
+        L* listener_ptr = &listener;
+        this->update_table([=](DispatchTable& table) -> bool {
+            table.listener = listener_ptr;
+            table.listener_dispatch = &Gamepad::dispatch_listener<L>;
+            return true;
+        });
+    }
+    
+    inline void Gamepad::unlisten() {
+        this->update_table([](DispatchTable& table) -> bool {
+            table.listener = NULL;
+            table.listener_dispatch = NULL;
+            return true;
+        });
+    }
+    
+    inline int Gamepad::subscribe(const Subscriber& subscriber) {
+        int id = 0;
+        this->update_table([&](DispatchTable& table) -> bool {
+            if (~table.used == 0)
+                return false;
+            int index = count_trailing_zeros(~table.used);
+            id = ++ _next_subscription_id;
+            TimingCounters& timing = _timing[index];
+            timing.calls.reset();
+            timing.slow_calls.reset();
+            timing.max_nanoseconds.reset();
+            table.subscribers[index] = subscriber;
+            table.ids[index] = id;
+            table.used |= uint64_t(1) << index;
+            return true;
+        });
+        return id;
+    }
+    
+    inline void Gamepad::unsubscribe(int subscription) {
+        this->update_table([=](DispatchTable& table) -> bool {
+            for (uint64_t remaining = table.used; remaining; remaining &= remaining - 1) {
+                int index = count_trailing_zeros(remaining);
+                if (table.ids[index] == subscription) {
+                    table.used &= ~(uint64_t(1) << index);
+                    table.deliveries[index].reset();
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+    
+    inline void Gamepad::claim_single_slot() {
+        const void* owner = _sole_observer.load();
+        if (!owner && _hub_shared.load())
+            throw GamepadSharedException();
+        _state_owner.store(owner);
+    }
+    
+    inline void Gamepad::clear_single_slot() {
+        this->update_table([](DispatchTable& table) -> bool {
+            table.axis_changed_callback = NULL;
+            table.axis_state_callback = NULL;
+            table.button_changed_callback = NULL;
+            table.axis_group_changed_callback = NULL;
+            table.axis_group_state_changed_callback = NULL;
+            table.frame_callback = NULL;
+            table.listener = NULL;
+            table.listener_dispatch = NULL;
+            return true;
+        });
+        this->associate(NULL);
+        this->set_idle_timeout(0, NULL);
+        delete _stall_timer;
+        _stall_timer = NULL;
+        _stall_callback = NULL;
+        _stalled = false;
+        _state_owner.store(NULL);
+    }
+    
+    inline void Gamepad::wait_for_dispatch() const {
+        // after the table is replaced, seq_cst as begin_dispatch().
+        while (_dispatching.load(std::memory_order_seq_cst))
+            std::this_thread::yield();
+    }
+    
+    inline int Gamepad::slot() const {
+        return _slot;
+    }
+    
+    inline const Frame& Gamepad::last_frame() const {
+        return _frame;
     }
 
     
@@ -197,6 +989,8 @@ namespace GP {
     }
     
     inline void Gamepad::associate(void* object, void (*deleter)(void*)) {
+        if (object || deleter)
+            this->claim_single_slot();
         if (_associated_deleter)
             _associated_deleter(_associated_object);
         _associated_object = object;
@@ -207,9 +1001,192 @@ namespace GP {
         return _associated_object;
     }
     
+    inline void Gamepad::set_idle_timeout(int milliseconds, void* eventloop) {
+        if (milliseconds > 0)
+            this->claim_single_slot();
+        delete _idle_timer;
+        _idle_timer = NULL;
+        _idle_timeout = milliseconds;
+        
+        if (milliseconds > 0) {
+            _idle_timer = this->create_timer(Gamepad::idle_timer_fired, milliseconds, eventloop);
+            if (!_frame.moving_axes)
+                _idle_timer->stop();
+        }
+    }
+    
+    inline void Gamepad::idle_timer_fired(void* self, Timer* timer) {
+        Gamepad* this_ = static_cast<Gamepad*>(self);
+        if (!this_->_frame.moving_axes) {
+            timer->stop();
+            return;
+        }
+        
+        // a report came since the timer was armed: wait out the rest.
+        uint64_t deadline = this_->_last_report_time + uint64_t(this_->_idle_timeout) * 1000000;
+        uint64_t now = this_->now();
+        if (now < deadline) {
+            timer->restart(static_cast<int>((deadline - now + 999999) / 1000000));
+            return;
+        }
+        
+        for (int i = 0; i < static_cast<int>(Axis::count); ++ i)
+            if (this_->_frame.moving_axes >> i & 1)
+                this_->set_axis_value(static_cast<Axis>(i), this_->_centroid[i]);
+        
+        // at most ~4.29 s fits in the elapsed time.
+        uint64_t nanoseconds_elapsed = uint64_t(this_->_idle_timeout) * 1000000;
+        if (nanoseconds_elapsed > ~0u)
+            nanoseconds_elapsed = ~0u;
+        this_->_synthetic_frame = true;
+        this_->handle_axes_change(static_cast<unsigned>(nanoseconds_elapsed));
+        this_->handle_frame(static_cast<unsigned>(nanoseconds_elapsed));
+        this_->_synthetic_frame = false;
+    }
+    
+    inline void Gamepad::set_clock(ClockSource* clock) {
+        _clock = clock;
+    }
+    
+    // The eventloop is not needed by the timers of a clock.
+    inline Timer* Gamepad::create_timer(Timer::Callback callback, int milliseconds, void* eventloop) {
+        return _clock ? _clock->create_timer(this, callback, milliseconds) : Timer::create(this, callback, milliseconds, eventloop);
+    }
+    
+    inline void Gamepad::set_stall_watchdog(void* self, StallCallback callback, unsigned factor, int minimum_milliseconds, void* eventloop) {
+        if (callback)
+            this->claim_single_slot();
+        delete _stall_timer;
+        _stall_timer = NULL;
+        _stall_self = self;
+        _stall_callback = callback;
+        _stalled = false;
+        _report_rate.set_stall_threshold(factor, minimum_milliseconds > 0 ? uint64_t(minimum_milliseconds) * 1000000 : 0);
+        
+        if (callback) {
+            int tick = minimum_milliseconds / 2;
+            _stall_timer = this->create_timer(Gamepad::stall_timer_fired, tick > 0 ? tick : 1, eventloop);
+        }
+    }
+    
+    inline void Gamepad::stall_timer_fired(void* self, Timer*) {
+        Gamepad* this_ = static_cast<Gamepad*>(self);
+        if (this_->_stalled || !this_->_last_report_time)
+            return;
+        
+        uint64_t silence = this_->now() - this_->_last_report_time;
+        if (silence <= this_->_report_rate.stall_threshold())
+            return;
+        this_->_stalled = true;
+        this_->_stall_callback(this_->_stall_self, this_, true, silence);
+    }
+    
+    inline void Gamepad::end_stall(uint64_t now) {
+        uint64_t silence = now - _last_report_time;
+        FlightRecorder::instance().record(FlightEvent::stall, this, _report_rate.expected_interval(), _last_report_time, silence);
+        if (_stalled) {
+            _stalled = false;
+            _stall_callback(_stall_self, this, false, silence);
+        }
+    }
+    
+    inline ReportRate Gamepad::report_rate() const {
+        return _report_rate.summary();
+    }
+    
+    inline void Gamepad::set_callback_budget(unsigned microseconds, unsigned isolate_after, unsigned queue_capacity) {
+        _isolate_after.store(isolate_after, std::memory_order_relaxed);
+        _delivery_capacity.store(queue_capacity, std::memory_order_relaxed);
+        _callback_budget.store(uint64_t(microseconds) * 1000, std::memory_order_relaxed);
+    }
+    
+    inline Gamepad::CallbackTiming Gamepad::callback_timing(int subscription) const {
+        CallbackTiming retval = {0, 0, 0, false, 0};
+        int index = kMaxSubscribers;
+        
+        // the table cannot be retired while the writers are held off.
+        std::lock_guard<std::mutex> lock(_table_mutex);
+        const DispatchTable* table = _table.load(std::memory_order_relaxed);
+        if (subscription) {
+            index = -1;
+            for (uint64_t remaining = table->used; remaining; remaining &= remaining - 1) {
+                int i = count_trailing_zeros(remaining);
+                if (table->ids[i] == subscription)
+                    index = i;
+            }
+            if (index < 0)
+                return retval;
+            if (const Delivery* delivery = table->deliveries[index].get()) {
+                retval.isolated = true;
+                retval.dropped_events = delivery->dropped.get();
+            }
+        }
+        
+        const TimingCounters& timing = _timing[index];
+        retval.calls = timing.calls.get();
+        retval.slow_calls = timing.slow_calls.get();
+        retval.max_nanoseconds = timing.max_nanoseconds.get();
+        return retval;
+    }
+    
+    inline Statistics Gamepad::statistics() const {
+        return _statistics.snapshot();
+    }
+    
+    inline Statistics Gamepad::total_statistics() {
+        return StatisticsRegistry::instance().total();
+    }
+    
+    inline LatencySummary Gamepad::latency(LatencyStage stage) const {
+        LatencyDistribution distribution;
+#if GP_LATENCY_HISTOGRAMS
+        _latency.copy_to(stage, distribution);
+#else
+        (void)stage;
+#endif
+        return distribution.summary();
+    }
+    
+    inline LatencySummary Gamepad::total_latency(LatencyStage stage) {
+#if GP_LATENCY_HISTOGRAMS
+        return LatencyRegistry::instance().total(stage).summary();
+#else
+        (void)stage;
+        return LatencyDistribution().summary();
+#endif
+    }
+    
     inline Gamepad::~Gamepad() {
+        StatisticsRegistry::instance().remove(&_statistics);
+#if GP_LATENCY_HISTOGRAMS
+        LatencyRegistry::instance().remove(&_latency);
+#endif
+        delete _idle_timer;
+        delete _stall_timer;
         if (_associated_deleter)
             _associated_deleter(_associated_object);
+        this->reclaim_tables();
+        // joins the delivery threads still running.
+        _stopping_deliveries.clear();
+        delete _table.load(std::memory_order_relaxed);
+    }
+    
+    inline FrameTap::FrameTap(Gamepad* gamepad, int device, Callback callback, void* owner)
+        : _gamepad(gamepad), _device(device), _callback(callback), _owner(owner) {
+        Gamepad::Subscriber subscriber = {};
+        subscriber.self = this;
+        subscriber.frame = FrameTap::frame;
+        subscriber.interest = Interest::everything();
+        _subscription = gamepad->subscribe(subscriber);
+    }
+    
+    inline void FrameTap::frame(void* self, Gamepad* gamepad, const Frame& frame) {
+        FrameTap* tap = static_cast<FrameTap*>(self);
+        tap->_callback(tap->_owner, tap->_device, gamepad, frame);
+    }
+    
+    inline void FrameTap::unsubscribe() {
+        _gamepad->unsubscribe(_subscription);
     }
 
 
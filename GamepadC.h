@@ -0,0 +1,169 @@
+/*
+ 
+GamepadC.h ... A flat C interface to the library, for foreign function interfaces.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef GAMEPADC_H_w4c9lbz1ma6e0tqo
+#define GAMEPADC_H_w4c9lbz1ma6e0tqo 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* As EXPORT of Compatibility.hpp, which is C++. */
+#if _WIN32
+#ifdef _WINDLL
+#define GP_C_EXPORT __declspec(dllexport)
+#else
+#define GP_C_EXPORT __declspec(dllimport)
+#endif
+#else
+#define GP_C_EXPORT
+#endif
+
+/*
+ * Every type here is plain data of fixed width, and every function takes
+ * and returns such data, so that C#, Python and other foreign function
+ * interfaces can bind them without a C++ compiler. The layouts only grow,
+ * at their end, as GP_C_VERSION grows.
+ *
+ * Crossing into a managed language costs far more than a C call, so input
+ * is not pushed into a callback per axis: the library queues events, and
+ * gp_poll_events() copies as many as fit into the caller's array in one
+ * crossing. gp_set_event_callback() exists for callers to whom a crossing
+ * is cheap.
+ *
+ * A context and its devices belong to the thread that created it; call
+ * every function of a context on it.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GP_C_VERSION 1
+
+typedef struct gp_context gp_context;
+
+/* A device handle: never reused, and never 0. A handle of a detached device
+ * is refused by the functions below. */
+typedef uint32_t gp_device;
+
+enum gp_event_type {
+    GP_EVENT_ATTACHED = 1,
+    GP_EVENT_DETACHED,
+    GP_EVENT_AXIS,              /* index: a gp_axis; value: the new value. */
+    GP_EVENT_BUTTON,            /* index: the button; value: 1 if pressed. */
+    GP_EVENT_FRAME              /* the end of a report; value: the moving axes. */
+};
+
+/* The order of GP::Axis. */
+enum gp_axis {
+    GP_AXIS_X, GP_AXIS_Y, GP_AXIS_Z, GP_AXIS_RX, GP_AXIS_RY, GP_AXIS_RZ,
+    GP_AXIS_VX, GP_AXIS_VY, GP_AXIS_VZ, GP_AXIS_VBRX, GP_AXIS_VBRY, GP_AXIS_VBRZ, GP_AXIS_VNO,
+    GP_AXIS_COUNT
+};
+
+/* Buttons are numbered as GP::Button: 1 to 59 for the numbered ones, and
+ * 0x30040, 0x300cd, 0x300e9 and 0x300ea for menu, play/pause, volume up
+ * and volume down. */
+
+typedef struct gp_event {
+    uint64_t timestamp;         /* the monotonic clock of the library, in ns. */
+    uint64_t sequence;          /* of the report; 0 for attach and detach. */
+    gp_device device;
+    uint32_t type;              /* a gp_event_type. */
+    int32_t index;
+    int32_t value;
+} gp_event;
+
+typedef struct gp_device_info {
+    gp_device device;
+    int32_t slot;               /* as GP::Gamepad::slot(). */
+    uint32_t axes;              /* a bit per gp_axis the device has. */
+    int32_t axis_bounds[GP_AXIS_COUNT];
+} gp_device_info;
+
+typedef struct gp_state {
+    gp_device device;
+    uint32_t moving_axes;       /* a bit per gp_axis off center. */
+    uint64_t sequence;          /* of the last report. */
+    uint64_t elapsed;           /* ns from the attach to the last report. */
+    uint64_t buttons;           /* bit 1 to 59: buttons 1 to 59; 60 to 63: menu,
+                                   play/pause, volume up and down. */
+    int32_t axes[GP_AXIS_COUNT];
+} gp_state;
+
+typedef void (*gp_event_callback)(void* user, const gp_event* event);
+
+/* Return GP_C_VERSION of the library. */
+GP_C_EXPORT uint32_t gp_version(void);
+
+/* Create a context on an event loop of its own, which gp_dispatch() runs,
+ * holding up to 'queue_capacity' events not polled yet; 0 picks 4096.
+ * Return NULL on failure. */
+GP_C_EXPORT gp_context* gp_create(size_t queue_capacity);
+
+/* Create a context on an event loop the caller runs, as the 'eventloop' of
+ * GP::GamepadChangedObserver::create(). */
+GP_C_EXPORT gp_context* gp_create_on_loop(void* eventloop, size_t queue_capacity);
+
+GP_C_EXPORT void gp_destroy(gp_context* context);
+
+/* A descriptor readable when gp_dispatch() has work, for the caller's own
+ * poll(); -1 on a loop the caller runs. */
+GP_C_EXPORT int gp_fd(const gp_context* context);
+
+/* Wait up to 'timeout_ms' (-1 for ever, 0 not at all) for input on the
+ * context's own loop, handle it, and return the number of events queued. */
+GP_C_EXPORT size_t gp_dispatch(gp_context* context, int timeout_ms);
+
+/* Move up to 'capacity' of the oldest queued events to 'events', and
+ * return their number. */
+GP_C_EXPORT size_t gp_poll_events(gp_context* context, gp_event* events, size_t capacity);
+
+/* Pass each event to 'callback' as it happens instead of queuing it; NULL
+ * queues again. */
+GP_C_EXPORT void gp_set_event_callback(gp_context* context, gp_event_callback callback, void* user);
+
+/* Events the full queue turned away. */
+GP_C_EXPORT uint64_t gp_dropped_events(const gp_context* context);
+
+/* Copy up to 'capacity' handles of the attached devices, and return how
+ * many are attached. */
+GP_C_EXPORT size_t gp_devices(const gp_context* context, gp_device* devices, size_t capacity);
+
+/* Return 0, or -1 for a handle of no attached device. */
+GP_C_EXPORT int gp_device_info_of(const gp_context* context, gp_device device, gp_device_info* info);
+GP_C_EXPORT int gp_state_of(const gp_context* context, gp_device device, gp_state* state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -34,11 +34,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define GAMEPAD_CHANGED_OBSERVER_HPP_rskkt3ru5raa714i 1
 
 #include "Compatibility.hpp"
+#include "Gamepad.hpp"
+#include <vector>
 
 
 namespace GP {
-    class Gamepad;
-
     ENUM_CLASS GamepadState {
         attached,
         detaching
@@ -53,16 +53,79 @@ namespace GP {
         void* _self;
         Callback _callback;
         
+        // Attached gamepads by slot, and the subscriptions made on them by
+        // subscribe().
+        struct Subscription {
+            int id;
+            Gamepad::Subscriber subscriber;
+            int gamepad_subscriptions[64];
+        };
+        Gamepad* _gamepads[64];
+        uint64_t _used_slots;
+        std::vector<Subscription> _subscriptions;
+        int _next_subscription_id;
+        
+        GamepadChangedObserver(const GamepadChangedObserver&);
+        GamepadChangedObserver& operator=(const GamepadChangedObserver&);
+        
     protected:
         virtual void observe_impl() = 0;
         
-        void handle_event(Gamepad* gamepad, GamepadState state) const {
+        void handle_event(Gamepad* gamepad, GamepadState state) {
+            FlightRecorder::instance().record(state == GamepadState::attached ? FlightEvent::attach : FlightEvent::detach,
+                                              gamepad, gamepad->_slot, Timer::monotonic_nanoseconds());
+            if (state == GamepadState::attached && ~_used_slots != 0) {
+                // a gamepad shared by the observers of a hub comes with its
+                // slot, which every one of them keeps; other gamepads have
+                // only this observer, which assigns one.
+                int slot = gamepad->_slot;
+                if (slot < 0 || _used_slots >> slot & 1)
+                    slot = count_trailing_zeros(~_used_slots);
+                _used_slots |= uint64_t(1) << slot;
+                _gamepads[slot] = gamepad;
+                gamepad->_slot = slot;
+                for (auto it = _subscriptions.begin(); it != _subscriptions.end(); ++ it)
+                    if (it->subscriber.interest.devices >> slot & 1)
+                        it->gamepad_subscriptions[slot] = gamepad->subscribe(it->subscriber);
+            } else if (state == GamepadState::detaching) {
+                // another observer sharing the gamepad may have cleared it.
+                gamepad->_slot = this->slot_of(gamepad);
+            }
+            
             if (_callback)
                 _callback(_self, gamepad, state);
+            
+            if (state == GamepadState::detaching) {
+                this->forget(gamepad);
+                gamepad->_slot = -1;
+            }
+        }
+        
+        int slot_of(const Gamepad* gamepad) const {
+            for (uint64_t remaining = _used_slots; remaining; remaining &= remaining - 1) {
+                int slot = count_trailing_zeros(remaining);
+                if (_gamepads[slot] == gamepad)
+                    return slot;
+            }
+            return -1;
+        }
+        
+        // Drop the subscriptions on the gamepad, and its slot, without telling
+        // the callback.
+        void forget(Gamepad* gamepad) {
+            int slot = this->slot_of(gamepad);
+            if (slot < 0)
+                return;
+            for (auto it = _subscriptions.begin(); it != _subscriptions.end(); ++ it) {
+                gamepad->unsubscribe(it->gamepad_subscriptions[slot]);
+                it->gamepad_subscriptions[slot] = 0;
+            }
+            _used_slots &= ~(uint64_t(1) << slot);
+            _gamepads[slot] = NULL;
         }
         
         GamepadChangedObserver(void* self, Callback callback)
-            : _self(self), _callback(callback) {}
+            : _self(self), _callback(callback), _used_slots(0), _next_subscription_id(0) {}
         
         static EXPORT GamepadChangedObserver* create_impl(void* self, Callback callback, void* eventloop);
         
@@ -74,6 +137,32 @@ namespace GP {
             return retval;
         }
 
+        // Subscribe to every current and future gamepad whose slot is in the
+        // devices mask of the interest. Return an id for unsubscribe().
+        int subscribe(const Gamepad::Subscriber& subscriber) {
+            Subscription subscription;
+            subscription.id = ++ _next_subscription_id;
+            subscription.subscriber = subscriber;
+            for (int slot = 0; slot < 64; ++ slot) {
+                bool wanted = (_used_slots & subscriber.interest.devices) >> slot & 1;
+                subscription.gamepad_subscriptions[slot] = wanted ? _gamepads[slot]->subscribe(subscriber) : 0;
+            }
+            _subscriptions.push_back(subscription);
+            return subscription.id;
+        }
+        
+        void unsubscribe(int subscription) {
+            for (auto it = _subscriptions.begin(); it != _subscriptions.end(); ++ it) {
+                if (it->id == subscription) {
+                    for (int slot = 0; slot < 64; ++ slot)
+                        if (it->gamepad_subscriptions[slot])
+                            _gamepads[slot]->unsubscribe(it->gamepad_subscriptions[slot]);
+                    _subscriptions.erase(it);
+                    return;
+                }
+            }
+        }
+
         virtual ~GamepadChangedObserver() {}
     };
     
@@ -0,0 +1,244 @@
+/*
+ 
+GamepadQueue.hpp ... Queues the events of gamepads as plain data, for the C interface.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef GAMEPADQUEUE_HPP_4iouc34sk3shm386
+#define GAMEPADQUEUE_HPP_4iouc34sk3shm386 1
+
+#include "GamepadC.h"
+#include "Gamepad.hpp"
+#include "Timer.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+
+namespace GP {
+    static_assert(GP_AXIS_COUNT == static_cast<int>(Axis::count), "gp_axis follows Axis");
+    
+    /// The events of gamepads as gp_event, in a ring polled by the caller or
+    /// passed to a callback one by one, and the handles of the gamepads.
+    /// Events are made from each frame, so that an axis returning to the
+    /// center is an event too. Every method, and the gamepads, must run on
+    /// one thread.
+    class GamepadQueue {
+    public:
+        enum { kMaxDevices = 64, kDefaultCapacity = 4096 };
+        
+    private:
+        struct Device {
+            GamepadQueue* queue;
+            Gamepad* gamepad;           // NULL if the entry is free.
+            uint32_t generation;
+            int subscription;
+        };
+        
+        Device _devices[kMaxDevices];
+        std::vector<gp_event> _ring;
+        size_t _head;           // the oldest event.
+        size_t _count;
+        uint64_t _dropped;
+        gp_event_callback _callback;
+        void* _user;
+        
+        GamepadQueue(const GamepadQueue&);
+        GamepadQueue& operator=(const GamepadQueue&);
+        
+        static gp_device handle_of(const Device& device, int index) {
+            return device.generation << 6 | static_cast<uint32_t>(index);
+        }
+        
+        const Device* device_of(gp_device handle) const {
+            const Device& device = _devices[handle & (kMaxDevices - 1)];
+            return device.gamepad && handle == handle_of(device, handle & (kMaxDevices - 1)) ? &device : NULL;
+        }
+        
+        void push(gp_device device, uint32_t type, int32_t index, int32_t value, uint64_t sequence, uint64_t timestamp) {
+            gp_event event;
+            event.timestamp = timestamp;
+            event.sequence = sequence;
+            event.device = device;
+            event.type = type;
+            event.index = index;
+            event.value = value;
+            if (_callback) {
+                _callback(_user, &event);
+                return;
+            }
+            // a full queue drops new events, as a full delivery queue does.
+            if (_count == _ring.size()) {
+                ++ _dropped;
+                return;
+            }
+            size_t tail = _head + _count;
+            _ring[tail < _ring.size() ? tail : tail - _ring.size()] = event;
+            ++ _count;
+        }
+        
+        static void frame(void* self, Gamepad*, const Frame& frame) {
+            Device& device = *static_cast<Device*>(self);
+            GamepadQueue* queue = device.queue;
+            gp_device handle = handle_of(device, static_cast<int>(&device - queue->_devices));
+            uint64_t now = Timer::monotonic_nanoseconds();
+            for (unsigned changed = frame.changed_axes; changed; changed &= changed - 1) {
+                int axis = count_trailing_zeros(changed);
+                queue->push(handle, GP_EVENT_AXIS, axis, static_cast<int32_t>(frame.axes[axis]), frame.sequence, now);
+            }
+            frame.for_each_button_change([&](Button button, bool is_pressed) {
+                queue->push(handle, GP_EVENT_BUTTON, static_cast<int32_t>(button), is_pressed, frame.sequence, now);
+            });
+            queue->push(handle, GP_EVENT_FRAME, 0, static_cast<int32_t>(frame.moving_axes), frame.sequence, now);
+        }
+        
+    public:
+        explicit GamepadQueue(size_t capacity = kDefaultCapacity)
+            : _ring(capacity ? capacity : static_cast<size_t>(kDefaultCapacity)), _head(0), _count(0), _dropped(0), _callback(NULL), _user(NULL) {
+            for (int i = 0; i < kMaxDevices; ++ i) {
+                _devices[i].queue = this;
+                _devices[i].gamepad = NULL;
+                _devices[i].generation = 0;
+            }
+        }
+        
+        ~GamepadQueue() {
+            for (int i = 0; i < kMaxDevices; ++ i)
+                if (_devices[i].gamepad)
+                    _devices[i].gamepad->unsubscribe(_devices[i].subscription);
+        }
+        
+        /// Queue the events of a gamepad, starting with its attach, and
+        /// return its handle, or 0 if kMaxDevices are already queued.
+        gp_device add_gamepad(Gamepad* gamepad) {
+            int index = 0;
+            while (index < kMaxDevices && _devices[index].gamepad)
+                ++ index;
+            if (index == kMaxDevices)
+                return 0;
+            
+            Device& device = _devices[index];
+            device.gamepad = gamepad;
+            // the generation starts from 1, so that no handle is 0.
+            ++ device.generation;
+            Gamepad::Subscriber subscriber = {};
+            subscriber.self = &device;
+            subscriber.frame = GamepadQueue::frame;
+            subscriber.interest = Interest::everything();
+            device.subscription = gamepad->subscribe(subscriber);
+            gp_device handle = handle_of(device, index);
+            this->push(handle, GP_EVENT_ATTACHED, 0, 0, 0, Timer::monotonic_nanoseconds());
+            return handle;
+        }
+        
+        /// Stop queuing the events of a gamepad, with a detach event; call
+        /// it before the gamepad is deleted.
+        void remove_gamepad(Gamepad* gamepad) {
+            for (int i = 0; i < kMaxDevices; ++ i) {
+                Device& device = _devices[i];
+                if (device.gamepad != gamepad)
+                    continue;
+                gamepad->unsubscribe(device.subscription);
+                device.gamepad = NULL;
+                this->push(handle_of(device, i), GP_EVENT_DETACHED, 0, 0, 0, Timer::monotonic_nanoseconds());
+                return;
+            }
+        }
+        
+        /// Pass each event to 'callback' instead of queuing it, or with
+        /// NULL, queue again.
+        void set_callback(gp_event_callback callback, void* user) {
+            _callback = callback;
+            _user = user;
+        }
+        
+        size_t poll(gp_event* events, size_t capacity) {
+            size_t count = 0;
+            while (count < capacity && _count) {
+                // copy the run up to the end of the ring at once.
+                size_t run = std::min(std::min(capacity - count, _count), _ring.size() - _head);
+                std::copy(&_ring[_head], &_ring[_head] + run, events + count);
+                count += run;
+                _count -= run;
+                _head = _head + run == _ring.size() ? 0 : _head + run;
+            }
+            return count;
+        }
+        
+        size_t pending() const {
+            return _count;
+        }
+        
+        uint64_t dropped() const {
+            return _dropped;
+        }
+        
+        size_t devices(gp_device* handles, size_t capacity) const {
+            size_t count = 0;
+            for (int i = 0; i < kMaxDevices; ++ i)
+                if (_devices[i].gamepad) {
+                    if (count < capacity)
+                        handles[count] = handle_of(_devices[i], i);
+                    ++ count;
+                }
+            return count;
+        }
+        
+        bool device_info(gp_device handle, gp_device_info& info) const {
+            const Device* device = this->device_of(handle);
+            if (!device)
+                return false;
+            info.device = handle;
+            info.slot = device->gamepad->slot();
+            info.axes = 0;
+            for (int i = 0; i < GP_AXIS_COUNT; ++ i) {
+                info.axis_bounds[i] = static_cast<int32_t>(device->gamepad->axis_bound(static_cast<Axis>(i)));
+                if (info.axis_bounds[i])
+                    info.axes |= 1u << i;
+            }
+            return true;
+        }
+        
+        bool state(gp_device handle, gp_state& state) const {
+            const Device* device = this->device_of(handle);
+            if (!device)
+                return false;
+            const Frame& frame = device->gamepad->last_frame();
+            state.device = handle;
+            state.moving_axes = frame.moving_axes;
+            state.sequence = frame.sequence;
+            state.elapsed = frame.timestamp;
+            state.buttons = frame.held.bits();
+            for (int i = 0; i < GP_AXIS_COUNT; ++ i)
+                state.axes[i] = static_cast<int32_t>(frame.axes[i]);
+            return true;
+        }
+    };
+}
+
+#endif
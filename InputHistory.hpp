@@ -0,0 +1,404 @@
+/*
+ 
+InputHistory.hpp ... Keeps the input of a player by simulation frame, for rollback.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef INPUTHISTORY_HPP_mxwk6p652yfahb4j
+#define INPUTHISTORY_HPP_mxwk6p652yfahb4j 1
+
+#include "Gamepad.hpp"
+#include "Session.hpp"
+#include "Timer.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+namespace GP {
+    /// The input of a player in one simulation frame: the axes and the held
+    /// buttons of a gamepad, as ButtonSet::bits().
+    struct InputState {
+        int32_t axes[static_cast<int>(Axis::count)];
+        uint64_t buttons;
+        
+        static InputState of(const Frame& frame) {
+            InputState state;
+            for (int i = 0; i < static_cast<int>(Axis::count); ++ i)
+                state.axes[i] = static_cast<int32_t>(frame.axes[i]);
+            state.buttons = frame.held.bits();
+            return state;
+        }
+        
+        static InputState zero() {
+            InputState state = {};
+            return state;
+        }
+        
+        bool operator==(const InputState& other) const {
+            return buttons == other.buttons && memcmp(axes, other.axes, sizeof(axes)) == 0;
+        }
+        bool operator!=(const InputState& other) const { return !(*this == other); }
+    };
+    
+    ENUM_CLASS InputOrigin {
+        none,                   // not held: never written, or overwritten.
+        predicted,              // a guess, the input of the frame before.
+        confirmed               // sampled locally, or received.
+    };
+    
+    // A diff is a varint mask of what changed, a bit per Axis and bit 13 for
+    // the buttons, then a zigzag varint delta per changed axis and a varint
+    // of the buttons toggled. An unchanged frame is one byte.
+    //
+    // A range is a varint first frame, a varint count, and a varint 1 if
+    // the first diff is against the frame before it, which the receiver
+    // must hold confirmed, or 0 if against InputState::zero(); then a diff
+    // per frame, each against the one before.
+    namespace InputEncoding {
+        enum {
+            kButtonsBit = static_cast<int>(Axis::count),
+            kMaxDiff = (2 + static_cast<int>(Axis::count)) * SessionEncoding::kMaxVarint
+        };
+        
+        inline void put_diff(std::vector<uint8_t>& out, const InputState& base, const InputState& state) {
+            using namespace SessionEncoding;
+            unsigned mask = base.buttons != state.buttons ? 1u << kButtonsBit : 0;
+            for (int i = 0; i < static_cast<int>(Axis::count); ++ i)
+                if (base.axes[i] != state.axes[i])
+                    mask |= 1u << i;
+            put_varint(out, mask);
+            for (unsigned axes = mask & ((1u << kButtonsBit) - 1); axes; axes &= axes - 1) {
+                int i = count_trailing_zeros(axes);
+                put_varint(out, zigzag(int64_t(state.axes[i]) - base.axes[i]));
+            }
+            if (mask >> kButtonsBit & 1)
+                put_varint(out, base.buttons ^ state.buttons);
+        }
+        
+        // Advance 'p', or return false on a damaged diff.
+        inline bool get_diff(const uint8_t*& p, const uint8_t* end, const InputState& base, InputState& state) {
+            using namespace SessionEncoding;
+            uint64_t mask, value;
+            if (!get_varint(p, end, mask) || mask >> (kButtonsBit + 1))
+                return false;
+            state = base;
+            for (unsigned axes = static_cast<unsigned>(mask) & ((1u << kButtonsBit) - 1); axes; axes &= axes - 1) {
+                int i = count_trailing_zeros(axes);
+                if (!get_varint(p, end, value))
+                    return false;
+                state.axes[i] = static_cast<int32_t>(base.axes[i] + unzigzag(value));
+            }
+            if (mask >> kButtonsBit & 1) {
+                if (!get_varint(p, end, value))
+                    return false;
+                state.buttons ^= value;
+            }
+            return true;
+        }
+    }
+    
+    /// The input of one player by simulation frame, for rollback netcode: a
+    /// ring of the latest 'capacity' frames, allocated once, where finding a
+    /// frame is one index. Frames the remote input has not reached yet are
+    /// predicted to repeat the last one; when the input arrives and differs,
+    /// the earliest such frame is kept for take_rollback(). Frames count up
+    /// from 0. Only one thread may use a history.
+    class InputHistory {
+    public:
+        static const int64_t kNone = -1;
+        
+    private:
+        struct Entry {
+            int64_t frame;
+            InputState state;
+            InputOrigin origin;
+        };
+        
+        std::vector<Entry> _entries;
+        uint64_t _mask;
+        int64_t _oldest;
+        int64_t _newest;
+        int64_t _confirmed;     // every frame up to it is confirmed.
+        int64_t _overrun;       // the newest frame dropped unconfirmed.
+        int64_t _rollback;
+        
+        InputHistory(const InputHistory&);
+        InputHistory& operator=(const InputHistory&);
+        
+        Entry& entry(int64_t frame) {
+            return _entries[static_cast<uint64_t>(frame) & _mask];
+        }
+        const Entry& entry(int64_t frame) const {
+            return _entries[static_cast<uint64_t>(frame) & _mask];
+        }
+        
+        // Write the frames after the newest up to 'frame' as predictions.
+        void extend_to(int64_t frame) {
+            InputState last = _newest >= 0 ? entry(_newest).state : InputState::zero();
+            // the first frame written has none before it.
+            int64_t first = _newest == kNone ? frame : std::max(_newest + 1, frame - static_cast<int64_t>(_mask));
+            // the frames before the first are not the history's to confirm.
+            if (_oldest == kNone) {
+                _oldest = first;
+                _confirmed = first - 1;
+            }
+            for (int64_t f = first; f <= frame; ++ f) {
+                Entry& written = entry(f);
+                written.frame = f;
+                written.state = last;
+                written.origin = InputOrigin::predicted;
+            }
+            if (frame > _newest)
+                _newest = frame;
+            _oldest = std::max(_oldest, _newest - static_cast<int64_t>(_mask));
+            if (_oldest - 1 > _confirmed)
+                _overrun = _oldest - 1;
+        }
+        
+    public:
+        /// 'capacity' is rounded up to a power of two; it bounds how far
+        /// back a rollback can go.
+        explicit InputHistory(size_t capacity = 128) : _oldest(kNone), _newest(kNone), _confirmed(kNone), _overrun(kNone), _rollback(kNone) {
+            size_t size = 1;
+            while (size < capacity)
+                size *= 2;
+            Entry empty = {kNone, InputState::zero(), InputOrigin::none};
+            _entries.assign(size, empty);
+            _mask = size - 1;
+        }
+        
+        size_t capacity() const { return _entries.size(); }
+        
+        /// The newest frame held, or kNone.
+        int64_t newest() const { return _newest; }
+        /// The oldest frame held, or kNone.
+        int64_t oldest() const { return _oldest; }
+        /// The last frame up to which every frame is confirmed, or kNone.
+        int64_t confirmed_through() const { return _confirmed; }
+        /// The newest frame dropped from the history before it was
+        /// confirmed, or kNone. Once there is one, confirmed_through() stays
+        /// before it: the simulation ran further ahead than the history
+        /// holds, and must be brought back in step some other way.
+        int64_t overrun() const { return _overrun; }
+        
+        /// Return the input of a frame, or NULL if it is not held.
+        const InputState* at(int64_t frame) const {
+            const Entry& found = entry(frame);
+            return frame >= 0 && found.frame == frame ? &found.state : NULL;
+        }
+        
+        InputOrigin origin(int64_t frame) const {
+            const Entry& found = entry(frame);
+            return frame >= 0 && found.frame == frame ? found.origin : InputOrigin::none;
+        }
+        
+        /// Return the input of a frame, predicting it and the frames before
+        /// it not held yet. A frame older than the history is zero.
+        const InputState& predict(int64_t frame) {
+            static const InputState zero = InputState::zero();
+            if (frame > _newest)
+                this->extend_to(frame);
+            const InputState* state = this->at(frame);
+            return state ? *state : zero;
+        }
+        
+        /// Write the real input of a frame, and return true if it differs
+        /// from the prediction the frame held. A frame older than the
+        /// history is ignored.
+        bool confirm(int64_t frame, const InputState& state) {
+            if (frame < 0 || (_oldest != kNone && frame < _oldest))
+                return false;
+            // a frame past the newest was never simulated, so never mispredicted.
+            bool simulated = frame <= _newest;
+            if (!simulated)
+                this->extend_to(frame);
+            Entry& written = entry(frame);
+            bool mispredicted = simulated && written.origin == InputOrigin::predicted && written.state != state;
+            written.state = state;
+            written.origin = InputOrigin::confirmed;
+            if (mispredicted && (_rollback == kNone || frame < _rollback))
+                _rollback = frame;
+            
+            while (_confirmed < _newest && entry(_confirmed + 1).origin == InputOrigin::confirmed && entry(_confirmed + 1).frame == _confirmed + 1)
+                ++ _confirmed;
+            return mispredicted;
+        }
+        
+        /// Confirm the frames 'first' to 'last' as all holding 'state'. Of
+        /// a run longer than the history, only the frames it can hold are
+        /// written; the older ones still count as confirmed when the run
+        /// follows confirmed_through().
+        void confirm_run(int64_t first, int64_t last, const InputState& state) {
+            int64_t from = std::max(first, last - static_cast<int64_t>(_mask));
+            if (from > first && _confirmed == first - 1 && _oldest != kNone)
+                _confirmed = from - 1;
+            for (int64_t f = from; f <= last; ++ f)
+                this->confirm(f, state);
+        }
+        
+        /// Return the earliest frame confirmed unlike its prediction since
+        /// the last call, or kNone: the simulation must go back to it.
+        int64_t take_rollback() {
+            int64_t frame = _rollback;
+            _rollback = kNone;
+            return frame;
+        }
+        
+        /// Predict the frames after 'frame' again from the input before
+        /// them, once 'frame' has been confirmed as other than predicted,
+        /// and return how many changed. Confirmed frames stay.
+        int repredict_after(int64_t frame) {
+            const InputState* last = this->at(frame);
+            if (!last)
+                return 0;
+            int changed = 0;
+            for (int64_t f = frame + 1; f <= _newest; ++ f) {
+                Entry& written = entry(f);
+                if (written.origin == InputOrigin::predicted && written.state != *last) {
+                    written.state = *last;
+                    ++ changed;
+                }
+                last = &written.state;
+            }
+            return changed;
+        }
+        
+        /// Append the frames 'first' to 'last' as a range, and return false,
+        /// appending nothing, unless every one is confirmed.
+        bool encode_range(int64_t first, int64_t last, std::vector<uint8_t>& out) const {
+            using namespace SessionEncoding;
+            if (first < 0 || last < first)
+                return false;
+            for (int64_t f = first; f <= last; ++ f)
+                if (this->origin(f) != InputOrigin::confirmed)
+                    return false;
+            bool based = this->origin(first - 1) == InputOrigin::confirmed;
+            put_varint(out, static_cast<uint64_t>(first));
+            put_varint(out, static_cast<uint64_t>(last - first + 1));
+            put_varint(out, based ? 1 : 0);
+            const InputState* base = based ? this->at(first - 1) : NULL;
+            InputState zero = InputState::zero();
+            for (int64_t f = first; f <= last; ++ f) {
+                const InputState* state = this->at(f);
+                InputEncoding::put_diff(out, base ? *base : zero, *state);
+                base = state;
+            }
+            return true;
+        }
+        
+        /// Confirm the frames of a range, and return how many were decoded,
+        /// or -1 if it is damaged or its base is not held confirmed.
+        int apply_range(const uint8_t* bytes, size_t size) {
+            using namespace SessionEncoding;
+            const uint8_t* p = bytes;
+            const uint8_t* end = bytes + size;
+            uint64_t first, count, based;
+            if (!get_varint(p, end, first) || !get_varint(p, end, count) || !get_varint(p, end, based)
+             || first > (uint64_t(1) << 62) || count > size)
+                return -1;
+            InputState base = InputState::zero();
+            if (based) {
+                if (!first || this->origin(static_cast<int64_t>(first) - 1) != InputOrigin::confirmed)
+                    return -1;
+                base = *this->at(static_cast<int64_t>(first) - 1);
+            }
+            for (uint64_t i = 0; i < count; ++ i) {
+                InputState state;
+                if (!InputEncoding::get_diff(p, end, base, state))
+                    return -1;
+                this->confirm(static_cast<int64_t>(first + i), state);
+                base = state;
+            }
+            return static_cast<int>(count);
+        }
+    };
+    
+    /// Samples a gamepad into a history at fixed tick boundaries: frame
+    /// first_frame + n holds the input as it was at start + n * tick, and a
+    /// report at a boundary falls into the next frame. Reports record the
+    /// boundaries they pass; call advance() from the simulation too, on the
+    /// thread the gamepad dispatches on, for the boundaries of a pad left
+    /// alone. Times are of the clock of the gamepad, Gamepad::now().
+    class InputSampler {
+    private:
+        Gamepad* _gamepad;
+        InputHistory& _history;
+        uint64_t _start;
+        uint64_t _tick;
+        int64_t _first_frame;
+        int64_t _next_frame;
+        InputState _state;
+        int _subscription;
+        
+        InputSampler(const InputSampler&);
+        InputSampler& operator=(const InputSampler&);
+        
+        static void frame(void* self, Gamepad* gamepad, const Frame& frame) {
+            InputSampler* sampler = static_cast<InputSampler*>(self);
+            sampler->advance(gamepad->now());
+            sampler->_state = InputState::of(frame);
+        }
+        
+    public:
+        InputSampler(Gamepad* gamepad, InputHistory& history, uint64_t tick_nanoseconds, uint64_t start, int64_t first_frame = 0)
+            : _gamepad(gamepad), _history(history), _start(start), _tick(tick_nanoseconds ? tick_nanoseconds : 1),
+              _first_frame(first_frame), _next_frame(first_frame), _state(InputState::of(gamepad->last_frame())) {
+            Gamepad::Subscriber subscriber = {};
+            subscriber.self = this;
+            subscriber.frame = InputSampler::frame;
+            subscriber.interest = Interest::everything();
+            _subscription = gamepad->subscribe(subscriber);
+        }
+        
+        ~InputSampler() {
+            _gamepad->unsubscribe(_subscription);
+        }
+        
+        /// Confirm every frame whose boundary is at or before 'now', and
+        /// return how many. After a pause longer than the history, only
+        /// the frames it can hold are written.
+        int64_t advance(uint64_t now) {
+            if (now < _start)
+                return 0;
+            int64_t last = _first_frame + static_cast<int64_t>((now - _start) / _tick);
+            if (last < _next_frame)
+                return 0;
+            int64_t count = last - _next_frame + 1;
+            _history.confirm_run(_next_frame, last, _state);
+            _next_frame = last + 1;
+            return count;
+        }
+        
+        /// The frame the next boundary samples.
+        int64_t next_frame() const { return _next_frame; }
+    };
+}
+
+#endif
@@ -0,0 +1,263 @@
+/*
+ 
+Latency.hpp ... Histograms of the time reports take to reach the callbacks.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef LATENCY_HPP_4755rxpwyapn6pjc
+#define LATENCY_HPP_4755rxpwyapn6pjc 1
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include "Compatibility.hpp"
+#include "Statistics.hpp"
+
+// Define as 0 to compile the timestamps and the histograms out of the report
+// path. The query functions then return empty summaries.
+#ifndef GP_LATENCY_HISTOGRAMS
+#define GP_LATENCY_HISTOGRAMS 1
+#endif
+
+namespace GP {
+    // The points a report passes on its way from the device to the callbacks.
+    // A backend stamps only those it has: Linux has no queue, for instance.
+    ENUM_CLASS LatencyStamp {
+        arrived,                // the kernel timestamped the report.
+        read_returned,
+        enqueued,               // handed to the dispatching thread.
+        dequeued,
+        decoded,
+        callbacks_started,
+        callbacks_returned,
+        stamp_count
+    };
+    
+    // The time between a stamp and the one before it, named after the stamp
+    // which ends it. A stage whose stamp is missing is folded into the next.
+    ENUM_CLASS LatencyStage {
+        read_delay,             // arrived to read_returned.
+        enqueue_delay,
+        queue_delay,
+        decode_time,
+        dispatch_delay,
+        callback_time,
+        end_to_end,             // the first stamp to callbacks_returned.
+        stage_count
+    };
+    
+    /// The percentiles of a stage, in nanoseconds.
+    struct LatencySummary {
+        uint64_t count;
+        uint64_t p50;
+        uint64_t p99;
+        uint64_t max;
+    };
+    
+    /// A snapshot of a histogram, which can be summed and queried.
+    struct LatencyDistribution {
+        // Log-linear buckets, as HdrHistogram's: 16 per power of two, so a
+        // bucket is at most 1/16 wider than its values. Values from 2^36 ns,
+        // about a minute, up are counted in the last one.
+        enum {
+            kSubBucketBits = 4,
+            kSubBuckets = 1 << kSubBucketBits,
+            kMaxBits = 36,
+            kBuckets = (kMaxBits - kSubBucketBits + 1) * kSubBuckets
+        };
+        
+        uint64_t counts[kBuckets];
+        uint64_t count;
+        uint64_t max;
+        
+        LatencyDistribution() : count(0), max(0) {
+            std::fill(counts, counts + kBuckets, 0);
+        }
+        
+        static int bucket_of(uint64_t value) {
+            if (value < kSubBuckets)
+                return static_cast<int>(value);
+            if (value >> kMaxBits)
+                return kBuckets - 1;
+            int shift = 63 - count_leading_zeros(value) - kSubBucketBits;
+            return (shift + 1) * kSubBuckets + static_cast<int>(value >> shift) - kSubBuckets;
+        }
+        
+        // The highest value counted in the bucket.
+        static uint64_t highest_in(int bucket) {
+            if (bucket < kSubBuckets)
+                return bucket;
+            int shift = bucket / kSubBuckets - 1;
+            uint64_t lowest = static_cast<uint64_t>(kSubBuckets + bucket % kSubBuckets) << shift;
+            return lowest + (uint64_t(1) << shift) - 1;
+        }
+        
+        LatencyDistribution& operator+=(const LatencyDistribution& other) {
+            for (int i = 0; i < kBuckets; ++ i)
+                counts[i] += other.counts[i];
+            count += other.count;
+            max = std::max(max, other.max);
+            return *this;
+        }
+        
+        // The value under which 'fraction' of the values are, rounded up to
+        // the top of its bucket.
+        uint64_t percentile(double fraction) const {
+            if (!count)
+                return 0;
+            uint64_t rank = static_cast<uint64_t>(fraction * count + 0.5);
+            if (rank < 1)
+                rank = 1;
+            uint64_t seen = 0;
+            for (int i = 0; i < kBuckets; ++ i) {
+                seen += counts[i];
+                if (seen >= rank)
+                    return std::min(highest_in(i), max);
+            }
+            return max;
+        }
+        
+        LatencySummary summary() const {
+            LatencySummary retval = {count, percentile(0.5), percentile(0.99), max};
+            return retval;
+        }
+    };
+    
+    /// A histogram in fixed memory, written by one thread and read by any.
+    class LatencyHistogram {
+    private:
+        Counter _counts[LatencyDistribution::kBuckets];
+        Counter _max;
+        
+    public:
+        void record(uint64_t nanoseconds) {
+            _counts[LatencyDistribution::bucket_of(nanoseconds)].add();
+            _max.raise_to(nanoseconds);
+        }
+        
+        void copy_to(LatencyDistribution& distribution) const {
+            distribution.count = 0;
+            for (int i = 0; i < LatencyDistribution::kBuckets; ++ i) {
+                distribution.counts[i] = _counts[i].get();
+                distribution.count += distribution.counts[i];
+            }
+            distribution.max = _max.get();
+        }
+    };
+    
+    /// The stamps of the report in flight, and a histogram per stage. Only
+    /// the dispatching thread may stamp and record.
+    class LatencyRecorder {
+    private:
+        enum {
+            kStamps = static_cast<int>(LatencyStamp::stamp_count),
+            kStages = static_cast<int>(LatencyStage::stage_count)
+        };
+        
+        uint64_t _stamps[kStamps];
+        LatencyHistogram _histograms[kStages];
+        
+    public:
+        LatencyRecorder() {
+            std::fill(_stamps, _stamps + kStamps, 0);
+        }
+        
+        void stamp(LatencyStamp stamp, uint64_t nanoseconds) {
+            _stamps[static_cast<int>(stamp)] = nanoseconds;
+        }
+        
+        // Fold the stamps of the report into the histograms, and clear them
+        // for the next one.
+        void record() {
+            uint64_t first = 0, previous = 0;
+            for (int i = 0; i < kStamps; ++ i) {
+                uint64_t time = _stamps[i];
+                if (!time)
+                    continue;
+                _stamps[i] = 0;
+                if (!previous)
+                    first = time;
+                else
+                    _histograms[i - 1].record(time > previous ? time - previous : 0);
+                previous = time;
+            }
+            if (previous != first)
+                _histograms[static_cast<int>(LatencyStage::end_to_end)].record(previous > first ? previous - first : 0);
+        }
+        
+        void copy_to(LatencyStage stage, LatencyDistribution& distribution) const {
+            _histograms[static_cast<int>(stage)].copy_to(distribution);
+        }
+    };
+    
+    /// Every live LatencyRecorder, and the histograms of those already
+    /// deleted, for the process-wide distributions.
+    class LatencyRegistry {
+    private:
+        enum { kStages = static_cast<int>(LatencyStage::stage_count) };
+        
+        std::mutex _mutex;
+        std::vector<const LatencyRecorder*> _live;
+        LatencyDistribution _retired[kStages];
+        
+    public:
+        static LatencyRegistry& instance() {
+            static LatencyRegistry registry;
+            return registry;
+        }
+        
+        void add(const LatencyRecorder* recorder) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _live.push_back(recorder);
+        }
+        
+        void remove(const LatencyRecorder* recorder) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _live.erase(std::remove(_live.begin(), _live.end(), recorder), _live.end());
+            LatencyDistribution distribution;
+            for (int i = 0; i < kStages; ++ i) {
+                recorder->copy_to(static_cast<LatencyStage>(i), distribution);
+                _retired[i] += distribution;
+            }
+        }
+        
+        LatencyDistribution total(LatencyStage stage) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            LatencyDistribution total = _retired[static_cast<int>(stage)];
+            LatencyDistribution distribution;
+            for (auto it = _live.begin(); it != _live.end(); ++ it) {
+                (*it)->copy_to(stage, distribution);
+                total += distribution;
+            }
+            return total;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,227 @@
+/*
+ 
+Replay.hpp ... Deterministic replay of recorded sessions.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef REPLAY_HPP_x8ls0hfygbj4vbjj
+#define REPLAY_HPP_x8ls0hfygbj4vbjj 1
+
+#include "Gamepad.hpp"
+#include "GamepadChangedObserver.hpp"
+#include "Session.hpp"
+#include "VirtualClock.hpp"
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+namespace GP {
+    /// A gamepad playing back recorded frames through the whole of Gamepad:
+    /// axis states and groups, the callbacks, subscribers and listeners,
+    /// the idle timeout and the report rate all run as for a device, on
+    /// 'clock' if given.
+    class ReplayGamepad : public Gamepad {
+    private:
+        unsigned _axes;
+        ButtonSet _held;
+        
+    public:
+        explicit ReplayGamepad(const SessionDevice& descriptor, ClockSource* clock = NULL) : _axes(descriptor.axes) {
+            this->set_clock(clock);
+            // frames are relative to the centroid, which is then 0.
+            for (int i = 0; i < static_cast<int>(Axis::count); ++ i)
+                if (_axes >> i & 1)
+                    this->set_bounds_for_axis(static_cast<Axis>(i), -descriptor.bounds[i], descriptor.bounds[i] - 1);
+        }
+        
+        /// Drive the gamepad to 'state'. The buttons of 'taps' went and came
+        /// back since the last frame, such as a press and release which
+        /// were merged; each is changed twice before the others change.
+        void replay_frame(const SessionDeviceState& state, unsigned nanoseconds_elapsed, ButtonSet taps = ButtonSet()) {
+            for (int i = 0; i < static_cast<int>(Axis::count); ++ i)
+                if (_axes >> i & 1)
+                    this->set_axis_value(static_cast<Axis>(i), state.axes[i]);
+            this->handle_axes_change(nanoseconds_elapsed);
+            
+            taps.for_each([&](Button button) {
+                bool held = _held.contains(button);
+                this->handle_button_change(button, !held);
+                this->handle_button_change(button, held);
+            });
+            
+            uint64_t changed = state.held.bits() ^ _held.bits();
+            for (; changed; changed &= changed - 1) {
+                int index = count_trailing_zeros(changed);
+                Button button = ButtonSet::button_at(index);
+                this->handle_button_change(button, state.held.contains(button));
+            }
+            _held = state.held;
+            this->handle_frame(nanoseconds_elapsed);
+        }
+    };
+    
+    /// Re-drives a recorded session through ReplayGamepads, on a virtual
+    /// clock of the replay, so that their timers and Gamepad::now() follow
+    /// the recording: the same session gives the same callbacks at real
+    /// time, N times faster or as fast as it goes. Nothing else sees the
+    /// clock, so live gamepads and timers run on beside a replay. Raw reports are handed to a callback, to be fed
+    /// to the decoder of their platform, such as Gamepad_Linux::handle_events().
+    class SessionReplay {
+    public:
+        typedef void (*RawCallback)(void* self, int device, const uint8_t* bytes, size_t size);
+        
+    private:
+        const SessionReader& _reader;
+        VirtualClock _clock;
+        double _speed;
+        std::vector<std::unique_ptr<ReplayGamepad> > _gamepads;
+        void* _self;
+        GamepadChangedObserver::Callback _callback;
+        void* _raw_self;
+        RawCallback _raw_callback;
+        
+        // Map recorded time to the steady clock.
+        std::chrono::steady_clock::time_point _wall_start;
+        uint64_t _start;
+        
+        SessionReplay(const SessionReplay&);
+        SessionReplay& operator=(const SessionReplay&);
+        
+        void pace(uint64_t time) {
+            if (_speed > 0 && time > _start) {
+                std::chrono::nanoseconds offset(static_cast<int64_t>((time - _start) / _speed));
+                std::this_thread::sleep_until(_wall_start + offset);
+            }
+        }
+        
+        // Fire the timers due up to 'time', each at its time, then move there.
+        void advance_to(uint64_t time) {
+            for (uint64_t due; (due = _clock.next_due()) <= time; ) {
+                this->pace(due);
+                _clock.advance_to(due);
+            }
+            this->pace(time);
+            _clock.advance_to(time);
+        }
+        
+        ReplayGamepad* gamepad(const SessionRecord& record) {
+            size_t device = record.device;
+            if (device >= _gamepads.size())
+                _gamepads.resize(device + 1);
+            // a device attached before a seek is met first by its frames.
+            if (!_gamepads[device] && record.state->attached)
+                this->attach(device, record.state->descriptor);
+            return _gamepads[device].get();
+        }
+        
+        void attach(size_t device, const SessionDevice& descriptor) {
+            this->detach(device);
+            _gamepads[device].reset(new ReplayGamepad(descriptor, &_clock));
+            if (_callback)
+                _callback(_self, _gamepads[device].get(), GamepadState::attached);
+        }
+        
+        void detach(size_t device) {
+            if (device < _gamepads.size() && _gamepads[device]) {
+                if (_callback)
+                    _callback(_self, _gamepads[device].get(), GamepadState::detaching);
+                _gamepads[device].reset();
+            }
+        }
+        
+    public:
+        explicit SessionReplay(const SessionReader& reader)
+            : _reader(reader), _speed(0), _self(NULL), _callback(NULL), _raw_self(NULL), _raw_callback(NULL), _start(0) {}
+        
+        /// Replay 'speed' times as fast as recorded; 0, the default, as
+        /// fast as possible.
+        void set_speed(double speed) { _speed = speed > 0 ? speed : 0; }
+        
+        /// Told of the gamepads as the recording attaches and detaches them,
+        /// as by a GamepadChangedObserver.
+        void set_callback(void* self, GamepadChangedObserver::Callback callback) {
+            _self = self;
+            _callback = callback;
+        }
+        
+        void set_raw_callback(void* self, RawCallback callback) {
+            _raw_self = self;
+            _raw_callback = callback;
+        }
+        
+        const VirtualClock& clock() const { return _clock; }
+        
+        /// Replay the records from 'from' on, and return how many there
+        /// were. The gamepads are detached at the end.
+        uint64_t run(uint64_t from = 0) {
+            SessionReader::Cursor cursor = _reader.seek(from);
+            SessionRecord record;
+            uint64_t records = 0;
+            bool more = cursor.next_from(from, record);
+            if (more) {
+                _start = record.timestamp;
+                _wall_start = std::chrono::steady_clock::now();
+                _clock.advance_to(record.timestamp);
+            }
+            
+            for (; more; more = cursor.next(record)) {
+                this->advance_to(record.timestamp);
+                ++ records;
+                switch (record.type) {
+                    case SessionRecordType::attach:
+                        if (size_t(record.device) >= _gamepads.size())
+                            _gamepads.resize(record.device + 1);
+                        this->attach(record.device, record.state->descriptor);
+                        break;
+                    case SessionRecordType::detach:
+                        this->detach(record.device);
+                        break;
+                    case SessionRecordType::frame:
+                        if (ReplayGamepad* gamepad = this->gamepad(record))
+                            gamepad->replay_frame(*record.state, record.nanoseconds_elapsed);
+                        break;
+                    case SessionRecordType::raw:
+                        if (_raw_callback)
+                            _raw_callback(_raw_self, record.device, record.raw, record.raw_size);
+                        break;
+                    default:
+                        break;
+                }
+            }
+            
+            for (size_t device = 0; device < _gamepads.size(); ++ device)
+                this->detach(device);
+            _gamepads.clear();
+            return records;
+        }
+    };
+}
+
+#endif
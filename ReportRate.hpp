@@ -0,0 +1,173 @@
+/*
+ 
+ReportRate.hpp ... How often a device reports, and how regularly.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef REPORTRATE_HPP_gxaa2f0557d2ife7
+#define REPORTRATE_HPP_gxaa2f0557d2ife7 1
+
+#include <stdint.h>
+#include <atomic>
+#include <cmath>
+#include <algorithm>
+#include "Compatibility.hpp"
+#include "Statistics.hpp"
+#include "Latency.hpp"
+
+namespace GP {
+    /// The intervals between the reports of a device, in nanoseconds.
+    struct ReportRate {
+        uint64_t intervals;             // intervals measured, stalls excepted.
+        double mean_interval;           // over all of them.
+        double interval_deviation;      // their standard deviation.
+        double recent_interval;         // a moving average: the learned norm.
+        double reports_per_second;      // after recent_interval.
+        LatencySummary jitter;          // how far intervals fall from the norm.
+        uint64_t stalls;                // intervals far longer than the norm.
+        uint64_t longest_stall;
+    };
+    
+    /// Learns the report interval of a device from the reports, at a
+    /// constant cost per report. Only the dispatching thread may record; any
+    /// thread may read.
+    class ReportRateEstimator {
+    public:
+        enum {
+            kWarmUp = 8,            // intervals learned before judging any.
+            kRelearnAfter = 4,      // stalls in a row taken as a new rate.
+            kRecentWeight = 16      // the moving average weighs 1/16 new.
+        };
+        
+    private:
+        // A seqlock, odd while the writer updates the moments, so that a
+        // reader retries rather than mix two reports.
+        std::atomic<uint64_t> _version;
+        std::atomic<uint64_t> _intervals;
+        std::atomic<double> _mean;
+        std::atomic<double> _m2;        // sum of squared deviations (Welford).
+        std::atomic<double> _recent;
+        
+        LatencyHistogram _jitter;
+        Counter _stalls;
+        Counter _longest_stall;
+        unsigned _stalls_in_a_row;
+        
+        std::atomic<unsigned> _stall_factor;
+        std::atomic<uint64_t> _minimum_stall;
+        
+    public:
+        ReportRateEstimator() : _version(0), _intervals(0), _mean(0), _m2(0), _recent(0),
+                                _stalls_in_a_row(0), _stall_factor(8), _minimum_stall(0) {}
+        
+        /// Count intervals longer than 'factor' times the norm, and than
+        /// 'minimum_nanoseconds', as stalls.
+        void set_stall_threshold(unsigned factor, uint64_t minimum_nanoseconds) {
+            _stall_factor.store(factor, std::memory_order_relaxed);
+            _minimum_stall.store(minimum_nanoseconds, std::memory_order_relaxed);
+        }
+        
+        /// The interval past which the device is stalled, or ~0 while the
+        /// norm is not learned yet.
+        uint64_t stall_threshold() const {
+            if (_intervals.load(std::memory_order_relaxed) < kWarmUp)
+                return ~uint64_t(0);
+            uint64_t threshold = static_cast<uint64_t>(_recent.load(std::memory_order_relaxed) * _stall_factor.load(std::memory_order_relaxed));
+            return std::max(threshold, _minimum_stall.load(std::memory_order_relaxed));
+        }
+        
+        /// The learned interval, in nanoseconds, or 0 before any report.
+        uint64_t expected_interval() const {
+            return static_cast<uint64_t>(_recent.load(std::memory_order_relaxed));
+        }
+        
+        /// Learn the interval since the previous report, and return whether
+        /// it was a stall. A stall is kept out of the moments, unless
+        /// kRelearnAfter come in a row: then the device changed its rate,
+        /// and the norm starts over from the new one.
+        bool record(uint64_t interval) {
+            // the first report of a device has no interval.
+            if (!interval)
+                return false;
+            
+            uint64_t count = _intervals.load(std::memory_order_relaxed);
+            double recent = _recent.load(std::memory_order_relaxed);
+            bool stalled = interval > this->stall_threshold();
+            if (stalled) {
+                _stalls.add();
+                _longest_stall.raise_to(interval);
+                if (++ _stalls_in_a_row < kRelearnAfter)
+                    return true;
+                recent = 0;
+            }
+            _stalls_in_a_row = 0;
+            
+            double value = static_cast<double>(interval);
+            if (recent)
+                _jitter.record(static_cast<uint64_t>(value > recent ? value - recent : recent - value));
+            
+            uint64_t version = _version.load(std::memory_order_relaxed);
+            _version.store(version + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            double mean = _mean.load(std::memory_order_relaxed);
+            double delta = value - mean;
+            mean += delta / (count + 1);
+            _m2.store(_m2.load(std::memory_order_relaxed) + delta * (value - mean), std::memory_order_relaxed);
+            _mean.store(mean, std::memory_order_relaxed);
+            _recent.store(recent ? recent + (value - recent) / kRecentWeight : value, std::memory_order_relaxed);
+            _intervals.store(count + 1, std::memory_order_relaxed);
+            _version.store(version + 2, std::memory_order_release);
+            return stalled;
+        }
+        
+        ReportRate summary() const {
+            ReportRate retval;
+            double m2;
+            for (;;) {
+                uint64_t version = _version.load(std::memory_order_acquire);
+                retval.intervals = _intervals.load(std::memory_order_relaxed);
+                retval.mean_interval = _mean.load(std::memory_order_relaxed);
+                m2 = _m2.load(std::memory_order_relaxed);
+                retval.recent_interval = _recent.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (!(version & 1) && _version.load(std::memory_order_relaxed) == version)
+                    break;
+            }
+            retval.interval_deviation = retval.intervals > 1 ? std::sqrt(m2 / (retval.intervals - 1)) : 0;
+            retval.reports_per_second = retval.recent_interval ? 1e9 / retval.recent_interval : 0;
+            LatencyDistribution jitter;
+            _jitter.copy_to(jitter);
+            retval.jitter = jitter.summary();
+            retval.stalls = _stalls.get();
+            retval.longest_stall = _longest_stall.get();
+            return retval;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,979 @@
+/*
+ 
+Session.hpp ... Recording of gamepad sessions to a compact, indexed file.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef SESSION_HPP_titt0fxo8ew3ey31
+#define SESSION_HPP_titt0fxo8ew3ey31 1
+
+#include "Gamepad.hpp"
+#include "Exception.hpp"
+#include "Timer.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <cstdio>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+
+namespace GP {
+    // A session file, all integers little-endian:
+    //
+    //   SessionFileHeader
+    //   blocks: a SessionBlockHeader, then its payload
+    //   the index: a SessionIndexEntry per block
+    //   SessionTrailer
+    //
+    // A payload starts with a keyframe: every attached device, with its
+    // descriptor and its whole state. So a block decodes without the blocks
+    // before it, and a seek is a binary search of the index and a scan of
+    // one block. Then come the records, each a tag byte, the varint device,
+    // the zigzag varint time since the previous record of the block (or
+    // since its first), and:
+    //
+    //   frame    varint sequence delta, varint nanoseconds elapsed, varint
+    //            mask of the axes which changed, a zigzag varint delta per
+    //            changed axis, varint held buttons xor those before.
+    //   raw      varint size, the bytes of the report as read.
+    //   attach   the descriptor: varint name size, name, varint axis mask,
+    //            a varint bound per axis.
+    //   detach   nothing.
+    //
+    // A file whose writer did not close it has no index; the reader then
+    // walks the block headers instead.
+    
+    ENUM_CLASS SessionRecordType {
+        keyframe_end,           // only in files: closes the keyframe.
+        frame,
+        raw,
+        attach,
+        detach
+    };
+    
+    struct SessionFileHeader {
+        char magic[8];          // "GPSESSN\0"
+        uint32_t version;
+        uint32_t block_size;
+    };
+    
+    struct SessionBlockHeader {
+        uint32_t magic;         // kBlockMagic
+        uint32_t payload_size;
+        uint32_t record_count;
+        uint32_t keyframe_size; // the records start this far into the payload.
+        uint64_t first_timestamp;
+        uint64_t last_timestamp;
+    };
+    
+    struct SessionIndexEntry {
+        uint64_t offset;        // of the block header in the file.
+        uint64_t first_timestamp;
+        uint64_t last_timestamp;
+        uint64_t first_record;  // records in the blocks before.
+    };
+    
+    struct SessionTrailer {
+        uint64_t index_offset;
+        uint64_t block_count;
+        uint64_t record_count;
+        uint64_t dropped;       // records the writer had no room for.
+        char magic[8];          // "GPINDEX\0"
+    };
+    
+    /// What a recording keeps of a device.
+    struct SessionDevice {
+        char name[64];
+        unsigned axes;                          // a bit per Axis.
+        long bounds[static_cast<int>(Axis::count)];   // as Gamepad::axis_bound().
+        
+        /// The descriptor of a gamepad, named 'name'.
+        static SessionDevice of(const Gamepad* gamepad, const char* name) {
+            SessionDevice descriptor;
+            memset(&descriptor, 0, sizeof(descriptor));
+            strncpy(descriptor.name, name, sizeof(descriptor.name) - 1);
+            for (int i = 0; i < static_cast<int>(Axis::count); ++ i) {
+                descriptor.bounds[i] = gamepad->axis_bound(static_cast<Axis>(i));
+                if (descriptor.bounds[i])
+                    descriptor.axes |= 1u << i;
+            }
+            return descriptor;
+        }
+    };
+    
+    /// The state of a device, as the last frame recorded left it.
+    struct SessionDeviceState {
+        bool attached;
+        SessionDevice descriptor;
+        uint64_t sequence;
+        long axes[static_cast<int>(Axis::count)];
+        ButtonSet held;
+    };
+    
+    namespace SessionEncoding {
+        enum {
+            kVersion = 1,
+            kBlockMagic = 0x4b4c4247,           // "GBLK"
+            kMaxVarint = 10,
+            // a frame record: tag, device, time, sequence, elapsed, mask,
+            // the axes and the buttons.
+            kMaxRecord = (6 + static_cast<int>(Axis::count)) * kMaxVarint
+        };
+        
+        inline void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+            while (value >= 0x80) {
+                out.push_back(static_cast<uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<uint8_t>(value));
+        }
+        
+        inline uint64_t zigzag(int64_t value) {
+            return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+        }
+        
+        inline int64_t unzigzag(uint64_t value) {
+            return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+        }
+        
+        // Advance 'p', or return false past 'end'.
+        inline bool get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+            value = 0;
+            for (int shift = 0; p < end && shift < 7 * kMaxVarint; shift += 7) {
+                uint8_t byte = *p ++;
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if (!(byte & 0x80))
+                    return true;
+            }
+            return false;
+        }
+        
+        inline void put_descriptor(std::vector<uint8_t>& out, const SessionDevice& device) {
+            size_t length = strnlen(device.name, sizeof(device.name));
+            put_varint(out, length);
+            out.insert(out.end(), device.name, device.name + length);
+            put_varint(out, device.axes);
+            for (int i = 0; i < static_cast<int>(Axis::count); ++ i)
+                if (device.axes >> i & 1)
+                    put_varint(out, static_cast<uint64_t>(device.bounds[i]));
+        }
+        
+        inline bool get_descriptor(const uint8_t*& p, const uint8_t* end, SessionDevice& device) {
+            uint64_t length, axes;
+            if (!get_varint(p, end, length) || length >= sizeof(device.name) || length > uint64_t(end - p))
+                return false;
+            memset(&device, 0, sizeof(device));
+            memcpy(device.name, p, length);
+            p += length;
+            if (!get_varint(p, end, axes))
+                return false;
+            device.axes = static_cast<unsigned>(axes);
+            for (int i = 0; i < static_cast<int>(Axis::count); ++ i) {
+                uint64_t bound;
+                if (device.axes >> i & 1) {
+                    if (!get_varint(p, end, bound))
+                        return false;
+                    device.bounds[i] = static_cast<long>(bound);
+                }
+            }
+            return true;
+        }
+    }
+    
+    /// An entry of the writer's queue: a record, or a part of a raw report.
+    struct SessionEntry {
+        enum { kPayload = 232 };
+        
+        uint8_t type;           // a SessionRecordType.
+        uint8_t continued;      // the raw report goes on in the next entry.
+        uint16_t size;          // of the raw bytes in this entry.
+        uint32_t device;
+        uint64_t timestamp;
+        union {
+            struct {
+                uint64_t sequence;
+                uint64_t held;
+                unsigned nanoseconds_elapsed;
+                long axes[static_cast<int>(Axis::count)];
+            } frame;
+            SessionDevice descriptor;
+            uint8_t raw[kPayload];
+        };
+    };
+    
+    /// A bounded lock-free queue of entries, after Dmitry Vyukov's: any
+    /// thread pushes, one thread pops. A push reserves all the entries of a
+    /// record at once, so the records of two threads never interleave.
+    class SessionRing {
+    private:
+        enum { kCacheLine = 64 };
+        
+        struct Cell {
+            std::atomic<uint64_t> sequence;
+            SessionEntry entry;
+        };
+        
+        std::unique_ptr<Cell[]> _cells;
+        uint64_t _mask;
+        char _padding_before[kCacheLine];
+        std::atomic<uint64_t> _head;            // the next cell to push.
+        char _padding_between[kCacheLine];
+        // the next cell to pop; atomic only for size().
+        std::atomic<uint64_t> _tail;
+        char _padding_after[kCacheLine];
+        
+        SessionRing(const SessionRing&);
+        SessionRing& operator=(const SessionRing&);
+        
+    public:
+        /// 'capacity' is rounded up to a power of two.
+        explicit SessionRing(size_t capacity) : _mask(1), _head(0), _tail(0) {
+            while (_mask < capacity)
+                _mask <<= 1;
+            _cells.reset(new Cell[_mask]);
+            for (uint64_t i = 0; i < _mask; ++ i)
+                _cells[i].sequence.store(i, std::memory_order_relaxed);
+            -- _mask;
+        }
+        
+        size_t capacity() const { return _mask + 1; }
+        
+        /// The entries pushed and not yet popped, as they were a moment ago.
+        size_t size() const {
+            // the tail first: it never passes the head loaded after it.
+            uint64_t tail = _tail.load(std::memory_order_relaxed);
+            return static_cast<size_t>(_head.load(std::memory_order_relaxed) - tail);
+        }
+        
+        /// Push 'count' entries together, or none if they do not fit.
+        bool push(const SessionEntry* entries, size_t count) {
+            if (count > capacity())
+                return false;
+            uint64_t position = _head.load(std::memory_order_relaxed);
+            while (true) {
+                bool taken = false;
+                for (size_t i = 0; i < count; ++ i) {
+                    int64_t lag = static_cast<int64_t>(_cells[(position + i) & _mask].sequence.load(std::memory_order_acquire) - (position + i));
+                    if (lag < 0)
+                        return false;
+                    if (lag > 0) {
+                        taken = true;
+                        break;
+                    }
+                }
+                if (taken)
+                    position = _head.load(std::memory_order_relaxed);
+                else if (_head.compare_exchange_weak(position, position + count, std::memory_order_relaxed))
+                    break;
+            }
+            for (size_t i = 0; i < count; ++ i) {
+                Cell& cell = _cells[(position + i) & _mask];
+                cell.entry = entries[i];
+                cell.sequence.store(position + i + 1, std::memory_order_release);
+            }
+            return true;
+        }
+        
+        /// Only the popping thread may call it.
+        bool pop(SessionEntry& entry) {
+            uint64_t tail = _tail.load(std::memory_order_relaxed);
+            Cell& cell = _cells[tail & _mask];
+            if (cell.sequence.load(std::memory_order_acquire) != tail + 1)
+                return false;
+            entry = cell.entry;
+            cell.sequence.store(tail + _mask + 1, std::memory_order_release);
+            _tail.store(tail + 1, std::memory_order_relaxed);
+            return true;
+        }
+    };
+    
+    /// Records frames and raw reports of gamepads to a session file. The
+    /// recording threads only copy records into a ring; a background thread
+    /// encodes them into one block while another thread writes the block
+    /// before it. When the ring is full a record is dropped and counted,
+    /// never waited for.
+    class SessionWriter {
+    private:
+        struct Block {
+            std::vector<uint8_t> payload;
+            SessionBlockHeader header;
+        };
+        
+        FILE* _file;
+        size_t _block_size;
+        SessionRing _ring;
+        std::atomic<uint64_t> _dropped;
+        std::atomic<int> _next_device;
+        
+        std::mutex _taps_mutex;
+        std::vector<std::unique_ptr<FrameTap> > _taps;
+        // a removed tap may still be called by the report in flight.
+        std::vector<std::unique_ptr<FrameTap> > _removed_taps;
+        
+        // Only the encoding thread touches the device states and the block
+        // being filled.
+        std::vector<SessionDeviceState> _devices;
+        Block _blocks[2];
+        int _filling;
+        uint64_t _previous_timestamp;
+        std::vector<uint8_t> _raw;
+        
+        // Handed from the encoding thread to the writing thread.
+        std::mutex _mutex;
+        std::condition_variable _changed;
+        // The encoding thread sleeps on _pushed once it finds the ring
+        // empty: it dozes for kDozeMilliseconds at a time, and after
+        // kQuietDozes dozes which found nothing, sleeps for up to
+        // kSleepMilliseconds. A push takes the mutex to wake it only if it
+        // sleeps, or dozes with the ring half full, so steady pushes make
+        // no system call. A wake-up missed in a race only delays the
+        // encoding to the end of the wait.
+        enum { kDozeMilliseconds = 50, kQuietDozes = 20, kSleepMilliseconds = 1000 };
+        enum { kAwake, kDozing, kAsleep };
+        std::condition_variable _pushed;
+        std::atomic<int> _encoder_state;
+        Block* _sealed;
+        bool _stopping;
+        bool _encoder_done;
+        uint64_t _offset;
+        uint64_t _records_written;
+        std::vector<SessionIndexEntry> _index;
+        
+        std::thread _encoder;
+        std::thread _flusher;
+        
+        SessionWriter(FILE* file, size_t block_size, size_t ring_capacity)
+            : _file(file), _block_size(block_size), _ring(ring_capacity), _dropped(0), _next_device(0),
+              _filling(0), _previous_timestamp(0), _encoder_state(kAwake), _sealed(NULL), _stopping(false), _encoder_done(false),
+              _offset(sizeof(SessionFileHeader)), _records_written(0) {
+            for (int i = 0; i < 2; ++ i)
+                _blocks[i].payload.reserve(block_size);
+            this->begin_block();
+            _encoder = std::thread(&SessionWriter::encode_entries, this);
+            _flusher = std::thread(&SessionWriter::write_blocks, this);
+        }
+        
+        SessionWriter(const SessionWriter&);
+        SessionWriter& operator=(const SessionWriter&);
+        
+        static void tap_frame(void* self, int device, Gamepad* gamepad, const Frame& frame) {
+            static_cast<SessionWriter*>(self)->record_frame(device, frame, gamepad->now());
+        }
+        
+        bool push(const SessionEntry* entries, size_t count) {
+            if (_ring.push(entries, count)) {
+                int state = _encoder_state.load(std::memory_order_relaxed);
+                if (state == kAsleep || (state == kDozing && _ring.size() >= _ring.capacity() / 2)) {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _pushed.notify_one();
+                }
+                return true;
+            }
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        
+        void begin_block() {
+            using namespace SessionEncoding;
+            Block& block = _blocks[_filling];
+            block.payload.clear();
+            memset(&block.header, 0, sizeof(block.header));
+            block.header.magic = kBlockMagic;
+            
+            std::vector<uint8_t>& out = block.payload;
+            for (size_t id = 0; id < _devices.size(); ++ id) {
+                const SessionDeviceState& state = _devices[id];
+                if (!state.attached)
+                    continue;
+                out.push_back(static_cast<uint8_t>(SessionRecordType::attach));
+                put_varint(out, id);
+                put_descriptor(out, state.descriptor);
+                put_varint(out, state.sequence);
+                for (int i = 0; i < static_cast<int>(Axis::count); ++ i)
+                    put_varint(out, zigzag(state.axes[i]));
+                put_varint(out, state.held.bits());
+            }
+            out.push_back(static_cast<uint8_t>(SessionRecordType::keyframe_end));
+            block.header.keyframe_size = static_cast<uint32_t>(out.size());
+        }
+        
+        void seal_block() {
+            Block& block = _blocks[_filling];
+            block.header.payload_size = static_cast<uint32_t>(block.payload.size());
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                // the other buffer is free once its block is written.
+                while (_sealed)
+                    _changed.wait(lock);
+                _sealed = &block;
+            }
+            _changed.notify_all();
+            _filling ^= 1;
+            this->begin_block();
+        }
+        
+        void encode(const SessionEntry& entry, const uint8_t* raw, size_t raw_size) {
+            using namespace SessionEncoding;
+            SessionRecordType type = static_cast<SessionRecordType>(entry.type);
+            if (entry.device >= _devices.size()) {
+                SessionDeviceState unknown = {};
+                _devices.resize(entry.device + 1, unknown);
+            }
+            SessionDeviceState& state = _devices[entry.device];
+            if (type != SessionRecordType::attach && !state.attached)
+                return;
+            
+            Block* block = &_blocks[_filling];
+            if (block->header.record_count && block->payload.size() + raw_size + kMaxRecord > _block_size) {
+                this->seal_block();
+                block = &_blocks[_filling];
+            }
+            if (!block->header.record_count) {
+                block->header.first_timestamp = entry.timestamp;
+                _previous_timestamp = entry.timestamp;
+            }
+            
+            std::vector<uint8_t>& out = block->payload;
+            out.push_back(entry.type);
+            put_varint(out, entry.device);
+            put_varint(out, zigzag(static_cast<int64_t>(entry.timestamp - _previous_timestamp)));
+            _previous_timestamp = entry.timestamp;
+            block->header.last_timestamp = std::max(block->header.last_timestamp, entry.timestamp);
+            ++ block->header.record_count;
+            
+            switch (type) {
+                case SessionRecordType::frame: {
+                    put_varint(out, entry.frame.sequence - state.sequence);
+                    put_varint(out, entry.frame.nanoseconds_elapsed);
+                    unsigned changed = 0;
+                    for (int i = 0; i < static_cast<int>(Axis::count); ++ i)
+                        if (entry.frame.axes[i] != state.axes[i])
+                            changed |= 1u << i;
+                    put_varint(out, changed);
+                    for (int i = 0; i < static_cast<int>(Axis::count); ++ i)
+                        if (changed >> i & 1)
+                            put_varint(out, zigzag(entry.frame.axes[i] - state.axes[i]));
+                    put_varint(out, entry.frame.held ^ state.held.bits());
+                    state.sequence = entry.frame.sequence;
+                    std::copy(entry.frame.axes, entry.frame.axes + static_cast<int>(Axis::count), state.axes);
+                    state.held = ButtonSet(entry.frame.held);
+                    break;
+                }
+                case SessionRecordType::raw:
+                    put_varint(out, raw_size);
+                    out.insert(out.end(), raw, raw + raw_size);
+                    break;
+                case SessionRecordType::attach: {
+                    put_descriptor(out, entry.descriptor);
+                    SessionDeviceState attached = {};
+                    attached.attached = true;
+                    attached.descriptor = entry.descriptor;
+                    state = attached;
+                    break;
+                }
+                default:
+                    state.attached = false;
+                    break;
+            }
+        }
+        
+        void encode_entries() {
+            SessionEntry entry;
+            int quiet_dozes = 0;
+            while (true) {
+                bool stopping;
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    stopping = _stopping;
+                }
+                bool any = false;
+                while (_ring.pop(entry)) {
+                    any = true;
+                    if (static_cast<SessionRecordType>(entry.type) != SessionRecordType::raw) {
+                        this->encode(entry, NULL, 0);
+                        continue;
+                    }
+                    // the parts of a raw report are pushed together.
+                    _raw.assign(entry.raw, entry.raw + entry.size);
+                    SessionEntry first = entry;
+                    while (entry.continued) {
+                        while (!_ring.pop(entry)) {}
+                        _raw.insert(_raw.end(), entry.raw, entry.raw + entry.size);
+                    }
+                    this->encode(first, _raw.data(), _raw.size());
+                }
+                if (stopping && !any)
+                    break;
+                if (any) {
+                    quiet_dozes = 0;
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (_stopping)
+                    continue;
+                bool asleep = quiet_dozes >= kQuietDozes;
+                _encoder_state.store(asleep ? kAsleep : kDozing, std::memory_order_relaxed);
+                _pushed.wait_for(lock, std::chrono::milliseconds(asleep ? kSleepMilliseconds : kDozeMilliseconds));
+                _encoder_state.store(kAwake, std::memory_order_relaxed);
+                if (!asleep)
+                    ++ quiet_dozes;
+            }
+            
+            if (_blocks[_filling].header.record_count)
+                this->seal_block();
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _encoder_done = true;
+            }
+            _changed.notify_all();
+        }
+        
+        void write_blocks() {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (true) {
+                while (!_sealed && !_encoder_done)
+                    _changed.wait(lock);
+                if (!_sealed)
+                    return;
+                Block* block = _sealed;
+                lock.unlock();
+                
+                SessionIndexEntry entry = {_offset, block->header.first_timestamp, block->header.last_timestamp, _records_written};
+                fwrite(&block->header, sizeof(block->header), 1, _file);
+                fwrite(block->payload.data(), 1, block->payload.size(), _file);
+                _offset += sizeof(block->header) + block->payload.size();
+                _records_written += block->header.record_count;
+                _index.push_back(entry);
+                
+                lock.lock();
+                _sealed = NULL;
+                _changed.notify_all();
+            }
+        }
+        
+    public:
+        /// Create 'path' and start recording. Blocks hold about 'block_size'
+        /// bytes; the ring holds 'ring_capacity' entries.
+        static SessionWriter* create(const char* path, size_t block_size = 65536, size_t ring_capacity = 16384) {
+            FILE* file = fopen(path, "wb");
+            if (!file)
+                throw SessionFileException();
+            SessionFileHeader header = {{'G', 'P', 'S', 'E', 'S', 'S', 'N', '\0'}, SessionEncoding::kVersion, static_cast<uint32_t>(block_size)};
+            fwrite(&header, sizeof(header), 1, file);
+            return new SessionWriter(file, std::max<size_t>(block_size, 256), ring_capacity);
+        }
+        
+        /// Record what is queued, then write the index and close the file.
+        /// Delete the writer outside the callbacks of the gamepads it still
+        /// records, and before them.
+        ~SessionWriter() {
+            {
+                std::lock_guard<std::mutex> lock(_taps_mutex);
+                for (auto it = _taps.begin(); it != _taps.end(); ++ it)
+                    (*it)->unsubscribe();
+                // as remove_gamepad() keeps a tap for the report in flight,
+                // free none before its gamepad is done with it.
+                for (auto it = _taps.begin(); it != _taps.end(); ++ it)
+                    (*it)->gamepad()->wait_for_dispatch();
+                _taps.clear();
+            }
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stopping = true;
+            }
+            _pushed.notify_one();
+            _encoder.join();
+            _flusher.join();
+            
+            SessionTrailer trailer = {_offset, _index.size(), _records_written, this->dropped(), {'G', 'P', 'I', 'N', 'D', 'E', 'X', '\0'}};
+            fwrite(_index.data(), sizeof(SessionIndexEntry), _index.size(), _file);
+            fwrite(&trailer, sizeof(trailer), 1, _file);
+            fclose(_file);
+        }
+        
+        /// Start recording a device, and return its number in the session.
+        int add_device(const SessionDevice& descriptor, uint64_t timestamp) {
+            int device = _next_device.fetch_add(1, std::memory_order_relaxed);
+            SessionEntry entry;
+            entry.type = static_cast<uint8_t>(SessionRecordType::attach);
+            entry.continued = 0;
+            entry.size = 0;
+            entry.device = device;
+            entry.timestamp = timestamp;
+            entry.descriptor = descriptor;
+            this->push(&entry, 1);
+            return device;
+        }
+        
+        void remove_device(int device, uint64_t timestamp) {
+            SessionEntry entry;
+            entry.type = static_cast<uint8_t>(SessionRecordType::detach);
+            entry.continued = 0;
+            entry.size = 0;
+            entry.device = device;
+            entry.timestamp = timestamp;
+            this->push(&entry, 1);
+        }
+        
+        /// Record the frames of a gamepad as they are dispatched, and return
+        /// its number in the session.
+        int add_gamepad(Gamepad* gamepad, const char* name) {
+            int device = this->add_device(SessionDevice::of(gamepad, name), gamepad->now());
+            std::unique_ptr<FrameTap> tap(new FrameTap(gamepad, device, SessionWriter::tap_frame, this));
+            std::lock_guard<std::mutex> lock(_taps_mutex);
+            _taps.push_back(std::move(tap));
+            return device;
+        }
+        
+        /// Stop recording a gamepad; call it before the gamepad is deleted.
+        void remove_gamepad(Gamepad* gamepad) {
+            std::lock_guard<std::mutex> lock(_taps_mutex);
+            for (auto it = _taps.begin(); it != _taps.end(); ++ it)
+                if ((*it)->gamepad() == gamepad) {
+                    (*it)->unsubscribe();
+                    this->remove_device((*it)->device(), gamepad->now());
+                    _removed_taps.push_back(std::move(*it));
+                    _taps.erase(it);
+                    return;
+                }
+        }
+        
+        /// Record the decoded state of a report. Any thread may record;
+        /// return false if the record was dropped.
+        bool record_frame(int device, const Frame& frame, uint64_t timestamp) {
+            SessionEntry entry;
+            entry.type = static_cast<uint8_t>(SessionRecordType::frame);
+            entry.continued = 0;
+            entry.size = 0;
+            entry.device = device;
+            entry.timestamp = timestamp;
+            entry.frame.sequence = frame.sequence;
+            entry.frame.held = frame.held.bits();
+            entry.frame.nanoseconds_elapsed = frame.nanoseconds_elapsed;
+            memcpy(entry.frame.axes, frame.axes, sizeof(entry.frame.axes));
+            return this->push(&entry, 1);
+        }
+        
+        /// Record a report as the device gave it.
+        bool record_raw(int device, const void* bytes, size_t size, uint64_t timestamp) {
+            enum { kMaxEntries = 16 };
+            SessionEntry entries[kMaxEntries];
+            size_t count = (size + SessionEntry::kPayload - 1) / SessionEntry::kPayload;
+            if (!count)
+                count = 1;
+            if (count > kMaxEntries) {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            const uint8_t* p = static_cast<const uint8_t*>(bytes);
+            for (size_t i = 0; i < count; ++ i) {
+                size_t part = std::min<size_t>(size - i * SessionEntry::kPayload, SessionEntry::kPayload);
+                entries[i].type = static_cast<uint8_t>(SessionRecordType::raw);
+                entries[i].continued = i + 1 < count;
+                entries[i].size = static_cast<uint16_t>(part);
+                entries[i].device = device;
+                entries[i].timestamp = timestamp;
+                memcpy(entries[i].raw, p + i * SessionEntry::kPayload, part);
+            }
+            return this->push(entries, count);
+        }
+        
+        /// Records dropped so far, the ring being full.
+        uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+    };
+    
+    /// One record of a session, as a cursor decodes it. The raw bytes point
+    /// into the file's memory; the device state is the cursor's.
+    struct SessionRecord {
+        SessionRecordType type;
+        int device;
+        uint64_t timestamp;
+        unsigned nanoseconds_elapsed;           // of a frame.
+        const SessionDeviceState* state;        // after the record.
+        const uint8_t* raw;
+        size_t raw_size;
+    };
+    
+    /// Reads a session from memory, such as a mapped file, without copying
+    /// it.
+    class SessionReader {
+    private:
+        const uint8_t* _data;
+        size_t _size;
+        const SessionIndexEntry* _index;
+        size_t _block_count;
+        uint64_t _record_count;
+        uint64_t _dropped;
+        // the index walked from the block headers, if the file has none.
+        std::vector<SessionIndexEntry> _recovered;
+        
+        const SessionBlockHeader& header_of(size_t block) const {
+            return *reinterpret_cast<const SessionBlockHeader*>(_data + _index[block].offset);
+        }
+        
+        // Whether every block of an index lies whole before 'end', as the
+        // recovery below checks; a damaged index is not trusted.
+        bool valid_index(const SessionIndexEntry* index, uint64_t count, uint64_t end) const {
+            for (uint64_t i = 0; i < count; ++ i) {
+                uint64_t offset = index[i].offset;
+                if (offset < sizeof(SessionFileHeader) || offset > end || end - offset < sizeof(SessionBlockHeader))
+                    return false;
+                const SessionBlockHeader* block = reinterpret_cast<const SessionBlockHeader*>(_data + offset);
+                if (block->magic != SessionEncoding::kBlockMagic || block->payload_size > end - offset - sizeof(SessionBlockHeader))
+                    return false;
+            }
+            return true;
+        }
+        
+    public:
+        /// Throw SessionFormatException unless 'data' holds a session.
+        SessionReader(const void* data, size_t size)
+            : _data(static_cast<const uint8_t*>(data)), _size(size), _index(NULL), _block_count(0), _record_count(0), _dropped(0) {
+            const SessionFileHeader* header = reinterpret_cast<const SessionFileHeader*>(_data);
+            if (size < sizeof(SessionFileHeader) || memcmp(header->magic, "GPSESSN", 8) || header->version != SessionEncoding::kVersion)
+                throw SessionFormatException();
+            
+            if (size >= sizeof(SessionFileHeader) + sizeof(SessionTrailer)) {
+                const SessionTrailer* trailer = reinterpret_cast<const SessionTrailer*>(_data + size - sizeof(SessionTrailer));
+                if (!memcmp(trailer->magic, "GPINDEX", 8) && trailer->index_offset >= sizeof(SessionFileHeader)
+                 && trailer->index_offset <= size - sizeof(SessionTrailer)
+                 && trailer->block_count == (size - sizeof(SessionTrailer) - trailer->index_offset) / sizeof(SessionIndexEntry)
+                 && this->valid_index(reinterpret_cast<const SessionIndexEntry*>(_data + trailer->index_offset), trailer->block_count, trailer->index_offset)) {
+                    _index = reinterpret_cast<const SessionIndexEntry*>(_data + trailer->index_offset);
+                    _block_count = trailer->block_count;
+                    _record_count = trailer->record_count;
+                    _dropped = trailer->dropped;
+                    return;
+                }
+            }
+            
+            // the writer did not finish: keep the whole blocks.
+            uint64_t offset = sizeof(SessionFileHeader);
+            while (offset + sizeof(SessionBlockHeader) <= size) {
+                const SessionBlockHeader* block = reinterpret_cast<const SessionBlockHeader*>(_data + offset);
+                if (block->magic != SessionEncoding::kBlockMagic || block->payload_size > size - offset - sizeof(SessionBlockHeader))
+                    break;
+                SessionIndexEntry entry = {offset, block->first_timestamp, block->last_timestamp, _record_count};
+                _recovered.push_back(entry);
+                _record_count += block->record_count;
+                offset += sizeof(SessionBlockHeader) + block->payload_size;
+            }
+            _index = _recovered.data();
+            _block_count = _recovered.size();
+        }
+        
+        size_t block_count() const { return _block_count; }
+        const SessionIndexEntry& block(size_t index) const { return _index[index]; }
+        uint64_t record_count() const { return _record_count; }
+        uint64_t dropped() const { return _dropped; }
+        /// Whether the index was rebuilt, the writer having not closed the file.
+        bool recovered() const { return !_recovered.empty(); }
+        
+        /// The last block starting at or before 'timestamp', or the first.
+        size_t find_block(uint64_t timestamp) const {
+            size_t low = 0, high = _block_count;
+            while (high - low > 1) {
+                size_t middle = low + (high - low) / 2;
+                if (_index[middle].first_timestamp <= timestamp)
+                    low = middle;
+                else
+                    high = middle;
+            }
+            return low;
+        }
+        
+        class Cursor {
+        private:
+            const SessionReader* _reader;
+            size_t _block;
+            const uint8_t* _p;
+            const uint8_t* _end;
+            uint64_t _timestamp;
+            std::vector<SessionDeviceState> _devices;
+            bool _damaged;
+            
+            SessionDeviceState& device(uint64_t id) {
+                if (id >= _devices.size()) {
+                    SessionDeviceState unknown = {};
+                    _devices.resize(id + 1, unknown);
+                }
+                return _devices[id];
+            }
+            
+            bool decode_keyframe() {
+                using namespace SessionEncoding;
+                for (auto it = _devices.begin(); it != _devices.end(); ++ it)
+                    it->attached = false;
+                while (_p < _end) {
+                    SessionRecordType type = static_cast<SessionRecordType>(*_p ++);
+                    if (type == SessionRecordType::keyframe_end)
+                        return true;
+                    uint64_t id, sequence, value;
+                    if (type != SessionRecordType::attach || !get_varint(_p, _end, id) || id > 0xffffffffu)
+                        return false;
+                    SessionDeviceState& state = this->device(id);
+                    if (!get_descriptor(_p, _end, state.descriptor) || !get_varint(_p, _end, sequence))
+                        return false;
+                    state.attached = true;
+                    state.sequence = sequence;
+                    for (int i = 0; i < static_cast<int>(Axis::count); ++ i) {
+                        if (!get_varint(_p, _end, value))
+                            return false;
+                        state.axes[i] = static_cast<long>(unzigzag(value));
+                    }
+                    if (!get_varint(_p, _end, value))
+                        return false;
+                    state.held = ButtonSet(value);
+                }
+                return false;
+            }
+            
+            bool enter(size_t block) {
+                _block = block;
+                if (block >= _reader->_block_count)
+                    return false;
+                const SessionBlockHeader& header = _reader->header_of(block);
+                _p = reinterpret_cast<const uint8_t*>(&header + 1);
+                _end = _p + header.payload_size;
+                _timestamp = header.first_timestamp;
+                _damaged = !this->decode_keyframe();
+                return !_damaged;
+            }
+            
+        public:
+            Cursor(const SessionReader* reader, size_t block) : _reader(reader), _p(NULL), _end(NULL), _timestamp(0), _damaged(false) {
+                this->enter(block);
+            }
+            
+            /// Whether a record failed to decode; the cursor stops there.
+            bool damaged() const { return _damaged; }
+            
+            /// Decode the first record from 'timestamp' on.
+            bool next_from(uint64_t timestamp, SessionRecord& record) {
+                while (this->next(record))
+                    if (record.timestamp >= timestamp)
+                        return true;
+                return false;
+            }
+            
+            /// Decode the next record, or return false at the end.
+            bool next(SessionRecord& record) {
+                using namespace SessionEncoding;
+                while (_p == _end) {
+                    if (_damaged || !this->enter(_block + 1))
+                        return false;
+                }
+                if (_damaged)
+                    return false;
+                
+                uint64_t id, delta;
+                record.type = static_cast<SessionRecordType>(*_p ++);
+                if (!get_varint(_p, _end, id) || id > 0xffffffffu || !get_varint(_p, _end, delta)) {
+                    _damaged = true;
+                    return false;
+                }
+                _timestamp += unzigzag(delta);
+                SessionDeviceState& state = this->device(id);
+                record.device = static_cast<int>(id);
+                record.timestamp = _timestamp;
+                record.nanoseconds_elapsed = 0;
+                record.state = &state;
+                record.raw = NULL;
+                record.raw_size = 0;
+                
+                bool ok = true;
+                switch (record.type) {
+                    case SessionRecordType::frame: {
+                        uint64_t sequence, elapsed, changed, held;
+                        ok = get_varint(_p, _end, sequence) && get_varint(_p, _end, elapsed) && get_varint(_p, _end, changed);
+                        for (int i = 0; ok && i < static_cast<int>(Axis::count); ++ i) {
+                            uint64_t value;
+                            if (changed >> i & 1) {
+                                ok = get_varint(_p, _end, value);
+                                state.axes[i] += static_cast<long>(unzigzag(value));
+                            }
+                        }
+                        ok = ok && get_varint(_p, _end, held);
+                        if (ok) {
+                            state.sequence += sequence;
+                            state.held = ButtonSet(state.held.bits() ^ held);
+                            record.nanoseconds_elapsed = static_cast<unsigned>(elapsed);
+                        }
+                        break;
+                    }
+                    case SessionRecordType::raw: {
+                        uint64_t size;
+                        ok = get_varint(_p, _end, size) && size <= uint64_t(_end - _p);
+                        if (ok) {
+                            record.raw = _p;
+                            record.raw_size = static_cast<size_t>(size);
+                            _p += size;
+                        }
+                        break;
+                    }
+                    case SessionRecordType::attach: {
+                        SessionDeviceState attached = {};
+                        ok = get_descriptor(_p, _end, attached.descriptor);
+                        attached.attached = true;
+                        state = attached;
+                        break;
+                    }
+                    case SessionRecordType::detach:
+                        state.attached = false;
+                        break;
+                    default:
+                        ok = false;
+                        break;
+                }
+                _damaged = !ok;
+                return ok;
+            }
+        };
+        
+        /// A cursor at the first record.
+        Cursor begin() const { return Cursor(this, 0); }
+        
+        /// A cursor at the block holding 'timestamp', found by a binary
+        /// search of the index; Cursor::next_from() then scans to it.
+        Cursor seek(uint64_t timestamp) const {
+            size_t block = this->find_block(timestamp);
+            // a record may be stamped earlier than one of the block before.
+            while (block > 0 && _index[block - 1].last_timestamp >= timestamp)
+                -- block;
+            return Cursor(this, block);
+        }
+    };
+}
+
+#endif
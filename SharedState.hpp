@@ -0,0 +1,466 @@
+/*
+ 
+SharedState.hpp ... Publishes the state of gamepads to other processes through shared memory.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef SHAREDSTATE_HPP_f7e1nkk6i5czz7bj
+#define SHAREDSTATE_HPP_f7e1nkk6i5czz7bj 1
+
+#include "Gamepad.hpp"
+#include "Exception.hpp"
+#include "Timer.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <thread>
+
+namespace GP {
+    // The gamepads of one process, in memory which any number of other
+    // processes map read-only, but for the count of readers waiting. It
+    // holds, each part 64-byte aligned:
+    //
+    //   header   the layout, a counter bumped at each publication, which
+    //            readers poll or wait on, the count of the readers waiting,
+    //            and the number of events written.
+    //   slots    a SharedSlot per device: the descriptor and the latest
+    //            frame, under a seqlock.
+    //   events   a ring of SharedEventEntry: attaches, detaches, and axis
+    //            and button changes, each under a seqlock of its own. The
+    //            ring overwrites the oldest; a reader that falls further
+    //            behind loses them, and counts them.
+    //
+    // Everything shared is a lock-free std::atomic of 32 or 64 bits, as
+    // those work across processes. Readers never write, so no reader can
+    // stall the publisher or another reader.
+    
+    ENUM_CLASS SharedEventType {
+        attach,
+        detach,
+        axis,                   // index: the Axis; value: its new value.
+        button                  // index: the Button; value: 1 if pressed.
+    };
+    
+    /// An event of the ring, as read.
+    struct SharedEvent {
+        uint64_t timestamp;     // Timer::monotonic_nanoseconds() of the publisher.
+        uint64_t sequence;      // of the frame; 0 for attach and detach.
+        int slot;
+        SharedEventType type;
+        int index;
+        long value;
+    };
+    
+    /// A device, as read.
+    struct SharedDeviceState {
+        uint32_t generation;    // counts the attaches to the slot; 0 if none yet.
+        bool attached;
+        char name[32];
+        long bounds[static_cast<int>(Axis::count)];   // as Gamepad::axis_bound().
+        uint64_t timestamp;     // of the latest frame, as SharedEvent.
+        uint64_t sequence;
+        long axes[static_cast<int>(Axis::count)];
+        ButtonSet held;
+    };
+    
+    namespace SharedStateLayout {
+        enum {
+            kVersion = 1,
+            kAlignment = 64,
+            kAxes = static_cast<int>(Axis::count),
+            kNameWords = 4,
+            // A torn read is retried with a pause kSpins times, then
+            // yielding, for up to kReadTimeoutMilliseconds.
+            kSpins = 100,
+            kReadTimeoutMilliseconds = 50
+        };
+        
+        inline size_t aligned(size_t offset) {
+            return (offset + kAlignment - 1) & ~static_cast<size_t>(kAlignment - 1);
+        }
+    }
+    
+    struct SharedStateHeader {
+        char magic[8];          // "GPSTATE", written last.
+        uint32_t version;
+        uint32_t slot_count;
+        uint32_t slot_size;
+        uint32_t event_capacity;        // a power of two.
+        uint64_t size;          // of the whole segment.
+        uint64_t slots_offset;
+        uint64_t events_offset;
+        uint8_t reserved[16];
+        // the second cache line, written at each publication.
+        std::atomic<uint32_t> changes;  // a futex word on Linux.
+        std::atomic<uint32_t> waiters;  // readers asleep on changes.
+        std::atomic<uint64_t> events_written;
+    };
+    
+    struct SharedSlot {
+        std::atomic<uint32_t> sequence; // odd while written.
+        std::atomic<uint32_t> generation;
+        std::atomic<uint32_t> attached;
+        std::atomic<uint32_t> reserved;
+        std::atomic<uint64_t> timestamp;
+        std::atomic<uint64_t> frame;
+        std::atomic<uint64_t> held;
+        std::atomic<int32_t> axes[SharedStateLayout::kAxes];
+        std::atomic<int32_t> bounds[SharedStateLayout::kAxes];
+        std::atomic<uint64_t> name[SharedStateLayout::kNameWords];
+    };
+    
+    struct SharedEventEntry {
+        std::atomic<uint64_t> stamp;    // 2 * index + 1 while written, then + 2.
+        std::atomic<uint64_t> timestamp;
+        std::atomic<uint64_t> sequence;
+        std::atomic<uint64_t> what;     // slot << 48 | type << 32 | index.
+        std::atomic<uint64_t> value;
+    };
+    
+    /// Writes the shared state. Every method, and the gamepads it publishes,
+    /// must run on one thread of one process.
+    class SharedStatePublisher {
+    private:
+        uint8_t* _memory;
+        SharedStateHeader* _header;
+        uint64_t _written;
+        std::vector<std::unique_ptr<FrameTap> > _taps;
+        
+        SharedStatePublisher(const SharedStatePublisher&);
+        SharedStatePublisher& operator=(const SharedStatePublisher&);
+        
+        static void tap_frame(void* self, int slot, Gamepad*, const Frame& frame) {
+            static_cast<SharedStatePublisher*>(self)->publish_frame(slot, frame, Timer::monotonic_nanoseconds());
+        }
+        
+        SharedSlot& slot_at(int slot) {
+            return *reinterpret_cast<SharedSlot*>(_memory + _header->slots_offset + size_t(slot) * _header->slot_size);
+        }
+        
+        void push_event(uint64_t timestamp, uint64_t sequence, int slot, SharedEventType type, int index, long value) {
+            SharedEventEntry* entries = reinterpret_cast<SharedEventEntry*>(_memory + _header->events_offset);
+            SharedEventEntry& entry = entries[_written & (_header->event_capacity - 1)];
+            entry.stamp.store(2 * _written + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            entry.timestamp.store(timestamp, std::memory_order_relaxed);
+            entry.sequence.store(sequence, std::memory_order_relaxed);
+            entry.what.store(static_cast<uint64_t>(slot) << 48 | static_cast<uint64_t>(type) << 32 | static_cast<uint32_t>(index), std::memory_order_relaxed);
+            entry.value.store(static_cast<uint64_t>(value), std::memory_order_relaxed);
+            entry.stamp.store(2 * _written + 2, std::memory_order_release);
+            ++ _written;
+        }
+        
+        // Make what was written visible, and wake the readers if any wait.
+        // A reader counts itself in waiters before it checks changes, so
+        // either it sees the new changes or this sees it waiting.
+        void publish() {
+            _header->events_written.store(_written, std::memory_order_release);
+            _header->changes.fetch_add(1, std::memory_order_seq_cst);
+            if (_header->waiters.load(std::memory_order_seq_cst))
+                this->notify();
+        }
+        
+    protected:
+        /// Wake the readers waiting for header.changes to change. Only
+        /// called while header.waiters is not 0.
+        virtual void notify() = 0;
+        
+        // 'memory' is zeroed, of size_for() bytes.
+        SharedStatePublisher(void* memory, int slot_count, int event_capacity)
+            : _memory(static_cast<uint8_t*>(memory)), _header(static_cast<SharedStateHeader*>(memory)),
+              _written(0) {
+            using namespace SharedStateLayout;
+            _header->version = kVersion;
+            _header->slot_count = slot_count;
+            _header->slot_size = static_cast<uint32_t>(aligned(sizeof(SharedSlot)));
+            _header->event_capacity = event_capacity;
+            _header->size = size_for(slot_count, event_capacity);
+            _header->slots_offset = aligned(sizeof(SharedStateHeader));
+            _header->events_offset = _header->slots_offset + size_t(slot_count) * _header->slot_size;
+            std::atomic_thread_fence(std::memory_order_release);
+            memcpy(_header->magic, "GPSTATE", 8);
+        }
+        
+        // Stop publishing every gamepad; a subclass which unmaps the memory
+        // calls it first.
+        void remove_gamepads() {
+            while (!_taps.empty())
+                this->remove_gamepad(_taps.back()->gamepad());
+        }
+        
+    public:
+        /// The bytes of a shared state; 'event_capacity' is a power of two.
+        static size_t size_for(int slot_count, int event_capacity) {
+            using namespace SharedStateLayout;
+            return aligned(sizeof(SharedStateHeader)) + size_t(slot_count) * aligned(sizeof(SharedSlot))
+                 + aligned(size_t(event_capacity) * sizeof(SharedEventEntry));
+        }
+        
+        virtual ~SharedStatePublisher() {
+            this->remove_gamepads();
+        }
+        
+        /// Take a free slot for a device, and return it, or -1 if all are
+        /// taken. 'bounds' is indexed by Axis.
+        int add_device(const char* name, const long bounds[]) {
+            int index = 0;
+            while (index < static_cast<int>(_header->slot_count) && slot_at(index).attached.load(std::memory_order_relaxed))
+                ++ index;
+            if (index == static_cast<int>(_header->slot_count))
+                return -1;
+            
+            SharedSlot& slot = slot_at(index);
+            uint64_t words[SharedStateLayout::kNameWords] = {};
+            strncpy(reinterpret_cast<char*>(words), name, sizeof(words) - 1);
+            uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+            slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.generation.store(slot.generation.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            slot.attached.store(1, std::memory_order_relaxed);
+            slot.timestamp.store(0, std::memory_order_relaxed);
+            slot.frame.store(0, std::memory_order_relaxed);
+            slot.held.store(0, std::memory_order_relaxed);
+            for (int i = 0; i < SharedStateLayout::kAxes; ++ i) {
+                slot.axes[i].store(0, std::memory_order_relaxed);
+                slot.bounds[i].store(static_cast<int32_t>(bounds[i]), std::memory_order_relaxed);
+            }
+            for (int i = 0; i < SharedStateLayout::kNameWords; ++ i)
+                slot.name[i].store(words[i], std::memory_order_relaxed);
+            slot.sequence.store(sequence + 2, std::memory_order_release);
+            
+            this->push_event(Timer::monotonic_nanoseconds(), 0, index, SharedEventType::attach, 0, 0);
+            this->publish();
+            return index;
+        }
+        
+        /// Free the slot of a device; readers see it detached.
+        void remove_device(int index) {
+            SharedSlot& slot = slot_at(index);
+            uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+            slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.attached.store(0, std::memory_order_relaxed);
+            slot.sequence.store(sequence + 2, std::memory_order_release);
+            this->push_event(Timer::monotonic_nanoseconds(), 0, index, SharedEventType::detach, 0, 0);
+            this->publish();
+        }
+        
+        /// Write the frame of a device to its slot, and its changes to the
+        /// ring, and wake the readers.
+        void publish_frame(int index, const Frame& frame, uint64_t timestamp) {
+            for (unsigned changed = frame.changed_axes; changed; changed &= changed - 1) {
+                int axis = count_trailing_zeros(changed);
+                this->push_event(timestamp, frame.sequence, index, SharedEventType::axis, axis, frame.axes[axis]);
+            }
+            frame.for_each_button_change([&](Button button, bool is_pressed) {
+                this->push_event(timestamp, frame.sequence, index, SharedEventType::button, static_cast<int>(button), is_pressed);
+            });
+            
+            SharedSlot& slot = slot_at(index);
+            uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+            slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.timestamp.store(timestamp, std::memory_order_relaxed);
+            slot.frame.store(frame.sequence, std::memory_order_relaxed);
+            slot.held.store(frame.held.bits(), std::memory_order_relaxed);
+            for (int i = 0; i < SharedStateLayout::kAxes; ++ i)
+                slot.axes[i].store(static_cast<int32_t>(frame.axes[i]), std::memory_order_relaxed);
+            slot.sequence.store(sequence + 2, std::memory_order_release);
+            this->publish();
+        }
+        
+        /// Publish every frame of a gamepad, and return its slot, or -1 if
+        /// all are taken.
+        int add_gamepad(Gamepad* gamepad, const char* name) {
+            long bounds[SharedStateLayout::kAxes];
+            for (int i = 0; i < SharedStateLayout::kAxes; ++ i)
+                bounds[i] = gamepad->axis_bound(static_cast<Axis>(i));
+            int slot = this->add_device(name, bounds);
+            if (slot < 0)
+                return -1;
+            _taps.push_back(std::unique_ptr<FrameTap>(new FrameTap(gamepad, slot, SharedStatePublisher::tap_frame, this)));
+            return slot;
+        }
+        
+        /// Stop publishing a gamepad; call it before the gamepad is deleted.
+        void remove_gamepad(Gamepad* gamepad) {
+            for (auto it = _taps.begin(); it != _taps.end(); ++ it)
+                if ((*it)->gamepad() == gamepad) {
+                    (*it)->unsubscribe();
+                    this->remove_device((*it)->device());
+                    _taps.erase(it);
+                    return;
+                }
+        }
+        
+        uint64_t events_written() const {
+            return _written;
+        }
+    };
+    
+    /// Reads a shared state mapped read-only. A reader keeps its own place
+    /// in the ring, so give each reading thread one.
+    class SharedStateReader {
+    private:
+        const uint8_t* _memory;
+        const SharedStateHeader* _header;
+        uint64_t _cursor;
+        uint64_t _lost;
+        
+        const SharedSlot& slot_at(int slot) const {
+            return *reinterpret_cast<const SharedSlot*>(_memory + _header->slots_offset + size_t(slot) * _header->slot_size);
+        }
+        
+    protected:
+        const SharedStateHeader* header() const {
+            return _header;
+        }
+        
+    public:
+        /// Throw SharedStateFormatException unless 'memory' holds a
+        /// shared state. Events start from those written now.
+        SharedStateReader(const void* memory, size_t size)
+            : _memory(static_cast<const uint8_t*>(memory)), _header(static_cast<const SharedStateHeader*>(memory)), _lost(0) {
+            using namespace SharedStateLayout;
+            if (size < sizeof(SharedStateHeader) || memcmp(_header->magic, "GPSTATE", 8) != 0)
+                throw SharedStateFormatException();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint32_t capacity = _header->event_capacity;
+            if (_header->version != kVersion || _header->size > size || !capacity || (capacity & (capacity - 1))
+             || _header->slot_size < sizeof(SharedSlot) || _header->slots_offset < sizeof(SharedStateHeader)
+             || _header->events_offset < _header->slots_offset + uint64_t(_header->slot_count) * _header->slot_size
+             || _header->events_offset + uint64_t(capacity) * sizeof(SharedEventEntry) > _header->size)
+                throw SharedStateFormatException();
+            _cursor = _header->events_written.load(std::memory_order_acquire);
+        }
+        
+        virtual ~SharedStateReader() {}
+        
+        int slot_count() const {
+            return static_cast<int>(_header->slot_count);
+        }
+        
+        /// Bumped at each publication: poll it, or wait for it to change.
+        uint32_t changes() const {
+            return _header->changes.load(std::memory_order_acquire);
+        }
+        
+        /// Copy a slot. Return false if no consistent copy could be made
+        /// for kReadTimeoutMilliseconds, as when the publisher was descheduled
+        /// that long, or died, in the middle of writing it.
+        bool read_device(int index, SharedDeviceState& state) const {
+            const SharedSlot& slot = slot_at(index);
+            uint64_t deadline = 0;
+            for (int attempt = 0; ; ++ attempt) {
+                if (attempt) {
+                    if (attempt <= SharedStateLayout::kSpins) {
+                        spin_pause();
+                    } else {
+                        uint64_t now = Timer::monotonic_nanoseconds();
+                        if (!deadline)
+                            deadline = now + uint64_t(SharedStateLayout::kReadTimeoutMilliseconds) * 1000000;
+                        else if (now >= deadline)
+                            return false;
+                        std::this_thread::yield();
+                    }
+                }
+                uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+                if (sequence & 1)
+                    continue;
+                state.generation = slot.generation.load(std::memory_order_relaxed);
+                state.attached = slot.attached.load(std::memory_order_relaxed) != 0;
+                state.timestamp = slot.timestamp.load(std::memory_order_relaxed);
+                state.sequence = slot.frame.load(std::memory_order_relaxed);
+                state.held = ButtonSet(slot.held.load(std::memory_order_relaxed));
+                for (int i = 0; i < SharedStateLayout::kAxes; ++ i) {
+                    state.axes[i] = slot.axes[i].load(std::memory_order_relaxed);
+                    state.bounds[i] = slot.bounds[i].load(std::memory_order_relaxed);
+                }
+                uint64_t words[SharedStateLayout::kNameWords];
+                for (int i = 0; i < SharedStateLayout::kNameWords; ++ i)
+                    words[i] = slot.name[i].load(std::memory_order_relaxed);
+                memcpy(state.name, words, sizeof(state.name));
+                state.name[sizeof(state.name) - 1] = 0;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.sequence.load(std::memory_order_relaxed) == sequence)
+                    return true;
+            }
+        }
+        
+        /// Copy up to 'capacity' events, oldest first, and return their
+        /// number. Events overwritten before they could be read are lost.
+        size_t read_events(SharedEvent* events, size_t capacity) {
+            const SharedEventEntry* entries = reinterpret_cast<const SharedEventEntry*>(_memory + _header->events_offset);
+            uint64_t mask = _header->event_capacity - 1;
+            uint64_t end = _header->events_written.load(std::memory_order_acquire);
+            size_t count = 0;
+            while (_cursor < end && count < capacity) {
+                if (end - _cursor > mask + 1) {
+                    _lost += end - _cursor - (mask + 1);
+                    _cursor = end - (mask + 1);
+                }
+                const SharedEventEntry& entry = entries[_cursor & mask];
+                uint64_t stamp = entry.stamp.load(std::memory_order_acquire);
+                SharedEvent& event = events[count];
+                event.timestamp = entry.timestamp.load(std::memory_order_relaxed);
+                event.sequence = entry.sequence.load(std::memory_order_relaxed);
+                uint64_t what = entry.what.load(std::memory_order_relaxed);
+                event.value = static_cast<long>(static_cast<int64_t>(entry.value.load(std::memory_order_relaxed)));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (stamp != 2 * _cursor + 2 || entry.stamp.load(std::memory_order_relaxed) != stamp) {
+                    // overwritten as we read: the publisher lapped us.
+                    end = _header->events_written.load(std::memory_order_acquire);
+                    ++ _lost;
+                    ++ _cursor;
+                    continue;
+                }
+                event.slot = static_cast<int>(what >> 48);
+                event.type = static_cast<SharedEventType>(what >> 32 & 0xff);
+                event.index = static_cast<int>(static_cast<uint32_t>(what));
+                ++ count;
+                ++ _cursor;
+            }
+            return count;
+        }
+        
+        /// Skip the events not read yet.
+        void skip_events() {
+            _cursor = _header->events_written.load(std::memory_order_acquire);
+        }
+        
+        /// The events lost by falling behind the ring.
+        uint64_t lost() const {
+            return _lost;
+        }
+    };
+}
+
+#endif
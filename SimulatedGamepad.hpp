@@ -0,0 +1,269 @@
+/*
+ 
+SimulatedGamepad.hpp ... A gamepad simulated from keyboard and pointer input.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef SIMULATED_GAMEPAD_HPP_ji21osknx3m7bli8
+#define SIMULATED_GAMEPAD_HPP_ji21osknx3m7bli8 1
+
+#include "Gamepad.hpp"
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+namespace GP {
+    /// The relative axes of a pointer device.
+    ENUM_CLASS PointerAxis {
+        horizontal,
+        vertical,
+        wheel,
+        pointer_axis_count
+    };
+    
+    /// A gamepad made up from keys and pointer motion, as a QA rig without
+    /// pads, or a player without one, would drive it. The backends feed it
+    /// the input of their platform, with key codes of that platform and
+    /// timestamps in nanoseconds on any clock which only goes forward, and
+    /// end every report of the input device with end_report().
+    ///
+    /// Pointer motion becomes a velocity: an axis is deflected by the counts
+    /// per second the pointer moves, so the same gesture gives the same
+    /// values at any report rate. Time is only read from the timestamps, so
+    /// a recorded stream replays to the same frames at any speed. Neither
+    /// is a timer needed to notice the pointer stopping: a report which
+    /// comes 'stop_after' after the last motion, or advance_to(), first
+    /// makes up the report centering the pointer axes at that time.
+    class SimulatedGamepad : public Gamepad {
+    private:
+        enum {
+            kAxes = static_cast<int>(Axis::count),
+            kPointerAxes = static_cast<int>(PointerAxis::pointer_axis_count)
+        };
+        
+        struct Binding {
+            Button button;          // or 0.
+            Axis axis;              // or Axis::invalid.
+            int direction;          // -1 or 1, toward which 'axis' goes.
+        };
+        struct PointerBinding {
+            Axis axis;
+            double counts_per_second;   // for full deflection; < 0 inverts.
+        };
+        
+        std::vector<Binding> _bindings;     // indexed by key code.
+        std::vector<bool> _held;
+        PointerBinding _pointer_bindings[kPointerAxes];
+        long _ranges[kAxes];
+        unsigned _bound_axes;
+        
+        // Per axis: the sum of the directions of the held keys, and the
+        // deflection of the last pointer motion.
+        int _key_deflection[kAxes];
+        double _pointer_deflection[kAxes];
+        // The counts moved since the last report.
+        long _motion[kPointerAxes];
+        bool _moved;
+        
+        uint64_t _stop_after;
+        uint64_t _previous_report;
+        uint64_t _last_motion;          // time of the last report with motion.
+        uint64_t _motion_interval;      // between the last two of them.
+        bool _pointer_moving;
+        bool _reported;
+        
+        void bind_axis(Axis axis) {
+            int index = static_cast<int>(axis);
+            if (!(_bound_axes >> index & 1)) {
+                _bound_axes |= 1u << index;
+                this->set_bounds_for_axis(axis, -_ranges[index], _ranges[index]);
+            }
+        }
+        
+        Binding& binding(int key) {
+            if (key >= static_cast<int>(_bindings.size())) {
+                Binding unbound = {static_cast<Button>(0), Axis::invalid, 0};
+                _bindings.resize(key + 1, unbound);
+                _held.resize(key + 1, false);
+            }
+            return _bindings[key];
+        }
+        
+        void dispatch(uint64_t timestamp) {
+            for (int i = 0; i < kAxes; ++ i) {
+                if (!(_bound_axes >> i & 1))
+                    continue;
+                double value = _key_deflection[i] * _ranges[i] + _pointer_deflection[i];
+                long rounded = long(value < 0 ? value - 0.5 : value + 0.5);
+                this->set_axis_value(static_cast<Axis>(i), std::max(-_ranges[i], std::min(_ranges[i], rounded)));
+            }
+            
+            // at most ~4.29 s fits in the elapsed time.
+            uint64_t elapsed = _reported && timestamp > _previous_report ? timestamp - _previous_report : 0;
+            unsigned nanoseconds_elapsed = static_cast<unsigned>(std::min<uint64_t>(elapsed, ~0u));
+            _previous_report = std::max(_previous_report, timestamp);
+            _reported = true;
+            this->handle_axes_change(nanoseconds_elapsed);
+            this->handle_frame(nanoseconds_elapsed);
+        }
+        
+    public:
+        /// Every axis ranges over -127 to 127 unless set otherwise.
+        SimulatedGamepad() : _bound_axes(0), _moved(false), _stop_after(50000000), _previous_report(0),
+                             _last_motion(0), _motion_interval(8000000), _pointer_moving(false), _reported(false) {
+            for (int i = 0; i < kPointerAxes; ++ i) {
+                _pointer_bindings[i].axis = Axis::invalid;
+                _pointer_bindings[i].counts_per_second = 0;
+                _motion[i] = 0;
+            }
+            for (int i = 0; i < kAxes; ++ i) {
+                _ranges[i] = 127;
+                _key_deflection[i] = 0;
+                _pointer_deflection[i] = 0;
+            }
+        }
+        
+        /// Deflect 'axis' from -'range' to 'range'.
+        void set_axis_range(Axis axis, long range) {
+            if (valid(axis) && range > 0) {
+                _ranges[static_cast<int>(axis)] = range;
+                if (_bound_axes >> static_cast<int>(axis) & 1)
+                    this->set_bounds_for_axis(axis, -range, range);
+            }
+        }
+        
+        /// Press 'button' while 'key' is down.
+        void map_key_to_button(int key, Button button) {
+            if (key < 0)
+                return;
+            Binding& binding = this->binding(key);
+            binding.button = button;
+            binding.axis = Axis::invalid;
+        }
+        
+        /// Deflect 'axis' fully toward 'direction', -1 or 1, while 'key' is
+        /// down. Opposite keys held together cancel out.
+        void map_key_to_axis(int key, Axis axis, int direction) {
+            if (key < 0 || !valid(axis))
+                return;
+            Binding& binding = this->binding(key);
+            binding.button = static_cast<Button>(0);
+            binding.axis = axis;
+            binding.direction = direction < 0 ? -1 : 1;
+            this->bind_axis(axis);
+        }
+        
+        /// Deflect 'axis' fully when the pointer moves 'counts_per_second'
+        /// along 'pointer_axis'; a negative speed inverts the axis.
+        void map_pointer_to_axis(PointerAxis pointer_axis, Axis axis, double counts_per_second) {
+            if (static_cast<int>(pointer_axis) >= kPointerAxes || !valid(axis) || !counts_per_second)
+                return;
+            _pointer_bindings[static_cast<int>(pointer_axis)].axis = axis;
+            _pointer_bindings[static_cast<int>(pointer_axis)].counts_per_second = counts_per_second;
+            this->bind_axis(axis);
+        }
+        
+        /// Center the pointer axes once the pointer has not moved for
+        /// 'nanoseconds', 50 ms by default.
+        void set_stop_after(uint64_t nanoseconds) { _stop_after = nanoseconds; }
+        
+        void handle_key(int key, bool is_pressed, uint64_t timestamp) {
+            this->advance_to(timestamp);
+            if (key < 0 || key >= static_cast<int>(_bindings.size()) || _held[key] == is_pressed)
+                return;
+            _held[key] = is_pressed;
+            const Binding& binding = _bindings[key];
+            if (binding.axis != Axis::invalid)
+                _key_deflection[static_cast<int>(binding.axis)] += is_pressed ? binding.direction : -binding.direction;
+            else if (static_cast<int>(binding.button))
+                this->handle_button_change(binding.button, is_pressed);
+        }
+        
+        void handle_motion(PointerAxis pointer_axis, long counts, uint64_t timestamp) {
+            this->advance_to(timestamp);
+            if (static_cast<int>(pointer_axis) < kPointerAxes && counts) {
+                _motion[static_cast<int>(pointer_axis)] += counts;
+                _moved = true;
+            }
+        }
+        
+        /// Dispatch the keys and motion handled since the last report.
+        void end_report(uint64_t timestamp) {
+            this->advance_to(timestamp);
+            if (_moved) {
+                // after a stop, the time since the last motion says nothing
+                // of the speed; the previous interval is the best guess.
+                if (_pointer_moving && timestamp > _last_motion)
+                    _motion_interval = timestamp - _last_motion;
+                double seconds = _motion_interval / 1e9;
+                
+                for (int i = 0; i < kAxes; ++ i)
+                    _pointer_deflection[i] = 0;
+                for (int i = 0; i < kPointerAxes; ++ i) {
+                    const PointerBinding& binding = _pointer_bindings[i];
+                    if (binding.axis != Axis::invalid) {
+                        int axis = static_cast<int>(binding.axis);
+                        _pointer_deflection[axis] += _motion[i] / seconds / binding.counts_per_second * _ranges[axis];
+                    }
+                    _motion[i] = 0;
+                }
+                _moved = false;
+                _pointer_moving = true;
+                _last_motion = timestamp;
+            }
+            this->dispatch(timestamp);
+        }
+        
+        /// Whether the pointer axes are deflected, so that advance_to() is
+        /// yet to center them.
+        bool pointer_moving() const { return _pointer_moving; }
+        
+        /// Tell the time, so that a pointer which stopped without another
+        /// report following is centered. A host with a frame loop calls it
+        /// once a frame.
+        void advance_to(uint64_t now) {
+            if (!_pointer_moving || now < _last_motion + _stop_after)
+                return;
+            _pointer_moving = false;
+            for (int i = 0; i < kAxes; ++ i)
+                _pointer_deflection[i] = 0;
+            
+            // the motion of the report in progress is yet to come.
+            long motion[kPointerAxes];
+            std::copy(_motion, _motion + kPointerAxes, motion);
+            bool moved = _moved;
+            std::fill(_motion, _motion + kPointerAxes, 0);
+            _moved = false;
+            this->dispatch(_last_motion + _stop_after);
+            std::copy(motion, motion + kPointerAxes, _motion);
+            _moved = moved;
+        }
+    };
+}
+
+#endif
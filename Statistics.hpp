@@ -0,0 +1,192 @@
+/*
+ 
+Statistics.hpp ... Counters of what the library does.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef STATISTICS_HPP_cp9xuy4rvdew6mda
+#define STATISTICS_HPP_cp9xuy4rvdew6mda 1
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+// The counters, grouped by the thread which writes them: the thread reading
+// the device, and the thread decoding and dispatching its reports. On Linux
+// and Darwin the two are the same thread.
+#define GP_READER_STATISTICS(X) \
+    X(reports_read)         /* reports read from the device. */ \
+    X(bytes_read) \
+    X(short_reads)          /* reads shorter than a report, which are dropped. */ \
+    X(dropped_reports)      /* times reports were lost before being read. */ \
+    X(queue_high_water)     /* most reports read but not dispatched at once. */
+#define GP_DISPATCH_STATISTICS(X) \
+    X(decode_errors) \
+    X(conflated_events)     /* axis values overwritten within one report. */ \
+    X(reports_dispatched) \
+    X(axis_changed_calls) \
+    X(axis_state_changed_calls) \
+    X(axis_group_changed_calls) \
+    X(axis_group_state_changed_calls) \
+    X(button_changed_calls) \
+    X(frame_calls) \
+    X(listener_calls)       /* reports dispatched to a listen()ed listener. */
+
+namespace GP {
+    /// A snapshot of the counters of one gamepad, or the sum over gamepads.
+    struct Statistics {
+#define GP_DECLARE_FIELD(name) uint64_t name;
+        GP_READER_STATISTICS(GP_DECLARE_FIELD)
+        GP_DISPATCH_STATISTICS(GP_DECLARE_FIELD)
+#undef GP_DECLARE_FIELD
+        
+        Statistics() {
+#define GP_CLEAR_FIELD(name) name = 0;
+            GP_READER_STATISTICS(GP_CLEAR_FIELD)
+            GP_DISPATCH_STATISTICS(GP_CLEAR_FIELD)
+#undef GP_CLEAR_FIELD
+        }
+        
+        Statistics& operator+=(const Statistics& other) {
+            // a high-water mark does not add up.
+            uint64_t high_water = std::max(queue_high_water, other.queue_high_water);
+#define GP_ADD_FIELD(name) name += other.name;
+            GP_READER_STATISTICS(GP_ADD_FIELD)
+            GP_DISPATCH_STATISTICS(GP_ADD_FIELD)
+#undef GP_ADD_FIELD
+            queue_high_water = high_water;
+            return *this;
+        }
+    };
+    
+    /// A counter written by a single thread, and read by any. Without a
+    /// second writer it needs no atomic read-modify-write, so counting costs
+    /// as much as a plain increment.
+    class Counter {
+    private:
+        std::atomic<uint64_t> _value;
+        
+    public:
+        Counter() : _value(0) {}
+        
+        void add(uint64_t amount = 1) {
+            _value.store(_value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        }
+        void raise_to(uint64_t value) {
+            if (value > _value.load(std::memory_order_relaxed))
+                _value.store(value, std::memory_order_relaxed);
+        }
+        uint64_t get() const {
+            return _value.load(std::memory_order_relaxed);
+        }
+        // An add() racing with the reset may survive it.
+        void reset() {
+            _value.store(0, std::memory_order_relaxed);
+        }
+    };
+    
+    /// The live counters of a gamepad. Each group sits on cache lines of its
+    /// own, so that the reading and the dispatching threads never contend.
+    class StatisticsCounters {
+    public:
+        struct Reader {
+#define GP_DECLARE_COUNTER(name) Counter name;
+            GP_READER_STATISTICS(GP_DECLARE_COUNTER)
+        };
+        struct Dispatch {
+            GP_DISPATCH_STATISTICS(GP_DECLARE_COUNTER)
+#undef GP_DECLARE_COUNTER
+        };
+        
+    private:
+        enum { kCacheLine = 64 };
+        char _padding_before[kCacheLine];
+        
+    public:
+        Reader reader;
+        
+    private:
+        char _padding_between[kCacheLine];
+        
+    public:
+        Dispatch dispatch;
+        
+    private:
+        char _padding_after[kCacheLine];
+        
+    public:
+        Statistics snapshot() const {
+            Statistics statistics;
+#define GP_READ_READER(name) statistics.name = reader.name.get();
+#define GP_READ_DISPATCH(name) statistics.name = dispatch.name.get();
+            GP_READER_STATISTICS(GP_READ_READER)
+            GP_DISPATCH_STATISTICS(GP_READ_DISPATCH)
+#undef GP_READ_READER
+#undef GP_READ_DISPATCH
+            return statistics;
+        }
+    };
+    
+    /// Every live StatisticsCounters, and the sum of those already deleted,
+    /// for the process-wide totals.
+    class StatisticsRegistry {
+    private:
+        std::mutex _mutex;
+        std::vector<const StatisticsCounters*> _live;
+        Statistics _retired;
+        
+    public:
+        static StatisticsRegistry& instance() {
+            static StatisticsRegistry registry;
+            return registry;
+        }
+        
+        void add(const StatisticsCounters* counters) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _live.push_back(counters);
+        }
+        
+        void remove(const StatisticsCounters* counters) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _live.erase(std::remove(_live.begin(), _live.end(), counters), _live.end());
+            _retired += counters->snapshot();
+        }
+        
+        Statistics total() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            Statistics total = _retired;
+            for (auto it = _live.begin(); it != _live.end(); ++ it)
+                total += (*it)->snapshot();
+            return total;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,783 @@
+/*
+ 
+Stream.hpp ... Streaming of gamepad events to other processes, over datagrams.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef STREAM_HPP_thyefkshizspfjsw
+#define STREAM_HPP_thyefkshizspfjsw 1
+
+#include "Gamepad.hpp"
+#include "GamepadChangedObserver.hpp"
+#include "Session.hpp"
+#include "Replay.hpp"
+#include "Timer.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <memory>
+#include <vector>
+
+namespace GP {
+    // A stream of the gamepads of one process to others, a datagram at a
+    // time, each starting with a StreamDatagram byte:
+    //
+    //   events   publisher to subscriber: varint number, then messages
+    //   hello    subscriber to publisher: varint version
+    //   ack      subscriber to publisher: varint flags, varint count, and
+    //            that many varint numbers of events datagrams received
+    //   bye      subscriber to publisher: nothing
+    //
+    // A message is a SessionRecordType byte and a varint device, then:
+    //
+    //   attach   the descriptor, as in sessions.
+    //   detach   nothing.
+    //   frame    varint sequence, varint base sequence, zigzag varint time
+    //            since the base, varint mask of the axes differing from the
+    //            base, a zigzag varint difference each, varint held buttons
+    //            xor those of the base, varint taps.
+    //
+    // A frame is the difference from the last frame of its device the
+    // subscriber acknowledged, its base, or from all zero for base 0. So a
+    // lost datagram costs nothing but its frames, and the next frame still
+    // decodes. Taps are the buttons which changed and changed back since
+    // the frame sent before, so that no press is lost to conflation.
+    //
+    // A subscriber has at most a window of datagrams unacknowledged. While
+    // it is full, or its socket is, frames of a device replace each other
+    // and go when there is room: a slow subscriber gets the latest state,
+    // later, and never holds back the publisher or the others.
+    
+    ENUM_CLASS StreamDatagram {
+        events = 1,
+        hello,
+        ack,
+        bye
+    };
+    
+    namespace StreamEncoding {
+        enum {
+            kVersion = 1,
+            kMaxWindow = 64,
+            kHistory = 128,         // frames of a device a subscriber keeps.
+            kMaxDevices = 64,       // numbered at once; a subscriber refuses others.
+            kMaxAcks = 128,
+            kResync = 1             // ack flag: a base was missing.
+        };
+    }
+    
+    /// A frame of a device, as a stream sends it.
+    struct StreamState {
+        uint64_t sequence;      // 0 for no frame: all zero.
+        uint64_t timestamp;     // Timer::monotonic_nanoseconds() of the publisher.
+        long axes[static_cast<int>(Axis::count)];
+        uint64_t held;
+    };
+    
+    struct StreamStatistics {
+        uint64_t datagrams;
+        uint64_t bytes;
+        uint64_t frames;        // sent.
+        uint64_t conflated;     // replaced by a later frame before being sent.
+        uint64_t blocked;       // sends refused, the subscriber's socket full.
+        uint64_t lost;          // datagrams never acknowledged.
+    };
+    
+    /// Publishes gamepads to subscribers, over a transport given by the
+    /// derived class. Every method runs on one thread, as the event loop of
+    /// the transport and of the gamepads.
+    class StreamPublisher {
+    private:
+        struct Device {
+            bool attached;
+            SessionDevice descriptor;
+            StreamState latest;
+        };
+        
+        // A device as one subscriber knows it.
+        struct Peer {
+            bool known;             // its attach was acknowledged.
+            bool attach_in_flight;
+            bool detaching;         // its detach is not acknowledged.
+            bool detach_in_flight;
+            bool dirty;             // a frame is newer than the one sent.
+            uint64_t edges;         // buttons changed since the frame sent.
+            uint64_t sent_held;
+            StreamState base;
+        };
+        
+        struct Item {
+            int device;
+            SessionRecordType type;
+            StreamState state;
+        };
+        
+        struct InFlight {
+            uint64_t number;
+            uint64_t sent_at;
+            bool acked;
+            std::vector<Item> items;
+        };
+        
+        struct Subscriber {
+            bool active;
+            uint64_t next_number;
+            uint64_t last_heard;
+            std::vector<Peer> peers;
+            // the datagrams from the oldest unacknowledged on, by number.
+            std::vector<InFlight> ring;
+            size_t head;
+            size_t size;
+            size_t in_flight;
+            StreamStatistics statistics;
+        };
+        
+        std::vector<Device> _devices;
+        std::vector<Subscriber> _subscribers;
+        std::vector<std::unique_ptr<FrameTap> > _taps;
+        std::vector<uint8_t> _buffer;
+        std::vector<Item> _items;
+        size_t _window;
+        size_t _max_datagram;
+        uint64_t _retransmit;
+        uint64_t _timeout;
+        
+        StreamPublisher(const StreamPublisher&);
+        StreamPublisher& operator=(const StreamPublisher&);
+        
+        static void tap_frame(void* self, int device, Gamepad*, const Frame& frame) {
+            static_cast<StreamPublisher*>(self)->publish_frame(device, frame, Timer::monotonic_nanoseconds());
+        }
+        
+        static void reset(Peer& peer) {
+            memset(&peer, 0, sizeof(peer));
+        }
+        
+        void put_frame(const Device& device, int index, const Peer& peer) {
+            using namespace SessionEncoding;
+            const StreamState& state = device.latest;
+            const StreamState& base = peer.base;
+            _buffer.push_back(static_cast<uint8_t>(SessionRecordType::frame));
+            put_varint(_buffer, index);
+            put_varint(_buffer, state.sequence);
+            put_varint(_buffer, base.sequence);
+            put_varint(_buffer, zigzag(int64_t(state.timestamp - base.timestamp)));
+            unsigned changed = 0;
+            for (int i = 0; i < static_cast<int>(Axis::count); ++ i)
+                if (state.axes[i] != base.axes[i])
+                    changed |= 1u << i;
+            put_varint(_buffer, changed);
+            for (unsigned remaining = changed; remaining; remaining &= remaining - 1) {
+                int i = count_trailing_zeros(remaining);
+                put_varint(_buffer, zigzag(int64_t(state.axes[i]) - base.axes[i]));
+            }
+            put_varint(_buffer, state.held ^ base.held);
+            put_varint(_buffer, peer.edges & ~(state.held ^ peer.sent_held));
+        }
+        
+        InFlight* find(Subscriber& subscriber, uint64_t number) {
+            if (!subscriber.size)
+                return NULL;
+            uint64_t first = subscriber.ring[subscriber.head].number;
+            if (number < first || number - first >= subscriber.size)
+                return NULL;
+            return &subscriber.ring[(subscriber.head + (number - first)) % subscriber.ring.size()];
+        }
+        
+        void acknowledge(Subscriber& subscriber, InFlight& datagram) {
+            for (size_t i = 0; i < datagram.items.size(); ++ i) {
+                const Item& item = datagram.items[i];
+                Peer& peer = subscriber.peers[item.device];
+                if (item.type == SessionRecordType::attach) {
+                    peer.known = true;
+                    peer.attach_in_flight = false;
+                } else if (item.type == SessionRecordType::detach) {
+                    reset(peer);
+                } else if (item.state.sequence > peer.base.sequence) {
+                    peer.base = item.state;
+                }
+            }
+            datagram.acked = true;
+            -- subscriber.in_flight;
+        }
+        
+        // What the datagram carried goes again, as it is now.
+        void lose(Subscriber& subscriber, InFlight& datagram) {
+            for (size_t i = 0; i < datagram.items.size(); ++ i) {
+                const Item& item = datagram.items[i];
+                Peer& peer = subscriber.peers[item.device];
+                if (item.type == SessionRecordType::attach)
+                    peer.attach_in_flight = false;
+                else if (item.type == SessionRecordType::detach)
+                    peer.detach_in_flight = false;
+                else if (item.state.sequence > peer.base.sequence && _devices[item.device].attached)
+                    peer.dirty = true;
+            }
+            datagram.acked = true;
+            -- subscriber.in_flight;
+            ++ subscriber.statistics.lost;
+        }
+        
+        void pop_acked(Subscriber& subscriber) {
+            while (subscriber.size && subscriber.ring[subscriber.head].acked) {
+                subscriber.head = (subscriber.head + 1) % subscriber.ring.size();
+                -- subscriber.size;
+            }
+        }
+        
+        // Fill the next datagram with what the subscriber lacks.
+        void fill(Subscriber& subscriber) {
+            using namespace SessionEncoding;
+            _buffer.clear();
+            _items.clear();
+            _buffer.push_back(static_cast<uint8_t>(StreamDatagram::events));
+            put_varint(_buffer, subscriber.next_number);
+            
+            for (size_t d = 0; d < _devices.size(); ++ d) {
+                const Device& device = _devices[d];
+                const Peer& peer = subscriber.peers[d];
+                size_t mark = _buffer.size();
+                size_t items = _items.size();
+                bool frame = device.attached && peer.dirty;
+                
+                // the descriptor goes with every frame until it is known.
+                if (device.attached && !peer.known && (frame || !peer.attach_in_flight)) {
+                    _buffer.push_back(static_cast<uint8_t>(SessionRecordType::attach));
+                    put_varint(_buffer, d);
+                    put_descriptor(_buffer, device.descriptor);
+                    Item item = {static_cast<int>(d), SessionRecordType::attach, device.latest};
+                    _items.push_back(item);
+                }
+                if (!device.attached && peer.detaching && !peer.detach_in_flight) {
+                    _buffer.push_back(static_cast<uint8_t>(SessionRecordType::detach));
+                    put_varint(_buffer, d);
+                    Item item = {static_cast<int>(d), SessionRecordType::detach, device.latest};
+                    _items.push_back(item);
+                }
+                if (frame) {
+                    this->put_frame(device, static_cast<int>(d), peer);
+                    Item item = {static_cast<int>(d), SessionRecordType::frame, device.latest};
+                    _items.push_back(item);
+                }
+                
+                if (_buffer.size() > _max_datagram && items) {
+                    _buffer.resize(mark);
+                    _items.resize(items);
+                    return;
+                }
+            }
+        }
+        
+        void flush(Subscriber& subscriber, int id) {
+            while (subscriber.in_flight < _window && subscriber.size < subscriber.ring.size()) {
+                this->fill(subscriber);
+                if (_items.empty())
+                    return;
+                if (!this->send_datagram(id, _buffer.data(), _buffer.size())) {
+                    ++ subscriber.statistics.blocked;
+                    return;
+                }
+                
+                for (size_t i = 0; i < _items.size(); ++ i) {
+                    const Item& item = _items[i];
+                    Peer& peer = subscriber.peers[item.device];
+                    if (item.type == SessionRecordType::attach) {
+                        peer.attach_in_flight = true;
+                    } else if (item.type == SessionRecordType::detach) {
+                        peer.detach_in_flight = true;
+                    } else {
+                        peer.dirty = false;
+                        peer.edges = 0;
+                        peer.sent_held = item.state.held;
+                        ++ subscriber.statistics.frames;
+                    }
+                }
+                
+                InFlight& datagram = subscriber.ring[(subscriber.head + subscriber.size) % subscriber.ring.size()];
+                datagram.number = subscriber.next_number ++;
+                datagram.sent_at = Timer::monotonic_nanoseconds();
+                datagram.acked = false;
+                datagram.items.assign(_items.begin(), _items.end());
+                ++ subscriber.size;
+                ++ subscriber.in_flight;
+                ++ subscriber.statistics.datagrams;
+                subscriber.statistics.bytes += _buffer.size();
+            }
+        }
+        
+    protected:
+        StreamPublisher()
+            : _window(16), _max_datagram(1400), _retransmit(50000000), _timeout(2000000000) {
+            _buffer.reserve(65536);
+        }
+        
+        /// Send a datagram to a subscriber; return false if its socket is
+        /// full, to be tried again when it acknowledges or at the next tick.
+        virtual bool send_datagram(int subscriber, const uint8_t* bytes, size_t size) = 0;
+        
+        /// Call flush() soon, once for everything published meanwhile, so
+        /// that the frames of all gamepads in a turn of the loop go together.
+        virtual void schedule_flush() = 0;
+        
+        /// The subscriber timed out; forget whatever addresses it.
+        virtual void subscriber_removed(int) {}
+        
+    public:
+        virtual ~StreamPublisher() {
+            for (size_t i = 0; i < _taps.size(); ++ i)
+                _taps[i]->unsubscribe();
+        }
+        
+        /// At most 'datagrams' unacknowledged per subscriber, up to
+        /// kMaxWindow, each of at most 'bytes' but for a lone large message.
+        void set_window(size_t datagrams) { _window = std::min<size_t>(std::max<size_t>(datagrams, 1), StreamEncoding::kMaxWindow); }
+        void set_max_datagram(size_t bytes) { _max_datagram = bytes; }
+        
+        /// Send again what was not acknowledged after 'retransmit_ms', and
+        /// drop a subscriber not heard from for 'timeout_ms' while it has
+        /// datagrams to acknowledge.
+        void set_timeouts(int retransmit_ms, int timeout_ms) {
+            _retransmit = uint64_t(retransmit_ms) * 1000000;
+            _timeout = uint64_t(timeout_ms) * 1000000;
+        }
+        
+        /// Publish a device, and return its number in the stream, or -1 if
+        /// kMaxDevices are published.
+        int add_device(const SessionDevice& descriptor) {
+            size_t d = 0;
+            for (; d < _devices.size(); ++ d) {
+                bool free = !_devices[d].attached;
+                for (size_t s = 0; free && s < _subscribers.size(); ++ s)
+                    free = !_subscribers[s].active || !_subscribers[s].peers[d].detaching;
+                if (free)
+                    break;
+            }
+            if (d == StreamEncoding::kMaxDevices)
+                return -1;
+            if (d == _devices.size())
+                _devices.push_back(Device());
+            
+            Device& device = _devices[d];
+            memset(&device, 0, sizeof(device));
+            device.attached = true;
+            device.descriptor = descriptor;
+            for (size_t s = 0; s < _subscribers.size(); ++ s) {
+                if (!_subscribers[s].active)
+                    continue;
+                _subscribers[s].peers.resize(_devices.size());
+                reset(_subscribers[s].peers[d]);
+            }
+            this->schedule_flush();
+            return static_cast<int>(d);
+        }
+        
+        void remove_device(int index) {
+            _devices[index].attached = false;
+            for (size_t s = 0; s < _subscribers.size(); ++ s) {
+                if (!_subscribers[s].active)
+                    continue;
+                Peer& peer = _subscribers[s].peers[index];
+                bool detaching = peer.known || peer.attach_in_flight;
+                reset(peer);
+                peer.detaching = detaching;
+            }
+            this->schedule_flush();
+        }
+        
+        /// Publish the state a report left a device in.
+        void publish_frame(int index, const Frame& frame, uint64_t timestamp) {
+            StreamState& latest = _devices[index].latest;
+            ++ latest.sequence;
+            latest.timestamp = timestamp;
+            memcpy(latest.axes, frame.axes, sizeof(latest.axes));
+            latest.held = frame.held.bits();
+            
+            uint64_t edges = frame.pressed.bits() | frame.released.bits();
+            for (size_t s = 0; s < _subscribers.size(); ++ s) {
+                Subscriber& subscriber = _subscribers[s];
+                if (!subscriber.active)
+                    continue;
+                Peer& peer = subscriber.peers[index];
+                subscriber.statistics.conflated += peer.dirty;
+                peer.dirty = true;
+                peer.edges |= edges;
+            }
+            this->schedule_flush();
+        }
+        
+        /// Publish the frames of a gamepad as they are dispatched, and
+        /// return its number in the stream, or -1 as add_device().
+        int add_gamepad(Gamepad* gamepad, const char* name) {
+            int device = this->add_device(SessionDevice::of(gamepad, name));
+            if (device < 0)
+                return -1;
+            _taps.push_back(std::unique_ptr<FrameTap>(new FrameTap(gamepad, device, StreamPublisher::tap_frame, this)));
+            return device;
+        }
+        
+        /// Stop publishing a gamepad; call it before the gamepad is deleted.
+        void remove_gamepad(Gamepad* gamepad) {
+            for (auto it = _taps.begin(); it != _taps.end(); ++ it)
+                if ((*it)->gamepad() == gamepad) {
+                    (*it)->unsubscribe();
+                    this->remove_device((*it)->device());
+                    _taps.erase(it);
+                    return;
+                }
+        }
+        
+        /// Start sending to a new subscriber, and return its number.
+        int add_subscriber() {
+            size_t s = 0;
+            while (s < _subscribers.size() && _subscribers[s].active)
+                ++ s;
+            if (s == _subscribers.size())
+                _subscribers.push_back(Subscriber());
+            
+            Subscriber& subscriber = _subscribers[s];
+            subscriber.active = true;
+            subscriber.next_number = 1;
+            subscriber.last_heard = Timer::monotonic_nanoseconds();
+            subscriber.peers.assign(_devices.size(), Peer());
+            for (size_t d = 0; d < _devices.size(); ++ d) {
+                reset(subscriber.peers[d]);
+                subscriber.peers[d].dirty = _devices[d].attached && _devices[d].latest.sequence;
+            }
+            subscriber.ring.resize(StreamEncoding::kMaxWindow);
+            subscriber.head = subscriber.size = subscriber.in_flight = 0;
+            memset(&subscriber.statistics, 0, sizeof(subscriber.statistics));
+            this->schedule_flush();
+            return static_cast<int>(s);
+        }
+        
+        void remove_subscriber(int id) {
+            _subscribers[id].active = false;
+            _subscribers[id].peers.clear();
+        }
+        
+        /// Take an ack from a subscriber.
+        void handle_datagram(int id, const uint8_t* bytes, size_t size) {
+            using namespace SessionEncoding;
+            Subscriber& subscriber = _subscribers[id];
+            const uint8_t* p = bytes;
+            const uint8_t* end = bytes + size;
+            uint64_t flags, count;
+            if (!subscriber.active || p == end || *p ++ != static_cast<uint8_t>(StreamDatagram::ack)
+             || !get_varint(p, end, flags) || !get_varint(p, end, count))
+                return;
+            subscriber.last_heard = Timer::monotonic_nanoseconds();
+            
+            uint64_t newest = 0;
+            for (uint64_t i = 0; i < count; ++ i) {
+                uint64_t number;
+                if (!get_varint(p, end, number))
+                    break;
+                InFlight* datagram = this->find(subscriber, number);
+                if (datagram && !datagram->acked)
+                    this->acknowledge(subscriber, *datagram);
+                newest = std::max(newest, number);
+            }
+            // datagrams come in order: those before the newest acknowledged
+            // and still unacknowledged are lost.
+            for (size_t i = 0; i < subscriber.size; ++ i) {
+                InFlight& datagram = subscriber.ring[(subscriber.head + i) % subscriber.ring.size()];
+                if (datagram.number >= newest)
+                    break;
+                if (!datagram.acked)
+                    this->lose(subscriber, datagram);
+            }
+            
+            if (flags & StreamEncoding::kResync) {
+                for (size_t i = 0; i < subscriber.size; ++ i) {
+                    InFlight& datagram = subscriber.ring[(subscriber.head + i) % subscriber.ring.size()];
+                    if (!datagram.acked)
+                        this->lose(subscriber, datagram);
+                }
+                for (size_t d = 0; d < _devices.size(); ++ d) {
+                    Peer& peer = subscriber.peers[d];
+                    memset(&peer.base, 0, sizeof(peer.base));
+                    peer.dirty = _devices[d].attached && _devices[d].latest.sequence;
+                }
+            }
+            this->pop_acked(subscriber);
+            this->flush(subscriber, id);
+        }
+        
+        /// Send what every subscriber lacks and has room for.
+        void flush() {
+            for (size_t s = 0; s < _subscribers.size(); ++ s)
+                if (_subscribers[s].active)
+                    this->flush(_subscribers[s], static_cast<int>(s));
+        }
+        
+        /// Send again what was not acknowledged in time, and drop the
+        /// subscribers gone silent. Return whether any datagram is still
+        /// unacknowledged, or any frame waits for room, to tick again.
+        bool tick() {
+            uint64_t now = Timer::monotonic_nanoseconds();
+            bool pending = false;
+            for (size_t s = 0; s < _subscribers.size(); ++ s) {
+                Subscriber& subscriber = _subscribers[s];
+                if (!subscriber.active)
+                    continue;
+                if (subscriber.in_flight && now - subscriber.last_heard > _timeout) {
+                    this->remove_subscriber(static_cast<int>(s));
+                    this->subscriber_removed(static_cast<int>(s));
+                    continue;
+                }
+                for (size_t i = 0; i < subscriber.size; ++ i) {
+                    InFlight& datagram = subscriber.ring[(subscriber.head + i) % subscriber.ring.size()];
+                    if (now - datagram.sent_at < _retransmit)
+                        break;
+                    if (!datagram.acked)
+                        this->lose(subscriber, datagram);
+                }
+                this->pop_acked(subscriber);
+                this->flush(subscriber, static_cast<int>(s));
+                
+                pending = pending || subscriber.in_flight;
+                for (size_t d = 0; !pending && d < subscriber.peers.size(); ++ d)
+                    pending = subscriber.peers[d].dirty || subscriber.peers[d].detaching;
+            }
+            return pending;
+        }
+        
+        bool subscribed(int id) const { return size_t(id) < _subscribers.size() && _subscribers[id].active; }
+        const StreamStatistics& statistics(int id) const { return _subscribers[id].statistics; }
+    };
+    
+    /// Receives a stream and drives a ReplayGamepad for each device, so
+    /// that a consumer sees the gamepads of the publisher through the
+    /// whole of Gamepad, as if attached here.
+    class StreamSubscriber {
+    private:
+        struct Device {
+            std::unique_ptr<ReplayGamepad> gamepad;
+            SessionDeviceState state;
+            uint64_t timestamp;
+            StreamState history[StreamEncoding::kHistory];
+        };
+        
+        std::vector<Device> _devices;
+        std::vector<uint64_t> _acks;
+        bool _resync;
+        void* _self;
+        GamepadChangedObserver::Callback _callback;
+        uint64_t _datagrams;
+        uint64_t _frames;
+        
+        StreamSubscriber(const StreamSubscriber&);
+        StreamSubscriber& operator=(const StreamSubscriber&);
+        
+        Device& device(uint64_t index) {
+            if (index >= _devices.size())
+                _devices.resize(index + 1);
+            return _devices[index];
+        }
+        
+        void detach(Device& device) {
+            if (device.gamepad) {
+                if (_callback)
+                    _callback(_self, device.gamepad.get(), GamepadState::detaching);
+                device.gamepad.reset();
+            }
+            device.state = SessionDeviceState();
+            device.timestamp = 0;
+            memset(device.history, 0, sizeof(device.history));
+        }
+        
+        static bool same(const SessionDevice& a, const SessionDevice& b) {
+            if (strncmp(a.name, b.name, sizeof(a.name)) || a.axes != b.axes)
+                return false;
+            for (int i = 0; i < static_cast<int>(Axis::count); ++ i)
+                if (a.bounds[i] != b.bounds[i])
+                    return false;
+            return true;
+        }
+        
+        bool decode_frame(const uint8_t*& p, const uint8_t* end, Device& device) {
+            using namespace SessionEncoding;
+            uint64_t sequence, base_sequence, time, changed, held, taps;
+            if (!get_varint(p, end, sequence) || !get_varint(p, end, base_sequence) || !get_varint(p, end, time)
+             || !get_varint(p, end, changed))
+                return false;
+            StreamState state;
+            memset(&state, 0, sizeof(state));
+            const StreamState& base = device.history[base_sequence % StreamEncoding::kHistory];
+            bool found = !base_sequence || base.sequence == base_sequence;
+            if (found && base_sequence)
+                state = base;
+            state.sequence = sequence;
+            state.timestamp += unzigzag(time);
+            for (; changed; changed &= changed - 1) {
+                int i = count_trailing_zeros(changed);
+                uint64_t delta;
+                if (i >= static_cast<int>(Axis::count) || !get_varint(p, end, delta))
+                    return false;
+                state.axes[i] += static_cast<long>(unzigzag(delta));
+            }
+            if (!get_varint(p, end, held) || !get_varint(p, end, taps))
+                return false;
+            state.held ^= held;
+            
+            if (!found) {
+                _resync = true;
+                return true;
+            }
+            // a frame sent again, or overtaken.
+            if (sequence <= device.state.sequence)
+                return true;
+            
+            device.history[sequence % StreamEncoding::kHistory] = state;
+            device.state.sequence = sequence;
+            memcpy(device.state.axes, state.axes, sizeof(state.axes));
+            device.state.held = ButtonSet(state.held);
+            uint64_t elapsed = device.timestamp && state.timestamp > device.timestamp ? state.timestamp - device.timestamp : 0;
+            device.timestamp = state.timestamp;
+            ++ _frames;
+            if (device.gamepad)
+                device.gamepad->replay_frame(device.state, static_cast<unsigned>(std::min<uint64_t>(elapsed, ~0u)), ButtonSet(taps));
+            return true;
+        }
+        
+    public:
+        StreamSubscriber() : _resync(false), _self(NULL), _callback(NULL), _datagrams(0), _frames(0) {
+            _acks.reserve(StreamEncoding::kMaxAcks);
+        }
+        
+        virtual ~StreamSubscriber() {
+            for (size_t d = 0; d < _devices.size(); ++ d)
+                this->detach(_devices[d]);
+        }
+        
+        /// Told of the gamepads as the publisher attaches and detaches them,
+        /// as by a GamepadChangedObserver.
+        void set_callback(void* self, GamepadChangedObserver::Callback callback) {
+            _self = self;
+            _callback = callback;
+        }
+        
+        /// Decode an events datagram, driving the gamepads; return false if
+        /// it is not one, or is damaged.
+        bool handle_datagram(const uint8_t* bytes, size_t size) {
+            using namespace SessionEncoding;
+            const uint8_t* p = bytes;
+            const uint8_t* end = bytes + size;
+            uint64_t number;
+            if (p == end || *p ++ != static_cast<uint8_t>(StreamDatagram::events) || !get_varint(p, end, number))
+                return false;
+            ++ _datagrams;
+            
+            bool ok = true;
+            while (ok && p < end) {
+                SessionRecordType type = static_cast<SessionRecordType>(*p ++);
+                uint64_t index;
+                if (!get_varint(p, end, index) || index >= StreamEncoding::kMaxDevices)
+                    return false;
+                Device& device = this->device(index);
+                switch (type) {
+                    case SessionRecordType::attach: {
+                        SessionDevice descriptor;
+                        ok = get_descriptor(p, end, descriptor);
+                        // sent again until acknowledged.
+                        if (ok && !(device.gamepad && same(descriptor, device.state.descriptor))) {
+                            this->detach(device);
+                            device.state.attached = true;
+                            device.state.descriptor = descriptor;
+                            device.gamepad.reset(new ReplayGamepad(descriptor));
+                            if (_callback)
+                                _callback(_self, device.gamepad.get(), GamepadState::attached);
+                        }
+                        break;
+                    }
+                    case SessionRecordType::detach:
+                        this->detach(device);
+                        break;
+                    case SessionRecordType::frame:
+                        ok = this->decode_frame(p, end, device);
+                        break;
+                    default:
+                        ok = false;
+                        break;
+                }
+            }
+            // acknowledged even if damaged: what it would have carried is
+            // asked for again by the resync.
+            if (_acks.size() == StreamEncoding::kMaxAcks)
+                _acks.erase(_acks.begin());
+            _acks.push_back(number);
+            _resync = _resync || !ok;
+            return ok;
+        }
+        
+        /// Write the ack of the datagrams handled since the last; return
+        /// false if there is none to send.
+        bool take_ack(std::vector<uint8_t>& out) {
+            using namespace SessionEncoding;
+            if (_acks.empty() && !_resync)
+                return false;
+            out.clear();
+            out.push_back(static_cast<uint8_t>(StreamDatagram::ack));
+            put_varint(out, _resync ? StreamEncoding::kResync : 0);
+            put_varint(out, _acks.size());
+            for (size_t i = 0; i < _acks.size(); ++ i)
+                put_varint(out, _acks[i]);
+            _acks.clear();
+            _resync = false;
+            return true;
+        }
+        
+        static void write_hello(std::vector<uint8_t>& out) {
+            out.clear();
+            out.push_back(static_cast<uint8_t>(StreamDatagram::hello));
+            SessionEncoding::put_varint(out, StreamEncoding::kVersion);
+        }
+        
+        static void write_bye(std::vector<uint8_t>& out) {
+            out.clear();
+            out.push_back(static_cast<uint8_t>(StreamDatagram::bye));
+        }
+        
+        /// The gamepad of a device of the stream, or NULL.
+        Gamepad* gamepad(int index) const {
+            return size_t(index) < _devices.size() ? _devices[index].gamepad.get() : NULL;
+        }
+        
+        /// The publisher's time of the last frame of a device, on its
+        /// Timer::monotonic_nanoseconds(), which is the clock of every
+        /// process of a machine on Linux.
+        uint64_t timestamp(int index) const {
+            return size_t(index) < _devices.size() ? _devices[index].timestamp : 0;
+        }
+        
+        uint64_t datagrams() const { return _datagrams; }
+        uint64_t frames() const { return _frames; }
+    };
+}
+
+#endif
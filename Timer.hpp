@@ -33,11 +33,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef TIMER_HPP_ngil72o5nr7fogvi
 #define TIMER_HPP_ngil72o5nr7fogvi 1
 
-#if _WINDLL
-#define EXPORT __declspec(dllexport)
-#else
-#define EXPORT
-#endif
+#include <stdint.h>
+#include "Compatibility.hpp"
+#include "FlightRecorder.hpp"
 
 namespace GP {
     class Timer {
@@ -55,11 +53,15 @@ namespace GP {
             : _self(self), _callback(callback), _stopped(false) {}
             
         void handle_timer() {
+            uint64_t start = monotonic_nanoseconds();
             if (_callback)
                 _callback(_self, this);
+            FlightRecorder::instance().record(FlightEvent::timer, this, 0, start, monotonic_nanoseconds() - start);
         }
         
         virtual void stop_impl() = 0;
+        virtual void restart_impl() = 0;
+        virtual void set_interval_impl(int milliseconds) = 0;
               
     public:
         bool running() const { return !_stopped; }
@@ -69,9 +71,33 @@ namespace GP {
                 _stopped = true; 
             }
         }
+        // Fire a full interval from now, and periodically after that, even if
+        // the timer was stopped.
+        void restart() {
+            this->restart_impl();
+            _stopped = false;
+        }
+        // Make the interval 'milliseconds', and restart.
+        void restart(int milliseconds) {
+            this->set_interval_impl(milliseconds);
+            this->restart();
+        }
         virtual ~Timer() {}
     
         static EXPORT Timer* create(void* self, Callback callback, int milliseconds, void* eventloop);
+        
+        // A clock which never goes back, with an arbitrary origin.
+        static EXPORT uint64_t monotonic_nanoseconds();
+    };
+    
+    // A clock standing in for the system's, such as the virtual clock of a
+    // replay, so that time-driven code runs the same at any speed. It is
+    // given to each gamepad which follows it, with Gamepad::set_clock().
+    class ClockSource {
+    public:
+        virtual ~ClockSource() {}
+        virtual uint64_t now() const = 0;
+        virtual Timer* create_timer(void* self, Timer::Callback callback, int milliseconds) = 0;
     };
 }
 
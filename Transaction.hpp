@@ -69,6 +69,15 @@ namespace GP {
             _feature_buttons.push_back(v);
         }
         
+        // Empty the transaction but keep its memory, so that one reused for
+        // every send stops allocating once it has grown to size.
+        void clear() {
+            _output_values.clear();
+            _feature_values.clear();
+            _output_buttons.clear();
+            _feature_buttons.clear();
+        }
+        
         const std::vector<Value>& output_values() const { return _output_values; }
         const std::vector<Value>& feature_values() const { return _feature_values; }
         const std::vector<Value>& output_buttons() const { return _output_buttons; }
@@ -0,0 +1,152 @@
+/*
+ 
+VirtualClock.hpp ... A clock and timers which move only when told to.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef VIRTUAL_CLOCK_HPP_7dpt3rqjrlybhhwk
+#define VIRTUAL_CLOCK_HPP_7dpt3rqjrlybhhwk 1
+
+#include "Timer.hpp"
+#include <stdint.h>
+#include <map>
+#include <utility>
+
+namespace GP {
+    /// A clock which stands still until advanced, with timers which fire as
+    /// it passes their times. Given to a gamepad with Gamepad::set_clock(),
+    /// it drives its idle timeout and stall watchdog, so a replay runs the
+    /// same at any speed. Only one thread may use the clock and its timers,
+    /// which are those of the gamepads given it.
+    class VirtualClock : public ClockSource {
+    private:
+        class VirtualTimer;
+        // Keyed by due time, then by order of starting, so that timers due
+        // together fire in a fixed order.
+        typedef std::map<std::pair<uint64_t, uint64_t>, VirtualTimer*> Queue;
+        
+        class VirtualTimer : public Timer {
+        private:
+            VirtualClock* _clock;
+            uint64_t _period;
+            Queue::iterator _position;
+            bool _queued;
+            
+            void stop_impl() { this->dequeue(); }
+            void restart_impl() {
+                this->dequeue();
+                this->enqueue(_clock->_now + _period);
+            }
+            void set_interval_impl(int milliseconds) {
+                _period = uint64_t(milliseconds > 0 ? milliseconds : 1) * 1000000;
+            }
+            
+        public:
+            VirtualTimer(VirtualClock* clock, void* self, Callback callback, int milliseconds)
+                : Timer(self, callback), _clock(clock),
+                  _period(uint64_t(milliseconds > 0 ? milliseconds : 1) * 1000000), _queued(false) {
+                this->enqueue(_clock->_now + _period);
+            }
+            
+            ~VirtualTimer() {
+                this->dequeue();
+                if (_clock->_firing == this)
+                    _clock->_firing = NULL;
+            }
+            
+            void enqueue(uint64_t due) {
+                _position = _clock->_queue.insert(std::make_pair(std::make_pair(due, _clock->_order ++), this)).first;
+                _queued = true;
+            }
+            
+            void dequeue() {
+                if (_queued) {
+                    _clock->_queue.erase(_position);
+                    _queued = false;
+                }
+            }
+            
+            bool queued() const { return _queued; }
+            uint64_t period() const { return _period; }
+            
+            void fire() {
+                _queued = false;
+                this->handle_timer();
+            }
+        };
+        
+        uint64_t _now;
+        uint64_t _order;
+        Queue _queue;
+        VirtualTimer* _firing;
+        
+        VirtualClock(const VirtualClock&);
+        VirtualClock& operator=(const VirtualClock&);
+        
+    public:
+        explicit VirtualClock(uint64_t now = 0) : _now(now), _order(0), _firing(NULL) {}
+        
+        /// The timers must be deleted before the clock.
+        ~VirtualClock() {}
+        
+        uint64_t now() const { return _now; }
+        
+        Timer* create_timer(void* self, Timer::Callback callback, int milliseconds) {
+            return new VirtualTimer(this, self, callback, milliseconds);
+        }
+        
+        /// The time the next timer is due, or ~0 if none is running.
+        uint64_t next_due() const {
+            return _queue.empty() ? ~uint64_t(0) : _queue.begin()->first.first;
+        }
+        
+        /// Move to 'time', firing every timer due by then in order, each with
+        /// the clock at its due time. The clock never goes back.
+        void advance_to(uint64_t time) {
+            while (!_queue.empty() && _queue.begin()->first.first <= time) {
+                Queue::iterator first = _queue.begin();
+                uint64_t due = first->first.first;
+                VirtualTimer* timer = first->second;
+                _queue.erase(first);
+                if (due > _now)
+                    _now = due;
+                // fire again a period after 'due', unless the callback
+                // stopped, restarted or deleted the timer.
+                _firing = timer;
+                timer->fire();
+                if (_firing == timer && !timer->queued() && timer->running())
+                    timer->enqueue(due + timer->period());
+                _firing = NULL;
+            }
+            if (time > _now)
+                _now = time;
+        }
+    };
+}
+
+#endif
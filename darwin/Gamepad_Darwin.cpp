@@ -94,13 +94,20 @@ namespace GP {
         }
     }
     
-    void Gamepad_Darwin::handle_report(void* context, IOReturn, void*, IOHIDReportType, uint32_t, uint8_t*, CFIndex) {
+    void Gamepad_Darwin::handle_report(void* context, IOReturn, void*, IOHIDReportType, uint32_t, uint8_t*, CFIndex report_length) {
         // Ref: http://developer.apple.com/library/mac/#qa/qa2004/qa1398.html
         static mach_timebase_info_data_t timebase_info;
         if (!timebase_info.denom)
             mach_timebase_info(&timebase_info);
 
         Gamepad_Darwin* this_ = static_cast<Gamepad_Darwin*>(context);
+        uint64_t read_time = Timer::monotonic_nanoseconds();
+        this_->stamp_latency(LatencyStamp::read_returned, read_time);
+        FlightRecorder::instance().record(FlightEvent::read, this_, report_length, read_time);
+        StatisticsCounters::Reader& counters = this_->statistics_counters().reader;
+        counters.reports_read.add();
+        counters.bytes_read.add(report_length);
+        counters.queue_high_water.raise_to(1);
         
         auto time_now = mach_absolute_time();
         auto timestamp_elapsed = time_now - this_->_last_report_time;
@@ -108,13 +115,15 @@ namespace GP {
         this_->_last_report_time = time_now;
         
         this_->handle_axes_change(nanoseconds_elapsed);
+        this_->handle_frame(nanoseconds_elapsed);
     }
     
     void send(int usage_page, int usage, const unsigned char* content, size_t content_size);
     void retrieve(int usage_page, int usage, unsigned char* buffer, size_t buffer_size);
 
         
-    Gamepad_Darwin::Gamepad_Darwin(IOHIDDeviceRef device) : Gamepad(), _device{device}, _last_report_time{mach_absolute_time()} {
+    Gamepad_Darwin::Gamepad_Darwin(IOHIDDeviceRef device) : Gamepad(), _device{device}, _last_report_time{mach_absolute_time()},
+            _output_transaction{IOHIDTransactionCreate(kCFAllocatorDefault, device, kIOHIDTransactionDirectionTypeOutput, 0)} {
         CFArrayRef elements = IOHIDDeviceCopyMatchingElements(device, NULL, kIOHIDOptionsTypeNone);
         CFMutableArrayRef restricted_elements = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
         
@@ -129,12 +138,21 @@ namespace GP {
         IOHIDDeviceRegisterInputReportCallback(device, NULL, 0, Gamepad_Darwin::handle_report, this);
     }
     
+    Gamepad_Darwin::~Gamepad_Darwin() {
+        if (_output_transaction)
+            CFRelease(_output_transaction);
+    }
+    
     //## WARNING: THE FOLLOWING TWO METHODS ARE NOT TESTED! 
     //            Testing will be delayed to when I've met a device that the
     //             output format is reliably decoded. Do not use them in 
     //             productive environment.
     bool Gamepad_Darwin::commit_transaction(const Transaction& transaction) {
-        auto trans = IOHIDTransactionCreate(kCFAllocatorDefault, _device, kIOHIDTransactionDirectionTypeOutput, 0);
+        uint64_t start = Timer::monotonic_nanoseconds();
+        auto trans = _output_transaction;
+        if (!trans)
+            return false;
+        std::lock_guard<std::mutex> lock(_transaction_mutex);
         
         auto abs_time = mach_absolute_time();        
         
@@ -161,21 +179,23 @@ namespace GP {
             feature_appender(trans, _valid_feature_elements, abs_time);
 
         
-        auto output_values = transaction.output_values();
+        const auto& output_values = transaction.output_values();
         std::for_each(output_values.cbegin(), output_values.cend(), output_appender);
                 
-        auto output_buttons = transaction.output_buttons();
+        const auto& output_buttons = transaction.output_buttons();
         std::for_each(output_buttons.cbegin(), output_buttons.cend(), output_appender);
         
-        auto feature_values = transaction.feature_values();
+        const auto& feature_values = transaction.feature_values();
         std::for_each(feature_values.cbegin(), feature_values.cend(), feature_appender);
         
-        auto feature_buttons = transaction.feature_buttons();
+        const auto& feature_buttons = transaction.feature_buttons();
         std::for_each(feature_buttons.cbegin(), feature_buttons.cend(), feature_appender);
                 
         IOReturn retval = IOHIDTransactionCommit(trans);
-        CFRelease(trans);
+        IOHIDTransactionClear(trans);
         
+        size_t count = output_values.size() + output_buttons.size() + feature_values.size() + feature_buttons.size();
+        FlightRecorder::instance().record(FlightEvent::transaction, this, count, start, Timer::monotonic_nanoseconds() - start);
         return retval == kIOReturnSuccess;
     }
     
@@ -37,6 +37,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "../Gamepad.hpp"
 #include <IOKit/hid/IOHIDManager.h>
 #include <unordered_map>
+#include <mutex>
 
 namespace GP {
     class Gamepad_Darwin : public Gamepad {
@@ -44,6 +45,9 @@ namespace GP {
         IOHIDDeviceRef _device;
         std::unordered_map<int, IOHIDElementRef> _valid_output_elements, _valid_feature_elements;
         uint64_t _last_report_time;
+        // Created once and cleared after each commit, under the mutex.
+        IOHIDTransactionRef _output_transaction;
+        std::mutex _transaction_mutex;
         
         static void collect_axis_bounds(const void* element, void* self);
         
@@ -55,6 +59,7 @@ namespace GP {
         
     public:
         Gamepad_Darwin(IOHIDDeviceRef device);
+        ~Gamepad_Darwin();
     };
 }
 
@@ -32,21 +32,24 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "../Timer.hpp"
 #include <CoreFoundation/CoreFoundation.h>
+#include <mach/mach_time.h>
 
 namespace GP {
     class Timer_Darwin : public Timer {
     private:
         CFRunLoopTimerRef _timer;
+        CFRunLoopRef _runloop;
+        CFTimeInterval _interval;
         
         void stop_impl();
+        void restart_impl();
+        void set_interval_impl(int milliseconds);
                 
     public:
-        Timer_Darwin(void* self, Callback callback) : Timer(self, callback), _timer(NULL) {}
+        Timer_Darwin(void* self, Callback callback, CFRunLoopRef runloop, CFTimeInterval interval)
+            : Timer(self, callback), _timer(NULL), _runloop(runloop), _interval(interval) {}
         
-        void set_timer(CFRunLoopTimerRef timer) {
-            if (!_timer)
-                _timer = timer;
-        }
+        void start();
         
         ~Timer_Darwin() {
             if (_timer)
@@ -56,6 +59,15 @@ namespace GP {
         static void timer_fired(CFRunLoopTimerRef timer, void* info);
     };
     
+    void Timer_Darwin::start() {
+        CFAbsoluteTime next_fire_date = CFAbsoluteTimeGetCurrent() + _interval;
+        CFRunLoopTimerContext ctx = {0, this, NULL, NULL, NULL};
+        _timer = CFRunLoopTimerCreate(kCFAllocatorDefault, next_fire_date, _interval, 0, 0, Timer_Darwin::timer_fired, &ctx);
+        
+        CFRunLoopAddTimer(_runloop, _timer, kCFRunLoopCommonModes);
+        CFRelease(_timer);
+    }
+    
     void Timer_Darwin::stop_impl() {
         if (_timer) {
             CFRunLoopTimerInvalidate(_timer);
@@ -63,23 +75,35 @@ namespace GP {
         }   
     }
     
+    void Timer_Darwin::restart_impl() {
+        if (_timer)
+            CFRunLoopTimerSetNextFireDate(_timer, CFAbsoluteTimeGetCurrent() + _interval);
+        else
+            this->start();
+    }
+    
+    // The interval of a run loop timer is fixed: another one takes a new timer.
+    void Timer_Darwin::set_interval_impl(int milliseconds) {
+        if (_interval != milliseconds / 1000.0) {
+            this->stop_impl();
+            _interval = milliseconds / 1000.0;
+        }
+    }
+    
     void Timer_Darwin::timer_fired(CFRunLoopTimerRef, void* info) {
         static_cast<Timer_Darwin*>(info)->handle_timer();
     }
     
     Timer* Timer::create(void* self, Callback callback, int milliseconds, void* eventloop) {
-        Timer_Darwin* retval = new Timer_Darwin(self, callback);
-        
-        CFTimeInterval interval = milliseconds / 1000.0;
-        CFAbsoluteTime next_fire_date = CFAbsoluteTimeGetCurrent() + interval;
-        CFRunLoopTimerContext ctx = {0, retval, NULL, NULL, NULL};
-        CFRunLoopTimerRef timer = CFRunLoopTimerCreate(kCFAllocatorDefault, next_fire_date, interval, 0, 0, Timer_Darwin::timer_fired, &ctx);
-        
-        retval->set_timer(timer);
-        
-        CFRunLoopAddTimer(static_cast<CFRunLoopRef>(eventloop), timer, kCFRunLoopCommonModes);
-        CFRelease(timer);
-        
+        Timer_Darwin* retval = new Timer_Darwin(self, callback, static_cast<CFRunLoopRef>(eventloop), milliseconds / 1000.0);
+        retval->start();
         return retval;
-    }    
+    }
+    
+    uint64_t Timer::monotonic_nanoseconds() {
+        static mach_timebase_info_data_t timebase_info;
+        if (!timebase_info.denom)
+            mach_timebase_info(&timebase_info);
+        return mach_absolute_time() * timebase_info.numer / timebase_info.denom;
+    }
 }
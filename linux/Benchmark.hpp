@@ -0,0 +1,204 @@
+/*
+ 
+Benchmark.hpp ... Helpers shared by the benchmark programs.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef BENCHMARK_HPP_u4k0fxa2c9zq17rm
+#define BENCHMARK_HPP_u4k0fxa2c9zq17rm 1
+
+#include "Gamepad.hpp"
+#include <time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+
+namespace GP {
+    namespace Bench {
+        static inline uint64_t now_ns() {
+            timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        }
+
+        /// Run body() `repetitions` times and return the fastest run in
+        /// nanoseconds. The fastest run is the least disturbed by the rest of
+        /// the system.
+        template <typename F>
+        uint64_t best_of(unsigned repetitions, F body) {
+            uint64_t best = ~uint64_t(0);
+            for (unsigned i = 0; i < repetitions; ++ i) {
+                uint64_t start = now_ns();
+                body();
+                uint64_t elapsed = now_ns() - start;
+                if (elapsed < best)
+                    best = elapsed;
+            }
+            return best;
+        }
+
+        struct Result {
+            std::string name;
+            double value;
+            std::string unit;
+            bool higher_is_better;
+        };
+        
+        static inline std::vector<Result>& results() {
+            static std::vector<Result> results;
+            return results;
+        }
+        
+        /// Print a result, and keep it for finish().
+        static inline void record(const char* name, double value, const char* unit, bool higher_is_better = false) {
+            printf("%-48s %10.1f %s\n", name, value, unit);
+            Result result = {name, value, unit, higher_is_better};
+            results().push_back(result);
+        }
+        
+        static inline void report(const char* name, double ns_per_op, const char* unit = "op") {
+            std::string per_unit = std::string("ns/") + unit;
+            record(name, ns_per_op, per_unit.c_str());
+        }
+        
+        static inline std::string json_path(const char* directory, const char* program) {
+            const char* slash = strrchr(program, '/');
+            return std::string(directory) + "/" + (slash ? slash + 1 : program) + ".json";
+        }
+        
+        // One result per line, so that a baseline reads back without a JSON
+        // parser.
+        static inline bool write_json(const std::string& path, const char* program) {
+            FILE* file = fopen(path.c_str(), "w");
+            if (!file)
+                return false;
+            const char* slash = strrchr(program, '/');
+            fprintf(file, "{\"benchmark\": \"%s\", \"results\": [\n", slash ? slash + 1 : program);
+            const std::vector<Result>& all = results();
+            for (size_t i = 0; i < all.size(); ++ i)
+                fprintf(file, "  {\"name\": \"%s\", \"value\": %.3f, \"unit\": \"%s\", \"higher_is_better\": %s}%s\n",
+                        all[i].name.c_str(), all[i].value, all[i].unit.c_str(),
+                        all[i].higher_is_better ? "true" : "false", i + 1 < all.size() ? "," : "");
+            fputs("]}\n", file);
+            return fclose(file) == 0;
+        }
+        
+        static inline bool read_json(const std::string& path, std::map<std::string, double>& values) {
+            FILE* file = fopen(path.c_str(), "r");
+            if (!file)
+                return false;
+            char line[512];
+            while (fgets(line, sizeof(line), file)) {
+                const char* name = strstr(line, "\"name\": \"");
+                const char* value = strstr(line, "\"value\": ");
+                if (!name || !value)
+                    continue;
+                name += 9;
+                const char* end = strchr(name, '"');
+                if (end)
+                    values[std::string(name, end)] = atof(value + 9);
+            }
+            fclose(file);
+            return true;
+        }
+        
+        /// Handle the options of a benchmark, once its results are recorded,
+        /// and return its exit status:
+        ///   --json DIR         write the results to DIR/<benchmark>.json.
+        ///   --baseline DIR     compare them with DIR/<benchmark>.json, and
+        ///                      fail if one is worse by more than
+        ///   --tolerance PCT    percent, 10 by default.
+        static inline int finish(int argc, char** argv) {
+            const char* json = NULL;
+            const char* baseline = NULL;
+            double tolerance = 10;
+            for (int i = 1; i + 1 < argc; i += 2) {
+                if (!strcmp(argv[i], "--json"))
+                    json = argv[i + 1];
+                else if (!strcmp(argv[i], "--baseline"))
+                    baseline = argv[i + 1];
+                else if (!strcmp(argv[i], "--tolerance"))
+                    tolerance = atof(argv[i + 1]);
+            }
+            
+            if (json && !write_json(json_path(json, argv[0]), argv[0])) {
+                fprintf(stderr, "cannot write %s\n", json_path(json, argv[0]).c_str());
+                return 1;
+            }
+            if (!baseline)
+                return 0;
+            
+            // a benchmark newer than the baseline has nothing to compare.
+            std::map<std::string, double> values;
+            if (!read_json(json_path(baseline, argv[0]), values)) {
+                fprintf(stderr, "no baseline in %s\n", json_path(baseline, argv[0]).c_str());
+                return 0;
+            }
+            int regressions = 0;
+            const std::vector<Result>& all = results();
+            for (auto it = all.begin(); it != all.end(); ++ it) {
+                auto found = values.find(it->name);
+                if (found == values.end())
+                    continue;
+                // from nothing, as idle wakeups, any amount is worse.
+                double change = found->second ? (it->value - found->second) / found->second * 100
+                              : it->value ? HUGE_VAL : 0;
+                bool worse = it->higher_is_better ? change < -tolerance : change > tolerance;
+                if (worse)
+                    ++ regressions;
+                printf("%-48s %10.1f -> %10.1f %s %+6.1f%%%s\n", it->name.c_str(), found->second, it->value,
+                       it->unit.c_str(), change, worse ? "  REGRESSION" : "");
+            }
+            return regressions ? 1 : 0;
+        }
+
+        /// Prevent the compiler from optimizing away a computed value.
+        static volatile long sink;
+    }
+
+    /// A gamepad without a device, driven directly by the benchmarks.
+    class SyntheticGamepad : public Gamepad {
+    public:
+        using Gamepad::set_bounds_for_axis;
+        using Gamepad::set_axis_value;
+        using Gamepad::handle_axes_change;
+        using Gamepad::handle_button_change;
+        using Gamepad::handle_frame;
+
+        SyntheticGamepad() {
+            for (int i = 0; i < static_cast<int>(Axis::count); ++ i)
+                this->set_bounds_for_axis(static_cast<Axis>(i), -512, 511);
+        }
+    };
+}
+
+#endif
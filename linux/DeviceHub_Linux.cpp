@@ -0,0 +1,220 @@
+/*
+ 
+DeviceHub_Linux.cpp ... Devices shared by the observers of an event loop.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "DeviceHub_Linux.hpp"
+#include "GamepadChangedObserver_Linux.hpp"
+#include "Gamepad_Linux.hpp"
+#include "../EventLoop.hpp"
+#include <sys/inotify.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+namespace GP {
+    static const char kDeviceDirectory[] = "/dev/input";
+    
+    static std::mutex hubs_mutex;
+    static std::unordered_map<EventLoop*, DeviceHub_Linux*> hubs;
+    
+    DeviceHub_Linux::DeviceHub_Linux(EventLoop* eventloop)
+        : _eventloop(eventloop), _inotify_fd(-1), _observer_count(0) {}
+    
+    DeviceHub_Linux::~DeviceHub_Linux() {
+        if (_inotify_fd >= 0) {
+            _eventloop->remove_watch(_inotify_fd);
+            close(_inotify_fd);
+        }
+    }
+    
+    DeviceHub_Linux* DeviceHub_Linux::retain(EventLoop* eventloop) {
+        DeviceHub_Linux* hub;
+        {
+            std::lock_guard<std::mutex> lock(hubs_mutex);
+            DeviceHub_Linux*& entry = hubs[eventloop];
+            if (entry) {
+                ++ entry->_observer_count;
+                return entry;
+            }
+            hub = entry = new DeviceHub_Linux(eventloop);
+            hub->_observer_count = 1;
+        }
+        hub->observe();
+        return hub;
+    }
+    
+    void DeviceHub_Linux::release() {
+        {
+            std::lock_guard<std::mutex> lock(hubs_mutex);
+            if (-- _observer_count)
+                return;
+            hubs.erase(_eventloop);
+        }
+        delete this;
+    }
+    
+    void DeviceHub_Linux::share(Gamepad* gamepad) const {
+        gamepad->_hub_shared.store(true);
+        gamepad->_sole_observer.store(_observers.size() == 1 ? _observers[0] : NULL);
+    }
+    
+    void DeviceHub_Linux::add_observer(GamepadChangedObserver_Linux* observer) {
+        _observers.push_back(observer);
+        for (auto it = _devices.begin(); it != _devices.end(); ++ it)
+            this->share(it->second.get());
+        auto devices = _devices;
+        for (auto it = devices.begin(); it != devices.end(); ++ it)
+            observer->handle_event(it->second.get(), GamepadState::attached);
+    }
+    
+    void DeviceHub_Linux::remove_observer(GamepadChangedObserver_Linux* observer) {
+        _observers.erase(std::remove(_observers.begin(), _observers.end(), observer), _observers.end());
+        for (auto it = _devices.begin(); it != _devices.end(); ++ it) {
+            Gamepad* gamepad = it->second.get();
+            observer->forget(gamepad);
+            // the callbacks and the rest the observer's client set go with it.
+            if (gamepad->_state_owner.load() == observer)
+                gamepad->clear_single_slot();
+            this->share(gamepad);
+        }
+    }
+    
+    void DeviceHub_Linux::attach(const std::string& name, int fd) {
+        std::shared_ptr<Gamepad_Linux> gamepad(new Gamepad_Linux(fd, _eventloop));
+        
+        // the slot is the hub's to assign, once, so that every observer
+        // reports the same one: the lowest not taken by another device.
+        uint64_t used_slots = 0;
+        for (auto it = _devices.begin(); it != _devices.end(); ++ it)
+            if (it->second->_slot >= 0)
+                used_slots |= uint64_t(1) << it->second->_slot;
+        if (~used_slots != 0)
+            gamepad->_slot = count_trailing_zeros(~used_slots);
+        this->share(gamepad.get());
+        _devices.push_back(std::make_pair(name, gamepad));
+        
+        // an observer may delete itself, or another observer, from its
+        // callback, and the last one the hub with it.
+        ++ _observer_count;
+        auto observers = _observers;
+        for (auto it = observers.begin(); it != observers.end(); ++ it)
+            if (std::find(_observers.begin(), _observers.end(), *it) != _observers.end())
+                (*it)->handle_event(gamepad.get(), GamepadState::attached);
+        this->release();
+    }
+    
+    void DeviceHub_Linux::detach(const std::string& name) {
+        auto device = _devices.begin();
+        while (device != _devices.end() && device->first != name)
+            ++ device;
+        if (device == _devices.end())
+            return;
+        
+        std::shared_ptr<Gamepad_Linux> gamepad = device->second;
+        _devices.erase(device);
+        
+        ++ _observer_count;
+        auto observers = _observers;
+        for (auto it = observers.begin(); it != observers.end(); ++ it)
+            if (std::find(_observers.begin(), _observers.end(), *it) != _observers.end())
+                (*it)->handle_event(gamepad.get(), GamepadState::detaching);
+        this->release();
+    }
+    
+    static bool is_event_node(const char* name) {
+        return strncmp(name, "event", 5) == 0;
+    }
+    
+    void DeviceHub_Linux::insert_device_with_name(const char* name) {
+        if (!is_event_node(name))
+            return;
+        for (auto it = _devices.begin(); it != _devices.end(); ++ it)
+            if (it->first == name)
+                return;
+        
+        std::string path = std::string(kDeviceDirectory) + "/" + name;
+        int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0)
+            return;
+        if (!Gamepad_Linux::is_gamepad(fd)) {
+            close(fd);
+            return;
+        }
+        this->attach(name, fd);
+    }
+    
+    void DeviceHub_Linux::remove_device_with_name(const char* name) {
+        this->detach(name);
+    }
+    
+    // this method is called whenever a node in /dev/input changes. A node is
+    // created before udev makes it readable, so attribute changes retry it.
+    void DeviceHub_Linux::handle_inotify(void* self, int fd) {
+        auto this_ = static_cast<DeviceHub_Linux*>(self);
+        
+        char buffer[4096] __attribute__((aligned(__alignof__(inotify_event))));
+        ssize_t size = read(fd, buffer, sizeof(buffer));
+        for (ssize_t offset = 0; offset < size; ) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+            if (!event->len)
+                continue;
+            
+            if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                this_->remove_device_with_name(event->name);
+            else if (event->mask & (IN_CREATE | IN_ATTRIB | IN_MOVED_TO))
+                this_->insert_device_with_name(event->name);
+        }
+    }
+    
+    void DeviceHub_Linux::observe() {
+        // watch for hot-plugging first, so no device is missed in between.
+        _inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (_inotify_fd >= 0) {
+            if (inotify_add_watch(_inotify_fd, kDeviceDirectory, IN_CREATE | IN_ATTRIB | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO) >= 0) {
+                _eventloop->add_watch(_inotify_fd, this, DeviceHub_Linux::handle_inotify);
+            } else {
+                close(_inotify_fd);
+                _inotify_fd = -1;
+            }
+        }
+        
+        DIR* directory = opendir(kDeviceDirectory);
+        if (directory) {
+            while (dirent* entry = readdir(directory))
+                this->insert_device_with_name(entry->d_name);
+            closedir(directory);
+        }
+    }
+}
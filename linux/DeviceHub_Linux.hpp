@@ -0,0 +1,93 @@
+/*
+ 
+DeviceHub_Linux.hpp ... Devices shared by the observers of an event loop.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef DEVICE_HUB_LINUX_HPP_686idhusfthqe2ty
+#define DEVICE_HUB_LINUX_HPP_686idhusfthqe2ty 1
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <utility>
+
+namespace GP {
+    class EventLoop;
+    class Gamepad;
+    class Gamepad_Linux;
+    class GamepadChangedObserver_Linux;
+    
+    // Opens each gamepad once per event loop, however many observers the loop
+    // has. Every report is read and decoded once by the one Gamepad_Linux of
+    // the device, which then dispatches it to the subscriptions and callbacks
+    // of all observers.
+    class DeviceHub_Linux {
+    private:
+        EventLoop* _eventloop;
+        int _inotify_fd;
+        int _observer_count;
+        // in the order they were attached, keyed by the name of the device
+        // node, e.g. "event3".
+        std::vector<std::pair<std::string, std::shared_ptr<Gamepad_Linux> > > _devices;
+        std::vector<GamepadChangedObserver_Linux*> _observers;
+        
+        explicit DeviceHub_Linux(EventLoop* eventloop);
+        ~DeviceHub_Linux();
+        
+        DeviceHub_Linux(const DeviceHub_Linux&);
+        DeviceHub_Linux& operator=(const DeviceHub_Linux&);
+        
+        void observe();
+        // Tell the gamepad whether it has a sole observer, to own the state
+        // it has a single slot of.
+        void share(Gamepad* gamepad) const;
+        void insert_device_with_name(const char* name);
+        void remove_device_with_name(const char* name);
+        static void handle_inotify(void* self, int fd);
+        
+    public:
+        // The hub of the event loop, created with its first observer and
+        // deleted with the last.
+        static DeviceHub_Linux* retain(EventLoop* eventloop);
+        void release();
+        
+        // Tell the observer about every device now and from now on.
+        void add_observer(GamepadChangedObserver_Linux* observer);
+        void remove_observer(GamepadChangedObserver_Linux* observer);
+        
+        // Take an open evdev fd as the device 'name', without checking it is
+        // a gamepad.
+        void attach(const std::string& name, int fd);
+        void detach(const std::string& name);
+        
+        const std::vector<std::pair<std::string, std::shared_ptr<Gamepad_Linux> > >& devices() const { return _devices; }
+    };
+}
+
+#endif
@@ -0,0 +1,208 @@
+/*
+ 
+EventLoop_Linux.cpp ... EventLoop on epoll.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "../EventLoop.hpp"
+#include "../Exception.hpp"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+
+namespace GP {
+    class EventLoop_Linux : public EventLoop {
+    private:
+        struct Watch {
+            int fd;
+            void* self;
+            Callback callback;
+        };
+        struct PostedTask {
+            void* self;
+            Task task;
+        };
+        
+        int _epoll_fd;
+        int _wake_fd;
+        bool _quit;
+        std::unordered_map<int, Watch*> _watches;
+        // Watches removed while dispatching. epoll_wait() may already have
+        // returned them, so they are only freed once the batch is done.
+        std::vector<Watch*> _removed_watches;
+        int _dispatch_depth;
+        
+        std::mutex _posted_mutex;
+        std::vector<PostedTask> _posted, _running;
+        
+        int dispatch(int timeout_milliseconds);
+        static void run_posted(void* self, int fd);
+        
+    public:
+        EventLoop_Linux(int epoll_fd, int wake_fd);
+        ~EventLoop_Linux();
+        
+        bool add_watch(int fd, void* self, Callback callback);
+        void remove_watch(int fd);
+        void post(void* self, Task task);
+        void run();
+        void quit();
+        int readiness_fd() const { return _epoll_fd; }
+        int dispatch_pending() { return this->dispatch(0); }
+    };
+    
+    EventLoop_Linux::EventLoop_Linux(int epoll_fd, int wake_fd)
+        : _epoll_fd(epoll_fd), _wake_fd(wake_fd), _quit(false), _dispatch_depth(0) {
+        this->add_watch(_wake_fd, this, EventLoop_Linux::run_posted);
+    }
+    
+    EventLoop_Linux::~EventLoop_Linux() {
+        for (auto it = _watches.begin(); it != _watches.end(); ++ it)
+            delete it->second;
+        for (auto it = _removed_watches.begin(); it != _removed_watches.end(); ++ it)
+            delete *it;
+        close(_wake_fd);
+        close(_epoll_fd);
+    }
+    
+    bool EventLoop_Linux::add_watch(int fd, void* self, Callback callback) {
+        if (_watches.count(fd))
+            return false;
+        
+        Watch* watch = new Watch;
+        watch->fd = fd;
+        watch->self = self;
+        watch->callback = callback;
+        
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = watch;
+        if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            delete watch;
+            return false;
+        }
+        _watches.insert({fd, watch});
+        return true;
+    }
+    
+    void EventLoop_Linux::remove_watch(int fd) {
+        auto it = _watches.find(fd);
+        if (it == _watches.end())
+            return;
+        
+        Watch* watch = it->second;
+        _watches.erase(it);
+        epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        
+        if (_dispatch_depth) {
+            watch->callback = NULL;
+            _removed_watches.push_back(watch);
+        } else {
+            delete watch;
+        }
+    }
+    
+    int EventLoop_Linux::dispatch(int timeout_milliseconds) {
+        epoll_event events[32];
+        int count = epoll_wait(_epoll_fd, events, sizeof(events)/sizeof(*events), timeout_milliseconds);
+        if (count <= 0)
+            return 0;
+        
+        ++ _dispatch_depth;
+        int dispatched = 0;
+        for (int i = 0; i < count; ++ i) {
+            Watch* watch = static_cast<Watch*>(events[i].data.ptr);
+            if (watch->callback) {
+                watch->callback(watch->self, watch->fd);
+                ++ dispatched;
+            }
+        }
+        if (-- _dispatch_depth == 0 && !_removed_watches.empty()) {
+            for (auto it = _removed_watches.begin(); it != _removed_watches.end(); ++ it)
+                delete *it;
+            _removed_watches.clear();
+        }
+        return dispatched;
+    }
+    
+    void EventLoop_Linux::post(void* self, Task task) {
+        {
+            std::lock_guard<std::mutex> lock(_posted_mutex);
+            PostedTask posted = {self, task};
+            _posted.push_back(posted);
+        }
+        uint64_t one = 1;
+        ssize_t written = write(_wake_fd, &one, sizeof(one));
+        (void)written;  // the eventfd can only be full if it is already readable.
+    }
+    
+    void EventLoop_Linux::run_posted(void* self, int fd) {
+        EventLoop_Linux* this_ = static_cast<EventLoop_Linux*>(self);
+        
+        uint64_t count;
+        ssize_t got = read(fd, &count, sizeof(count));
+        (void)got;
+        
+        {
+            std::lock_guard<std::mutex> lock(this_->_posted_mutex);
+            this_->_running.swap(this_->_posted);
+        }
+        // _running is not touched by post(), so a task may post again.
+        for (size_t i = 0; i < this_->_running.size(); ++ i)
+            this_->_running[i].task(this_->_running[i].self);
+        this_->_running.clear();
+    }
+    
+    void EventLoop_Linux::run() {
+        _quit = false;
+        while (!_quit)
+            this->dispatch(-1);
+    }
+    
+    void EventLoop_Linux::quit() {
+        _quit = true;
+    }
+    
+    EventLoop* EventLoop::create() {
+        int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0)
+            throw NoEventloopException();
+        
+        int wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wake_fd < 0) {
+            close(epoll_fd);
+            throw NoEventloopException();
+        }
+        
+        return new EventLoop_Linux(epoll_fd, wake_fd);
+    }
+}
@@ -0,0 +1,121 @@
+/*
+ 
+GamepadC_Linux.cpp ... The C interface on Linux.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "GamepadC_Linux.hpp"
+#include "../EventLoop.hpp"
+#include <poll.h>
+#include <new>
+
+gp_context::gp_context(GP::EventLoop* eventloop, bool owns_eventloop, size_t queue_capacity)
+    : eventloop(eventloop), owns_eventloop(owns_eventloop), observer(NULL), queue(queue_capacity) {
+    observer = GP::GamepadChangedObserver::create(this, gp_context::gamepad_changed, eventloop);
+}
+
+gp_context::~gp_context() {
+    delete observer;
+    if (owns_eventloop)
+        delete eventloop;
+}
+
+void gp_context::gamepad_changed(void* self, GP::Gamepad* gamepad, GP::GamepadState state) {
+    gp_context* context = static_cast<gp_context*>(self);
+    if (state == GP::GamepadState::attached)
+        context->queue.add_gamepad(gamepad);
+    else
+        context->queue.remove_gamepad(gamepad);
+}
+
+// No exception crosses into C: every failure is a NULL, a -1 or a 0.
+extern "C" {
+    uint32_t gp_version(void) {
+        return GP_C_VERSION;
+    }
+    
+    gp_context* gp_create(size_t queue_capacity) {
+        GP::EventLoop* eventloop = NULL;
+        try {
+            eventloop = GP::EventLoop::create();
+            return new gp_context(eventloop, true, queue_capacity);
+        } catch (...) {
+            delete eventloop;
+            return NULL;
+        }
+    }
+    
+    gp_context* gp_create_on_loop(void* eventloop, size_t queue_capacity) {
+        try {
+            return new gp_context(static_cast<GP::EventLoop*>(eventloop), false, queue_capacity);
+        } catch (...) {
+            return NULL;
+        }
+    }
+    
+    void gp_destroy(gp_context* context) {
+        delete context;
+    }
+    
+    int gp_fd(const gp_context* context) {
+        return context->owns_eventloop ? context->eventloop->readiness_fd() : -1;
+    }
+    
+    size_t gp_dispatch(gp_context* context, int timeout_ms) {
+        if (context->owns_eventloop) {
+            pollfd ready = {context->eventloop->readiness_fd(), POLLIN, 0};
+            if (poll(&ready, 1, timeout_ms) > 0)
+                while (context->eventloop->dispatch_pending()) {}
+        }
+        return context->queue.pending();
+    }
+    
+    size_t gp_poll_events(gp_context* context, gp_event* events, size_t capacity) {
+        return context->queue.poll(events, capacity);
+    }
+    
+    void gp_set_event_callback(gp_context* context, gp_event_callback callback, void* user) {
+        context->queue.set_callback(callback, user);
+    }
+    
+    uint64_t gp_dropped_events(const gp_context* context) {
+        return context->queue.dropped();
+    }
+    
+    size_t gp_devices(const gp_context* context, gp_device* devices, size_t capacity) {
+        return context->queue.devices(devices, capacity);
+    }
+    
+    int gp_device_info_of(const gp_context* context, gp_device device, gp_device_info* info) {
+        return context->queue.device_info(device, *info) ? 0 : -1;
+    }
+    
+    int gp_state_of(const gp_context* context, gp_device device, gp_state* state) {
+        return context->queue.state(device, *state) ? 0 : -1;
+    }
+}
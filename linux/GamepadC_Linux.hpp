@@ -0,0 +1,62 @@
+/*
+ 
+GamepadC_Linux.hpp ... The context of the C interface on Linux.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef GAMEPADC_LINUX_HPP_k8d2zq0w5ub7nc1e
+#define GAMEPADC_LINUX_HPP_k8d2zq0w5ub7nc1e 1
+
+#include "../GamepadC.h"
+#include "../GamepadQueue.hpp"
+#include "../GamepadChangedObserver.hpp"
+
+namespace GP {
+    class EventLoop;
+}
+
+// A context queues the gamepads of an observer. C++ code sharing a
+// context with foreign code can add gamepads of its own, such as
+// simulated or replayed ones, to 'queue'.
+struct gp_context {
+    GP::EventLoop* eventloop;
+    bool owns_eventloop;
+    GP::GamepadChangedObserver* observer;
+    GP::GamepadQueue queue;
+    
+    gp_context(GP::EventLoop* eventloop, bool owns_eventloop, size_t queue_capacity);
+    ~gp_context();
+    
+private:
+    gp_context(const gp_context&);
+    gp_context& operator=(const gp_context&);
+    
+    static void gamepad_changed(void* self, GP::Gamepad* gamepad, GP::GamepadState state);
+};
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ 
+GamepadChangedObserver_Linux.cpp ... Implementation of GamepadChangedObserver for Linux.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "GamepadChangedObserver_Linux.hpp"
+#include "Gamepad_Linux.hpp"
+#include "DeviceHub_Linux.hpp"
+#include "../EventLoop.hpp"
+#include "../Exception.hpp"
+
+namespace GP {
+    void GamepadChangedObserver_Linux::observe_impl() {
+        _hub = DeviceHub_Linux::retain(_eventloop);
+        _hub->add_observer(this);
+    }
+    
+    void GamepadChangedObserver_Linux::unobserve_impl() {
+        if (_hub) {
+            _hub->remove_observer(this);
+            _hub->release();
+            _hub = NULL;
+        }
+    }
+    
+    GamepadChangedObserver* GamepadChangedObserver::create_impl(void* self, Callback callback, void* eventloop) {
+        if (!eventloop)
+            throw NoEventloopException();
+        return new GamepadChangedObserver_Linux(self, callback, static_cast<EventLoop*>(eventloop));
+    }
+}
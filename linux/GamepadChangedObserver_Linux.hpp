@@ -0,0 +1,66 @@
+/*
+ 
+GamepadChangedObserver_Linux.hpp ... Observe evdev gamepads being attached and removed.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef GAMEPAD_CHANGED_OBSERVER_LINUX_HPP_fjyvw80ayjy8vjue
+#define GAMEPAD_CHANGED_OBSERVER_LINUX_HPP_fjyvw80ayjy8vjue 1
+
+#include "../GamepadChangedObserver.hpp"
+
+namespace GP {
+    class EventLoop;
+    class DeviceHub_Linux;
+    
+    // The devices are read by the DeviceHub_Linux of the event loop, which
+    // all observers of the loop share. So are the Gamepad objects: with more
+    // than one observer, prefer subscribe() to the set_*_callback() methods,
+    // which only hold one callback per gamepad.
+    class GamepadChangedObserver_Linux : public GamepadChangedObserver {
+    private:
+        EventLoop* _eventloop;
+        DeviceHub_Linux* _hub;
+        
+        friend class DeviceHub_Linux;
+        
+    protected:
+        virtual void observe_impl();
+        void unobserve_impl();
+        
+    public:
+        GamepadChangedObserver_Linux(void* self, Callback callback, EventLoop* eventloop)
+            : GamepadChangedObserver(self, callback), _eventloop(eventloop), _hub(NULL) {}
+        
+        ~GamepadChangedObserver_Linux() {
+            this->unobserve_impl();
+        }
+    };
+}
+
+#endif
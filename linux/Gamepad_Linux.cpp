@@ -0,0 +1,253 @@
+/*
+ 
+Gamepad_Linux.cpp ... Implementation of Gamepad for Linux evdev devices.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Gamepad_Linux.hpp"
+#include "../EventLoop.hpp"
+#include "../Session.hpp"
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+
+namespace GP {
+    static inline bool test_bit(const unsigned long* bits, int bit) {
+        const int bits_per_long = 8 * sizeof(long);
+        return bits[bit / bits_per_long] >> (bit % bits_per_long) & 1;
+    }
+    #define GP_BITS_LONGS(count) (((count) + 8 * sizeof(long) - 1) / (8 * sizeof(long)))
+    
+    bool Gamepad_Linux::is_gamepad(int fd) {
+        unsigned long abs_bits[GP_BITS_LONGS(ABS_CNT)] = {0};
+        unsigned long key_bits[GP_BITS_LONGS(KEY_CNT)] = {0};
+        if (ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs_bits)), abs_bits) < 0)
+            return false;
+        if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(key_bits)), key_bits) < 0)
+            return false;
+        
+        return test_bit(abs_bits, ABS_X) && test_bit(abs_bits, ABS_Y)
+            && (test_bit(key_bits, BTN_TRIGGER) || test_bit(key_bits, BTN_A) || test_bit(key_bits, BTN_1));
+    }
+    
+    Gamepad_Linux::Gamepad_Linux(int fd, EventLoop* eventloop)
+        : Gamepad(), _fd(fd), _eventloop(eventloop), _last_report_time(0), _read_time(0), _monotonic_timestamps(false), _dropped(false), _button_count(0),
+          _session(NULL), _session_device(0),
+          _count_perf_events(false) {
+        for (int i = 0; i < ABS_CNT; ++ i)
+            _axes[i] = Axis::invalid;
+        memset(_buttons, 0, sizeof(_buttons));
+        
+        //## Hats, throttles and the other absolute axes are ignored for now.
+        for (int code = ABS_X; code <= ABS_RZ; ++ code)
+            _axes[code] = static_cast<Axis>(code - ABS_X + static_cast<int>(Axis::X));
+        
+        unsigned long abs_bits[GP_BITS_LONGS(ABS_CNT)] = {0};
+        unsigned long key_bits[GP_BITS_LONGS(KEY_CNT)] = {0};
+        ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs_bits)), abs_bits);
+        ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(key_bits)), key_bits);
+        
+        // Stamp events on the clock of Timer::monotonic_nanoseconds(), so
+        // that the time they waited to be read can be measured.
+        int clock = CLOCK_MONOTONIC;
+        _monotonic_timestamps = ioctl(fd, EVIOCSCLOCKID, &clock) == 0;
+        
+        for (int code = ABS_X; code <= ABS_RZ; ++ code) {
+            input_absinfo info;
+            if (test_bit(abs_bits, code) && ioctl(fd, EVIOCGABS(code), &info) == 0)
+                this->describe_axis(code, info.minimum, info.maximum);
+        }
+        
+        // Number the buttons in the order of their codes, as the HID button
+        // usages would be.
+        for (int code = BTN_MISC; code < KEY_CNT; ++ code)
+            if (test_bit(key_bits, code))
+                this->describe_button(code);
+        _buttons[KEY_MENU] = Button::menu;
+        _buttons[KEY_PLAYPAUSE] = Button::play_pause;
+        _buttons[KEY_VOLUMEUP] = Button::volume_increase;
+        _buttons[KEY_VOLUMEDOWN] = Button::volume_decrease;
+        
+        if (_eventloop)
+            _eventloop->add_watch(_fd, this, Gamepad_Linux::handle_readable);
+    }
+    
+    Gamepad_Linux::~Gamepad_Linux() {
+        if (_eventloop)
+            _eventloop->remove_watch(_fd);
+        if (_fd >= 0)
+            close(_fd);
+    }
+    
+    void Gamepad_Linux::describe_axis(int code, int minimum, int maximum) {
+        if (code >= 0 && code < ABS_CNT && _axes[code] != Axis::invalid)
+            this->set_bounds_for_axis(_axes[code], minimum, maximum);
+    }
+    
+    void Gamepad_Linux::describe_button(int code) {
+        if (code >= 0 && code < KEY_CNT && !static_cast<int>(_buttons[code]))
+            _buttons[code] = static_cast<Button>(++ _button_count);
+    }
+    
+    bool Gamepad_Linux::count_perf_events(bool enable) {
+        bool available = PerfEventGroup::of_this_thread() != NULL;
+        _count_perf_events.store(enable && available, std::memory_order_relaxed);
+        return available;
+    }
+    
+    void Gamepad_Linux::handle_events(const input_event* events, size_t count) {
+        // Button changes are dispatched as they are decoded, so the stages
+        // alternate within a report.
+        bool perf = _count_perf_events.load(std::memory_order_relaxed);
+        if (perf)
+            _perf.switch_to(PerfStage::decode);
+        
+        StatisticsCounters::Reader& counters = this->statistics_counters().reader;
+        unsigned batch = 0;
+        for (size_t i = 0; i < count; ++ i) {
+            if (events[i].type == EV_SYN && events[i].code == SYN_REPORT)
+                ++ batch;
+        }
+        counters.reports_read.add(batch);
+        counters.queue_high_water.raise_to(batch);
+        
+        size_t report_begin = 0;
+        for (size_t i = 0; i < count; ++ i) {
+            const input_event& event = events[i];
+            
+            if (event.type == EV_SYN) {
+                if (event.code == SYN_DROPPED) {
+                    _dropped = true;
+                    counters.dropped_reports.add();
+                } else if (event.code == SYN_REPORT) {
+                    if (_dropped) {
+                        _dropped = false;
+                        this->resynchronize();
+                    }
+                    
+                    uint64_t time = static_cast<uint64_t>(event.input_event_sec) * 1000000000 + event.input_event_usec * 1000;
+                    // saturated, as idle_timer_fired() does, for reports over 4.29 s apart.
+                    unsigned nanoseconds_elapsed = _last_report_time ? static_cast<unsigned>(std::min<uint64_t>(time - _last_report_time, ~0u)) : 0;
+                    _last_report_time = time;
+                    
+                    if (_monotonic_timestamps)
+                        this->stamp_latency(LatencyStamp::arrived, time);
+                    if (_read_time)
+                        this->stamp_latency(LatencyStamp::read_returned, _read_time);
+                    uint64_t now = Timer::monotonic_nanoseconds();
+                    this->stamp_latency(LatencyStamp::decoded, now);
+                    FlightRecorder::instance().record(FlightEvent::decode, this, i + 1 - report_begin, now);
+                    report_begin = i + 1;
+                    
+                    if (perf)
+                        _perf.switch_to(PerfStage::dispatch);
+                    this->handle_axes_change(nanoseconds_elapsed);
+                    this->handle_frame(nanoseconds_elapsed);
+                    if (perf)
+                        _perf.switch_to(PerfStage::decode);
+                }
+            } else if (_dropped) {
+                // the kernel asks to ignore everything up to the next report.
+                continue;
+            } else if (event.type == EV_ABS) {
+                if (event.code < ABS_CNT)
+                    this->set_axis_value(_axes[event.code], event.value);
+            } else if (event.type == EV_KEY) {
+                // a value of 2 is auto-repeat.
+                if (event.code < KEY_CNT && static_cast<int>(_buttons[event.code]) && event.value != 2) {
+                    if (perf)
+                        _perf.switch_to(PerfStage::dispatch);
+                    this->handle_button_change(_buttons[event.code], event.value != 0);
+                    if (perf)
+                        _perf.switch_to(PerfStage::decode);
+                }
+            }
+        }
+        
+        if (perf)
+            _perf.stop();
+    }
+    
+    // Read the current state back after the kernel dropped events.
+    void Gamepad_Linux::resynchronize() {
+        if (_fd < 0)
+            return;
+        
+        for (int code = ABS_X; code <= ABS_RZ; ++ code) {
+            input_absinfo info;
+            if (ioctl(_fd, EVIOCGABS(code), &info) == 0)
+                this->set_axis_value(_axes[code], info.value);
+        }
+        
+        unsigned long key_bits[GP_BITS_LONGS(KEY_CNT)] = {0};
+        if (ioctl(_fd, EVIOCGKEY(sizeof(key_bits)), key_bits) < 0)
+            return;
+        const ButtonSet& held = this->last_frame().held;
+        for (int code = 0; code < KEY_CNT; ++ code) {
+            Button button = _buttons[code];
+            if (static_cast<int>(button) && test_bit(key_bits, code) != held.contains(button))
+                this->handle_button_change(button, test_bit(key_bits, code));
+        }
+    }
+    
+    void Gamepad_Linux::handle_readable(void* self, int fd) {
+        Gamepad_Linux* this_ = static_cast<Gamepad_Linux*>(self);
+        
+        input_event events[64];
+        ssize_t size;
+        do {
+            uint64_t start = Timer::monotonic_nanoseconds();
+            size = read(fd, events, sizeof(events));
+            if (size > 0) {
+                this_->_read_time = Timer::monotonic_nanoseconds();
+                FlightRecorder::instance().record(FlightEvent::read, this_, size, start, this_->_read_time - start);
+                StatisticsCounters::Reader& counters = this_->statistics_counters().reader;
+                counters.bytes_read.add(size);
+                if (size % sizeof(*events))
+                    counters.short_reads.add();
+                if (this_->_session)
+                    this_->_session->record_raw(this_->_session_device, events, size, this_->_read_time);
+                this_->handle_events(events, size / sizeof(*events));
+                this_->_read_time = 0;
+            }
+        } while (size == sizeof(events));
+        
+        // the device is gone, or the pipe or socket standing in for it was
+        // closed. The observer deletes the gamepad once the node is removed;
+        // until then, stop polling it, as the fd stays readable.
+        if (size == 0 || (size < 0 && errno == ENODEV)) {
+            this_->_eventloop->remove_watch(fd);
+            this_->_eventloop = NULL;
+        }
+    }
+    
+    #undef GP_BITS_LONGS
+}
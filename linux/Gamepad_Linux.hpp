@@ -0,0 +1,101 @@
+/*
+ 
+Gamepad_Linux.hpp ... Gamepad reading a Linux evdev device.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef GAMEPAD_LINUX_HPP_qkza00ns2uj0fjoa
+#define GAMEPAD_LINUX_HPP_qkza00ns2uj0fjoa 1
+
+#include "../Gamepad.hpp"
+#include "PerfCounters_Linux.hpp"
+#include <linux/input.h>
+#include <stddef.h>
+
+namespace GP {
+    class EventLoop;
+    class SessionWriter;
+    
+    class Gamepad_Linux : public Gamepad {
+    private:
+        int _fd;
+        EventLoop* _eventloop;
+        uint64_t _last_report_time;
+        uint64_t _read_time;
+        bool _monotonic_timestamps;
+        bool _dropped;
+        int _button_count;
+        
+        SessionWriter* _session;
+        int _session_device;
+        
+        std::atomic<bool> _count_perf_events;
+        PerfStageCounters _perf;
+        
+        // The axis and the button of each evdev code, or Axis::invalid and 0.
+        Axis _axes[ABS_CNT];
+        Button _buttons[KEY_CNT];
+        
+        void resynchronize();
+        static void handle_readable(void* self, int fd);
+        
+    public:
+        // Take ownership of an open evdev fd. Without an event loop, the
+        // device is not read, and events have to be fed to handle_events().
+        Gamepad_Linux(int fd, EventLoop* eventloop);
+        ~Gamepad_Linux();
+        
+        // Decode evdev events, as read from the device.
+        void handle_events(const input_event* events, size_t count);
+        
+        // Count the cycles, instructions, cache and branch misses of the
+        // thread reading the device, in decoding and in dispatching apart.
+        // Return false if perf events are restricted or missing; then
+        // nothing is counted, and reports cost no more than before.
+        bool count_perf_events(bool enable);
+        PerfCounts perf_counts(PerfStage stage) const { return _perf.counts(stage); }
+        
+        // Record the events read from the device to 'writer', as the device
+        // 'device' of its session, or stop with NULL. Call it on the thread
+        // reading the device.
+        void record_reports(SessionWriter* writer, int device) { _session = writer; _session_device = device; }
+        
+        // Describe a device which answers no ioctl, such as a pipe standing in
+        // for one: the bounds of an absolute axis, the next button, and the
+        // clock its events are stamped on, as the constructor would learn
+        // them from the driver.
+        void describe_axis(int code, int minimum, int maximum);
+        void describe_button(int code);
+        void describe_monotonic_timestamps() { _monotonic_timestamps = true; }
+        
+        // Whether the device looks like a joystick or gamepad, as SDL decides.
+        static bool is_gamepad(int fd);
+    };
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ 
+MappedFile_Linux.hpp ... A file mapped read-only into memory.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef MAPPED_FILE_LINUX_HPP_6eub7wc4a7jdubmh
+#define MAPPED_FILE_LINUX_HPP_6eub7wc4a7jdubmh 1
+
+#include <stddef.h>
+
+namespace GP {
+    // Maps a whole file read-only, such as a session for SessionReader, so
+    // that its pages are read on demand and never copied.
+    class MappedFile_Linux {
+    private:
+        const void* _data;
+        size_t _size;
+        
+        MappedFile_Linux(const MappedFile_Linux&);
+        MappedFile_Linux& operator=(const MappedFile_Linux&);
+        
+    public:
+        // Throw SessionFileException if the file cannot be mapped.
+        explicit MappedFile_Linux(const char* path);
+        ~MappedFile_Linux();
+        
+        const void* data() const { return _data; }
+        size_t size() const { return _size; }
+    };
+}
+
+#endif
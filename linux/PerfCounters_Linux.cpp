@@ -0,0 +1,150 @@
+/*
+ 
+PerfCounters_Linux.cpp ... Hardware counters of the decode and dispatch stages, from perf events.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "PerfCounters_Linux.hpp"
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+
+namespace GP {
+    static int open_counter(PerfCounter counter, int group_fd) {
+        static const uint64_t configs[] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES
+        };
+        
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[static_cast<int>(counter)];
+        attr.read_format = PERF_FORMAT_GROUP;
+        // counting the kernel needs perf_event_paranoid below 2.
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // this thread, on any cpu.
+        return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+    }
+    
+    PerfEventGroup::PerfEventGroup() : _opened(0) {
+        // The first counter which opens leads the group. A virtual machine
+        // may lack some, which are then left out.
+        int leader = -1;
+        for (int i = 0; i < kCounters; ++ i) {
+            _fds[i] = open_counter(static_cast<PerfCounter>(i), leader);
+            _positions[i] = _fds[i] < 0 ? -1 : _opened ++;
+            if (leader < 0)
+                leader = _fds[i];
+        }
+    }
+    
+    PerfEventGroup::~PerfEventGroup() {
+        for (int i = 0; i < kCounters; ++ i)
+            if (_fds[i] >= 0)
+                close(_fds[i]);
+    }
+    
+    namespace {
+        struct ThreadGroup {
+            bool opened;
+            PerfEventGroup* group;
+            ~ThreadGroup() { delete group; }
+        };
+        thread_local ThreadGroup thread_group = {false, NULL};
+    }
+    
+    PerfEventGroup* PerfEventGroup::of_this_thread() {
+        if (!thread_group.opened) {
+            thread_group.opened = true;
+            PerfEventGroup* group = new PerfEventGroup();
+            if (group->_opened)
+                thread_group.group = group;
+            else
+                delete group;
+        }
+        return thread_group.group;
+    }
+    
+    unsigned PerfEventGroup::available() const {
+        unsigned retval = 0;
+        for (int i = 0; i < kCounters; ++ i)
+            if (_positions[i] >= 0)
+                retval |= 1u << i;
+        return retval;
+    }
+    
+    bool PerfEventGroup::read(uint64_t values[kCounters]) const {
+        // the number of counters, and their values in the order opened.
+        uint64_t buffer[1 + kCounters];
+        int leader = 0;
+        while (_fds[leader] < 0)
+            ++ leader;
+        ssize_t size = ::read(_fds[leader], buffer, sizeof(buffer));
+        if (size < static_cast<ssize_t>(sizeof(uint64_t) * (1 + _opened)) || buffer[0] != static_cast<uint64_t>(_opened))
+            return false;
+        for (int i = 0; i < kCounters; ++ i)
+            values[i] = _positions[i] < 0 ? 0 : buffer[1 + _positions[i]];
+        return true;
+    }
+    
+    void PerfStageCounters::switch_to(int stage) {
+        PerfEventGroup* group = PerfEventGroup::of_this_thread();
+        uint64_t values[kCounters];
+        if (!group || !group->read(values)) {
+            _stage = -1;
+            return;
+        }
+        
+        if (_stage >= 0) {
+            Stage& running = _stages[_stage];
+            for (int i = 0; i < kCounters; ++ i)
+                running.values[i].add(values[i] - _last[i]);
+        }
+        if (stage >= 0)
+            _stages[stage].samples.add();
+        memcpy(_last, values, sizeof(_last));
+        _stage = stage;
+        _available.store(group->available(), std::memory_order_relaxed);
+    }
+    
+    PerfCounts PerfStageCounters::counts(PerfStage stage) const {
+        PerfCounts retval;
+        const Stage& counted = _stages[static_cast<int>(stage)];
+        retval.samples = counted.samples.get();
+        for (int i = 0; i < kCounters; ++ i)
+            retval.values[i] = counted.values[i].get();
+        retval.available = _available.load(std::memory_order_relaxed);
+        return retval;
+    }
+}
@@ -0,0 +1,127 @@
+/*
+ 
+PerfCounters_Linux.hpp ... Hardware counters of the decode and dispatch stages, from perf events.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef PERFCOUNTERS_LINUX_HPP_894udc9w73xn0w03
+#define PERFCOUNTERS_LINUX_HPP_894udc9w73xn0w03 1
+
+#include "../Compatibility.hpp"
+#include "../Statistics.hpp"
+#include <stdint.h>
+#include <atomic>
+
+namespace GP {
+    ENUM_CLASS PerfStage {
+        decode,                 // from the evdev events to the axis values.
+        dispatch,               // the callbacks, of the buttons and the report.
+        stage_count
+    };
+    
+    ENUM_CLASS PerfCounter {
+        cycles,
+        instructions,
+        cache_misses,
+        branch_misses,
+        counter_count
+    };
+    
+    /// What the hardware counted in a stage, in user space only.
+    struct PerfCounts {
+        uint64_t samples;       // times the stage was entered.
+        uint64_t values[static_cast<int>(PerfCounter::counter_count)];
+        unsigned available;     // bit i is set if values[i] was counted.
+    };
+    
+    /// The counters of one thread, as a perf event group read at once.
+    /// Opened the first time a thread samples, and closed when it exits.
+    class PerfEventGroup {
+    public:
+        enum { kCounters = static_cast<int>(PerfCounter::counter_count) };
+        
+    private:
+        int _fds[kCounters];
+        // The index of each opened counter in a group read.
+        int _positions[kCounters];
+        int _opened;
+        
+        PerfEventGroup();
+        PerfEventGroup(const PerfEventGroup&);
+        PerfEventGroup& operator=(const PerfEventGroup&);
+        
+    public:
+        ~PerfEventGroup();
+        
+        /// The group of the calling thread, or NULL if perf events are
+        /// restricted, by perf_event_paranoid or a sandbox, or missing.
+        static PerfEventGroup* of_this_thread();
+        
+        /// The counters which could be opened, as PerfCounts::available.
+        unsigned available() const;
+        
+        /// Read the counters. Those not available read 0.
+        bool read(uint64_t values[kCounters]) const;
+    };
+    
+    /// Attributes the counters of the dispatching thread to the stages of the
+    /// reports of one device. Each switch costs a read() of the group, about
+    /// a microsecond, so it is only done when enabled.
+    class PerfStageCounters {
+    private:
+        enum {
+            kStages = static_cast<int>(PerfStage::stage_count),
+            kCounters = PerfEventGroup::kCounters
+        };
+        
+        struct Stage {
+            Counter samples;
+            Counter values[kCounters];
+        };
+        Stage _stages[kStages];
+        
+        // Which counters the group of the dispatching thread has.
+        std::atomic<unsigned> _available;
+        int _stage;             // the stage running, or -1.
+        uint64_t _last[kCounters];
+        
+        void switch_to(int stage);
+        
+    public:
+        PerfStageCounters() : _available(0), _stage(-1) {}
+        
+        /// Charge the counts of the calling thread since the last switch to
+        /// the stage running, and run 'stage'. Only one thread may switch.
+        void switch_to(PerfStage stage) { this->switch_to(static_cast<int>(stage)); }
+        void stop() { this->switch_to(-1); }
+        
+        PerfCounts counts(PerfStage stage) const;
+    };
+}
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ 
+SharedState_Linux.cpp ... Shares the state of gamepads through POSIX shared memory or a memfd.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "SharedState_Linux.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+
+namespace GP {
+    SharedStatePublisher_Linux::SharedStatePublisher_Linux(int fd, void* memory, size_t size, int slot_count, int event_capacity, const char* name)
+        : SharedStatePublisher(memory, slot_count, event_capacity), _fd(fd), _memory(memory), _size(size), _name(name ? name : "") {
+    }
+    
+    SharedStatePublisher_Linux* SharedStatePublisher_Linux::create(const char* name, int slot_count, int event_capacity) {
+        if (slot_count <= 0 || slot_count > 0xffff || event_capacity <= 0 || event_capacity > (1 << 24))
+            throw SharedStateException();
+        int capacity = 1;
+        while (capacity < event_capacity)
+            capacity *= 2;
+        size_t size = SharedStatePublisher::size_for(slot_count, capacity);
+        
+        // readers of a segment left by a dead publisher keep it; new ones
+        // get a new one.
+        int fd;
+        if (name) {
+            shm_unlink(name);
+            fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        } else
+            fd = memfd_create("gamepad-state", MFD_CLOEXEC);
+        if (fd < 0)
+            throw SharedStateException();
+        void* memory = ftruncate(fd, size) == 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        if (memory == MAP_FAILED) {
+            close(fd);
+            if (name)
+                shm_unlink(name);
+            throw SharedStateException();
+        }
+        return new SharedStatePublisher_Linux(fd, memory, size, slot_count, capacity, name);
+    }
+    
+    SharedStatePublisher_Linux::~SharedStatePublisher_Linux() {
+        // the gamepads detach while the memory is still mapped.
+        this->remove_gamepads();
+        munmap(_memory, _size);
+        close(_fd);
+        if (!_name.empty())
+            shm_unlink(_name.c_str());
+    }
+    
+    void SharedStatePublisher_Linux::notify() {
+        SharedStateHeader* header = static_cast<SharedStateHeader*>(_memory);
+        syscall(SYS_futex, &header->changes, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+    
+    SharedStateReader_Linux::SharedStateReader_Linux(const void* memory, size_t size, void* header_page, size_t page_size)
+        : SharedStateReader(memory, size), _memory(memory), _size(size), _header_page(header_page), _page_size(page_size) {
+    }
+    
+    SharedStateReader_Linux* SharedStateReader_Linux::map(int fd, bool writable) {
+        struct stat status;
+        if (fstat(fd, &status) != 0 || status.st_size <= 0)
+            throw SharedStateException();
+        void* memory = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED)
+            throw SharedStateException();
+        // the header is within the first page.
+        size_t page_size = sysconf(_SC_PAGESIZE);
+        void* header_page = writable ? mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        if (header_page == MAP_FAILED)
+            header_page = NULL;
+        try {
+            return new SharedStateReader_Linux(memory, status.st_size, header_page, page_size);
+        } catch (...) {
+            munmap(memory, status.st_size);
+            if (header_page)
+                munmap(header_page, page_size);
+            throw;
+        }
+    }
+    
+    SharedStateReader_Linux* SharedStateReader_Linux::open(const char* name) {
+        bool writable = true;
+        int fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+        if (fd < 0 && errno == EACCES) {
+            writable = false;
+            fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+        }
+        if (fd < 0)
+            throw SharedStateException();
+        try {
+            SharedStateReader_Linux* reader = map(fd, writable);
+            close(fd);
+            return reader;
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+    }
+    
+    SharedStateReader_Linux* SharedStateReader_Linux::open_fd(int fd) {
+        int flags = fcntl(fd, F_GETFL);
+        return map(fd, flags >= 0 && (flags & O_ACCMODE) == O_RDWR);
+    }
+    
+    SharedStateReader_Linux::~SharedStateReader_Linux() {
+        munmap(const_cast<void*>(_memory), _size);
+        if (_header_page)
+            munmap(_header_page, _page_size);
+    }
+    
+    bool SharedStateReader_Linux::wait(uint32_t seen, int milliseconds) const {
+        // a shared futex: the publisher is another process.
+        std::atomic<uint32_t>* changes = const_cast<std::atomic<uint32_t>*>(&this->header()->changes);
+        std::atomic<uint32_t>* waiters = _header_page ? &static_cast<SharedStateHeader*>(_header_page)->waiters : NULL;
+        uint64_t deadline = milliseconds < 0 ? 0 : Timer::monotonic_nanoseconds() + uint64_t(milliseconds) * 1000000;
+        if (waiters)
+            waiters->fetch_add(1, std::memory_order_seq_cst);
+        bool changed = true;
+        while (this->changes() == seen) {
+            timespec timeout = {0, 0};
+            if (milliseconds >= 0) {
+                uint64_t now = Timer::monotonic_nanoseconds();
+                if (now >= deadline) {
+                    changed = false;
+                    break;
+                }
+                timeout.tv_sec = (deadline - now) / 1000000000;
+                timeout.tv_nsec = (deadline - now) % 1000000000;
+            }
+            // not counted in the waiters, so not woken: poll every millisecond.
+            if (!waiters) {
+                if (milliseconds < 0 || timeout.tv_sec || timeout.tv_nsec > 1000000) {
+                    timeout.tv_sec = 0;
+                    timeout.tv_nsec = 1000000;
+                }
+                nanosleep(&timeout, NULL);
+                continue;
+            }
+            if (syscall(SYS_futex, changes, FUTEX_WAIT, seen, milliseconds < 0 ? NULL : &timeout, NULL, 0) != 0
+             && errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT) {
+                changed = this->changes() != seen;
+                break;
+            }
+        }
+        if (waiters)
+            waiters->fetch_sub(1, std::memory_order_relaxed);
+        return changed;
+    }
+}
@@ -0,0 +1,93 @@
+/*
+ 
+SharedState_Linux.hpp ... Shares the state of gamepads through POSIX shared memory or a memfd.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef SHAREDSTATE_LINUX_HPP_n5x0k2hc8wq1yd7m
+#define SHAREDSTATE_LINUX_HPP_n5x0k2hc8wq1yd7m 1
+
+#include "../SharedState.hpp"
+#include <string>
+
+namespace GP {
+    // A shared state is named "/<name>", as for shm_open(), or is an
+    // anonymous memfd when the name is NULL: pass its fd() to the readers,
+    // by fork() or over a Unix domain socket.
+    
+    // Publishes to every reader; a publication costs a FUTEX_WAKE only
+    // while a reader waits.
+    class SharedStatePublisher_Linux : public SharedStatePublisher {
+    private:
+        int _fd;
+        void* _memory;
+        size_t _size;
+        std::string _name;      // unlinked at the end.
+        
+        SharedStatePublisher_Linux(int fd, void* memory, size_t size, int slot_count, int event_capacity, const char* name);
+        
+    protected:
+        void notify();
+        
+    public:
+        // Throw SharedStateException if the segment cannot be created. The
+        // capacity is rounded up to a power of two.
+        static SharedStatePublisher_Linux* create(const char* name, int slot_count = 16, int event_capacity = 4096);
+        ~SharedStatePublisher_Linux();
+        
+        int fd() const { return _fd; }
+    };
+    
+    // Maps a shared state read-only, and the page of its header read-write
+    // too, to count itself in the waiters. A reader that may not write the
+    // segment polls it instead of waiting on the futex.
+    class SharedStateReader_Linux : public SharedStateReader {
+    private:
+        const void* _memory;
+        size_t _size;
+        void* _header_page;     // NULL if the segment is not writable.
+        size_t _page_size;
+        
+        SharedStateReader_Linux(const void* memory, size_t size, void* header_page, size_t page_size);
+        static SharedStateReader_Linux* map(int fd, bool writable);
+        
+    public:
+        // Throw SharedStateException if there is no such segment, and
+        // SharedStateFormatException if it holds no shared state.
+        static SharedStateReader_Linux* open(const char* name);
+        // The mapping does not keep 'fd'; close it when you like.
+        static SharedStateReader_Linux* open_fd(int fd);
+        ~SharedStateReader_Linux();
+        
+        // Sleep until changes() is no longer 'seen', or 'milliseconds' pass
+        // (-1 for ever), and return whether it changed.
+        bool wait(uint32_t seen, int milliseconds) const;
+    };
+}
+
+#endif
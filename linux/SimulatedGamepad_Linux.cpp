@@ -0,0 +1,108 @@
+/*
+ 
+SimulatedGamepad_Linux.cpp ... Implementation of SimulatedGamepad for Linux keyboards and mice.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "SimulatedGamepad_Linux.hpp"
+#include "../EventLoop.hpp"
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+namespace GP {
+    SimulatedGamepad_Linux::SimulatedGamepad_Linux(EventLoop* eventloop) : SimulatedGamepad(), _eventloop(eventloop) {
+        static const int keys[] = {KEY_W, KEY_E, KEY_A, KEY_D, KEY_Z, KEY_X, KEY_S, KEY_SPACE, BTN_LEFT, BTN_RIGHT};
+        for (size_t i = 0; i < sizeof(keys) / sizeof(*keys); ++ i)
+            this->map_key_to_button(keys[i], static_cast<Button>(i + 1));
+        this->map_pointer_to_axis(PointerAxis::horizontal, Axis::X, 2000);
+        this->map_pointer_to_axis(PointerAxis::vertical, Axis::Y, 2000);
+        this->map_pointer_to_axis(PointerAxis::wheel, Axis::Z, 20);
+    }
+    
+    SimulatedGamepad_Linux::~SimulatedGamepad_Linux() {
+        for (auto it = _fds.begin(); it != _fds.end(); ++ it) {
+            if (_eventloop)
+                _eventloop->remove_watch(*it);
+            close(*it);
+        }
+    }
+    
+    void SimulatedGamepad_Linux::add_device(int fd) {
+        int clock = CLOCK_MONOTONIC;
+        ioctl(fd, EVIOCSCLOCKID, &clock);
+        _fds.push_back(fd);
+        if (_eventloop)
+            _eventloop->add_watch(fd, this, SimulatedGamepad_Linux::handle_readable);
+    }
+    
+    void SimulatedGamepad_Linux::handle_events(const input_event* events, size_t count) {
+        for (size_t i = 0; i < count; ++ i) {
+            const input_event& event = events[i];
+            uint64_t timestamp = uint64_t(event.time.tv_sec) * 1000000000 + uint64_t(event.time.tv_usec) * 1000;
+            
+            switch (event.type) {
+                case EV_KEY:
+                    if (event.value != 2)
+                        this->handle_key(event.code, event.value != 0, timestamp);
+                    break;
+                case EV_REL:
+                    if (event.code == REL_X)
+                        this->handle_motion(PointerAxis::horizontal, event.value, timestamp);
+                    else if (event.code == REL_Y)
+                        this->handle_motion(PointerAxis::vertical, event.value, timestamp);
+                    else if (event.code == REL_WHEEL)
+                        this->handle_motion(PointerAxis::wheel, event.value, timestamp);
+                    break;
+                case EV_SYN:
+                    if (event.code == SYN_REPORT)
+                        this->end_report(timestamp);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    
+    void SimulatedGamepad_Linux::handle_readable(void* self, int fd) {
+        SimulatedGamepad_Linux* this_ = static_cast<SimulatedGamepad_Linux*>(self);
+        
+        input_event events[64];
+        ssize_t size;
+        do {
+            size = read(fd, events, sizeof(events));
+            if (size > 0)
+                this_->handle_events(events, size / sizeof(*events));
+        } while (size == sizeof(events));
+        
+        // the device is gone; stop polling it.
+        if (size < 0 && errno == ENODEV)
+            this_->_eventloop->remove_watch(fd);
+    }
+}
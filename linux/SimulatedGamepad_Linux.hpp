@@ -0,0 +1,76 @@
+/*
+ 
+SimulatedGamepad_Linux.hpp ... A gamepad simulated from Linux keyboards and mice.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef SIMULATED_GAMEPAD_LINUX_HPP_7fzzwjs7jzmn9dyn
+#define SIMULATED_GAMEPAD_LINUX_HPP_7fzzwjs7jzmn9dyn 1
+
+#include "../SimulatedGamepad.hpp"
+#include <linux/input.h>
+#include <stddef.h>
+#include <vector>
+
+namespace GP {
+    class EventLoop;
+    
+    // A SimulatedGamepad reading keyboard and mouse evdev devices, or fed
+    // the events of a recording. By default W, E, A, D, Z, X, S and space
+    // press buttons 1 to 8 and the left and right mouse buttons 9 and 10, as
+    // on Windows; the mouse moves X and Y at full deflection at 2000 counts
+    // per second, and the wheel Z at 20 notches per second. Key codes are
+    // the KEY_ and BTN_ codes of evdev.
+    class SimulatedGamepad_Linux : public SimulatedGamepad {
+    private:
+        EventLoop* _eventloop;
+        std::vector<int> _fds;
+        
+        static void handle_readable(void* self, int fd);
+        
+        SimulatedGamepad_Linux(const SimulatedGamepad_Linux&);
+        SimulatedGamepad_Linux& operator=(const SimulatedGamepad_Linux&);
+        
+    public:
+        // Without an event loop, devices are not read, and events have to be
+        // fed to handle_events().
+        explicit SimulatedGamepad_Linux(EventLoop* eventloop);
+        ~SimulatedGamepad_Linux();
+        
+        // Take ownership of an open keyboard or mouse evdev fd. Its events
+        // are stamped on the clock of Timer::monotonic_nanoseconds(), which
+        // advance_to() is then to be given.
+        void add_device(int fd);
+        
+        // Handle evdev events, as read from a device or recorded; a report
+        // is dispatched at each SYN_REPORT. Key repeats are ignored.
+        void handle_events(const input_event* events, size_t count);
+    };
+}
+
+#endif
@@ -0,0 +1,296 @@
+/*
+ 
+Stream_Linux.cpp ... Streaming of gamepad events over Unix domain and UDP sockets.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Stream_Linux.hpp"
+#include "../EventLoop.hpp"
+#include "../Exception.hpp"
+#include "../Timer.hpp"
+#include <sys/eventfd.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <cstdlib>
+
+namespace GP {
+    // Datagrams are far smaller; a larger one is cut, and fails to decode.
+    static const size_t kMaxDatagram = 65536;
+    // Retransmissions and timeouts are checked this often while anything
+    // is unacknowledged.
+    static const int kTickMilliseconds = 10;
+    static const int kHelloMilliseconds = 100;
+    
+    // Fill 'address' from "unix:<path>", "unix:@<name>" or "udp:<host>:<port>",
+    // and return the socket type's domain, or -1.
+    static int parse_address(const char* text, sockaddr_storage& address, socklen_t& size, std::string& path) {
+        memset(&address, 0, sizeof(address));
+        if (!strncmp(text, "unix:", 5)) {
+            const char* name = text + 5;
+            sockaddr_un* un = reinterpret_cast<sockaddr_un*>(&address);
+            size_t length = strlen(name);
+            if (!length || length >= sizeof(un->sun_path))
+                return -1;
+            un->sun_family = AF_UNIX;
+            memcpy(un->sun_path, name, length);
+            if (name[0] == '@')
+                un->sun_path[0] = '\0';
+            else
+                path = name;
+            size = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + length + (name[0] != '@'));
+            return AF_UNIX;
+        }
+        if (!strncmp(text, "udp:", 4)) {
+            const char* host = text + 4;
+            const char* colon = strrchr(host, ':');
+            if (!colon)
+                return -1;
+            std::string name(host, colon);
+            sockaddr_in* in = reinterpret_cast<sockaddr_in*>(&address);
+            in->sin_family = AF_INET;
+            in->sin_port = htons(static_cast<uint16_t>(atoi(colon + 1)));
+            if (inet_pton(AF_INET, name == "localhost" ? "127.0.0.1" : name.c_str(), &in->sin_addr) != 1)
+                return -1;
+            size = sizeof(sockaddr_in);
+            return AF_INET;
+        }
+        return -1;
+    }
+    
+    //-------------------------------------------------------------------------
+    
+    StreamServer_Linux::StreamServer_Linux(EventLoop* eventloop, int fd, const std::string& path)
+        : _eventloop(eventloop), _fd(fd), _flush_scheduled(false), _path(path), _buffer(kMaxDatagram) {
+        _flush_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        _eventloop->add_watch(_fd, this, StreamServer_Linux::handle_readable);
+        _eventloop->add_watch(_flush_fd, this, StreamServer_Linux::handle_flush);
+        _timer = Timer::create(this, StreamServer_Linux::timer_fired, kTickMilliseconds, eventloop);
+        _timer->stop();
+    }
+    
+    StreamServer_Linux* StreamServer_Linux::create(const char* text, EventLoop* eventloop) {
+        sockaddr_storage address;
+        socklen_t size;
+        std::string path;
+        int domain = parse_address(text, address, size, path);
+        if (domain < 0)
+            throw StreamSocketException();
+        
+        int fd = socket(domain, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            throw StreamSocketException();
+        // a socket left behind by a server gone is taken over.
+        if (!path.empty())
+            unlink(path.c_str());
+        if (bind(fd, reinterpret_cast<sockaddr*>(&address), size) != 0) {
+            close(fd);
+            throw StreamSocketException();
+        }
+        return new StreamServer_Linux(eventloop, fd, path);
+    }
+    
+    StreamServer_Linux::~StreamServer_Linux() {
+        delete _timer;
+        _eventloop->remove_watch(_flush_fd);
+        _eventloop->remove_watch(_fd);
+        close(_flush_fd);
+        close(_fd);
+        if (!_path.empty())
+            unlink(_path.c_str());
+    }
+    
+    int StreamServer_Linux::subscriber_at(const sockaddr_storage& address, socklen_t size) const {
+        for (size_t i = 0; i < _addresses.size(); ++ i)
+            if (_addresses[i].second == size && !memcmp(&_addresses[i].first, &address, size) && this->subscribed(static_cast<int>(i)))
+                return static_cast<int>(i);
+        return -1;
+    }
+    
+    void StreamServer_Linux::handle_readable(void* self, int fd) {
+        StreamServer_Linux* this_ = static_cast<StreamServer_Linux*>(self);
+        while (true) {
+            sockaddr_storage address;
+            memset(&address, 0, sizeof(address));
+            socklen_t size = sizeof(address);
+            ssize_t length = recvfrom(fd, this_->_buffer.data(), this_->_buffer.size(), 0, reinterpret_cast<sockaddr*>(&address), &size);
+            if (length <= 0)
+                break;
+            
+            int subscriber = this_->subscriber_at(address, size);
+            switch (static_cast<StreamDatagram>(this_->_buffer[0])) {
+                case StreamDatagram::hello: {
+                    // a subscriber of another version could not decode us.
+                    const uint8_t* p = this_->_buffer.data() + 1;
+                    uint64_t version;
+                    if (!SessionEncoding::get_varint(p, this_->_buffer.data() + length, version) || version != StreamEncoding::kVersion)
+                        break;
+                    // a hello again is answered by what is not acknowledged.
+                    if (subscriber < 0) {
+                        subscriber = this_->add_subscriber();
+                        if (size_t(subscriber) >= this_->_addresses.size())
+                            this_->_addresses.resize(subscriber + 1);
+                        this_->_addresses[subscriber] = std::make_pair(address, size);
+                    }
+                    // answered even with nothing to send, to be connected.
+                    if (!this_->statistics(subscriber).datagrams) {
+                        uint8_t welcome[] = {static_cast<uint8_t>(StreamDatagram::events), 0};
+                        this_->send_datagram(subscriber, welcome, sizeof(welcome));
+                    }
+                    break;
+                }
+                case StreamDatagram::bye:
+                    if (subscriber >= 0)
+                        this_->remove_subscriber(subscriber);
+                    break;
+                case StreamDatagram::ack:
+                    if (subscriber >= 0)
+                        this_->handle_datagram(subscriber, this_->_buffer.data(), length);
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (this_->tick() && !this_->_timer->running())
+            this_->_timer->restart();
+    }
+    
+    void StreamServer_Linux::handle_flush(void* self, int fd) {
+        StreamServer_Linux* this_ = static_cast<StreamServer_Linux*>(self);
+        uint64_t count;
+        if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+            return;
+        this_->_flush_scheduled = false;
+        this_->flush();
+        if (!this_->_timer->running())
+            this_->_timer->restart();
+    }
+    
+    void StreamServer_Linux::timer_fired(void* self, Timer* timer) {
+        StreamServer_Linux* this_ = static_cast<StreamServer_Linux*>(self);
+        if (!this_->tick())
+            timer->stop();
+    }
+    
+    bool StreamServer_Linux::send_datagram(int subscriber, const uint8_t* bytes, size_t size) {
+        const std::pair<sockaddr_storage, socklen_t>& address = _addresses[subscriber];
+        if (sendto(_fd, bytes, size, MSG_DONTWAIT | MSG_NOSIGNAL, reinterpret_cast<const sockaddr*>(&address.first), address.second) >= 0)
+            return true;
+        // the subscriber's socket is gone: it left without a bye.
+        if (errno == ECONNREFUSED || errno == ENOENT)
+            this->remove_subscriber(subscriber);
+        return false;
+    }
+    
+    void StreamServer_Linux::schedule_flush() {
+        if (_flush_scheduled)
+            return;
+        _flush_scheduled = true;
+        uint64_t one = 1;
+        if (write(_flush_fd, &one, sizeof(one)) < 0)
+            _flush_scheduled = false;
+    }
+    
+    void StreamServer_Linux::subscriber_removed(int subscriber) {
+        memset(&_addresses[subscriber].first, 0, sizeof(_addresses[subscriber].first));
+        _addresses[subscriber].second = 0;
+    }
+    
+    //-------------------------------------------------------------------------
+    
+    StreamClient_Linux::StreamClient_Linux(const char* text, EventLoop* eventloop)
+        : _eventloop(eventloop), _fd(-1), _timer(NULL), _connected(false), _buffer(kMaxDatagram) {
+        sockaddr_storage address;
+        socklen_t size;
+        std::string path;
+        int domain = parse_address(text, address, size, path);
+        if (domain < 0)
+            throw StreamSocketException();
+        _fd = socket(domain, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (_fd < 0)
+            throw StreamSocketException();
+        
+        // a Unix domain client needs an address to be answered at: bind to
+        // an abstract one the kernel picks.
+        sa_family_t family = AF_UNIX;
+        if ((domain == AF_UNIX && bind(_fd, reinterpret_cast<sockaddr*>(&family), sizeof(family)) != 0)
+         || connect(_fd, reinterpret_cast<sockaddr*>(&address), size) != 0) {
+            close(_fd);
+            throw StreamSocketException();
+        }
+        
+        this->send_hello();
+        if (_eventloop) {
+            _eventloop->add_watch(_fd, this, StreamClient_Linux::handle_readable);
+            _timer = Timer::create(this, StreamClient_Linux::timer_fired, kHelloMilliseconds, eventloop);
+        }
+    }
+    
+    StreamClient_Linux::~StreamClient_Linux() {
+        delete _timer;
+        if (_eventloop)
+            _eventloop->remove_watch(_fd);
+        StreamSubscriber::write_bye(_reply);
+        send(_fd, _reply.data(), _reply.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+        close(_fd);
+    }
+    
+    void StreamClient_Linux::send_hello() {
+        StreamSubscriber::write_hello(_reply);
+        send(_fd, _reply.data(), _reply.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+    
+    int StreamClient_Linux::receive() {
+        int count = 0;
+        ssize_t length;
+        while ((length = recv(_fd, _buffer.data(), _buffer.size(), 0)) > 0) {
+            _connected = true;
+            this->handle_datagram(_buffer.data(), length);
+            ++ count;
+        }
+        if (this->take_ack(_reply))
+            send(_fd, _reply.data(), _reply.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+        return count;
+    }
+    
+    void StreamClient_Linux::handle_readable(void* self, int) {
+        static_cast<StreamClient_Linux*>(self)->receive();
+    }
+    
+    void StreamClient_Linux::timer_fired(void* self, Timer* timer) {
+        StreamClient_Linux* this_ = static_cast<StreamClient_Linux*>(self);
+        if (this_->_connected)
+            timer->stop();
+        else
+            this_->send_hello();
+    }
+}
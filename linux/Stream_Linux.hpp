@@ -0,0 +1,112 @@
+/*
+ 
+Stream_Linux.hpp ... Streaming of gamepad events over Unix domain and UDP sockets.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef STREAM_LINUX_HPP_q3m8xv1c0ze7rl5d
+#define STREAM_LINUX_HPP_q3m8xv1c0ze7rl5d 1
+
+#include "../Stream.hpp"
+#include <sys/socket.h>
+#include <string>
+#include <vector>
+
+namespace GP {
+    class EventLoop;
+    class Timer;
+    
+    // An address is "unix:<path>" for a datagram socket at a path,
+    // "unix:@<name>" for one in the abstract namespace, or
+    // "udp:<host>:<port>".
+    
+    // Publishes to the subscribers which say hello to its socket. Every
+    // method, and the gamepads it publishes, run on 'eventloop'.
+    class StreamServer_Linux : public StreamPublisher {
+    private:
+        EventLoop* _eventloop;
+        int _fd;
+        int _flush_fd;          // an eventfd, written when a flush is due.
+        bool _flush_scheduled;
+        Timer* _timer;
+        std::string _path;      // unlinked at the end.
+        std::vector<std::pair<sockaddr_storage, socklen_t> > _addresses;   // by subscriber
+        std::vector<uint8_t> _buffer;
+        
+        StreamServer_Linux(EventLoop* eventloop, int fd, const std::string& path);
+        
+        static void handle_readable(void* self, int fd);
+        static void handle_flush(void* self, int fd);
+        static void timer_fired(void* self, Timer* timer);
+        int subscriber_at(const sockaddr_storage& address, socklen_t size) const;
+        
+    protected:
+        bool send_datagram(int subscriber, const uint8_t* bytes, size_t size);
+        void schedule_flush();
+        void subscriber_removed(int subscriber);
+        
+    public:
+        // Throw StreamSocketException if the address cannot be bound.
+        static StreamServer_Linux* create(const char* address, EventLoop* eventloop);
+        ~StreamServer_Linux();
+        
+        int fd() const { return _fd; }
+    };
+    
+    // Subscribes to a StreamServer_Linux, and drives a gamepad here for each
+    // of its devices. With an event loop, the client receives on it, and
+    // says hello again until the server answers; without, call receive()
+    // when fd() is readable.
+    class StreamClient_Linux : public StreamSubscriber {
+    private:
+        EventLoop* _eventloop;
+        int _fd;
+        Timer* _timer;
+        bool _connected;
+        std::vector<uint8_t> _buffer;
+        std::vector<uint8_t> _reply;
+        
+        static void handle_readable(void* self, int fd);
+        static void timer_fired(void* self, Timer* timer);
+        void send_hello();
+        
+    public:
+        // Throw StreamSocketException if the address cannot be reached.
+        StreamClient_Linux(const char* address, EventLoop* eventloop);
+        ~StreamClient_Linux();
+        
+        // Handle every datagram waiting, acknowledge them together, and
+        // return how many there were.
+        int receive();
+        
+        int fd() const { return _fd; }
+        bool connected() const { return _connected; }
+    };
+}
+
+#endif
@@ -0,0 +1,253 @@
+/*
+ 
+TimerWheel.hpp ... Hierarchical timing wheel.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#ifndef TIMER_WHEEL_HPP_r07gw2ugzs2q9o0q
+#define TIMER_WHEEL_HPP_r07gw2ugzs2q9o0q 1
+
+#include "../Compatibility.hpp"
+#include <cstddef>
+#include <stdint.h>
+
+namespace GP {
+    // Keeps any number of timers in 4 levels of 64 slots each. A timer due
+    // within 64 ticks is kept in a slot of level 0, one due within 64^2 ticks
+    // in level 1, and so on; as time passes, the slots of the higher levels
+    // are cascaded down. Starting and stopping a timer is O(1), and finding
+    // the next tick with work to do costs one bit scan per level.
+    //
+    // The wheel has no clock: ticks are whatever unit the caller advances it
+    // by.
+    class TimerWheel {
+    public:
+        struct Link {
+            Link* prev;
+            Link* next;
+        };
+        
+        struct Entry : public Link {
+            // the tick at which the entry fires, and for periodic entries the
+            // ticks between two firings.
+            uint64_t expires;
+            uint64_t period;
+            int slot;
+            void* self;
+            void (*callback)(void* self, Entry* entry);
+            
+            Entry(void* self_, void (*callback_)(void* self, Entry* entry))
+                : expires(0), period(0), slot(-1), self(self_), callback(callback_) {
+                prev = next = NULL;
+            }
+            
+            bool pending() const { return slot >= 0; }
+        };
+        
+        static const uint64_t kNever = ~uint64_t(0);
+        
+    private:
+        enum {
+            kLevels = 4,
+            kSlotBits = 6,
+            kSlots = 1 << kSlotBits,
+            // Later entries are parked in the last level and re-inserted when
+            // they get there.
+            kMaxDelta = (uint64_t(1) << (kLevels * kSlotBits)) - 1
+        };
+        
+        Link _slots[kLevels * kSlots];
+        uint64_t _occupied[kLevels];
+        // all ticks before this one have been processed.
+        uint64_t _now;
+        
+        TimerWheel(const TimerWheel&);
+        TimerWheel& operator=(const TimerWheel&);
+        
+        static uint64_t rotate_right(uint64_t bits, int count) {
+            return count ? bits >> count | bits << (64 - count) : bits;
+        }
+        
+        void insert(Entry* entry) {
+            uint64_t expires = entry->expires;
+            if (expires < _now)
+                expires = _now;
+            if (expires - _now > kMaxDelta)
+                expires = _now + kMaxDelta;
+            
+            uint64_t delta = expires - _now;
+            int level = 0;
+            while (level < kLevels - 1 && delta >> ((level + 1) * kSlotBits))
+                ++ level;
+            int index = expires >> (level * kSlotBits) & (kSlots - 1);
+            
+            Link* head = &_slots[level * kSlots + index];
+            entry->slot = level * kSlots + index;
+            entry->next = head;
+            entry->prev = head->prev;
+            head->prev->next = entry;
+            head->prev = entry;
+            _occupied[level] |= uint64_t(1) << index;
+        }
+        
+        void unlink(Entry* entry) {
+            entry->prev->next = entry->next;
+            entry->next->prev = entry->prev;
+            if (entry->slot >= 0) {
+                Link* head = &_slots[entry->slot];
+                if (head->next == head)
+                    _occupied[entry->slot / kSlots] &= ~(uint64_t(1) << entry->slot % kSlots);
+            }
+            entry->slot = -1;
+        }
+        
+        // Move the slot to a list of its own, so the entries can be
+        // re-inserted or fired while the slot fills up again.
+        void take_slot(int slot, Link* list) {
+            Link* head = &_slots[slot];
+            if (head->next == head) {
+                list->prev = list->next = list;
+            } else {
+                list->next = head->next;
+                list->prev = head->prev;
+                list->next->prev = list;
+                list->prev->next = list;
+                head->prev = head->next = head;
+            }
+            _occupied[slot / kSlots] &= ~(uint64_t(1) << slot % kSlots);
+        }
+        
+        void cascade(int level, int index) {
+            Link list;
+            this->take_slot(level * kSlots + index, &list);
+            while (list.next != &list) {
+                Entry* entry = static_cast<Entry*>(list.next);
+                entry->slot = -1;
+                this->unlink(entry);
+                this->insert(entry);
+            }
+        }
+        
+        void process(uint64_t tick) {
+            _now = tick;
+            for (int level = 1; level < kLevels; ++ level) {
+                if (tick & ((uint64_t(1) << (level * kSlotBits)) - 1))
+                    break;
+                this->cascade(level, tick >> (level * kSlotBits) & (kSlots - 1));
+            }
+            
+            Link list;
+            this->take_slot(tick & (kSlots - 1), &list);
+            _now = tick + 1;
+            
+            while (list.next != &list) {
+                Entry* entry = static_cast<Entry*>(list.next);
+                entry->slot = -1;
+                this->unlink(entry);
+                
+                if (entry->expires > tick) {
+                    // parked beyond kMaxDelta, not due yet.
+                    this->insert(entry);
+                    continue;
+                }
+                
+                // Periodic entries keep their phase: the next expiry follows
+                // from the last one rather than from now, and firings missed
+                // while the caller was late are skipped, not bunched up.
+                if (entry->period) {
+                    entry->expires += entry->period;
+                    if (entry->expires <= tick)
+                        entry->expires += ((tick - entry->expires) / entry->period + 1) * entry->period;
+                    this->insert(entry);
+                }
+                entry->callback(entry->self, entry);
+            }
+        }
+        
+    public:
+        explicit TimerWheel(uint64_t now = 0) : _now(now) {
+            for (int i = 0; i < kLevels * kSlots; ++ i)
+                _slots[i].prev = _slots[i].next = &_slots[i];
+            for (int level = 0; level < kLevels; ++ level)
+                _occupied[level] = 0;
+        }
+        
+        // The first tick that advance() has not processed yet.
+        uint64_t now() const { return _now; }
+        
+        // (Re)start the entry to fire at the tick 'expires', and then every
+        // 'period' ticks if period is not 0. An expiry in the past fires at
+        // the next advance().
+        void start(Entry* entry, uint64_t expires, uint64_t period = 0) {
+            if (entry->pending())
+                this->unlink(entry);
+            entry->expires = expires;
+            entry->period = period;
+            this->insert(entry);
+        }
+        
+        void stop(Entry* entry) {
+            if (entry->pending())
+                this->unlink(entry);
+        }
+        
+        // Fire every entry expiring up to and including the tick, in order
+        // of expiry. Callbacks may start and stop any entry.
+        void advance(uint64_t tick) {
+            while (_now <= tick) {
+                uint64_t next = this->next_tick();
+                if (next > tick) {
+                    _now = tick + 1;
+                    break;
+                }
+                this->process(next);
+            }
+        }
+        
+        // The first tick at which advance() has anything to do, which is a
+        // cascade or a firing, or kNever if the wheel is empty. Firings due
+        // before now() are reported as now().
+        uint64_t next_tick() const {
+            uint64_t next = kNever;
+            for (int level = 0; level < kLevels; ++ level) {
+                if (!_occupied[level])
+                    continue;
+                int shift = level * kSlotBits;
+                // the first unit of this level starting at or after now.
+                uint64_t unit = (_now + (uint64_t(1) << shift) - 1) >> shift;
+                int distance = count_trailing_zeros(rotate_right(_occupied[level], unit & (kSlots - 1)));
+                uint64_t tick = (unit + distance) << shift;
+                if (tick < next)
+                    next = tick;
+            }
+            return next;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,208 @@
+/*
+ 
+Timer_Linux.cpp ... Timer in Linux
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "../Timer.hpp"
+#include "../EventLoop.hpp"
+#include "../Exception.hpp"
+#include "TimerWheel.hpp"
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <mutex>
+#include <unordered_map>
+
+namespace GP {
+    // All the timers of an event loop share one timing wheel with a tick of
+    // 1 ms, and one timerfd armed for the next tick with work to do.
+    class TimerDriver {
+    private:
+        EventLoop* _eventloop;
+        int _fd;
+        int _timer_count;
+        uint64_t _origin;
+        uint64_t _armed_tick;
+        TimerWheel _wheel;
+        
+        static std::mutex drivers_mutex;
+        static std::unordered_map<EventLoop*, TimerDriver*> drivers;
+        
+        static void handle_readable(void* self, int fd);
+        
+        TimerDriver(EventLoop* eventloop, int fd);
+        
+    public:
+        static const uint64_t kNanosecondsPerTick = 1000000;
+        
+        static uint64_t monotonic_time() {
+            timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        }
+        
+        // The driver of the event loop, created with the first timer and
+        // deleted with the last.
+        static TimerDriver* retain(EventLoop* eventloop);
+        void release();
+        
+        // Start the entry to fire 'milliseconds' from now, and then every
+        // 'milliseconds'.
+        void start(TimerWheel::Entry* entry, int milliseconds);
+        void stop(TimerWheel::Entry* entry) { _wheel.stop(entry); }
+        
+        void arm();
+    };
+    
+    std::mutex TimerDriver::drivers_mutex;
+    std::unordered_map<EventLoop*, TimerDriver*> TimerDriver::drivers;
+    
+    TimerDriver::TimerDriver(EventLoop* eventloop, int fd)
+        : _eventloop(eventloop), _fd(fd), _timer_count(0),
+          _origin(monotonic_time()), _armed_tick(TimerWheel::kNever) {
+        _eventloop->add_watch(_fd, this, TimerDriver::handle_readable);
+    }
+    
+    TimerDriver* TimerDriver::retain(EventLoop* eventloop) {
+        std::lock_guard<std::mutex> lock(drivers_mutex);
+        
+        TimerDriver*& driver = drivers[eventloop];
+        if (!driver) {
+            int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (fd < 0) {
+                drivers.erase(eventloop);
+                throw NoEventloopException();
+            }
+            driver = new TimerDriver(eventloop, fd);
+        }
+        ++ driver->_timer_count;
+        return driver;
+    }
+    
+    void TimerDriver::release() {
+        std::lock_guard<std::mutex> lock(drivers_mutex);
+        
+        if (-- _timer_count == 0) {
+            drivers.erase(_eventloop);
+            _eventloop->remove_watch(_fd);
+            close(_fd);
+            delete this;
+        }
+    }
+    
+    void TimerDriver::start(TimerWheel::Entry* entry, int milliseconds) {
+        uint64_t period = milliseconds > 0 ? milliseconds : 1;
+        // round up, so that the timer never fires early.
+        uint64_t now = monotonic_time() - _origin;
+        uint64_t expires = (now + kNanosecondsPerTick - 1) / kNanosecondsPerTick + period;
+        _wheel.start(entry, expires, period);
+        
+        // Moving a timer later, as re-arming does, needs no system call: the
+        // timerfd may then fire early, and just finds nothing to do.
+        if (expires < _armed_tick)
+            this->arm();
+    }
+    
+    void TimerDriver::arm() {
+        uint64_t tick = _wheel.next_tick();
+        _armed_tick = tick;
+        
+        itimerspec spec = {{0, 0}, {0, 0}};
+        if (tick != TimerWheel::kNever) {
+            uint64_t time = _origin + tick * kNanosecondsPerTick;
+            spec.it_value.tv_sec = time / 1000000000;
+            spec.it_value.tv_nsec = time % 1000000000;
+        }
+        timerfd_settime(_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+    }
+    
+    void TimerDriver::handle_readable(void* self, int fd) {
+        TimerDriver* this_ = static_cast<TimerDriver*>(self);
+        
+        uint64_t expirations;
+        ssize_t got = read(fd, &expirations, sizeof(expirations));
+        (void)got;
+        
+        // a timer callback may delete the last timer and with it the driver,
+        // so keep it alive until the wheel is done.
+        {
+            std::lock_guard<std::mutex> lock(drivers_mutex);
+            ++ this_->_timer_count;
+        }
+        this_->_armed_tick = TimerWheel::kNever;
+        this_->_wheel.advance((monotonic_time() - this_->_origin) / kNanosecondsPerTick);
+        this_->arm();
+        this_->release();
+    }
+    
+    
+    class Timer_Linux : public Timer {
+    private:
+        TimerDriver* _driver;
+        TimerWheel::Entry _entry;
+        int _milliseconds;
+        
+        void stop_impl() {
+            _driver->stop(&_entry);
+        }
+        void restart_impl() {
+            _driver->start(&_entry, _milliseconds);
+        }
+        void set_interval_impl(int milliseconds) {
+            _milliseconds = milliseconds;
+        }
+        
+        static void entry_fired(void* self, TimerWheel::Entry*) {
+            static_cast<Timer_Linux*>(self)->handle_timer();
+        }
+                
+    public:
+        Timer_Linux(void* self, Callback callback, EventLoop* eventloop, int milliseconds)
+            : Timer(self, callback), _driver(TimerDriver::retain(eventloop)),
+              _entry(this, Timer_Linux::entry_fired), _milliseconds(milliseconds) {
+            _driver->start(&_entry, _milliseconds);
+        }
+        
+        ~Timer_Linux() {
+            _driver->stop(&_entry);
+            _driver->release();
+        }
+    };
+    
+    Timer* Timer::create(void* self, Callback callback, int milliseconds, void* eventloop) {
+        if (!eventloop)
+            throw NoEventloopException();
+        return new Timer_Linux(self, callback, static_cast<EventLoop*>(eventloop), milliseconds);
+    }
+    
+    // The clock evdev stamps events with, once asked to by EVIOCSCLOCKID.
+    uint64_t Timer::monotonic_nanoseconds() {
+        return TimerDriver::monotonic_time();
+    }
+}
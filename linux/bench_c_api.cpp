@@ -0,0 +1,120 @@
+/*
+ 
+bench_c_api.cpp ... Compares per-event callbacks with batched polling through the C interface.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+#include "GamepadC_Linux.hpp"
+
+// A pad moving 4 axes every report, and a button every 8, is read through
+// the C interface: once with a callback per event, and once polling the
+// events of 16 reports into an array, as a game would each of its frames.
+// A foreign function interface makes every crossing dearer; that is
+// modelled by spinning for a fixed time in each callback, and after each
+// poll.
+
+static const int kReports = 20000;
+static const int kReportsPerPoll = 16;
+
+namespace {
+    uint64_t crossing_nanoseconds;
+    
+    void cross() {
+        if (!crossing_nanoseconds)
+            return;
+        uint64_t end = GP::Bench::now_ns() + crossing_nanoseconds;
+        while (GP::Bench::now_ns() < end) {}
+    }
+    
+    void on_event(void*, const gp_event* event) {
+        cross();
+        GP::Bench::sink += event->value;
+    }
+    
+    void drive(GP::SyntheticGamepad& pad, int i) {
+        for (int a = 0; a < 4; ++ a)
+            pad.set_axis_value(static_cast<GP::Axis>(a), (i * (a + 1)) % 1000 - 500);
+        pad.handle_axes_change(1000000);
+        if (i % 8 == 0)
+            pad.handle_button_change(GP::Button::_1, i / 8 % 2 == 1);
+        pad.handle_frame(1000000);
+    }
+    
+    // Return the ns per event.
+    double measure(bool poll) {
+        gp_context* context = gp_create(0);
+        GP::SyntheticGamepad pad;
+        context->queue.add_gamepad(&pad);
+        gp_event events[1024];
+        gp_poll_events(context, events, 1024);
+        if (!poll)
+            gp_set_event_callback(context, on_event, NULL);
+        
+        uint64_t count = 0;
+        uint64_t ns = GP::Bench::best_of(5, [&]() {
+            count = 0;
+            for (int i = 1; i <= kReports; ++ i) {
+                drive(pad, i);
+                if (!poll || i % kReportsPerPoll)
+                    continue;
+                size_t got;
+                while ((got = gp_poll_events(context, events, 1024)) > 0) {
+                    cross();
+                    for (size_t e = 0; e < got; ++ e)
+                        GP::Bench::sink += events[e].value;
+                    count += got;
+                }
+            }
+        });
+        if (!poll) {
+            // the events of the callback run, counted by polling them.
+            gp_set_event_callback(context, NULL, NULL);
+            for (int i = 1; i <= kReports; ++ i) {
+                drive(pad, i);
+                count += gp_poll_events(context, events, 1024);
+            }
+        }
+        context->queue.remove_gamepad(&pad);
+        gp_destroy(context);
+        return double(ns) / count;
+    }
+}
+
+int main(int argc, char** argv) {
+    static const uint64_t crossings[] = {0, 100};
+    for (int c = 0; c < 2; ++ c) {
+        crossing_nanoseconds = crossings[c];
+        char name[96];
+        snprintf(name, sizeof(name), "callback per event, %llu ns a crossing", (unsigned long long)crossings[c]);
+        GP::Bench::report(name, measure(false), "event");
+        snprintf(name, sizeof(name), "gp_poll_events per 16 reports, %llu ns a crossing", (unsigned long long)crossings[c]);
+        GP::Bench::report(name, measure(true), "event");
+    }
+    return GP::Bench::finish(argc, argv);
+}
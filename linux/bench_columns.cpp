@@ -0,0 +1,91 @@
+/*
+ 
+bench_columns.cpp ... Measures scans over exported session columns.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+#include "ColumnScan.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Scans of 4M rows held in memory, as a mapped columns file gives them,
+// with each instruction set the processor has: a range of an axis, a
+// button of the held ones, and the edges and join of a whole query.
+
+static const size_t kRows = 1 << 22;
+
+int main(int argc, char** argv) {
+    std::vector<int32_t> values(kRows);
+    std::vector<uint64_t> held(kRows);
+    std::vector<uint64_t> timestamps(kRows);
+    for (size_t i = 0; i < kRows; ++ i) {
+        // an axis sweeping its range, a button held a while every so often.
+        values[i] = static_cast<int32_t>(i * 7 % 2001) - 1000 + rand() % 11 - 5;
+        held[i] = i % 500 < 40 ? 0x40 | (i & 3) : i & 3;
+        timestamps[i] = uint64_t(i) * 1000000;
+    }
+    
+    static const char* isa_names[] = {"scalar", "sse2", "avx2"};
+    GP::RowMask selected, edges;
+    for (int isa = 0; isa < static_cast<int>(GP::ScanIsa::scan_isa_count); ++ isa) {
+        if (!GP::ColumnScan::select(static_cast<GP::ScanIsa>(isa)))
+            continue;
+        char name[64];
+        
+        uint64_t ns = GP::Bench::best_of(5, [&]() {
+            GP::ColumnScan::between(values.data(), kRows, 800, INT32_MAX, selected);
+            GP::Bench::sink += selected.words()[1];
+        });
+        snprintf(name, sizeof(name), "axis range, %s", isa_names[isa]);
+        GP::Bench::record(name, kRows * 1e3 / ns, "Mrows/s", true);
+        
+        ns = GP::Bench::best_of(5, [&]() {
+            GP::ColumnScan::held(held.data(), kRows, GP::Button::_7, selected);
+            GP::Bench::sink += selected.words()[1];
+        });
+        snprintf(name, sizeof(name), "held button, %s", isa_names[isa]);
+        GP::Bench::record(name, kRows * 1e3 / ns, "Mrows/s", true);
+        
+        ns = GP::Bench::best_of(5, [&]() {
+            std::vector<uint64_t> presses, crossings;
+            bool pressed = false, crossed = false;
+            GP::ColumnScan::held(held.data(), kRows, GP::Button::_7, selected);
+            GP::ColumnScan::rising(selected, pressed, edges);
+            GP::ColumnScan::times(timestamps.data(), edges, presses);
+            GP::ColumnScan::between(values.data(), kRows, 800, INT32_MAX, selected);
+            GP::ColumnScan::rising(selected, crossed, edges);
+            GP::ColumnScan::times(timestamps.data(), edges, crossings);
+            GP::Bench::sink += GP::ColumnScan::join_within(presses, crossings, 50000000, 50000000);
+        });
+        snprintf(name, sizeof(name), "press within 50 ms of a crossing, %s", isa_names[isa]);
+        GP::Bench::record(name, kRows * 1e3 / ns, "Mrows/s", true);
+    }
+    return GP::Bench::finish(argc, argv);
+}
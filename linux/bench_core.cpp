@@ -0,0 +1,198 @@
+/*
+ 
+bench_core.cpp ... Microbenchmarks of the core: axes, buttons, usages, transactions, names.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+#include "Transaction.hpp"
+
+// The building blocks of the report path, each on its own, with no device.
+
+static const int kIterations = 100000;
+
+static void axis_changed(void*, GP::Gamepad*, GP::Axis axis, long value, unsigned) {
+    GP::Bench::sink += value + static_cast<long>(axis);
+}
+
+static void button_changed(void*, GP::Gamepad*, GP::Button button, bool is_pressed) {
+    GP::Bench::sink += static_cast<long>(button) + is_pressed;
+}
+
+// handle_axes_change() with 'axes' axes moving in every report, and
+// 'callbacks' axis_changed callbacks: the C callback, then subscribers.
+static void measure_axes(int axes, int callbacks) {
+    GP::SyntheticGamepad gamepad;
+    if (callbacks > 0)
+        gamepad.set_axis_changed_callback(NULL, axis_changed);
+    for (int i = 1; i < callbacks; ++ i) {
+        GP::Gamepad::Subscriber subscriber = {};
+        subscriber.axis_changed = axis_changed;
+        subscriber.interest = GP::Interest::everything();
+        gamepad.subscribe(subscriber);
+    }
+    
+    uint64_t ns = GP::Bench::best_of(5, [&]() {
+        for (int r = 0; r < kIterations; ++ r) {
+            for (int a = 0; a < axes; ++ a)
+                gamepad.set_axis_value(static_cast<GP::Axis>(a), (r + a) % 200 - 100);
+            gamepad.handle_axes_change(1000000);
+        }
+    });
+    
+    char name[64];
+    snprintf(name, sizeof(name), "handle_axes_change, %2d axes, %d callbacks", axes, callbacks);
+    GP::Bench::report(name, double(ns) / kIterations, "report");
+}
+
+// The edges of a report against the previous one, as the Windows backend
+// finds them: two masks and a walk over the bits which differ.
+static void measure_button_edges() {
+    std::vector<uint64_t> states(1024);
+    uint64_t state = 0;
+    for (size_t i = 0; i < states.size(); ++ i) {
+        state ^= uint64_t(1) << (rand() % 64);
+        states[i] = state;
+    }
+    
+    uint64_t ns = GP::Bench::best_of(5, [&]() {
+        GP::ButtonSet previous;
+        long edges = 0;
+        for (int r = 0; r < kIterations; ++ r) {
+            GP::ButtonSet active(states[r % states.size()] & ~uint64_t(1));
+            GP::ButtonSet(active.bits() & ~previous.bits()).for_each([&](GP::Button button) { edges += static_cast<long>(button); });
+            GP::ButtonSet(previous.bits() & ~active.bits()).for_each([&](GP::Button button) { edges -= static_cast<long>(button); });
+            previous = active;
+        }
+        GP::Bench::sink += edges;
+    });
+    GP::Bench::report("button edges, 1 change per report", double(ns) / kIterations, "report");
+    
+    GP::SyntheticGamepad gamepad;
+    gamepad.set_button_changed_callback(NULL, button_changed);
+    ns = GP::Bench::best_of(5, [&]() {
+        for (int r = 0; r < kIterations; ++ r) {
+            gamepad.handle_button_change(static_cast<GP::Button>(r % 16 + 1), r / 16 % 2 == 0);
+            gamepad.handle_frame(1000000);
+        }
+    });
+    GP::Bench::report("handle_button_change + handle_frame, 1 callback", double(ns) / kIterations, "report");
+}
+
+static void measure_usages() {
+    // the generic desktop axes, and usages around them which are not axes.
+    static const int usages[][2] = {
+        {1, 0x30}, {1, 0x31}, {1, 0x32}, {1, 0x33}, {1, 0x34}, {1, 0x35},
+        {1, 0x40}, {1, 0x41}, {1, 0x42}, {1, 0x44}, {1, 0x39}, {2, 0xbb},
+        {1, 0x36}, {1, 0x37}, {9, 0x01}, {0xff00, 0x01}
+    };
+    const int count = sizeof(usages) / sizeof(*usages);
+    
+    uint64_t ns = GP::Bench::best_of(5, [&]() {
+        long sum = 0;
+        for (int r = 0; r < kIterations; ++ r) {
+            const int* usage = usages[r % count];
+            sum += static_cast<long>(GP::axis_from_usage(usage[0] + (r >> 20), usage[1]));
+        }
+        GP::Bench::sink += sum;
+    });
+    GP::Bench::report("axis_from_usage", double(ns) / kIterations);
+    
+    ns = GP::Bench::best_of(5, [&]() {
+        long sum = 0;
+        for (int r = 0; r < kIterations; ++ r)
+            sum += GP::ButtonSet::index(GP::button_from_usage(r % 8 ? 9 : 12, r % 8 ? r % 64 + 1 : 0xcd));
+        GP::Bench::sink += sum;
+    });
+    GP::Bench::report("button_from_usage + ButtonSet::index", double(ns) / kIterations);
+}
+
+static void fill(GP::Transaction& transaction, int r) {
+    for (int i = 0; i < 4; ++ i) {
+        transaction.set_output_value(8, i, r + i);
+        transaction.set_output_button(9, i + 1, (r >> i) & 1);
+        transaction.set_feature_value(0xff00, i, r - i);
+        transaction.set_feature_button(0xff00, i + 8, true);
+    }
+}
+
+static void measure_transactions() {
+    const int transactions = kIterations / 10;
+    uint64_t ns = GP::Bench::best_of(5, [&]() {
+        for (int r = 0; r < transactions; ++ r) {
+            GP::Transaction transaction;
+            fill(transaction, r);
+            GP::Bench::sink += transaction.output_values().size();
+        }
+    });
+    GP::Bench::report("Transaction of 16 values, new", double(ns) / transactions, "transaction");
+    
+    GP::Transaction transaction;
+    ns = GP::Bench::best_of(5, [&]() {
+        for (int r = 0; r < transactions; ++ r) {
+            transaction.clear();
+            fill(transaction, r);
+            GP::Bench::sink += transaction.output_values().size();
+        }
+    });
+    GP::Bench::report("Transaction of 16 values, reused with clear()", double(ns) / transactions, "transaction");
+}
+
+static void measure_names() {
+    const int axes = static_cast<int>(GP::Axis::count);
+    const int groups = static_cast<int>(GP::AxisGroup::group_count);
+    
+    uint64_t ns = GP::Bench::best_of(5, [&]() {
+        long sum = 0;
+        for (int r = 0; r < kIterations; ++ r)
+            sum += *GP::name<char>(static_cast<GP::Axis>(r % axes));
+        GP::Bench::sink += sum;
+    });
+    GP::Bench::report("name<char>(Axis)", double(ns) / kIterations);
+    
+    ns = GP::Bench::best_of(5, [&]() {
+        long sum = 0;
+        for (int r = 0; r < kIterations; ++ r)
+            sum += *GP::name<wchar_t>(static_cast<GP::AxisGroup>(r % groups));
+        GP::Bench::sink += sum;
+    });
+    GP::Bench::report("name<wchar_t>(AxisGroup)", double(ns) / kIterations);
+}
+
+int main(int argc, char** argv) {
+    static const int axes[] = {1, 3, 6, 12};
+    static const int callbacks[] = {0, 1, 8};
+    for (int i = 0; i < 4; ++ i)
+        for (int j = 0; j < 3; ++ j)
+            measure_axes(axes[i], callbacks[j]);
+    measure_button_edges();
+    measure_usages();
+    measure_transactions();
+    measure_names();
+    return GP::Bench::finish(argc, argv);
+}
@@ -0,0 +1,110 @@
+/*
+ 
+bench_frame.cpp ... Compare per-event callbacks with the frame callback.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+#include <vector>
+
+// 64 devices reporting at 1 kHz, for 2 seconds of simulated input.
+static const int kDevices = 64;
+static const int kReportsPerDevice = 2000;
+static const unsigned kNanosecondsPerReport = 1000000;
+
+static void axis_changed(void*, GP::Gamepad*, GP::Axis axis, long value, unsigned) {
+    GP::Bench::sink += value + static_cast<long>(axis);
+}
+static void axis_state_changed(void*, GP::Gamepad*, GP::Axis axis, GP::AxisState state) {
+    GP::Bench::sink += static_cast<long>(axis) + static_cast<long>(state);
+}
+static void axis_group_changed(void*, GP::Gamepad*, GP::AxisGroup group, long values[], unsigned) {
+    GP::Bench::sink += values[0] + static_cast<long>(group);
+}
+static void axis_group_state_changed(void*, GP::Gamepad*, GP::AxisGroup group, GP::AxisState state) {
+    GP::Bench::sink += static_cast<long>(group) + static_cast<long>(state);
+}
+static void button_changed(void*, GP::Gamepad*, GP::Button button, bool is_pressed) {
+    GP::Bench::sink += static_cast<long>(button) + is_pressed;
+}
+static void frame_received(void*, GP::Gamepad*, const GP::Frame& frame) {
+    long sum = 0;
+    for (unsigned mask = frame.moving_axes; mask; mask &= mask - 1)
+        sum += frame.axes[count_trailing_zeros(mask)];
+    GP::Bench::sink += sum + static_cast<long>(frame.pressed.bits() ^ frame.released.bits());
+}
+
+// Feed every device the same report pattern: 6 axes moving along a triangle
+// wave, and one button toggling every 50 reports.
+static void run_session(std::vector<GP::SyntheticGamepad>& gamepads) {
+    for (int r = 0; r < kReportsPerDevice; ++ r) {
+        long phase = r % 200 < 100 ? r % 100 : 100 - r % 100;
+        for (int d = 0; d < kDevices; ++ d) {
+            GP::SyntheticGamepad& gamepad = gamepads[d];
+            for (int a = 0; a < 6; ++ a)
+                gamepad.set_axis_value(static_cast<GP::Axis>(a), phase * (a + 1) - 256);
+            if (r % 50 == 0)
+                gamepad.handle_button_change(GP::Button::_1, r % 100 == 0);
+            gamepad.handle_axes_change(kNanosecondsPerReport);
+            gamepad.handle_frame(kNanosecondsPerReport);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const double reports = double(kDevices) * kReportsPerDevice;
+
+    std::vector<GP::SyntheticGamepad> per_event(kDevices);
+    for (auto it = per_event.begin(); it != per_event.end(); ++ it) {
+        it->set_axis_changed_callback(NULL, axis_changed);
+        it->set_axis_state_changed_callback(NULL, axis_state_changed);
+        it->set_axis_group_changed_callback(NULL, axis_group_changed);
+        it->set_axis_group_state_changed_callback(NULL, axis_group_state_changed);
+        it->set_button_changed_callback(NULL, button_changed);
+    }
+
+    std::vector<GP::SyntheticGamepad> per_frame(kDevices);
+    for (auto it = per_frame.begin(); it != per_frame.end(); ++ it)
+        it->set_frame_callback(NULL, frame_received);
+
+    std::vector<GP::SyntheticGamepad> none(kDevices);
+
+    uint64_t baseline = GP::Bench::best_of(5, [&]{ run_session(none); });
+    uint64_t event_time = GP::Bench::best_of(5, [&]{ run_session(per_event); });
+    uint64_t frame_time = GP::Bench::best_of(5, [&]{ run_session(per_frame); });
+
+    printf("%d devices x 1 kHz, %d reports each\n", kDevices, kReportsPerDevice);
+    GP::Bench::report("no callbacks", baseline / reports, "report");
+    GP::Bench::report("per-event callbacks (axis, state, group, button)", event_time / reports, "report");
+    GP::Bench::report("frame callback", frame_time / reports, "report");
+
+    // At 64 kHz of reports, this is the share of one core spent on dispatch.
+    printf("%-48s %9.2f%% / %.2f%%\n", "CPU at 1 kHz x 64 devices (per-event / frame)",
+           event_time / reports * kDevices * 1000 / 1e7, frame_time / reports * kDevices * 1000 / 1e7);
+    return GP::Bench::finish(argc, argv);
+}
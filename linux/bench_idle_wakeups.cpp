@@ -0,0 +1,138 @@
+/*
+ 
+bench_idle_wakeups.cpp ... Wakeups per second of an idle event loop.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+#include "EventLoop.hpp"
+#include "GamepadChangedObserver.hpp"
+#include <sys/syscall.h>
+#include <poll.h>
+#include <unistd.h>
+#include <thread>
+#include <atomic>
+#include <cstring>
+
+// Observe gamepads for a while with nothing happening, and count how often
+// the thread serving the library wakes up. The count comes from the kernel's
+// voluntary context switches, so wakeups hidden inside the library count too.
+
+static const int kSeconds = 1;
+
+static long voluntary_switches(long tid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%ld/status", tid);
+    FILE* file = fopen(path, "r");
+    if (!file)
+        return -1;
+    
+    long switches = -1;
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+        if (sscanf(line, "voluntary_ctxt_switches: %ld", &switches) == 1)
+            break;
+    fclose(file);
+    return switches;
+}
+
+// Run body() on a new thread for kSeconds and return its wakeups per second.
+// body() must return once stop is set, after calling started().
+template <typename F>
+static double wakeups_of_thread(F body) {
+    std::atomic<long> tid(0);
+    std::atomic<bool> stop(false);
+    std::thread thread([&]() {
+        tid = syscall(SYS_gettid);
+        body(stop);
+    });
+    while (!tid)
+        std::this_thread::yield();
+    usleep(100000);
+    
+    long before = voluntary_switches(tid);
+    usleep(kSeconds * 1000000);
+    long after = voluntary_switches(tid);
+    
+    stop = true;
+    thread.join();
+    return double(after - before) / kSeconds;
+}
+
+static void quit_loop(void* self) {
+    static_cast<GP::EventLoop*>(self)->quit();
+}
+
+int main(int argc, char** argv) {
+    double built_in = wakeups_of_thread([](std::atomic<bool>& stop) {
+        GP::EventLoop* loop = GP::EventLoop::create();
+        GP::GamepadChangedObserver* observer = GP::GamepadChangedObserver::create(NULL, NULL, loop);
+        std::thread stopper([&]() {
+            while (!stop)
+                usleep(10000);
+            loop->post(loop, quit_loop);
+        });
+        loop->run();
+        stopper.join();
+        delete observer;
+        delete loop;
+    });
+    
+    double embedded = wakeups_of_thread([](std::atomic<bool>& stop) {
+        GP::EventLoop* loop = GP::EventLoop::create();
+        GP::GamepadChangedObserver* observer = GP::GamepadChangedObserver::create(NULL, NULL, loop);
+        int stop_fd[2];
+        if (pipe(stop_fd) != 0)
+            return;
+        std::thread stopper([&]() {
+            while (!stop)
+                usleep(10000);
+            ssize_t written = write(stop_fd[1], "", 1);
+            (void)written;
+        });
+        // the host application's own loop.
+        pollfd fds[2] = {{loop->readiness_fd(), POLLIN, 0}, {stop_fd[0], POLLIN, 0}};
+        while (poll(fds, 2, -1) >= 0 && !fds[1].revents)
+            loop->dispatch_pending();
+        stopper.join();
+        close(stop_fd[0]);
+        close(stop_fd[1]);
+        delete observer;
+        delete loop;
+    });
+    
+    double polling = wakeups_of_thread([](std::atomic<bool>& stop) {
+        while (!stop)
+            usleep(1000);
+    });
+    
+    GP::Bench::record("built-in loop, idle", built_in, "/s");
+    GP::Bench::record("embedded in the host's poll(), idle", embedded, "/s");
+    GP::Bench::record("polling every millisecond, for comparison", polling, "/s");
+    return GP::Bench::finish(argc, argv);
+}
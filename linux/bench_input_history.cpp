@@ -0,0 +1,126 @@
+/*
+ 
+bench_input_history.cpp ... Measures the input history for rollback.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+#include "InputHistory.hpp"
+#include <vector>
+
+// The costs a rollback game pays each simulation frame: sampling the pad
+// into the history, looking a frame up, encoding the diff of a frame for
+// the wire and decoding it, and, on a misprediction, confirming the late
+// input, predicting the frames after it again and reading them back for
+// the resimulation.
+
+static const int kFrames = 100000;
+static const int kRollbackDepth = 8;
+
+namespace {
+    GP::Frame frame_of(int i) {
+        GP::Frame frame = {};
+        frame.sequence = i;
+        frame.axes[0] = i / 3 % 200 - 100;
+        frame.axes[1] = i / 5 % 200 - 100;
+        frame.axes[5] = i % 7 ? 0 : 511;
+        frame.held = GP::ButtonSet(i / 6 % 2 ? 2 : 0);
+        return frame;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<GP::Frame> frames;
+    for (int i = 0; i < kFrames; ++ i)
+        frames.push_back(frame_of(i));
+    
+    GP::InputHistory history;
+    uint64_t ns = GP::Bench::best_of(5, [&]() {
+        for (int i = 0; i < kFrames; ++ i)
+            history.confirm(kFrames + i, GP::InputState::of(frames[i]));
+    });
+    GP::Bench::report("snapshot a frame into the history", double(ns) / kFrames, "frame");
+    
+    ns = GP::Bench::best_of(5, [&]() {
+        for (int i = 0; i < kFrames; ++ i) {
+            const GP::InputState* state = history.at(2 * kFrames - 1 - (i & 127));
+            GP::Bench::sink += state->axes[0];
+        }
+    });
+    GP::Bench::report("look up a frame", double(ns) / kFrames, "lookup");
+    
+    std::vector<uint8_t> bytes;
+    bytes.reserve(GP::InputEncoding::kMaxDiff);
+    size_t total = 0;
+    ns = GP::Bench::best_of(5, [&]() {
+        total = 0;
+        for (int i = 1; i < kFrames; ++ i) {
+            bytes.clear();
+            GP::InputEncoding::put_diff(bytes, GP::InputState::of(frames[i - 1]), GP::InputState::of(frames[i]));
+            total += bytes.size();
+        }
+    });
+    GP::Bench::report("encode the diff of a frame", double(ns) / (kFrames - 1), "frame");
+    GP::Bench::record("bytes a frame diff", double(total) / (kFrames - 1), "B");
+    
+    std::vector<uint8_t> stream;
+    for (int i = 1; i < kFrames; ++ i)
+        GP::InputEncoding::put_diff(stream, GP::InputState::of(frames[i - 1]), GP::InputState::of(frames[i]));
+    ns = GP::Bench::best_of(5, [&]() {
+        const uint8_t* p = stream.data();
+        GP::InputState state = GP::InputState::of(frames[0]);
+        for (int i = 1; i < kFrames; ++ i) {
+            GP::InputState next;
+            GP::InputEncoding::get_diff(p, stream.data() + stream.size(), state, next);
+            state = next;
+        }
+        GP::Bench::sink += state.axes[0];
+    });
+    GP::Bench::report("decode the diff of a frame", double(ns) / (kFrames - 1), "frame");
+    
+    // the remote input arrives kRollbackDepth frames late, and unlike
+    // the prediction every frame it changes.
+    int rollbacks = 0;
+    ns = GP::Bench::best_of(5, [&]() {
+        GP::InputHistory remote;
+        rollbacks = 0;
+        for (int i = 0; i < kFrames; ++ i) {
+            remote.predict(i + kRollbackDepth);
+            remote.confirm(i, GP::InputState::of(frames[i]));
+            int64_t from = remote.take_rollback();
+            if (from == GP::InputHistory::kNone)
+                continue;
+            ++ rollbacks;
+            remote.repredict_after(from);
+            for (int64_t f = from; f <= i + kRollbackDepth; ++ f)
+                GP::Bench::sink += remote.at(f)->axes[0];
+        }
+    });
+    GP::Bench::report("rewind 8 frames on a misprediction", double(ns) / std::max(rollbacks, 1), "rollback");
+    return GP::Bench::finish(argc, argv);
+}
@@ -0,0 +1,104 @@
+/*
+ 
+bench_listener.cpp ... Compare C callbacks with listeners bound at compile time.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+
+static const int kReports = 1000000;
+
+// Both consumers do the same work: sum every axis value and count the
+// axis state and button transitions.
+struct Totals {
+    long sum;
+    long transitions;
+};
+
+static void axis_changed(void* self, GP::Gamepad*, GP::Axis, long value, unsigned) {
+    static_cast<Totals*>(self)->sum += value;
+}
+static void axis_state_changed(void* self, GP::Gamepad*, GP::Axis, GP::AxisState) {
+    ++ static_cast<Totals*>(self)->transitions;
+}
+static void button_changed(void* self, GP::Gamepad*, GP::Button, bool) {
+    ++ static_cast<Totals*>(self)->transitions;
+}
+
+struct TotalsListener : public GP::Listener {
+    Totals totals;
+
+    void axis_changed(GP::Gamepad*, GP::Axis, long value, unsigned) {
+        totals.sum += value;
+    }
+    void axis_state_changed(GP::Gamepad*, GP::Axis, GP::AxisState) {
+        ++ totals.transitions;
+    }
+    void button_changed(GP::Gamepad*, GP::Button, bool) {
+        ++ totals.transitions;
+    }
+};
+
+static void run_session(GP::SyntheticGamepad& gamepad) {
+    for (int r = 0; r < kReports; ++ r) {
+        long phase = r % 64;
+        for (int a = 0; a < 8; ++ a)
+            gamepad.set_axis_value(static_cast<GP::Axis>(a), phase == 0 ? 0 : phase * (a + 1));
+        if (r % 16 == 0)
+            gamepad.handle_button_change(GP::Button::_2, r % 32 == 0);
+        gamepad.handle_axes_change(1000000);
+        gamepad.handle_frame(1000000);
+    }
+}
+
+int main(int argc, char** argv) {
+    Totals callback_totals = {0, 0};
+    GP::SyntheticGamepad with_callbacks;
+    with_callbacks.set_axis_changed_callback(&callback_totals, axis_changed);
+    with_callbacks.set_axis_state_changed_callback(&callback_totals, axis_state_changed);
+    with_callbacks.set_button_changed_callback(&callback_totals, button_changed);
+
+    TotalsListener listener;
+    listener.totals.sum = listener.totals.transitions = 0;
+    GP::SyntheticGamepad with_listener;
+    with_listener.listen(listener);
+
+    uint64_t callback_time = GP::Bench::best_of(5, [&]{ run_session(with_callbacks); });
+    uint64_t listener_time = GP::Bench::best_of(5, [&]{ run_session(with_listener); });
+
+    if (callback_totals.sum != listener.totals.sum || callback_totals.transitions != listener.totals.transitions) {
+        printf("Listener and callbacks disagree: sum %ld/%ld, transitions %ld/%ld\n",
+               callback_totals.sum, listener.totals.sum, callback_totals.transitions, listener.totals.transitions);
+        return 1;
+    }
+
+    GP::Bench::report("C callbacks (axis, axis state, button)", double(callback_time) / kReports, "report");
+    GP::Bench::report("listen<TotalsListener>", double(listener_time) / kReports, "report");
+    GP::Bench::record("speedup", double(callback_time) / listener_time, "x", true);
+    return GP::Bench::finish(argc, argv);
+}
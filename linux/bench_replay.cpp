@@ -0,0 +1,168 @@
+/*
+ 
+bench_replay.cpp ... Measures how fast sessions replay.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+#include "Replay.hpp"
+#include "Gamepad_Linux.hpp"
+#include "MappedFile_Linux.hpp"
+#include <unistd.h>
+#include <string>
+
+// A recorded session of 4 pads, replayed unthrottled: once as frames
+// through ReplayGamepad to a subscriber, and once as raw reports decoded
+// by Gamepad_Linux. The rate is in recorded events per second.
+
+static const int kDevices = 4;
+static const int kFrames = 50000;
+
+static void axis_changed(void*, GP::Gamepad*, GP::Axis axis, long value, unsigned) {
+    GP::Bench::sink += value + static_cast<long>(axis);
+}
+
+static void frame(void*, GP::Gamepad*, const GP::Frame& frame) {
+    GP::Bench::sink += frame.sequence;
+}
+
+static void attached(void*, GP::Gamepad* gamepad, GP::GamepadState state) {
+    if (state != GP::GamepadState::attached)
+        return;
+    GP::Gamepad::Subscriber subscriber = {};
+    subscriber.axis_changed = axis_changed;
+    subscriber.frame = frame;
+    subscriber.interest = GP::Interest::everything();
+    gamepad->subscribe(subscriber);
+}
+
+static void decode_raw(void* self, int device, const uint8_t* bytes, size_t size) {
+    GP::Gamepad_Linux** gamepads = static_cast<GP::Gamepad_Linux**>(self);
+    gamepads[device]->handle_events(reinterpret_cast<const input_event*>(bytes), size / sizeof(input_event));
+}
+
+// Each device moves 3 axes and toggles a button every 8 reports, 1 ms apart.
+static std::string record_session(bool raw) {
+    char path[] = "/tmp/bench_replay_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0)
+        close(fd);
+    
+    GP::SessionWriter* writer = GP::SessionWriter::create(path);
+    int devices[kDevices];
+    for (int d = 0; d < kDevices; ++ d) {
+        GP::SessionDevice descriptor = {};
+        snprintf(descriptor.name, sizeof(descriptor.name), "pad %d", d);
+        descriptor.axes = 7;
+        descriptor.bounds[0] = descriptor.bounds[1] = descriptor.bounds[2] = 512;
+        devices[d] = writer->add_device(descriptor, 0);
+    }
+    
+    GP::Frame recorded = {};
+    for (int i = 0; i < kFrames; ++ i) {
+        uint64_t time = 1000000000ull + uint64_t(i) * 1000000;
+        for (int d = 0; d < kDevices; ++ d) {
+            ++ recorded.sequence;
+            recorded.nanoseconds_elapsed = 1000000;
+            for (int a = 0; a < 3; ++ a)
+                recorded.axes[a] = (i * (a + 3) + d * 50) % 1000 - 500;
+            recorded.held = GP::ButtonSet(i / 8 % 2 ? 2 : 0);
+            if (!raw) {
+                writer->record_frame(devices[d], recorded, time);
+                continue;
+            }
+            input_event events[5] = {};
+            for (int a = 0; a < 3; ++ a) {
+                events[a].type = EV_ABS;
+                events[a].code = ABS_X + a;
+                events[a].value = recorded.axes[a];
+            }
+            events[3].type = EV_KEY;
+            events[3].code = BTN_SOUTH;
+            events[3].value = i / 8 % 2;
+            events[4].type = EV_SYN;
+            events[4].code = SYN_REPORT;
+            writer->record_raw(devices[d], events, sizeof(events), time);
+        }
+        // the writer drops what its ring cannot hold; give the encoder time.
+        if (i % 1000 == 999)
+            usleep(2000);
+    }
+    delete writer;
+    return path;
+}
+
+static void measure_frames() {
+    std::string path = record_session(false);
+    {
+        GP::MappedFile_Linux file(path.c_str());
+        GP::SessionReader reader(file.data(), file.size());
+        uint64_t records = 0;
+        uint64_t ns = GP::Bench::best_of(5, [&]() {
+            GP::SessionReplay replay(reader);
+            replay.set_speed(0);
+            replay.set_callback(NULL, attached);
+            records = replay.run();
+        });
+        GP::Bench::record("frames through ReplayGamepad", records * 1e9 / ns, "events/s", true);
+    }
+    unlink(path.c_str());
+}
+
+static void measure_raw() {
+    std::string path = record_session(true);
+    {
+        GP::MappedFile_Linux file(path.c_str());
+        GP::SessionReader reader(file.data(), file.size());
+        GP::Gamepad_Linux* gamepads[kDevices];
+        for (int d = 0; d < kDevices; ++ d) {
+            gamepads[d] = new GP::Gamepad_Linux(-1, NULL);
+            for (int a = 0; a < 3; ++ a)
+                gamepads[d]->describe_axis(ABS_X + a, -512, 511);
+            gamepads[d]->describe_button(BTN_SOUTH);
+            gamepads[d]->set_axis_changed_callback(NULL, axis_changed);
+        }
+        uint64_t records = 0;
+        uint64_t ns = GP::Bench::best_of(5, [&]() {
+            GP::SessionReplay replay(reader);
+            replay.set_speed(0);
+            replay.set_raw_callback(gamepads, decode_raw);
+            records = replay.run();
+        });
+        for (int d = 0; d < kDevices; ++ d)
+            delete gamepads[d];
+        GP::Bench::record("raw reports through Gamepad_Linux", records * 1e9 / ns, "events/s", true);
+    }
+    unlink(path.c_str());
+}
+
+int main(int argc, char** argv) {
+    measure_frames();
+    measure_raw();
+    return GP::Bench::finish(argc, argv);
+}
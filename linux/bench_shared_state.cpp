@@ -0,0 +1,161 @@
+/*
+ 
+bench_shared_state.cpp ... Measures the latency of the shared state between processes.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+#include "SharedState_Linux.hpp"
+#include "Latency.hpp"
+#include <sys/wait.h>
+#include <sched.h>
+#include <unistd.h>
+#include <string>
+
+// A frame every 200 us is published to a shared state, and a forked
+// process reads its events: once sleeping on the futex between them, and
+// once polling changes(), yielding the processor between polls. The
+// latency runs from the publisher's timestamp to the reader's copy. The
+// cost of a publication is measured with no reader.
+
+static const int kFrames = 5000;
+
+namespace {
+    // Read until the detach; write the latencies to 'out'.
+    void read_events(GP::SharedStateReader_Linux* reader, bool poll, int out) {
+        GP::LatencyHistogram latency;
+        bool detached = false;
+        while (!detached) {
+            uint32_t seen = reader->changes();
+            GP::SharedEvent events[64];
+            size_t count;
+            while ((count = reader->read_events(events, 64)) > 0) {
+                uint64_t now = GP::Timer::monotonic_nanoseconds();
+                for (size_t i = 0; i < count; ++ i)
+                    if (events[i].type == GP::SharedEventType::detach)
+                        detached = true;
+                    else if (events[i].type == GP::SharedEventType::axis && now > events[i].timestamp)
+                        latency.record(now - events[i].timestamp);
+            }
+            if (detached)
+                break;
+            if (!poll)
+                reader->wait(seen, 1000);
+            else
+                while (reader->changes() == seen)
+                    sched_yield();
+        }
+        GP::LatencyDistribution distribution;
+        latency.copy_to(distribution);
+        if (write(out, &distribution, sizeof(distribution)) != sizeof(distribution))
+            _exit(1);
+    }
+    
+    void measure(const char* label, bool poll) {
+        char name[64];
+        snprintf(name, sizeof(name), "/bench_shared_state_%d", int(getpid()));
+        GP::SharedStatePublisher_Linux* publisher = GP::SharedStatePublisher_Linux::create(name);
+        long bounds[static_cast<int>(GP::Axis::count)] = {};
+        int slot = publisher->add_device("pad", bounds);
+        
+        int pipes[2];
+        if (pipe(pipes) != 0)
+            return;
+        pid_t child = fork();
+        if (child == 0) {
+            GP::SharedStateReader_Linux* reader = GP::SharedStateReader_Linux::open(name);
+            char byte = 1;
+            if (write(pipes[1], &byte, 1) != 1)
+                _exit(1);
+            read_events(reader, poll, pipes[1]);
+            _exit(0);
+        }
+        char byte;
+        if (read(pipes[0], &byte, 1) != 1)
+            return;
+        
+        GP::Frame frame = {};
+        frame.changed_axes = 1;
+        for (int i = 1; i <= kFrames; ++ i) {
+            frame.sequence = i;
+            frame.axes[0] = i % 1000 - 500;
+            publisher->publish_frame(slot, frame, GP::Timer::monotonic_nanoseconds());
+            usleep(200);
+        }
+        publisher->remove_device(slot);
+        
+        GP::LatencyDistribution latency;
+        size_t got = 0;
+        while (got < sizeof(latency)) {
+            ssize_t size = read(pipes[0], reinterpret_cast<char*>(&latency) + got, sizeof(latency) - got);
+            if (size <= 0)
+                break;
+            got += size;
+        }
+        waitpid(child, NULL, 0);
+        close(pipes[0]);
+        close(pipes[1]);
+        delete publisher;
+        if (got != sizeof(latency))
+            return;
+        
+        GP::LatencySummary summary = latency.summary();
+        std::string text = std::string(label) + ": p50 latency";
+        GP::Bench::record(text.c_str(), summary.p50 / 1000.0, "us");
+        text = std::string(label) + ": p99 latency";
+        GP::Bench::record(text.c_str(), summary.p99 / 1000.0, "us");
+    }
+    
+    void measure_publication() {
+        GP::SharedStatePublisher_Linux* publisher = GP::SharedStatePublisher_Linux::create(NULL);
+        long bounds[static_cast<int>(GP::Axis::count)] = {};
+        int slot = publisher->add_device("pad", bounds);
+        GP::Frame frame = {};
+        frame.changed_axes = 3;
+        const int kPublications = 100000;
+        uint64_t ns = GP::Bench::best_of(5, [&]() {
+            for (int i = 1; i <= kPublications; ++ i) {
+                frame.sequence = i;
+                frame.axes[0] = i;
+                frame.held = GP::ButtonSet(i & 2);
+                frame.pressed = GP::ButtonSet(i % 4 == 2 ? 2 : 0);
+                frame.released = GP::ButtonSet(i % 4 == 0 ? 2 : 0);
+                publisher->publish_frame(slot, frame, i);
+            }
+        });
+        GP::Bench::report("publish a frame, 2 axes and a button", double(ns) / kPublications, "frame");
+        delete publisher;
+    }
+}
+
+int main(int argc, char** argv) {
+    measure("futex wait", false);
+    measure("polling", true);
+    measure_publication();
+    return GP::Bench::finish(argc, argv);
+}
@@ -0,0 +1,134 @@
+/*
+ 
+bench_stream.cpp ... Measures the latency of streaming gamepad events between threads.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+#include "Stream_Linux.hpp"
+#include "EventLoop.hpp"
+#include "Latency.hpp"
+#include <poll.h>
+#include <unistd.h>
+#include <thread>
+#include <atomic>
+#include <string>
+
+// A pad moving every millisecond is published on the main thread's event
+// loop, and a client on another thread receives it. The latency runs from
+// the publisher's timestamp of a frame to the client's frame callback,
+// over Unix domain and UDP sockets.
+
+static const int kMilliseconds = 2000;
+
+namespace {
+    struct Client {
+        GP::StreamClient_Linux* client;
+        GP::LatencyHistogram latency;
+    };
+    
+    void frame(void* self, GP::Gamepad*, const GP::Frame&) {
+        Client* client = static_cast<Client*>(self);
+        uint64_t now = GP::Timer::monotonic_nanoseconds();
+        uint64_t sent = client->client->timestamp(0);
+        if (sent && now > sent)
+            client->latency.record(now - sent);
+    }
+    
+    void gamepad_changed(void* self, GP::Gamepad* gamepad, GP::GamepadState state) {
+        if (state == GP::GamepadState::attached)
+            gamepad->set_frame_callback(self, frame);
+    }
+    
+    void tick(void* self, GP::Timer*) {
+        GP::SyntheticGamepad* pad = static_cast<GP::SyntheticGamepad*>(self);
+        static int i = 0;
+        ++ i;
+        pad->set_axis_value(GP::Axis::X, i % 1000 - 500);
+        pad->set_axis_value(GP::Axis::Y, i % 700 - 350);
+        pad->handle_axes_change(1000000);
+        if (i % 50 == 0)
+            pad->handle_button_change(GP::Button::_1, i / 50 % 2 == 1);
+        pad->handle_frame(1000000);
+    }
+    
+    void measure(const char* address, const char* name) {
+        GP::EventLoop* loop = GP::EventLoop::create();
+        GP::StreamServer_Linux* server = GP::StreamServer_Linux::create(address, loop);
+        GP::SyntheticGamepad pad;
+        server->add_gamepad(&pad, "pad");
+        GP::Timer* timer = GP::Timer::create(&pad, tick, 1, loop);
+        
+        Client client;
+        client.client = NULL;
+        std::atomic<bool> stop(false);
+        std::thread thread([&]() {
+            client.client = new GP::StreamClient_Linux(address, NULL);
+            client.client->set_callback(&client, gamepad_changed);
+            while (!stop) {
+                pollfd ready = {client.client->fd(), POLLIN, 0};
+                if (poll(&ready, 1, 10) > 0)
+                    client.client->receive();
+            }
+            delete client.client;
+        });
+        
+        uint64_t deadline = GP::Timer::monotonic_nanoseconds() + uint64_t(kMilliseconds) * 1000000;
+        while (GP::Timer::monotonic_nanoseconds() < deadline) {
+            pollfd ready = {loop->readiness_fd(), POLLIN, 0};
+            poll(&ready, 1, 10);
+            loop->dispatch_pending();
+        }
+        stop = true;
+        thread.join();
+        
+        GP::StreamStatistics statistics = server->statistics(0);
+        GP::LatencyDistribution latency;
+        client.latency.copy_to(latency);
+        GP::LatencySummary summary = latency.summary();
+        std::string label = std::string(name) + ": p50 latency";
+        GP::Bench::record(label.c_str(), summary.p50 / 1000.0, "us");
+        label = std::string(name) + ": p99 latency";
+        GP::Bench::record(label.c_str(), summary.p99 / 1000.0, "us");
+        label = std::string(name) + ": bytes a frame";
+        GP::Bench::record(label.c_str(), statistics.frames ? double(statistics.bytes) / statistics.frames : 0, "B");
+        
+        delete timer;
+        server->remove_gamepad(&pad);
+        delete server;
+        delete loop;
+    }
+}
+
+int main(int argc, char** argv) {
+    char address[64];
+    snprintf(address, sizeof(address), "unix:@bench_stream_%d", int(getpid()));
+    measure(address, "unix");
+    measure("udp:127.0.0.1:47998", "udp");
+    return GP::Bench::finish(argc, argv);
+}
@@ -0,0 +1,89 @@
+/*
+ 
+bench_subscribers.cpp ... Dispatch cost against the number of subscribers.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+
+static const int kReports = 200000;
+
+static void axis_changed(void* self, GP::Gamepad*, GP::Axis, long value, unsigned) {
+    *static_cast<long*>(self) += value;
+}
+
+static void button_changed(void* self, GP::Gamepad*, GP::Button, bool is_pressed) {
+    *static_cast<long*>(self) += is_pressed;
+}
+
+// 6 axes and button 1 change in every report.
+static void run_session(GP::SyntheticGamepad& gamepad) {
+    for (int r = 0; r < kReports; ++ r) {
+        long phase = r % 64 + 1;
+        for (int a = 0; a < 6; ++ a)
+            gamepad.set_axis_value(static_cast<GP::Axis>(a), phase * (a + 1));
+        gamepad.handle_button_change(GP::Button::_1, r & 1);
+        gamepad.handle_axes_change(1000000);
+        gamepad.handle_frame(1000000);
+    }
+}
+
+static double measure(int subscribers, bool all_interested) {
+    static long totals[GP::Gamepad::kMaxSubscribers];
+    GP::SyntheticGamepad gamepad;
+
+    for (int i = 0; i < subscribers; ++ i) {
+        GP::Gamepad::Subscriber subscriber = {
+            &totals[i], axis_changed, NULL, NULL, NULL, button_changed, NULL, GP::Interest::everything()
+        };
+        if (!all_interested && i > 0) {
+            // The others only listen to an axis and a button which never change.
+            subscriber.interest.axes = 1u << static_cast<int>(GP::Axis::Vno);
+            subscriber.interest.buttons = GP::ButtonSet();
+            subscriber.interest.buttons.insert(GP::Button::_12);
+        }
+        gamepad.subscribe(subscriber);
+    }
+
+    return double(GP::Bench::best_of(5, [&]{ run_session(gamepad); })) / kReports;
+}
+
+int main(int argc, char** argv) {
+    const int counts[] = {1, 2, 4, 8, 16, 32};
+    char name[64];
+
+    for (unsigned i = 0; i < sizeof(counts)/sizeof(*counts); ++ i) {
+        snprintf(name, sizeof(name), "%2d subscribers, all interested", counts[i]);
+        GP::Bench::report(name, measure(counts[i], true), "report");
+    }
+    for (unsigned i = 0; i < sizeof(counts)/sizeof(*counts); ++ i) {
+        snprintf(name, sizeof(name), "%2d subscribers, 1 interested", counts[i]);
+        GP::Bench::report(name, measure(counts[i], false), "report");
+    }
+    return GP::Bench::finish(argc, argv);
+}
@@ -0,0 +1,150 @@
+/*
+ 
+bench_timers.cpp ... Re-arm cost and firing jitter of many timers.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+#include "EventLoop.hpp"
+#include "Timer.hpp"
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+static const int kTimers = 10000;
+static const int kRearms = 1000000;
+static const int kRunMilliseconds = 2000;
+
+static uint64_t random_state = 88172645463325252ULL;
+static unsigned random_below(unsigned limit) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state % limit;
+}
+
+static void nothing(void*, GP::Timer*) {}
+
+// Re-arm random timers among kTimers, as an idle timeout does on every input.
+static void measure_rearm(GP::EventLoop* loop) {
+    std::vector<GP::Timer*> timers;
+    for (int i = 0; i < kTimers; ++ i)
+        timers.push_back(GP::Timer::create(NULL, nothing, 10 + random_below(1000), loop));
+    std::vector<int> order(kRearms);
+    for (int i = 0; i < kRearms; ++ i)
+        order[i] = random_below(kTimers);
+    
+    uint64_t ns = GP::Bench::best_of(5, [&]() {
+        for (int i = 0; i < kRearms; ++ i)
+            timers[order[i]]->restart();
+    });
+    GP::Bench::report("restart(), 10k timers on the wheel", double(ns) / kRearms);
+    
+    ns = GP::Bench::best_of(5, [&]() {
+        for (int i = 0; i < kRearms; ++ i) {
+            timers[order[i]]->stop();
+            timers[order[i]]->restart();
+        }
+    });
+    GP::Bench::report("stop() + restart()", double(ns) / kRearms);
+    
+    for (auto it = timers.begin(); it != timers.end(); ++ it)
+        delete *it;
+    
+    // For comparison: one timerfd per timer, re-armed with a system call.
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    itimerspec spec = {{0, 100000000}, {0, 100000000}};
+    ns = GP::Bench::best_of(5, [&]() {
+        for (int i = 0; i < kRearms / 10; ++ i)
+            timerfd_settime(fd, 0, &spec, NULL);
+    });
+    GP::Bench::report("timerfd_settime(), for comparison", double(ns) / (kRearms / 10));
+    close(fd);
+}
+
+struct Firing {
+    uint64_t created;
+    uint64_t period;
+    uint64_t count;
+    std::vector<int64_t>* lateness;
+};
+
+static void record_firing(void* self, GP::Timer*) {
+    Firing* firing = static_cast<Firing*>(self);
+    uint64_t now = GP::Bench::now_ns();
+    uint64_t ideal = firing->created + ++ firing->count * firing->period;
+    firing->lateness->push_back(static_cast<int64_t>(now - ideal));
+}
+
+static void quit_loop(void* self, GP::Timer* timer) {
+    timer->stop();
+    static_cast<GP::EventLoop*>(self)->quit();
+}
+
+// Run kTimers periodic timers, and measure how late each firing is against
+// creation time + n * period. Without drift compensation the lateness would
+// grow with n.
+static void measure_jitter(GP::EventLoop* loop) {
+    std::vector<int64_t> lateness, last_lateness;
+    lateness.reserve(kTimers * kRunMilliseconds / 10);
+    
+    std::vector<Firing> firings(kTimers);
+    std::vector<GP::Timer*> timers;
+    for (int i = 0; i < kTimers; ++ i) {
+        int milliseconds = 10 + random_below(90);
+        Firing firing = {GP::Bench::now_ns(), uint64_t(milliseconds) * 1000000, 0, &lateness};
+        firings[i] = firing;
+        timers.push_back(GP::Timer::create(&firings[i], record_firing, milliseconds, loop));
+    }
+    GP::Timer* stop = GP::Timer::create(loop, quit_loop, kRunMilliseconds, loop);
+    loop->run();
+    delete stop;
+    for (auto it = timers.begin(); it != timers.end(); ++ it)
+        delete *it;
+    
+    size_t count = lateness.size();
+    // the firings of the last tenth of the run, to show there is no drift.
+    last_lateness.assign(lateness.end() - count / 10, lateness.end());
+    std::sort(lateness.begin(), lateness.end());
+    std::sort(last_lateness.begin(), last_lateness.end());
+    
+    GP::Bench::record("firings of 10k periodic timers in 2 s", count, "", true);
+    GP::Bench::record("lateness, median", lateness[count / 2] / 1000.0, "us");
+    GP::Bench::record("lateness, 99th percentile", lateness[count * 99 / 100] / 1000.0, "us");
+    GP::Bench::record("lateness, maximum", lateness[count - 1] / 1000.0, "us");
+    GP::Bench::record("lateness, median of the last 10%", last_lateness[last_lateness.size() / 2] / 1000.0, "us");
+}
+
+int main(int argc, char** argv) {
+    GP::EventLoop* loop = GP::EventLoop::create();
+    measure_rearm(loop);
+    measure_jitter(loop);
+    delete loop;
+    return GP::Bench::finish(argc, argv);
+}
@@ -0,0 +1,70 @@
+/*
+ 
+flight_trace.cpp ... Converts a flight recorder dump to a Chrome trace.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "FlightRecorder.hpp"
+#include <cstdio>
+#include <vector>
+
+// flight_trace <dump> [<trace.json>]
+//
+// Read what FlightRecorder::dump_on_crash() wrote, and write it as Chrome
+// trace events, to the standard output if no file is named. Open the trace
+// in chrome://tracing or https://ui.perfetto.dev.
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s <dump> [<trace.json>]\n", argv[0]);
+        return 2;
+    }
+    
+    FILE* input = fopen(argv[1], "rb");
+    if (!input) {
+        perror(argv[1]);
+        return 1;
+    }
+    std::vector<GP::FlightRecord> records;
+    bool ok = GP::FlightRecorder::read_dump(input, records);
+    fclose(input);
+    if (!ok) {
+        fprintf(stderr, "%s: not a flight recorder dump\n", argv[1]);
+        return 1;
+    }
+    
+    FILE* output = argc == 3 ? fopen(argv[2], "w") : stdout;
+    if (!output) {
+        perror(argv[2]);
+        return 1;
+    }
+    GP::FlightRecorder::write_chrome_trace(output, records.data(), records.size());
+    if (output != stdout)
+        fclose(output);
+    return 0;
+}
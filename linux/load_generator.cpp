@@ -0,0 +1,419 @@
+/*
+ 
+load_generator.cpp ... Drives virtual gamepads through the Linux reader.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "EventLoop.hpp"
+#include "GamepadChangedObserver.hpp"
+#include "Timer.hpp"
+#include "DeviceHub_Linux.hpp"
+#include "Gamepad_Linux.hpp"
+#include "Benchmark.hpp"
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+// load_generator [--pads N] [--rate HZ] [--seconds S] [--axes 0-6]
+//                [--buttons N] [--bounds MIN:MAX] [--waveform W]
+//                [--frequency HZ] [--script FILE] [--transport pipe|socketpair]
+//                [--threads N] [--json DIR] [--baseline DIR]
+//
+// Emulate N gamepads, each a pipe or a SOCK_SEQPACKET socketpair written
+// evdev events as a device node would be read, and attached to the device
+// hub, so that the real reader, decoder and dispatcher run. The axes follow
+// a sine, triangle, square or noise waveform, out of phase across pads, and
+// the buttons toggle; or every pad plays a script, one report per line of
+// 'X=<value> RY=<value> B3=1 ...', starting at a line of its own.
+//
+// Reports the reports delivered per second, the CPU of the reading thread
+// and of the writing threads per report, and the percentiles of the time
+// from a write to the return of the callbacks. The results take --json and
+// --baseline as the benchmarks do.
+
+namespace {
+    ENUM_CLASS Waveform { sine, triangle, square, noise, script };
+    
+    struct Options {
+        int pads;
+        int rate;
+        double seconds;
+        int axes;
+        int buttons;
+        int minimum;
+        int maximum;
+        Waveform waveform;
+        double frequency;
+        const char* script;
+        bool socketpair;
+        int threads;
+    };
+    
+    // The events of one scripted report: (type, code, value).
+    typedef std::vector<input_event> ScriptLine;
+    
+    struct VirtualPad {
+        int fd;
+        int axis_values[ABS_RZ + 1 - ABS_X];
+        uint32_t pressed;
+        uint32_t noise;
+        size_t script_line;
+    };
+    
+    struct GeneratorResult {
+        uint64_t written;
+        uint64_t refused;           // the fd was full: the reader fell behind.
+        uint64_t late_ticks;
+        uint64_t cpu_nanoseconds;
+    };
+    
+    std::atomic<bool> running(true);
+    long frames = 0;
+    
+    bool parse_script(const char* path, std::vector<ScriptLine>& lines) {
+        static const char* const axis_names[] = {"X", "Y", "Z", "RX", "RY", "RZ"};
+        FILE* file = fopen(path, "r");
+        if (!file)
+            return false;
+        char buffer[1024];
+        while (fgets(buffer, sizeof(buffer), file)) {
+            ScriptLine line;
+            for (char* token = strtok(buffer, " \t\r\n"); token; token = strtok(NULL, " \t\r\n")) {
+                char* equals = strchr(token, '=');
+                if (!equals)
+                    continue;
+                *equals = '\0';
+                input_event event = {};
+                event.value = atoi(equals + 1);
+                if (token[0] == 'B' && token[1] >= '0' && token[1] <= '9') {
+                    event.type = EV_KEY;
+                    event.code = BTN_GAMEPAD + atoi(token + 1) - 1;
+                    event.value = event.value != 0;
+                } else {
+                    for (int i = 0; i < 6; ++ i)
+                        if (!strcmp(token, axis_names[i])) {
+                            event.type = EV_ABS;
+                            event.code = ABS_X + i;
+                        }
+                }
+                if (event.type)
+                    line.push_back(event);
+            }
+            if (!line.empty())
+                lines.push_back(line);
+        }
+        fclose(file);
+        return !lines.empty();
+    }
+    
+    // The waveform at a phase in [0, 1), between -1 and 1.
+    double wave(Waveform waveform, double phase, uint32_t& noise) {
+        switch (waveform) {
+            case Waveform::sine:
+                return sin(2 * M_PI * phase);
+            case Waveform::triangle:
+                return phase < 0.5 ? 4 * phase - 1 : 3 - 4 * phase;
+            case Waveform::square:
+                return phase < 0.5 ? 1 : -1;
+            default:
+                // xorshift32
+                noise ^= noise << 13;
+                noise ^= noise >> 17;
+                noise ^= noise << 5;
+                return noise / 2147483648.0 - 1;
+        }
+    }
+    
+    void add_event(input_event* events, size_t& count, uint64_t now, int type, int code, int value) {
+        input_event& event = events[count ++];
+        event.time.tv_sec = now / 1000000000;
+        event.time.tv_usec = now % 1000000000 / 1000;
+        event.type = type;
+        event.code = code;
+        event.value = value;
+    }
+    
+    // Write a report to every pad of [begin, end) at each tick of the rate,
+    // stamped with the time of the write, as the kernel would stamp it.
+    void generate(const Options& options, const std::vector<ScriptLine>& script,
+                  VirtualPad* begin, VirtualPad* end, GeneratorResult* result) {
+        uint64_t period = 1000000000 / options.rate;
+        uint64_t next = GP::Timer::monotonic_nanoseconds();
+        uint64_t tick = 0;
+        double half_range = (options.maximum - options.minimum) / 2.0;
+        double center = options.minimum + half_range;
+        
+        while (running.load(std::memory_order_relaxed)) {
+            double seconds = double(tick) / options.rate;
+            for (VirtualPad* pad = begin; pad != end; ++ pad) {
+                input_event events[ABS_RZ + 1 - ABS_X + 32 + 1];
+                size_t count = 0;
+                uint64_t now = GP::Timer::monotonic_nanoseconds();
+                
+                if (options.waveform == Waveform::script) {
+                    const ScriptLine& line = script[pad->script_line];
+                    pad->script_line = (pad->script_line + 1) % script.size();
+                    for (auto it = line.begin(); it != line.end() && count < 32; ++ it)
+                        add_event(events, count, now, it->type, it->code, it->value);
+                } else {
+                    double pad_phase = double(pad - begin) / (end - begin);
+                    for (int axis = 0; axis < options.axes; ++ axis) {
+                        double phase = seconds * options.frequency + pad_phase + axis / 8.0;
+                        int value = int(center + half_range * wave(options.waveform, phase - floor(phase), pad->noise));
+                        // evdev leaves out the axes which did not move.
+                        if (value != pad->axis_values[axis]) {
+                            pad->axis_values[axis] = value;
+                            add_event(events, count, now, EV_ABS, ABS_X + axis, value);
+                        }
+                    }
+                    // button b is held for half of every 2^b reports.
+                    for (int button = 0; button < options.buttons; ++ button) {
+                        bool down = (tick >> button) & 1;
+                        if (down != ((pad->pressed >> button) & 1)) {
+                            pad->pressed ^= 1u << button;
+                            add_event(events, count, now, EV_KEY, BTN_GAMEPAD + button, down);
+                        }
+                    }
+                }
+                add_event(events, count, now, EV_SYN, SYN_REPORT, 0);
+                
+                if (write(pad->fd, events, count * sizeof(*events)) > 0)
+                    ++ result->written;
+                else
+                    ++ result->refused;
+            }
+            
+            ++ tick;
+            next += period;
+            uint64_t now = GP::Timer::monotonic_nanoseconds();
+            if (now >= next) {
+                ++ result->late_ticks;
+                continue;
+            }
+            timespec deadline = {time_t(next / 1000000000), long(next % 1000000000)};
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+        }
+        
+        timespec cpu;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+        result->cpu_nanoseconds = uint64_t(cpu.tv_sec) * 1000000000 + cpu.tv_nsec;
+    }
+    
+    void count_frame(void*, GP::Gamepad*, const GP::Frame&) {
+        ++ frames;
+    }
+    
+    // Past the 64 slots of an observer, gamepads are not subscribed by the
+    // observer; subscribe every one of them directly.
+    void handle_gamepad(void*, GP::Gamepad* gamepad, GP::GamepadState state) {
+        if (state != GP::GamepadState::attached)
+            return;
+        GP::Gamepad::Subscriber subscriber = {};
+        subscriber.frame = count_frame;
+        subscriber.interest = GP::Interest::everything();
+        gamepad->subscribe(subscriber);
+    }
+    
+    void stop(void* eventloop, GP::Timer*) {
+        static_cast<GP::EventLoop*>(eventloop)->quit();
+    }
+    
+    bool parse_options(int argc, char** argv, Options& options) {
+        for (int i = 1; i < argc; i += 2) {
+            if (i + 1 >= argc)
+                return false;
+            const char* name = argv[i];
+            const char* value = argv[i + 1];
+            if (!strcmp(name, "--pads"))
+                options.pads = atoi(value);
+            else if (!strcmp(name, "--rate"))
+                options.rate = atoi(value);
+            else if (!strcmp(name, "--seconds"))
+                options.seconds = atof(value);
+            else if (!strcmp(name, "--axes"))
+                options.axes = atoi(value);
+            else if (!strcmp(name, "--buttons"))
+                options.buttons = atoi(value);
+            else if (!strcmp(name, "--bounds")) {
+                if (sscanf(value, "%d:%d", &options.minimum, &options.maximum) != 2)
+                    return false;
+            } else if (!strcmp(name, "--waveform")) {
+                if (!strcmp(value, "sine"))
+                    options.waveform = Waveform::sine;
+                else if (!strcmp(value, "triangle"))
+                    options.waveform = Waveform::triangle;
+                else if (!strcmp(value, "square"))
+                    options.waveform = Waveform::square;
+                else if (!strcmp(value, "noise"))
+                    options.waveform = Waveform::noise;
+                else
+                    return false;
+            } else if (!strcmp(name, "--frequency"))
+                options.frequency = atof(value);
+            else if (!strcmp(name, "--script")) {
+                options.script = value;
+                options.waveform = Waveform::script;
+            } else if (!strcmp(name, "--transport")) {
+                if (strcmp(value, "pipe") && strcmp(value, "socketpair"))
+                    return false;
+                options.socketpair = !strcmp(value, "socketpair");
+            } else if (!strcmp(name, "--threads"))
+                options.threads = atoi(value);
+            else if (strcmp(name, "--json") && strcmp(name, "--baseline") && strcmp(name, "--tolerance"))
+                return false;
+        }
+        return options.pads > 0 && options.rate > 0 && options.seconds > 0
+            && options.axes >= 0 && options.axes <= ABS_RZ + 1 - ABS_X
+            && options.buttons >= 0 && options.buttons <= 16
+            && options.minimum < options.maximum && options.threads > 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options = {100, 1000, 5, 6, 12, -32768, 32767, Waveform::sine, 1, NULL, false, 1};
+    if (!parse_options(argc, argv, options)) {
+        fprintf(stderr, "usage: %s [--pads N] [--rate HZ] [--seconds S] [--axes 0-6] [--buttons 0-16]\n"
+                        "       [--bounds MIN:MAX] [--waveform sine|triangle|square|noise] [--frequency HZ]\n"
+                        "       [--script FILE] [--transport pipe|socketpair] [--threads N]\n"
+                        "       [--json DIR] [--baseline DIR] [--tolerance PCT]\n", argv[0]);
+        return 2;
+    }
+    std::vector<ScriptLine> script;
+    if (options.script && !parse_script(options.script, script)) {
+        fprintf(stderr, "%s: no reports in the script\n", options.script);
+        return 1;
+    }
+    
+    // two fds a pad.
+    rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+    
+    GP::EventLoop* loop = GP::EventLoop::create();
+    GP::GamepadChangedObserver* observer = GP::GamepadChangedObserver::create(NULL, handle_gamepad, loop);
+    GP::DeviceHub_Linux* hub = GP::DeviceHub_Linux::retain(loop);
+    
+    std::vector<VirtualPad> pads(options.pads);
+    for (int i = 0; i < options.pads; ++ i) {
+        int fds[2];
+        int status = options.socketpair ? socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds)
+                                        : pipe2(fds, O_NONBLOCK | O_CLOEXEC);
+        if (status != 0) {
+            perror("cannot create a virtual pad");
+            return 1;
+        }
+        
+        hub->attach("virtual" + std::to_string(i), fds[0]);
+        GP::Gamepad_Linux* gamepad = hub->devices().back().second.get();
+        for (int axis = 0; axis < options.axes; ++ axis)
+            gamepad->describe_axis(ABS_X + axis, options.minimum, options.maximum);
+        for (int button = 0; button < options.buttons; ++ button)
+            gamepad->describe_button(BTN_GAMEPAD + button);
+        gamepad->describe_monotonic_timestamps();
+        
+        VirtualPad& pad = pads[i];
+        pad.fd = fds[1];
+        for (int axis = 0; axis < ABS_RZ + 1 - ABS_X; ++ axis)
+            pad.axis_values[axis] = options.minimum - 1;
+        pad.pressed = 0;
+        pad.noise = 2463534242u + i;
+        pad.script_line = script.empty() ? 0 : i % script.size();
+    }
+    
+    int threads = std::min(options.threads, options.pads);
+    std::vector<GeneratorResult> results(threads, GeneratorResult());
+    std::vector<std::thread> generators;
+    timespec cpu;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    double reader_cpu = -(cpu.tv_sec * 1e9 + cpu.tv_nsec);
+    uint64_t start = GP::Timer::monotonic_nanoseconds();
+    for (int t = 0; t < threads; ++ t)
+        generators.push_back(std::thread(generate, std::cref(options), std::cref(script),
+                                         &pads[0] + options.pads * t / threads,
+                                         &pads[0] + options.pads * (t + 1) / threads, &results[t]));
+    
+    GP::Timer* timer = GP::Timer::create(loop, stop, int(options.seconds * 1000), loop);
+    loop->run();
+    delete timer;
+    running = false;
+    for (auto it = generators.begin(); it != generators.end(); ++ it)
+        it->join();
+    while (loop->dispatch_pending()) {}
+    double elapsed = (GP::Timer::monotonic_nanoseconds() - start) / 1e9;
+    
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    reader_cpu += cpu.tv_sec * 1e9 + cpu.tv_nsec;
+    GeneratorResult total = {};
+    for (auto it = results.begin(); it != results.end(); ++ it) {
+        total.written += it->written;
+        total.refused += it->refused;
+        total.late_ticks += it->late_ticks;
+        total.cpu_nanoseconds += it->cpu_nanoseconds;
+    }
+    
+    GP::Statistics statistics = GP::Gamepad::total_statistics();
+    GP::LatencySummary end_to_end = GP::Gamepad::total_latency(GP::LatencyStage::end_to_end);
+    GP::LatencySummary read_delay = GP::Gamepad::total_latency(GP::LatencyStage::read_delay);
+    printf("%d pads at %d Hz for %.1f s over %ss: %llu reports written, %llu refused, %llu late ticks,\n"
+           "%llu dispatched, %ld frames delivered\n",
+           options.pads, options.rate, elapsed, options.socketpair ? "socketpair" : "pipe",
+           (unsigned long long)total.written, (unsigned long long)total.refused,
+           (unsigned long long)total.late_ticks, (unsigned long long)statistics.reports_dispatched, frames);
+    
+    double delivered = double(frames);
+    GP::Bench::record("load: reports offered", total.written / elapsed, "reports/s", true);
+    GP::Bench::record("load: reports delivered", delivered / elapsed, "reports/s", true);
+    GP::Bench::record("load: reader CPU per report", delivered ? reader_cpu / delivered : 0, "ns/report");
+    GP::Bench::record("load: writer CPU per report", total.written ? total.cpu_nanoseconds / double(total.written) : 0, "ns/report");
+    GP::Bench::record("load: end to end p50", end_to_end.p50, "ns");
+    GP::Bench::record("load: end to end p99", end_to_end.p99, "ns");
+    GP::Bench::record("load: end to end max", end_to_end.max, "ns");
+    GP::Bench::record("load: waiting to be read p99", read_delay.p99, "ns");
+    
+    for (int i = 0; i < options.pads; ++ i) {
+        hub->detach("virtual" + std::to_string(i));
+        close(pads[i].fd);
+    }
+    hub->release();
+    delete observer;
+    delete loop;
+    return GP::Bench::finish(argc, argv);
+}
@@ -0,0 +1,225 @@
+/*
+ 
+session_columns.cpp ... Exports sessions to columns, and queries them.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Columns.hpp"
+#include "ColumnScan.hpp"
+#include "MappedFile_Linux.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+// session_columns export <session> <columns> [<rows per group>]
+// session_columns info <columns>
+// session_columns query <columns> --press <button> --cross <axis>:<fraction>
+//                       [--within <ms>] [--device <n>] [--isa scalar|sse2|avx2]
+//
+// Export the frames of a session recording to a columns file, list the
+// devices of one, or count, per device, the presses of a button within a
+// time of an axis crossing a fraction of its range: "--press 7 --cross
+// Rz:0.8 --within 50" counts the presses of button 7 within 50 ms, before
+// or after, of Rz rising past 80% of the way to its positive end. A
+// negative fraction crosses towards the negative end.
+
+namespace {
+    struct Query {
+        GP::Button button;
+        GP::Axis axis;
+        double fraction;
+        uint64_t within;
+        int device;             // -1 for all.
+    };
+    
+    // What a device adds up to over its groups.
+    struct DeviceResult {
+        std::string name;
+        uint64_t rows;
+        bool pressed;
+        bool crossed;
+        std::vector<uint64_t> presses;
+        std::vector<uint64_t> crossings;
+    };
+    
+    int export_session(const char* session, const char* columns, size_t group_rows) {
+        GP::MappedFile_Linux file(session);
+        GP::SessionReader reader(file.data(), file.size());
+        std::unique_ptr<GP::ColumnExporter> exporter(GP::ColumnExporter::create(columns, group_rows));
+        bool whole = exporter->add(reader);
+        // a write which failed, as on a full disk, throws here.
+        exporter->close();
+        printf("%llu rows in %llu groups\n", (unsigned long long)exporter->rows(), (unsigned long long)exporter->groups());
+        if (!whole)
+            fprintf(stderr, "%s: damaged; exported the records before\n", session);
+        if (reader.recovered())
+            fprintf(stderr, "%s: not closed by its writer; exported its whole blocks\n", session);
+        return 0;
+    }
+    
+    int info(const char* columns) {
+        GP::MappedFile_Linux file(columns);
+        GP::ColumnReader reader(file.data(), file.size());
+        for (size_t i = 0; i < reader.group_count(); ++ i) {
+            const GP::ColumnGroup& group = reader.group(i);
+            printf("device %d \"%s\": %zu rows, %.3f s to %.3f s, axes", group.device, group.name, group.rows,
+                   group.first_timestamp / 1e9, group.last_timestamp / 1e9);
+            for (int a = 0; a < static_cast<int>(GP::Axis::count); ++ a)
+                if (group.axes >> a & 1)
+                    printf(" %s", GP::name<char>(static_cast<GP::Axis>(a)));
+            printf("\n");
+        }
+        if (!reader.complete())
+            fprintf(stderr, "%s: cut short after %zu groups\n", columns, reader.group_count());
+        return 0;
+    }
+    
+    int query(const char* columns, const Query& query) {
+        GP::MappedFile_Linux file(columns);
+        GP::ColumnReader reader(file.data(), file.size());
+        std::vector<DeviceResult> results;
+        GP::RowMask selected, edges;
+        
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        uint64_t scanned = 0;
+        for (size_t i = 0; i < reader.group_count(); ++ i) {
+            const GP::ColumnGroup& group = reader.group(i);
+            if (query.device >= 0 && group.device != query.device)
+                continue;
+            if (size_t(group.device) >= results.size())
+                results.resize(group.device + 1);
+            DeviceResult& result = results[group.device];
+            result.name = group.name;
+            result.rows += group.rows;
+            scanned += group.rows;
+            
+            GP::ColumnScan::held(group.buttons, group.rows, query.button, selected);
+            GP::ColumnScan::rising(selected, result.pressed, edges);
+            GP::ColumnScan::times(group.timestamps, edges, result.presses);
+            
+            const int32_t* values = group.axis(query.axis);
+            if (!values)
+                continue;
+            int32_t threshold = group.threshold(query.axis, query.fraction);
+            if (query.fraction >= 0)
+                GP::ColumnScan::between(values, group.rows, threshold, INT32_MAX, selected);
+            else
+                GP::ColumnScan::between(values, group.rows, INT32_MIN, threshold, selected);
+            GP::ColumnScan::rising(selected, result.crossed, edges);
+            GP::ColumnScan::times(group.timestamps, edges, result.crossings);
+        }
+        
+        uint64_t presses = 0;
+        uint64_t matches = 0;
+        for (size_t device = 0; device < results.size(); ++ device) {
+            DeviceResult& result = results[device];
+            if (!result.rows)
+                continue;
+            size_t near = GP::ColumnScan::join_within(result.presses, result.crossings, query.within, query.within);
+            printf("device %zu \"%s\": %zu of %zu presses within %.0f ms of %s crossing %g%% (%zu crossings in %llu rows)\n",
+                   device, result.name.c_str(), near, result.presses.size(), query.within / 1e6,
+                   GP::name<char>(query.axis), query.fraction * 100, result.crossings.size(), (unsigned long long)result.rows);
+            presses += result.presses.size();
+            matches += near;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        static const char* isa_names[] = {"scalar", "sse2", "avx2"};
+        printf("all devices: %llu of %llu presses; %llu rows scanned in %.1f ms with %s\n", (unsigned long long)matches,
+               (unsigned long long)presses, (unsigned long long)scanned, seconds * 1e3, isa_names[static_cast<int>(GP::ColumnScan::isa())]);
+        return 0;
+    }
+    
+    bool parse_query(int argc, char** argv, Query& query) {
+        bool has_button = false;
+        bool has_axis = false;
+        for (int i = 3; i < argc; i += 2) {
+            if (i + 1 >= argc)
+                return false;
+            const char* name = argv[i];
+            const char* value = argv[i + 1];
+            if (!strcmp(name, "--press")) {
+                int button = atoi(value);
+                if (button < 1 || button > 31)
+                    return false;
+                query.button = static_cast<GP::Button>(button);
+                has_button = true;
+            } else if (!strcmp(name, "--cross")) {
+                const char* colon = strchr(value, ':');
+                if (!colon)
+                    return false;
+                for (int a = 0; a < static_cast<int>(GP::Axis::count); ++ a) {
+                    const char* axis_name = GP::name<char>(static_cast<GP::Axis>(a));
+                    if (strlen(axis_name) == size_t(colon - value) && !strncmp(value, axis_name, colon - value)) {
+                        query.axis = static_cast<GP::Axis>(a);
+                        has_axis = true;
+                    }
+                }
+                query.fraction = atof(colon + 1);
+            } else if (!strcmp(name, "--within"))
+                query.within = uint64_t(atof(value) * 1e6);
+            else if (!strcmp(name, "--device"))
+                query.device = atoi(value);
+            else if (!strcmp(name, "--isa")) {
+                static const char* isa_names[] = {"scalar", "sse2", "avx2"};
+                int isa = 0;
+                while (isa < 3 && strcmp(value, isa_names[isa]))
+                    ++ isa;
+                if (isa == 3 || !GP::ColumnScan::select(static_cast<GP::ScanIsa>(isa))) {
+                    fprintf(stderr, "%s: not supported here\n", value);
+                    return false;
+                }
+            } else
+                return false;
+        }
+        return has_button && has_axis && query.fraction >= -1 && query.fraction <= 1;
+    }
+}
+
+int main(int argc, char** argv) {
+    try {
+        if (argc >= 4 && argc <= 5 && !strcmp(argv[1], "export"))
+            return export_session(argv[2], argv[3], argc == 5 ? strtoul(argv[4], NULL, 10) : 65536);
+        if (argc == 3 && !strcmp(argv[1], "info"))
+            return info(argv[2]);
+        Query options = {GP::Button::_1, GP::Axis::X, 0, 50000000, -1};
+        if (argc >= 3 && !strcmp(argv[1], "query") && parse_query(argc, argv, options))
+            return query(argv[2], options);
+    } catch (const GP::BaseException& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    fprintf(stderr, "usage: %s export <session> <columns> [<rows per group>]\n"
+                    "       %s info <columns>\n"
+                    "       %s query <columns> --press <button> --cross <axis>:<fraction>\n"
+                    "                [--within <ms>] [--device <n>] [--isa scalar|sse2|avx2]\n", argv[0], argv[0], argv[0]);
+    return 2;
+}
@@ -0,0 +1,185 @@
+/*
+ 
+test_c_api.cpp ... Tests the C interface.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+#include "GamepadC_Linux.hpp"
+#include "EventLoop.hpp"
+#include "DeviceHub_Linux.hpp"
+#include "Gamepad_Linux.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <vector>
+
+// Attach a device fed through a pipe to a context: its attach, axis,
+// button and frame events must be polled in order, and its handle must
+// give its state until it detaches. Overfill a small queue: the newest
+// events are dropped and counted. With a callback, nothing is queued. A
+// button pressed and released within one report gives both events.
+
+namespace {
+    void write_report(int fd, int x, int south) {
+        input_event events[3] = {};
+        events[0].type = EV_ABS;
+        events[0].code = ABS_X;
+        events[0].value = x;
+        events[1].type = EV_KEY;
+        events[1].code = BTN_SOUTH;
+        events[1].value = south;
+        events[2].type = EV_SYN;
+        events[2].code = SYN_REPORT;
+        ssize_t written = write(fd, events, sizeof(events));
+        (void)written;
+    }
+    
+    bool check_device(GP::EventLoop* loop) {
+        gp_context* context = gp_create_on_loop(loop, 0);
+        int fds[2];
+        if (!context || pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0)
+            return false;
+        GP::DeviceHub_Linux* hub = GP::DeviceHub_Linux::retain(loop);
+        hub->attach("event-c-api", fds[0]);
+        GP::Gamepad_Linux* gamepad = hub->devices().back().second.get();
+        gamepad->describe_axis(ABS_X, -512, 511);
+        gamepad->describe_button(BTN_SOUTH);
+        
+        gp_device device = 0;
+        bool ok = gp_devices(context, &device, 1) == 1 && device != 0;
+        gp_event events[16];
+        size_t count = gp_poll_events(context, events, 16);
+        ok = ok && count == 1 && events[0].type == GP_EVENT_ATTACHED && events[0].device == device;
+        
+        write_report(fds[1], 300, 1);
+        write_report(fds[1], 300, 0);
+        while (loop->dispatch_pending()) {}
+        count = gp_poll_events(context, events, 16);
+        // X, button 1 down, frame; button 1 up, frame.
+        ok = ok && count == 5
+                && events[0].type == GP_EVENT_AXIS && events[0].index == GP_AXIS_X && events[0].value == 300
+                && events[1].type == GP_EVENT_BUTTON && events[1].index == 1 && events[1].value == 1
+                && events[2].type == GP_EVENT_FRAME && events[2].sequence == 1 && events[2].value == 1
+                && events[3].type == GP_EVENT_BUTTON && events[3].value == 0 && events[3].sequence == 2;
+        
+        gp_state state;
+        gp_device_info info;
+        ok = ok && gp_state_of(context, device, &state) == 0 && state.sequence == 2 && state.axes[GP_AXIS_X] == 300
+                && state.buttons == 0 && state.moving_axes == 1
+                && gp_device_info_of(context, device, &info) == 0 && info.slot == gamepad->slot()
+                && (info.axes & 1u << GP_AXIS_X) && info.axis_bounds[GP_AXIS_X] == gamepad->axis_bound(GP::Axis::X);
+        
+        hub->detach("event-c-api");
+        hub->release();
+        close(fds[1]);
+        count = gp_poll_events(context, events, 16);
+        ok = ok && count == 1 && events[0].type == GP_EVENT_DETACHED && events[0].device == device
+                && gp_state_of(context, device, &state) == -1 && gp_devices(context, NULL, 0) == 0;
+        printf("a device from attach to detach: %s\n", ok ? "ok" : "FAILED");
+        gp_destroy(context);
+        return ok;
+    }
+    
+    void count_event(void* user, const gp_event*) {
+        ++ *static_cast<int*>(user);
+    }
+    
+    bool check_overflow_and_callback() {
+        gp_context* context = gp_create(8);
+        bool ok = context && gp_fd(context) >= 0 && gp_dispatch(context, 0) == 0;
+        if (!context)
+            return false;
+        GP::SyntheticGamepad pad;
+        gp_device device = context->queue.add_gamepad(&pad);
+        
+        // attach, then 3 events a frame.
+        for (int i = 1; i <= 10; ++ i) {
+            pad.set_axis_value(GP::Axis::Y, i);
+            pad.handle_axes_change(1000000);
+            pad.handle_button_change(GP::Button::_2, i % 2 == 1);
+            pad.handle_frame(1000000);
+        }
+        gp_event events[16];
+        size_t count = gp_poll_events(context, events, 16);
+        ok = ok && device && count == 8 && gp_dropped_events(context) == 31 - 8
+                && events[0].type == GP_EVENT_ATTACHED && events[7].type == GP_EVENT_AXIS && events[7].sequence == 3;
+        
+        int called = 0;
+        gp_set_event_callback(context, count_event, &called);
+        pad.set_axis_value(GP::Axis::Y, 100);
+        pad.handle_axes_change(1000000);
+        pad.handle_frame(1000000);
+        ok = ok && called == 2 && gp_poll_events(context, events, 16) == 0;
+        printf("a queue of 8: %zu polled, %llu dropped; a callback: %d events, %s\n", count,
+               (unsigned long long)gp_dropped_events(context), called, ok ? "ok" : "FAILED");
+        context->queue.remove_gamepad(&pad);
+        gp_destroy(context);
+        return ok;
+    }
+    
+    bool check_tap() {
+        gp_context* context = gp_create(16);
+        if (!context)
+            return false;
+        GP::SyntheticGamepad pad;
+        context->queue.add_gamepad(&pad);
+        
+        // _1 tapped, then _2 held and tapped again.
+        pad.handle_button_change(GP::Button::_1, true);
+        pad.handle_button_change(GP::Button::_1, false);
+        pad.handle_button_change(GP::Button::_2, true);
+        pad.handle_frame(1000000);
+        pad.handle_button_change(GP::Button::_2, false);
+        pad.handle_button_change(GP::Button::_2, true);
+        pad.handle_frame(1000000);
+        gp_event events[16];
+        size_t count = gp_poll_events(context, events, 16);
+        // attach; _1 down, _1 up, _2 down, frame; _2 up, _2 down, frame.
+        bool ok = count == 8
+                && events[1].type == GP_EVENT_BUTTON && events[1].index == 1 && events[1].value == 1
+                && events[2].type == GP_EVENT_BUTTON && events[2].index == 1 && events[2].value == 0
+                && events[3].type == GP_EVENT_BUTTON && events[3].index == 2 && events[3].value == 1
+                && events[5].type == GP_EVENT_BUTTON && events[5].index == 2 && events[5].value == 0
+                && events[6].type == GP_EVENT_BUTTON && events[6].index == 2 && events[6].value == 1;
+        printf("buttons tapped within a report: %zu events, %s\n", count, ok ? "ok" : "FAILED");
+        context->queue.remove_gamepad(&pad);
+        gp_destroy(context);
+        return ok;
+    }
+}
+
+int main() {
+    GP::EventLoop* loop = GP::EventLoop::create();
+    bool ok = gp_version() == GP_C_VERSION;
+    ok = check_device(loop) && ok;
+    ok = check_overflow_and_callback() && ok;
+    ok = check_tap() && ok;
+    delete loop;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+/*
+ 
+test_callback_swap.cpp ... Stress test for swapping callbacks while a gamepad dispatches.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdio>
+
+// One thread feeds a gamepad, first at 1 kHz like a real device and then as
+// fast as it can, while writer threads keep replacing its callbacks, its
+// listener and its subscribers. Every handler checks that it was called
+// with the self it was registered with.
+
+static const int kPacedReports = 1000;
+static const int kBurstReports = 200000;
+static const int kWriters = 3;
+
+static std::atomic<long> mismatches(0);
+static std::atomic<long> calls(0);
+
+struct Owner {
+    char tag;
+};
+static Owner owner_a = {'A'};
+static Owner owner_b = {'B'};
+
+static void check(char actual, char expected) {
+    if (actual != expected)
+        mismatches.fetch_add(1, std::memory_order_relaxed);
+    calls.fetch_add(1, std::memory_order_relaxed);
+}
+static void check(void* self, char expected) {
+    check(static_cast<Owner*>(self)->tag, expected);
+}
+
+static void axis_changed_a(void* self, GP::Gamepad*, GP::Axis, long, unsigned) { check(self, 'A'); }
+static void axis_changed_b(void* self, GP::Gamepad*, GP::Axis, long, unsigned) { check(self, 'B'); }
+static void button_changed_a(void* self, GP::Gamepad*, GP::Button, bool) { check(self, 'A'); }
+static void button_changed_b(void* self, GP::Gamepad*, GP::Button, bool) { check(self, 'B'); }
+static void frame_a(void* self, GP::Gamepad*, const GP::Frame&) { check(self, 'A'); }
+static void frame_b(void* self, GP::Gamepad*, const GP::Frame&) { check(self, 'B'); }
+
+// Each instantiation is dispatched by its own thunk, so a thunk paired with
+// the other listener reads the wrong tag.
+template <char Tag>
+struct TaggedListener : public GP::Listener {
+    char tag;
+    
+    TaggedListener() : tag(Tag) {}
+    
+    void axis_changed(GP::Gamepad*, GP::Axis, long, unsigned) {
+        check(tag, Tag);
+    }
+    void frame(GP::Gamepad*, const GP::Frame&) {
+        check(tag, Tag);
+    }
+};
+
+static void swap_callbacks(GP::Gamepad* gamepad, const std::atomic<bool>* done) {
+    static TaggedListener<'A'> listener_a;
+    static TaggedListener<'B'> listener_b;
+    
+    for (unsigned i = 0; !done->load(std::memory_order_relaxed); ++ i) {
+        bool a = i & 1;
+        gamepad->set_axis_changed_callback(a ? &owner_a : &owner_b, a ? axis_changed_a : axis_changed_b);
+        gamepad->set_button_changed_callback(a ? &owner_a : &owner_b, a ? button_changed_a : button_changed_b);
+        gamepad->set_frame_callback(a ? &owner_a : &owner_b, a ? frame_a : frame_b);
+        if (i % 4 == 0)
+            gamepad->listen(listener_b);
+        else if (i % 4 == 1)
+            gamepad->listen(listener_a);
+        else if (i % 4 == 2)
+            gamepad->unlisten();
+        
+        GP::Gamepad::Subscriber subscriber = {};
+        subscriber.self = a ? &owner_a : &owner_b;
+        subscriber.axis_changed = a ? axis_changed_a : axis_changed_b;
+        subscriber.button_changed = a ? button_changed_a : button_changed_b;
+        subscriber.frame = a ? frame_a : frame_b;
+        subscriber.interest = GP::Interest::everything();
+        int id = gamepad->subscribe(subscriber);
+        std::this_thread::yield();
+        gamepad->unsubscribe(id);
+    }
+}
+
+static void feed(GP::SyntheticGamepad& gamepad, int reports, bool paced) {
+    uint64_t next = GP::Bench::now_ns();
+    for (int r = 0; r < reports; ++ r) {
+        if (paced) {
+            next += 1000000;
+            while (GP::Bench::now_ns() < next)
+                std::this_thread::yield();
+        }
+        for (int a = 0; a < 4; ++ a)
+            gamepad.set_axis_value(static_cast<GP::Axis>(a), (r % 32) * (a + 1));
+        if (r % 8 == 0)
+            gamepad.handle_button_change(GP::Button::_1, r % 16 == 0);
+        gamepad.handle_axes_change(1000000);
+        gamepad.handle_frame(1000000);
+    }
+}
+
+int main() {
+    GP::SyntheticGamepad gamepad;
+    std::atomic<bool> done(false);
+    
+    std::vector<std::thread> writers;
+    for (int i = 0; i < kWriters; ++ i)
+        writers.push_back(std::thread(swap_callbacks, &gamepad, &done));
+    
+    feed(gamepad, kPacedReports, true);
+    feed(gamepad, kBurstReports, false);
+    
+    done = true;
+    for (auto it = writers.begin(); it != writers.end(); ++ it)
+        it->join();
+    
+    printf("%ld handler calls, %ld with the wrong self\n", calls.load(), mismatches.load());
+    return mismatches.load() == 0 && calls.load() > 0 ? 0 : 1;
+}
@@ -0,0 +1,301 @@
+/*
+ 
+test_columns.cpp ... Tests the columnar export of sessions, and scans over it.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Columns.hpp"
+#include "ColumnScan.hpp"
+#include "MappedFile_Linux.hpp"
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Every scan must select the same rows with each instruction set the
+// processor has, at every length around a word, as a row by row check
+// does. Edges and joins must carry over from group to group. A session of
+// two devices must export to groups holding exactly the states a cursor
+// decodes, and a query over them must find the presses planted near
+// crossings. An export to a full disk must fail on close().
+
+namespace {
+    const char* isa_names[] = {"scalar", "sse2", "avx2"};
+    
+    bool same(const GP::RowMask& mask, const std::vector<bool>& expected) {
+        if (mask.size() != expected.size())
+            return false;
+        for (size_t i = 0; i < expected.size(); ++ i)
+            if (mask.test(i) != expected[i])
+                return false;
+        size_t count = 0;
+        for (size_t i = 0; i < expected.size(); ++ i)
+            count += expected[i];
+        return mask.count() == count;
+    }
+    
+    bool check_scans() {
+        static const size_t lengths[] = {0, 1, 7, 63, 64, 65, 200, 1031};
+        std::vector<int32_t> values(1031);
+        std::vector<uint64_t> held(1031);
+        for (size_t i = 0; i < values.size(); ++ i) {
+            values[i] = i % 97 == 0 ? INT32_MIN : i % 89 == 0 ? INT32_MAX : rand() % 2001 - 1000;
+            held[i] = uint64_t(rand()) << 32 ^ rand();
+        }
+        
+        bool ok = true;
+        for (int isa = 0; isa < static_cast<int>(GP::ScanIsa::scan_isa_count); ++ isa) {
+            if (!GP::ColumnScan::select(static_cast<GP::ScanIsa>(isa)))
+                continue;
+            bool isa_ok = true;
+            for (size_t l = 0; l < sizeof(lengths) / sizeof(*lengths); ++ l) {
+                size_t rows = lengths[l];
+                GP::RowMask mask;
+                std::vector<bool> expected(rows);
+                
+                static const int32_t ranges[][2] = {{-500, 500}, {INT32_MIN, 0}, {800, INT32_MAX}, {3, 2}};
+                for (int r = 0; r < 4; ++ r) {
+                    for (size_t i = 0; i < rows; ++ i)
+                        expected[i] = values[i] >= ranges[r][0] && values[i] <= ranges[r][1];
+                    GP::ColumnScan::between(values.data(), rows, ranges[r][0], ranges[r][1], mask);
+                    isa_ok = isa_ok && same(mask, expected);
+                }
+                
+                static const uint64_t masks[][2] = {{1, 1}, {0x41, 0x40}, {~0ull, held[5]}, {0, 0}};
+                for (int m = 0; m < 4; ++ m) {
+                    for (size_t i = 0; i < rows; ++ i)
+                        expected[i] = (held[i] & masks[m][0]) == masks[m][1];
+                    GP::ColumnScan::buttons(held.data(), rows, masks[m][0], masks[m][1], mask);
+                    isa_ok = isa_ok && same(mask, expected);
+                }
+            }
+            printf("scans with %s: %s\n", isa_names[isa], isa_ok ? "ok" : "FAILED");
+            ok = ok && isa_ok;
+        }
+        GP::ColumnScan::select(GP::ColumnScan::best_isa());
+        return ok;
+    }
+    
+    // A predicate held from row 60 to 70 and from 130 on, scanned as two
+    // groups of 100 rows: it rises at 60 and 130 and falls at 71 only.
+    bool check_edges() {
+        GP::RowMask first(100), second(100);
+        first.set_range(60, 71);
+        second.set_range(30, 100);
+        
+        bool rising_previous = false;
+        bool falling_previous = false;
+        GP::RowMask edges;
+        std::vector<size_t> rises, falls;
+        GP::ColumnScan::rising(first, rising_previous, edges);
+        edges.for_each([&](size_t row) { rises.push_back(row); });
+        GP::ColumnScan::falling(first, falling_previous, edges);
+        edges.for_each([&](size_t row) { falls.push_back(row); });
+        GP::ColumnScan::rising(second, rising_previous, edges);
+        edges.for_each([&](size_t row) { rises.push_back(row + 100); });
+        GP::ColumnScan::falling(second, falling_previous, edges);
+        edges.for_each([&](size_t row) { falls.push_back(row + 100); });
+        
+        // the next group starting selected is no edge.
+        GP::RowMask third(10);
+        third.set_range(0, 10);
+        GP::ColumnScan::rising(third, rising_previous, edges);
+        
+        bool ok = rises.size() == 2 && rises[0] == 60 && rises[1] == 130 && falls.size() == 1 && falls[0] == 71
+               && edges.count() == 0 && rising_previous;
+        
+        std::vector<uint64_t> left, right;
+        uint64_t left_times[] = {100, 200, 300, 400};
+        uint64_t right_times[] = {45, 260, 460, 1000};
+        left.assign(left_times, left_times + 4);
+        right.assign(right_times, right_times + 4);
+        std::vector<size_t> matched;
+        // within 60 before or 50 after: 100 by 45, 300 by 260.
+        size_t matches = GP::ColumnScan::join_within(left, right, 60, 50, &matched);
+        ok = ok && matches == 2 && matched[0] == 0 && matched[1] == 2;
+        // only after: 200 by 260, 400 by 460.
+        ok = ok && GP::ColumnScan::join_within(left, right, 0, 60) == 2;
+        printf("edges and joins: %s\n", ok ? "ok" : "FAILED");
+        return ok;
+    }
+    
+    std::string temporary_path() {
+        char path[] = "/tmp/test_columns_XXXXXX";
+        int fd = mkstemp(path);
+        if (fd >= 0)
+            close(fd);
+        return path;
+    }
+    
+    const int kFrames = 1000;
+    const uint64_t kStart = 1000000000ull;
+    
+    // Device 0 has X, Y and Rz, and presses button 7 every 100 frames, 10
+    // frames after Rz goes past 80%, or 30 frames after for every other;
+    // device 1 has X alone and presses button 7 now and then.
+    std::string record_session() {
+        std::string path = temporary_path();
+        GP::SessionWriter* writer = GP::SessionWriter::create(path.c_str(), 4096);
+        GP::SessionDevice pad = {};
+        snprintf(pad.name, sizeof(pad.name), "pad");
+        pad.axes = 1 << static_cast<int>(GP::Axis::X) | 1 << static_cast<int>(GP::Axis::Y) | 1 << static_cast<int>(GP::Axis::Rz);
+        pad.bounds[static_cast<int>(GP::Axis::X)] = pad.bounds[static_cast<int>(GP::Axis::Y)] = pad.bounds[static_cast<int>(GP::Axis::Rz)] = 1000;
+        GP::SessionDevice stick = {};
+        snprintf(stick.name, sizeof(stick.name), "stick");
+        stick.axes = 1;
+        stick.bounds[0] = 100;
+        int devices[] = {writer->add_device(pad, kStart), writer->add_device(stick, kStart)};
+        
+        GP::Frame frames[2] = {};
+        for (int i = 0; i < kFrames; ++ i) {
+            uint64_t time = kStart + uint64_t(i) * 1000000;
+            int phase = i % 100;
+            GP::Frame& frame = frames[0];
+            ++ frame.sequence;
+            frame.axes[static_cast<int>(GP::Axis::X)] = i;
+            frame.axes[static_cast<int>(GP::Axis::Y)] = -i;
+            frame.axes[static_cast<int>(GP::Axis::Rz)] = phase >= 20 && phase < 40 ? 900 : 100;
+            int press = i / 100 % 2 ? 50 : 30;
+            frame.held = GP::ButtonSet(phase >= press && phase < press + 5 ? uint64_t(1) << GP::ButtonSet::index(GP::Button::_7) : 0);
+            writer->record_frame(devices[0], frame, time);
+            
+            GP::Frame& other = frames[1];
+            ++ other.sequence;
+            other.axes[0] = i % 50;
+            other.held = GP::ButtonSet(i % 7 == 0 ? uint64_t(1) << GP::ButtonSet::index(GP::Button::_7) : 0);
+            writer->record_frame(devices[1], other, time + 500000);
+        }
+        delete writer;
+        return path;
+    }
+    
+    bool check_export() {
+        std::string session = record_session();
+        std::string columns = temporary_path();
+        bool ok = true;
+        {
+            GP::MappedFile_Linux file(session.c_str());
+            GP::SessionReader reader(file.data(), file.size());
+            GP::ColumnExporter* exporter = GP::ColumnExporter::create(columns.c_str(), 300);
+            ok = exporter->add(reader);
+            exporter->close();
+            delete exporter;
+            
+            GP::MappedFile_Linux exported(columns.c_str());
+            GP::ColumnReader groups(exported.data(), exported.size());
+            ok = ok && groups.complete() && groups.row_count() == 2 * kFrames && groups.group_count() == 8;
+            
+            // the rows of each device, in order, are the states after its frames.
+            size_t next[2] = {0, 0};
+            size_t group_of[2] = {0, 0};
+            size_t row_of[2] = {0, 0};
+            std::vector<size_t> device_groups[2];
+            for (size_t g = 0; g < groups.group_count(); ++ g)
+                device_groups[groups.group(g).device].push_back(g);
+            
+            GP::SessionReader::Cursor cursor = reader.begin();
+            GP::SessionRecord record;
+            while (ok && cursor.next(record)) {
+                if (record.type != GP::SessionRecordType::frame)
+                    continue;
+                int d = record.device;
+                const GP::ColumnGroup& group = groups.group(device_groups[d][group_of[d]]);
+                size_t row = row_of[d];
+                ok = group.timestamps[row] == record.timestamp && group.buttons[row] == record.state->held.bits();
+                for (int a = 0; a < static_cast<int>(GP::Axis::count); ++ a)
+                    if (group.axes >> a & 1)
+                        ok = ok && group.axis_columns[a][row] == record.state->axes[a];
+                ++ next[d];
+                if (++ row_of[d] == group.rows) {
+                    row_of[d] = 0;
+                    ++ group_of[d];
+                }
+            }
+            ok = ok && next[0] == size_t(kFrames) && next[1] == size_t(kFrames);
+            ok = ok && !groups.group(device_groups[1][0]).axis(GP::Axis::Rz) && !strcmp(groups.group(device_groups[1][0]).name, "stick");
+            printf("%zu groups of %llu rows exported: %s\n", groups.group_count(), (unsigned long long)groups.row_count(), ok ? "ok" : "FAILED");
+            
+            // the presses of device 0, each 10 frames (ms) after a crossing
+            // half of the time, and 30 frames after the other half.
+            std::vector<uint64_t> presses, crossings;
+            bool pressed = false, crossed = false;
+            GP::RowMask selected, edges;
+            for (size_t g = 0; g < device_groups[0].size(); ++ g) {
+                const GP::ColumnGroup& group = groups.group(device_groups[0][g]);
+                GP::ColumnScan::held(group.buttons, group.rows, GP::Button::_7, selected);
+                GP::ColumnScan::rising(selected, pressed, edges);
+                GP::ColumnScan::times(group.timestamps, edges, presses);
+                GP::ColumnScan::between(group.axis(GP::Axis::Rz), group.rows, group.threshold(GP::Axis::Rz, 0.8), INT32_MAX, selected);
+                GP::ColumnScan::rising(selected, crossed, edges);
+                GP::ColumnScan::times(group.timestamps, edges, crossings);
+            }
+            size_t near = GP::ColumnScan::join_within(presses, crossings, 15000000, 15000000);
+            bool query_ok = presses.size() == 10 && crossings.size() == 10 && near == 5;
+            printf("presses within 15 ms of Rz crossing 80%%: %zu of %zu, %zu crossings: %s\n",
+                   near, presses.size(), crossings.size(), query_ok ? "ok" : "FAILED");
+            ok = ok && query_ok;
+        }
+        
+        // a file cut short keeps its whole groups.
+        if (truncate(columns.c_str(), 20000) == 0) {
+            GP::MappedFile_Linux exported(columns.c_str());
+            GP::ColumnReader groups(exported.data(), exported.size());
+            bool cut_ok = !groups.complete() && groups.group_count() > 0 && groups.group_count() < 8;
+            printf("a cut file keeps %zu groups: %s\n", groups.group_count(), cut_ok ? "ok" : "FAILED");
+            ok = ok && cut_ok;
+        }
+        
+        // a full disk is reported, rather than leaving a short file.
+        {
+            GP::MappedFile_Linux file(session.c_str());
+            GP::SessionReader reader(file.data(), file.size());
+            GP::ColumnExporter* exporter = GP::ColumnExporter::create("/dev/full", 300);
+            exporter->add(reader);
+            bool full_ok = !exporter->flush();
+            try {
+                exporter->close();
+                full_ok = false;
+            } catch (const GP::ColumnFileException&) {
+            }
+            delete exporter;
+            printf("an export to a full disk: %s\n", full_ok ? "refused on close" : "FAILED");
+            ok = ok && full_ok;
+        }
+        unlink(session.c_str());
+        unlink(columns.c_str());
+        return ok;
+    }
+}
+
+int main() {
+    bool ok = check_scans();
+    ok = check_edges() && ok;
+    ok = check_export() && ok;
+    return ok ? 0 : 1;
+}
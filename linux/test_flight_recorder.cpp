@@ -0,0 +1,126 @@
+/*
+ 
+test_flight_recorder.cpp ... Checks the flight recorder under concurrent writers and on a crash.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "FlightRecorder.hpp"
+#include "Timer.hpp"
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+// Four threads record while the main thread takes snapshots: a record must
+// never be torn, and each thread's records must come out in order. Then a
+// child process crashes, and its dump must hold the records it made last.
+
+static const int kThreads = 4;
+static const uint64_t kRecords = 200000;
+
+// The argument and the duration are derived from the start, so that a torn
+// record shows.
+static void record_many(int thread) {
+    for (uint64_t i = 1; i <= kRecords; ++ i) {
+        uint64_t start = i << 8 | thread;
+        GP::FlightRecorder::instance().record(GP::FlightEvent::read, NULL, start * 3, start, start * 7);
+    }
+}
+
+static bool check_record(const GP::FlightRecord& record, uint64_t* last_start) {
+    if (record.argument != record.start * 3 || record.duration != record.start * 7)
+        return false;
+    if (record.thread < 1 || record.thread > kThreads + 1)
+        return false;
+    // a thread's records are in the order it made them.
+    bool ordered = record.start > last_start[record.thread];
+    last_start[record.thread] = record.start;
+    return ordered;
+}
+
+static bool check_concurrent_writers() {
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreads; ++ i)
+        threads.push_back(std::thread(record_many, i));
+    
+    std::vector<GP::FlightRecord> records(GP::FlightRecorder::kCapacity);
+    long snapshots = 0, checked = 0, torn = 0;
+    for (int round = 0; round < 2000; ++ round) {
+        size_t count = GP::FlightRecorder::instance().snapshot(records.data(), records.size());
+        uint64_t last_start[kThreads + 2] = {0};
+        for (size_t i = 0; i < count; ++ i, ++ checked)
+            if (!check_record(records[i], last_start))
+                ++ torn;
+        ++ snapshots;
+    }
+    for (auto it = threads.begin(); it != threads.end(); ++ it)
+        it->join();
+    
+    printf("%ld snapshots, %ld records checked, %ld torn or out of order\n", snapshots, checked, torn);
+    return torn == 0;
+}
+
+static bool check_crash_dump() {
+    char path[] = "/tmp/test_flight_recorder.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return false;
+    close(fd);
+    
+    pid_t child = fork();
+    if (child == 0) {
+        GP::FlightRecorder::dump_on_crash(path);
+        for (int i = 0; i < 10; ++ i)
+            GP::FlightRecorder::instance().record(GP::FlightEvent::timer, path, 1000 + i, GP::Timer::monotonic_nanoseconds());
+        abort();
+    }
+    int status;
+    waitpid(child, &status, 0);
+    
+    std::vector<GP::FlightRecord> records;
+    FILE* file = fopen(path, "rb");
+    bool ok = file && GP::FlightRecorder::read_dump(file, records);
+    if (file)
+        fclose(file);
+    unlink(path);
+    
+    ok = ok && WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT && records.size() >= 10;
+    for (int i = 0; ok && i < 10; ++ i)
+        ok = records[records.size() - 10 + i].argument == static_cast<uint64_t>(1000 + i);
+    printf("crashed child dumped %zu records\n", records.size());
+    if (ok)
+        GP::FlightRecorder::write_chrome_trace(stdout, &records[records.size() - 2], 2);
+    return ok;
+}
+
+int main() {
+    return check_concurrent_writers() && check_crash_dump() ? 0 : 1;
+}
@@ -0,0 +1,103 @@
+/*
+ 
+test_idle_timeout.cpp ... Check that a silent gamepad is centered after the idle timeout.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+#include "EventLoop.hpp"
+#include "Timer.hpp"
+
+// Report an off-center axis every 5 ms for 100 ms, then go silent. With a
+// 20 ms idle timeout, the axis must stop exactly once, no earlier than 20 ms
+// after the last report.
+
+static const int kTimeout = 20;
+static const int kReports = 20;
+
+struct Context {
+    GP::SyntheticGamepad gamepad;
+    GP::EventLoop* loop;
+    int reports;
+    int starts;
+    int stops;
+    uint64_t last_report_time;
+    uint64_t stop_time;
+};
+
+static void axis_state_changed(void* self, GP::Gamepad*, GP::Axis axis, GP::AxisState state) {
+    Context* context = static_cast<Context*>(self);
+    if (axis != GP::Axis::X)
+        return;
+    if (state == GP::AxisState::start_moving) {
+        ++ context->starts;
+    } else {
+        ++ context->stops;
+        context->stop_time = GP::Bench::now_ns();
+    }
+}
+
+static void send_report(void* self, GP::Timer* timer) {
+    Context* context = static_cast<Context*>(self);
+    context->gamepad.set_axis_value(GP::Axis::X, 100);
+    context->gamepad.handle_axes_change(5000000);
+    context->gamepad.handle_frame(5000000);
+    context->last_report_time = GP::Bench::now_ns();
+    if (++ context->reports == kReports)
+        timer->stop();
+}
+
+static void quit_loop(void* self, GP::Timer*) {
+    static_cast<GP::EventLoop*>(self)->quit();
+}
+
+int main() {
+    Context context;
+    context.loop = GP::EventLoop::create();
+    context.reports = context.starts = context.stops = 0;
+    context.last_report_time = context.stop_time = 0;
+    
+    context.gamepad.set_axis_state_changed_callback(&context, axis_state_changed);
+    context.gamepad.set_idle_timeout(kTimeout, context.loop);
+    
+    GP::Timer* reporter = GP::Timer::create(&context, send_report, 5, context.loop);
+    GP::Timer* quitter = GP::Timer::create(context.loop, quit_loop, 5 * kReports + 10 * kTimeout, context.loop);
+    context.loop->run();
+    delete quitter;
+    delete reporter;
+    
+    double silence = (context.stop_time - context.last_report_time) / 1e6;
+    printf("%d reports, %d start, %d stop after %.1f ms of silence, X = %ld\n",
+           context.reports, context.starts, context.stops, silence, context.gamepad.last_frame().axes[0]);
+    
+    bool ok = context.reports == kReports && context.starts == 1 && context.stops == 1
+           && silence >= kTimeout && context.gamepad.last_frame().axes[0] == 0;
+    context.gamepad.set_idle_timeout(0, NULL);
+    delete context.loop;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+/*
+ 
+test_input_history.cpp ... Tests the input history for rollback.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+#include "InputHistory.hpp"
+#include "VirtualClock.hpp"
+#include <cstdio>
+#include <vector>
+
+// Hold more frames than the ring: the oldest go, and the rest are found
+// by frame. Predict a remote player ahead, then confirm frames unlike the
+// prediction: the earliest is the rollback, and later predictions follow
+// the confirmed input. Predict further ahead than the ring holds: the
+// frames dropped unconfirmed are an overrun, not confirmed. Send
+// confirmed frames as a range and apply it to another history. Sample a
+// pad on a virtual clock: a frame holds the input as it was at its
+// boundary. Leave it an hour: the hour of frames is confirmed at once,
+// without an overrun.
+
+namespace {
+    GP::InputState state_of(int x, uint64_t buttons) {
+        GP::InputState state = GP::InputState::zero();
+        state.axes[static_cast<int>(GP::Axis::X)] = x;
+        state.buttons = buttons;
+        return state;
+    }
+    
+    bool check_ring() {
+        GP::InputHistory history(100);
+        for (int f = 0; f < 300; ++ f)
+            history.confirm(f, state_of(f, 0));
+        bool ok = history.capacity() == 128 && history.newest() == 299 && history.oldest() == 172
+               && !history.at(171) && history.at(172) && history.at(172)->axes[0] == 172
+               && history.at(299)->axes[0] == 299 && !history.at(300) && history.confirmed_through() == 299
+               && !history.confirm(100, state_of(0, 0));
+        printf("300 frames in a ring of %zu: oldest %lld, %s\n", history.capacity(), (long long)history.oldest(), ok ? "ok" : "FAILED");
+        return ok;
+    }
+    
+    bool check_rollback() {
+        GP::InputHistory history;
+        history.confirm(0, state_of(10, 1));
+        // the simulation runs ahead to frame 8 on predictions.
+        bool ok = history.predict(8) == state_of(10, 1) && history.origin(5) == GP::InputOrigin::predicted
+               && history.confirmed_through() == 0;
+        
+        // frames 1 and 2 arrive as predicted, 3 and 4 not.
+        ok = ok && !history.confirm(1, state_of(10, 1)) && !history.confirm(2, state_of(10, 1))
+                && history.take_rollback() == GP::InputHistory::kNone;
+        ok = ok && history.confirm(4, state_of(-5, 0)) && history.confirm(3, state_of(20, 1));
+        ok = ok && history.take_rollback() == 3 && history.take_rollback() == GP::InputHistory::kNone
+                && history.confirmed_through() == 4;
+        int changed = history.repredict_after(3);
+        ok = ok && changed == 4 && *history.at(8) == state_of(-5, 0) && *history.at(3) == state_of(20, 1)
+                && history.origin(6) == GP::InputOrigin::predicted;
+        printf("mispredicted from frame 3: %d predictions redone, %s\n", changed, ok ? "ok" : "FAILED");
+        return ok;
+    }
+    
+    bool check_overrun() {
+        GP::InputHistory history(8);
+        history.confirm(0, state_of(1, 0));
+        history.predict(20);
+        history.confirm(20, state_of(2, 0));
+        bool ok = history.oldest() == 13 && history.confirmed_through() == 0 && history.overrun() == 12;
+        for (int f = 13; f < 20; ++ f)
+            history.confirm(f, state_of(1, 0));
+        ok = ok && history.confirmed_through() == 0 && history.overrun() == 12;
+        printf("20 frames ahead in a ring of 8: confirmed through %lld, overrun at %lld, %s\n",
+               (long long)history.confirmed_through(), (long long)history.overrun(), ok ? "ok" : "FAILED");
+        return ok;
+    }
+    
+    bool check_range() {
+        GP::InputHistory sender, receiver;
+        for (int f = 0; f < 60; ++ f)
+            sender.confirm(f, state_of(f / 4 * 3, f / 10 % 2 ? 4 : 0));
+        std::vector<uint8_t> bytes;
+        bool ok = sender.encode_range(0, 29, bytes) && receiver.apply_range(bytes.data(), bytes.size()) == 30;
+        size_t first_size = bytes.size();
+        
+        // the second range builds on the first.
+        bytes.clear();
+        ok = ok && sender.encode_range(30, 59, bytes) && receiver.apply_range(bytes.data(), bytes.size()) == 30;
+        for (int f = 0; ok && f < 60; ++ f)
+            ok = *receiver.at(f) == *sender.at(f) && receiver.origin(f) == GP::InputOrigin::confirmed;
+        
+        // a range whose base the receiver lacks, a damaged one, and one of
+        // unconfirmed frames.
+        GP::InputHistory stranger;
+        std::vector<uint8_t> cut(bytes.begin(), bytes.begin() + bytes.size() / 2);
+        std::vector<uint8_t> unsent;
+        sender.predict(70);
+        ok = ok && stranger.apply_range(bytes.data(), bytes.size()) == -1 && stranger.apply_range(cut.data(), cut.size()) == -1
+                && !sender.encode_range(55, 65, unsent) && unsent.empty();
+        printf("60 frames in 2 ranges of %zu and %zu bytes: %s\n", first_size, bytes.size(), ok ? "ok" : "FAILED");
+        return ok;
+    }
+    
+    bool check_sampler() {
+        GP::VirtualClock clock(1000000000);
+        GP::SyntheticGamepad pad;
+        pad.set_clock(&clock);
+        GP::InputHistory history;
+        const uint64_t kTick = 16666667;
+        GP::InputSampler sampler(&pad, history, kTick, clock.now(), 100);
+        
+        // X moves to 50 after the boundary of 101, and to 70 exactly at
+        // that of 103; nothing comes until past 105.
+        clock.advance_to(1000000000 + kTick + 1000);
+        pad.set_axis_value(GP::Axis::X, 50);
+        pad.handle_axes_change(1000000);
+        pad.handle_frame(1000000);
+        clock.advance_to(1000000000 + 3 * kTick);
+        pad.set_axis_value(GP::Axis::X, 70);
+        pad.handle_axes_change(1000000);
+        pad.handle_frame(1000000);
+        clock.advance_to(1000000000 + 5 * kTick + 5);
+        int sampled = sampler.advance(clock.now());
+        
+        int x[6];
+        for (int f = 0; f < 6; ++ f)
+            x[f] = history.at(100 + f) ? history.at(100 + f)->axes[static_cast<int>(GP::Axis::X)] : -1;
+        bool ok = sampled == 2 && sampler.next_frame() == 106 && x[0] == 0 && x[1] == 0 && x[2] == 50
+               && x[3] == 50 && x[4] == 70 && x[5] == 70 && history.confirmed_through() == 105;
+        printf("6 ticks sampled: %d %d %d %d %d %d, %s\n", x[0], x[1], x[2], x[3], x[4], x[5], ok ? "ok" : "FAILED");
+        return ok;
+    }
+    
+    bool check_long_pause() {
+        GP::VirtualClock clock(0);
+        GP::SyntheticGamepad pad;
+        pad.set_clock(&clock);
+        GP::InputHistory history(16);
+        GP::InputSampler sampler(&pad, history, 1000000, clock.now());
+        pad.set_axis_value(GP::Axis::X, 30);
+        pad.handle_axes_change(1000000);
+        pad.handle_frame(1000000);
+        
+        // frame 0 is sampled by the report; then an hour of 1 ms ticks.
+        clock.advance_to(3600000000000ull);
+        uint64_t start = GP::Bench::now_ns();
+        int64_t sampled = sampler.advance(clock.now());
+        uint64_t took = GP::Bench::now_ns() - start;
+        bool ok = sampled == 3600000 && sampler.next_frame() == 3600001 && history.confirmed_through() == 3600000
+               && history.overrun() == GP::InputHistory::kNone && history.oldest() == 3600000 - 15
+               && history.at(3600000)->axes[static_cast<int>(GP::Axis::X)] == 30;
+        printf("an hour of ticks sampled in %.1f us: %s\n", took / 1e3, ok ? "ok" : "FAILED");
+        return ok;
+    }
+}
+
+int main() {
+    bool ok = check_ring();
+    ok = check_rollback() && ok;
+    ok = check_overrun() && ok;
+    ok = check_range() && ok;
+    ok = check_sampler() && ok;
+    ok = check_long_pause() && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+/*
+ 
+test_latency.cpp ... Checks the latency histograms and the stages a report is stamped at.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "EventLoop.hpp"
+#include "Gamepad_Linux.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+
+// The histograms must place every value in a bucket at most 1/16 above it,
+// and a report read from a device must be timed at each stage the Linux
+// backend stamps. A pipe takes no EVIOCSCLOCKID, so the time reports waited
+// to be read is not measured.
+
+static const int kReports = 300;
+
+static bool check_buckets() {
+    for (int i = 0; i < 100000; ++ i) {
+        uint64_t value = static_cast<uint64_t>(rand()) << (rand() % 5);
+        uint64_t highest = GP::LatencyDistribution::highest_in(GP::LatencyDistribution::bucket_of(value));
+        if (highest < value || highest > value + value / 16) {
+            printf("%llu is counted up to %llu\n", (unsigned long long)value, (unsigned long long)highest);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool check_percentiles() {
+    GP::LatencyHistogram histogram;
+    for (uint64_t value = 1; value <= 100000; ++ value)
+        histogram.record(value);
+    GP::LatencyDistribution distribution;
+    histogram.copy_to(distribution);
+    GP::LatencySummary summary = distribution.summary();
+    printf("1..100000: p50 %llu, p99 %llu, max %llu\n",
+           (unsigned long long)summary.p50, (unsigned long long)summary.p99, (unsigned long long)summary.max);
+    return summary.count == 100000 && summary.max == 100000
+        && summary.p50 >= 50000 && summary.p50 <= 50000 + 50000 / 16
+        && summary.p99 >= 99000 && summary.p99 <= 100000;
+}
+
+static bool check_stages(GP::EventLoop* loop) {
+    int fds[2];
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0)
+        return false;
+    GP::Gamepad_Linux* gamepad = new GP::Gamepad_Linux(fds[0], loop);
+    
+    for (int r = 0; r < kReports; ++ r) {
+        input_event events[2] = {};
+        events[0].type = EV_ABS;
+        events[0].code = ABS_X;
+        events[0].value = r % 2 ? 100 : -100;
+        events[1].type = EV_SYN;
+        events[1].code = SYN_REPORT;
+        ssize_t written = write(fds[1], events, sizeof(events));
+        (void)written;
+        if (r % 32 == 31)
+            while (loop->dispatch_pending()) {}
+    }
+    while (loop->dispatch_pending()) {}
+    
+    static const char* const names[] = {"read", "enqueue", "queue", "decode", "dispatch", "callbacks", "end to end"};
+    static const uint64_t expected[] = {0, 0, 0, kReports, kReports, kReports, kReports};
+    bool ok = true;
+    for (int i = 0; i < static_cast<int>(GP::LatencyStage::stage_count); ++ i) {
+        GP::LatencySummary summary = gamepad->latency(static_cast<GP::LatencyStage>(i));
+        printf("%-10s %4llu reports, p50 %6llu ns, p99 %6llu ns, max %6llu ns\n", names[i],
+               (unsigned long long)summary.count, (unsigned long long)summary.p50,
+               (unsigned long long)summary.p99, (unsigned long long)summary.max);
+        ok = ok && summary.count == expected[i];
+    }
+    
+    delete gamepad;
+    close(fds[1]);
+    
+    // the reports of deleted gamepads stay in the totals.
+    return ok && GP::Gamepad::total_latency(GP::LatencyStage::end_to_end).count >= kReports;
+}
+
+int main() {
+    GP::EventLoop* loop = GP::EventLoop::create();
+    bool ok = check_buckets() && check_percentiles() && check_stages(loop);
+    delete loop;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,232 @@
+/*
+ 
+test_no_allocations.cpp ... Checks that reports and transactions allocate nothing once running.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "EventLoop.hpp"
+#include "Gamepad_Linux.hpp"
+#include "Transaction.hpp"
+#include "FlightRecorder.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Every allocation of the process goes through malloc, calloc or realloc,
+// operator new included, so counting them here counts them all. A session
+// of reports read from a pipe, with every instrument and kind of callback
+// on, must not allocate between its first report and its end, and neither
+// must a transaction reused for every send, committed to a device whose
+// output path does what the platforms do.
+
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* pointer, size_t size);
+}
+
+static std::atomic<bool> counting(false);
+static std::atomic<long> allocations(0);
+
+static void count_allocation() {
+    if (counting.load(std::memory_order_relaxed)) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        // stop at the first, so that a debugger can catch it here.
+        if (getenv("GP_ABORT_ON_ALLOCATION"))
+            abort();
+    }
+}
+
+extern "C" {
+    void* malloc(size_t size) {
+        count_allocation();
+        return __libc_malloc(size);
+    }
+    void* calloc(size_t count, size_t size) {
+        count_allocation();
+        return __libc_calloc(count, size);
+    }
+    void* realloc(void* pointer, size_t size) {
+        count_allocation();
+        return __libc_realloc(pointer, size);
+    }
+}
+
+static const int kReports = 100000;
+
+struct FrameCounter : GP::Listener {
+    long frames;
+    void frame(GP::Gamepad*, const GP::Frame&) { ++ frames; }
+};
+
+static void count_frame(void* self, GP::Gamepad*, const GP::Frame&) {
+    ++ *static_cast<long*>(self);
+}
+
+static void count_button(void* self, GP::Gamepad*, GP::Button, bool) {
+    ++ *static_cast<long*>(self);
+}
+
+static void count_axis(void* self, GP::Gamepad*, GP::Axis, long, unsigned) {
+    ++ *static_cast<long*>(self);
+}
+
+static void ignore_stall(void*, GP::Gamepad*, bool, uint64_t) {}
+
+static void send_report(int fd, int r) {
+    input_event events[3] = {};
+    events[0].type = EV_ABS;
+    events[0].code = ABS_X;
+    events[0].value = r % 2 ? 100 : -100;
+    events[1].type = EV_KEY;
+    events[1].code = KEY_MENU;
+    events[1].value = r / 10 % 2;
+    events[2].type = EV_SYN;
+    events[2].code = SYN_REPORT;
+    ssize_t written = write(fd, events, sizeof(events));
+    (void)written;
+}
+
+static void fill(GP::Transaction& transaction) {
+    for (int i = 0; i < 8; ++ i) {
+        transaction.set_output_value(8, i, i);
+        transaction.set_output_button(9, i, i % 2);
+        transaction.set_feature_value(0xff00, i, -i);
+        transaction.set_feature_button(0xff00, i + 8, true);
+    }
+}
+
+// Commits a transaction as Gamepad_Darwin and Gamepad_Windows do: under a
+// lock, each value is looked up among the elements of the device found
+// when it was opened, and set in a report made then, and the commit is
+// recorded. Only the system call which sends the report is left out.
+class OutputGamepad : public GP::Gamepad_Linux {
+private:
+    std::mutex _transaction_mutex;
+    // usage_page << 16 | usage, to the index in the report.
+    std::unordered_map<int, size_t> _elements;
+    std::vector<long> _report;
+    
+    size_t set_values(const std::vector<GP::Transaction::Value>& values) {
+        size_t set = 0;
+        for (auto it = values.begin(); it != values.end(); ++ it) {
+            auto element = _elements.find(it->usage_page << 16 | it->usage);
+            if (element != _elements.end()) {
+                _report[element->second] = it->value;
+                ++ set;
+            }
+        }
+        return set;
+    }
+    
+public:
+    long commits;
+    
+    OutputGamepad(int fd, GP::EventLoop* loop) : GP::Gamepad_Linux(fd, loop), commits(0) {
+        static const int pages[] = {8, 9, 0xff00};
+        for (int p = 0; p < 3; ++ p)
+            for (int usage = 0; usage < 16; ++ usage)
+                _elements[pages[p] << 16 | usage] = p * 16 + usage;
+        _report.resize(3 * 16);
+    }
+    
+    bool commit_transaction(const GP::Transaction& transaction) {
+        uint64_t start = GP::Timer::monotonic_nanoseconds();
+        std::lock_guard<std::mutex> lock(_transaction_mutex);
+        size_t set = this->set_values(transaction.output_values()) + this->set_values(transaction.output_buttons())
+                   + this->set_values(transaction.feature_values()) + this->set_values(transaction.feature_buttons());
+        size_t count = transaction.output_values().size() + transaction.output_buttons().size()
+                     + transaction.feature_values().size() + transaction.feature_buttons().size();
+        GP::FlightRecorder::instance().record(GP::FlightEvent::transaction, this, count, start, GP::Timer::monotonic_nanoseconds() - start);
+        ++ commits;
+        return set == count;
+    }
+};
+
+int main() {
+    int fds[2];
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0)
+        return 1;
+    GP::EventLoop* loop = GP::EventLoop::create();
+    OutputGamepad* gamepad = new OutputGamepad(fds[0], loop);
+    
+    long frames = 0, buttons = 0, axes = 0;
+    FrameCounter listener;
+    listener.frames = 0;
+    GP::Gamepad::Subscriber subscriber = {};
+    subscriber.self = &frames;
+    subscriber.frame = count_frame;
+    subscriber.interest = GP::Interest::everything();
+    gamepad->subscribe(subscriber);
+    gamepad->set_button_changed_callback(&buttons, count_button);
+    gamepad->set_axis_changed_callback(&axes, count_axis);
+    gamepad->listen(listener);
+    gamepad->set_callback_budget(1000);
+    gamepad->set_idle_timeout(1000, loop);
+    gamepad->set_stall_watchdog(NULL, ignore_stall, 8, 1000, loop);
+    
+    GP::Transaction transaction;
+    fill(transaction);
+    
+    // the first report initializes what is done once.
+    send_report(fds[1], 0);
+    while (loop->dispatch_pending()) {}
+    
+    counting = true;
+    for (int r = 1; r < kReports; ++ r) {
+        send_report(fds[1], r);
+        if (r % 32 == 0)
+            while (loop->dispatch_pending()) {}
+    }
+    while (loop->dispatch_pending()) {}
+    long committed = 0;
+    for (int i = 0; i < 1000; ++ i) {
+        transaction.clear();
+        fill(transaction);
+        committed += gamepad->commit_transaction(transaction);
+    }
+    counting = false;
+    
+    GP::Statistics statistics = gamepad->statistics();
+    printf("%llu reports: %ld frames, %ld listened, %ld buttons, %ld axis changes; %ld transactions committed; %ld allocations\n",
+           (unsigned long long)statistics.reports_dispatched, frames, listener.frames, buttons, axes, committed, allocations.load());
+    
+    bool ok = allocations == 0 && statistics.reports_dispatched == kReports
+           && frames == kReports && listener.frames == kReports && buttons > 0 && axes > 0
+           && committed == 1000 && gamepad->commits == 1000;
+    
+    delete gamepad;
+    close(fds[1]);
+    delete loop;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+/*
+ 
+test_perf_counters.cpp ... Checks the hardware counters of the decode and dispatch stages.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Gamepad_Linux.hpp"
+#include <cstdio>
+
+// Decode reports of an axis and a button, with a callback on the button.
+// Where perf events can be opened, each report must enter decoding three
+// times and dispatching twice, and both stages must count.
+// Where they cannot, counting must turn itself off and count nothing.
+
+static const int kReports = 1000;
+
+static void button_changed(void* self, GP::Gamepad*, GP::Button, bool) {
+    ++ *static_cast<long*>(self);
+}
+
+int main() {
+    GP::Gamepad_Linux* gamepad = new GP::Gamepad_Linux(-1, NULL);
+    long presses = 0;
+    gamepad->set_button_changed_callback(&presses, button_changed);
+    
+    bool available = gamepad->count_perf_events(true);
+    
+    // without an fd, no button is known but the media keys.
+    for (int r = 0; r < kReports; ++ r) {
+        input_event events[3] = {};
+        events[0].type = EV_ABS;
+        events[0].code = ABS_X;
+        events[0].value = r % 2 ? 100 : -100;
+        events[1].type = EV_KEY;
+        events[1].code = KEY_MENU;
+        events[1].value = r % 2;
+        events[2].type = EV_SYN;
+        events[2].code = SYN_REPORT;
+        gamepad->handle_events(events, 3);
+    }
+    
+    static const char* const names[] = {"decode", "dispatch"};
+    GP::PerfCounts counts[2];
+    for (int i = 0; i < 2; ++ i) {
+        counts[i] = gamepad->perf_counts(static_cast<GP::PerfStage>(i));
+        const uint64_t* values = counts[i].values;
+        printf("%-8s %5llu samples, %8llu cycles, %8llu instructions, %5llu cache misses, %5llu branch misses (available 0x%x)\n",
+               names[i], (unsigned long long)counts[i].samples, (unsigned long long)values[0],
+               (unsigned long long)values[1], (unsigned long long)values[2], (unsigned long long)values[3],
+               counts[i].available);
+    }
+    
+    bool ok = presses == kReports;
+    if (available) {
+        ok = ok && counts[0].samples == 3 * kReports && counts[1].samples == 2 * kReports
+                && counts[0].available && counts[0].values[0] + counts[0].values[1] > 0
+                && counts[1].values[0] + counts[1].values[1] > 0;
+    } else {
+        printf("perf events are not available\n");
+        ok = ok && !counts[0].samples && !counts[1].samples;
+    }
+    
+    delete gamepad;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,257 @@
+/*
+ 
+test_replay.cpp ... Tests the deterministic replay of sessions.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Replay.hpp"
+#include "Gamepad_Linux.hpp"
+#include "MappedFile_Linux.hpp"
+#include "EventLoop.hpp"
+#include <unistd.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Replay a session twice as fast as possible: the callbacks, with the
+// virtual time they see, must repeat exactly, and the idle timeout must
+// center the axes in the 300 ms the recording falls silent, at the virtual
+// time it would have. Replays at 1x and 10x must take as long as they
+// should, a replay from the middle must pick up the state there, and raw
+// reports must decode through Gamepad_Linux. A live timer started during a
+// replay must run on the system clock, and fire after it.
+
+namespace {
+    const uint64_t kStart = 5000000000ull;
+    const int kFrames = 100;
+    
+    struct Event {
+        int kind;               // 0 for an axis, 1 a button, 2 a frame.
+        int which;              // the axis, the button, or the moving axes of a frame.
+        long value;
+        uint64_t time;
+        
+        bool operator==(const Event& other) const {
+            return kind == other.kind && which == other.which && value == other.value && time == other.time;
+        }
+    };
+    
+    std::vector<Event> events;
+    
+    void axis_changed(void*, GP::Gamepad* gamepad, GP::Axis axis, long value, unsigned) {
+        Event event = {0, static_cast<int>(axis), value, gamepad->now()};
+        events.push_back(event);
+    }
+    
+    void button_changed(void*, GP::Gamepad* gamepad, GP::Button button, bool is_pressed) {
+        Event event = {1, static_cast<int>(button), is_pressed, gamepad->now()};
+        events.push_back(event);
+    }
+    
+    void frame(void*, GP::Gamepad* gamepad, const GP::Frame& frame) {
+        Event event = {2, int(frame.moving_axes), frame.axes[0], gamepad->now()};
+        events.push_back(event);
+    }
+    
+    void attached(void* eventloop, GP::Gamepad* gamepad, GP::GamepadState state) {
+        if (state != GP::GamepadState::attached)
+            return;
+        GP::Gamepad::Subscriber subscriber = {};
+        subscriber.axis_changed = axis_changed;
+        subscriber.button_changed = button_changed;
+        subscriber.frame = frame;
+        subscriber.interest = GP::Interest::everything();
+        gamepad->subscribe(subscriber);
+        gamepad->set_idle_timeout(100, eventloop);
+    }
+    
+    // 2 ms apart, but for 300 ms of silence after frame 50.
+    uint64_t frame_time(int i) {
+        return kStart + uint64_t(i) * 2000000 + (i > 50 ? 300000000 : 0);
+    }
+    
+    std::string record_session() {
+        char path[] = "/tmp/test_replay_XXXXXX";
+        int fd = mkstemp(path);
+        if (fd >= 0)
+            close(fd);
+        
+        GP::SessionWriter* writer = GP::SessionWriter::create(path, 1024);
+        GP::SessionDevice descriptor = {};
+        snprintf(descriptor.name, sizeof(descriptor.name), "recorded");
+        descriptor.axes = 3;
+        descriptor.bounds[0] = descriptor.bounds[1] = 512;
+        int device = writer->add_device(descriptor, kStart);
+        
+        GP::Frame recorded = {};
+        for (int i = 0; i < kFrames; ++ i) {
+            ++ recorded.sequence;
+            recorded.nanoseconds_elapsed = 2000000;
+            recorded.axes[0] = (i * 37) % 400 - 200;
+            recorded.axes[1] = i % 10 < 5 ? 100 : -100;
+            recorded.held = GP::ButtonSet(i % 8 < 3 ? 1 : 4);
+            writer->record_frame(device, recorded, frame_time(i));
+            
+            input_event raw[2] = {};
+            raw[0].type = EV_ABS;
+            raw[0].code = ABS_X;
+            raw[0].value = recorded.axes[0];
+            raw[1].type = EV_SYN;
+            raw[1].code = SYN_REPORT;
+            writer->record_raw(device, raw, sizeof(raw), frame_time(i));
+        }
+        delete writer;
+        return path;
+    }
+    
+    uint64_t replay(const GP::SessionReader& reader, double speed, uint64_t from = 0) {
+        events.clear();
+        GP::SessionReplay replay(reader);
+        replay.set_speed(speed);
+        int eventloop;
+        replay.set_callback(&eventloop, attached);
+        return replay.run(from);
+    }
+    
+    bool check_determinism(const GP::SessionReader& reader) {
+        replay(reader, 0);
+        std::vector<Event> first = events;
+        replay(reader, 0);
+        bool same = first == events;
+        
+        // the idle timeout makes up a frame with the axes centered and still
+        // 100 ms after the last report, to the millisecond of the timers.
+        uint64_t silence = frame_time(50);
+        uint64_t centered = silence;
+        for (auto it = first.begin(); it != first.end(); ++ it)
+            if (it->kind == 2 && it->which == 0 && it->value == 0 && it->time > silence && it->time < frame_time(51))
+                centered = it->time;
+        bool idle = centered >= silence + 100000000 && centered < silence + 101000000;
+        
+        int frames = 0;
+        for (auto it = first.begin(); it != first.end(); ++ it)
+            frames += it->kind == 2;
+        printf("%zu callbacks, %d frames; %s; centered %.1f ms into the silence\n", first.size(), frames,
+               same ? "repeated exactly" : "NOT REPEATED", (centered - silence) / 1e6);
+        return same && idle && frames == kFrames + 1;
+    }
+    
+    bool check_speed(const GP::SessionReader& reader) {
+        // the 49 frames after the silence take 96 ms.
+        bool ok = true;
+        static const double speeds[] = {1, 10, 0};
+        for (int i = 0; i < 3; ++ i) {
+            uint64_t start = GP::Timer::monotonic_nanoseconds();
+            replay(reader, speeds[i], frame_time(51));
+            double elapsed = (GP::Timer::monotonic_nanoseconds() - start) / 1e6;
+            printf("the last 96 ms at %gx: %.1f ms\n", speeds[i], elapsed);
+            if (speeds[i])
+                ok = ok && elapsed >= 96 / speeds[i] - 1;
+            else
+                ok = ok && elapsed < 9.6;
+        }
+        return ok;
+    }
+    
+    // From the middle, the state recorded there comes first.
+    bool check_seek(const GP::SessionReader& reader) {
+        uint64_t records = replay(reader, 0, frame_time(70));
+        bool ok = !events.empty() && events[0].kind == 0 && events[0].value == (70 * 37) % 400 - 200;
+        printf("from frame 70: %llu records, first X %ld\n", (unsigned long long)records, events.empty() ? 0 : events[0].value);
+        return ok && records == 2 * (kFrames - 70);
+    }
+    
+    void decode_raw(void* self, int, const uint8_t* bytes, size_t size) {
+        static_cast<GP::Gamepad_Linux*>(self)->handle_events(reinterpret_cast<const input_event*>(bytes), size / sizeof(input_event));
+    }
+    
+    bool check_raw(const GP::SessionReader& reader) {
+        GP::Gamepad_Linux gamepad(-1, NULL);
+        gamepad.describe_axis(ABS_X, -512, 511);
+        events.clear();
+        gamepad.set_axis_changed_callback(NULL, axis_changed);
+        GP::SessionReplay replay(reader);
+        replay.set_raw_callback(&gamepad, decode_raw);
+        replay.run();
+        printf("raw: %llu reports decoded, %zu axis changes\n",
+               (unsigned long long)gamepad.statistics().reports_dispatched, events.size());
+        return gamepad.statistics().reports_dispatched == kFrames && !events.empty()
+            && events.back().value == ((kFrames - 1) * 37) % 400 - 200;
+    }
+    
+    struct LiveTimer {
+        GP::EventLoop* loop;
+        GP::Timer* timer;
+        int fired;
+    };
+    
+    void live_timer_fired(void* self, GP::Timer* timer) {
+        ++ static_cast<LiveTimer*>(self)->fired;
+        timer->stop();
+    }
+    
+    void start_live_timer(void* self, GP::Gamepad*, GP::GamepadState state) {
+        LiveTimer* live = static_cast<LiveTimer*>(self);
+        if (state == GP::GamepadState::attached && !live->timer)
+            live->timer = GP::Timer::create(live, live_timer_fired, 10, live->loop);
+    }
+    
+    bool check_live_timer(const GP::SessionReader& reader) {
+        LiveTimer live = {GP::EventLoop::create(), NULL, 0};
+        GP::SessionReplay replay(reader);
+        replay.set_callback(&live, start_live_timer);
+        replay.run();
+        
+        bool on_time = live.timer && live.fired == 0;
+        for (int i = 0; i < 1000 && !live.fired; ++ i) {
+            usleep(1000);
+            live.loop->dispatch_pending();
+        }
+        bool ok = on_time && live.fired == 1;
+        printf("a live timer started in a replay: %s\n", ok ? "fired after it" : "FAILED");
+        delete live.timer;
+        delete live.loop;
+        return ok;
+    }
+}
+
+int main() {
+    std::string path = record_session();
+    bool ok;
+    {
+        GP::MappedFile_Linux file(path.c_str());
+        GP::SessionReader reader(file.data(), file.size());
+        ok = check_determinism(reader);
+        ok = check_speed(reader) && ok;
+        ok = check_seek(reader) && ok;
+        ok = check_raw(reader) && ok;
+        ok = check_live_timer(reader) && ok;
+    }
+    unlink(path.c_str());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,155 @@
+/*
+ 
+test_report_rate.cpp ... Checks the learned report rate, and the stall watchdog.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+#include "EventLoop.hpp"
+#include "Timer.hpp"
+#include <cstdlib>
+#include <cmath>
+
+// Feed 1 ms intervals with up to 50 us of jitter, one 30 ms gap, and then
+// 10 ms intervals: the gap must be a stall kept out of the moments, and the
+// norm must move to 10 ms. Then report every 2 ms on an event loop, pause,
+// resume and stop: the watchdog must notice both pauses, and the end of the first.
+
+static const int kReports = 30;
+
+struct Context {
+    GP::SyntheticGamepad gamepad;
+    int reports;
+    int stalls;
+    int resumes;
+    uint64_t stall_silence;
+    uint64_t resume_silence;
+};
+
+static void report(GP::SyntheticGamepad& gamepad, unsigned nanoseconds_elapsed) {
+    gamepad.handle_axes_change(nanoseconds_elapsed);
+    gamepad.handle_frame(nanoseconds_elapsed);
+}
+
+static void send_report(void* self, GP::Timer* timer) {
+    Context* context = static_cast<Context*>(self);
+    report(context->gamepad, 2000000);
+    if (++ context->reports % kReports == 0)
+        timer->stop();
+}
+
+static void resume_reports(void* self, GP::Timer* timer) {
+    static_cast<GP::Timer*>(self)->restart();
+    timer->stop();
+}
+
+static void stall_changed(void* self, GP::Gamepad*, bool stalled, uint64_t silent_nanoseconds) {
+    Context* context = static_cast<Context*>(self);
+    if (stalled) {
+        ++ context->stalls;
+        context->stall_silence = silent_nanoseconds;
+    } else {
+        ++ context->resumes;
+        context->resume_silence = silent_nanoseconds;
+    }
+}
+
+static void quit_loop(void* self, GP::Timer*) {
+    static_cast<GP::EventLoop*>(self)->quit();
+}
+
+static void print(const GP::ReportRate& rate) {
+    printf("%llu intervals, mean %.1f us, deviation %.1f us, recent %.1f us (%.0f Hz), "
+           "jitter p50 %llu us p99 %llu us, %llu stalls up to %.1f ms\n",
+           (unsigned long long)rate.intervals, rate.mean_interval / 1e3, rate.interval_deviation / 1e3,
+           rate.recent_interval / 1e3, rate.reports_per_second,
+           (unsigned long long)(rate.jitter.p50 / 1000), (unsigned long long)(rate.jitter.p99 / 1000),
+           (unsigned long long)rate.stalls, rate.longest_stall / 1e6);
+}
+
+static bool check_estimates() {
+    GP::SyntheticGamepad gamepad;
+    report(gamepad, 0);
+    for (int i = 0; i < 1000; ++ i)
+        report(gamepad, 950000 + rand() % 100001);
+    GP::ReportRate steady = gamepad.report_rate();
+    print(steady);
+    
+    report(gamepad, 30000000);
+    GP::ReportRate gap = gamepad.report_rate();
+    print(gap);
+    
+    for (int i = 0; i < 100; ++ i)
+        report(gamepad, 10000000);
+    GP::ReportRate slower = gamepad.report_rate();
+    print(slower);
+    
+    return steady.intervals == 1000 && steady.stalls == 0
+        && std::fabs(steady.mean_interval - 1e6) < 5e3
+        && steady.interval_deviation > 25e3 && steady.interval_deviation < 35e3
+        && std::fabs(steady.reports_per_second - 1000) < 50
+        && steady.jitter.max <= 100000 && steady.jitter.p99 <= 100000
+        && gap.intervals == 1000 && gap.stalls == 1 && gap.longest_stall == 30000000
+        && gap.mean_interval == steady.mean_interval
+        && slower.stalls == 1 + GP::ReportRateEstimator::kRelearnAfter - 1
+        && std::fabs(slower.recent_interval - 1e7) < 1e3
+        && gamepad.expected_report_interval() / 1000 == 10000;
+}
+
+static bool check_watchdog() {
+    Context context;
+    context.reports = context.stalls = context.resumes = 0;
+    context.stall_silence = context.resume_silence = 0;
+    GP::EventLoop* loop = GP::EventLoop::create();
+    
+    context.gamepad.set_stall_watchdog(&context, stall_changed, 4, 10, loop);
+    
+    GP::Timer* reporter = GP::Timer::create(&context, send_report, 2, loop);
+    GP::Timer* resumer = GP::Timer::create(reporter, resume_reports, 2 * kReports + 50, loop);
+    GP::Timer* quitter = GP::Timer::create(loop, quit_loop, 4 * kReports + 100, loop);
+    loop->run();
+    delete quitter;
+    delete resumer;
+    delete reporter;
+    
+    printf("%d reports, %d stalls, the last noticed after %.1f ms, %d resumes after %.1f ms\n",
+           context.reports, context.stalls, context.stall_silence / 1e6,
+           context.resumes, context.resume_silence / 1e6);
+    
+    bool ok = context.reports == 2 * kReports && context.stalls == 2 && context.resumes == 1
+           && context.stall_silence >= 10000000 && context.resume_silence >= context.stall_silence;
+    context.gamepad.set_stall_watchdog(NULL, NULL, 8, 0, NULL);
+    delete loop;
+    return ok;
+}
+
+int main() {
+    bool estimates = check_estimates();
+    bool watchdog = check_watchdog();
+    return estimates && watchdog ? 0 : 1;
+}
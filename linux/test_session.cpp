@@ -0,0 +1,347 @@
+/*
+ 
+test_session.cpp ... Tests the session recording format.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Session.hpp"
+#include "EventLoop.hpp"
+#include "Gamepad_Linux.hpp"
+#include "MappedFile_Linux.hpp"
+#include "Benchmark.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+// Record two devices to small blocks and read every record back, from the
+// start and from random times, from the file as closed and as a crash would
+// leave it. Then flood a small ring, which must drop rather than wait, and
+// record a gamepad read from a pipe. Delete a writer while another thread
+// dispatches the gamepad it records, which must carry on.
+
+namespace {
+    struct Expected {
+        GP::SessionRecordType type;
+        int device;
+        uint64_t timestamp;
+        uint64_t sequence;
+        long axes[static_cast<int>(GP::Axis::count)];
+        uint64_t held;
+        std::vector<uint8_t> raw;
+    };
+    
+    std::string temporary_path() {
+        char path[] = "/tmp/test_session_XXXXXX";
+        int fd = mkstemp(path);
+        if (fd >= 0)
+            close(fd);
+        return path;
+    }
+    
+    GP::SessionDevice descriptor(const char* name, long bound) {
+        GP::SessionDevice device = {};
+        snprintf(device.name, sizeof(device.name), "%s", name);
+        device.axes = 0x3f;
+        for (int i = 0; i < 6; ++ i)
+            device.bounds[i] = bound;
+        return device;
+    }
+    
+    // Whether a decoded record is the one written.
+    bool matches(const GP::SessionRecord& record, const Expected& expected) {
+        if (record.type != expected.type || record.device != expected.device || record.timestamp != expected.timestamp)
+            return false;
+        switch (record.type) {
+            case GP::SessionRecordType::frame:
+                return record.state->sequence == expected.sequence && record.state->held.bits() == expected.held
+                    && !memcmp(record.state->axes, expected.axes, sizeof(expected.axes));
+            case GP::SessionRecordType::raw:
+                return record.raw_size == expected.raw.size() && !memcmp(record.raw, expected.raw.data(), record.raw_size);
+            case GP::SessionRecordType::attach:
+                return record.state->attached && record.state->descriptor.bounds[0] == (expected.device ? 127 : 32767);
+            default:
+                return !record.state->attached;
+        }
+    }
+    
+    void write_session(const std::string& path, std::vector<Expected>& expected) {
+        GP::SessionWriter* writer = GP::SessionWriter::create(path.c_str(), 4096, 1 << 16);
+        Expected attach = {};
+        attach.type = GP::SessionRecordType::attach;
+        attach.timestamp = 1000;
+        attach.device = writer->add_device(descriptor("left", 32767), attach.timestamp);
+        expected.push_back(attach);
+        attach.device = writer->add_device(descriptor("right", 127), attach.timestamp);
+        expected.push_back(attach);
+        
+        GP::Frame frames[2] = {};
+        for (int i = 0; i < 20000; ++ i) {
+            uint64_t timestamp = 1000000 + uint64_t(i) * 500000;
+            int device = i < 15000 ? i % 2 : 0;
+            if (i == 15000) {
+                writer->remove_device(1, timestamp);
+                Expected detach = {};
+                detach.type = GP::SessionRecordType::detach;
+                detach.device = 1;
+                detach.timestamp = timestamp;
+                expected.push_back(detach);
+            }
+            
+            GP::Frame& frame = frames[device];
+            long bound = device ? 127 : 32767;
+            ++ frame.sequence;
+            frame.nanoseconds_elapsed = 1000000;
+            for (int axis = 0; axis < 6; ++ axis)
+                if ((i + axis) % 3)
+                    frame.axes[axis] = long(bound * sin(i / 50.0 + axis));
+            if (i % 7 == 0)
+                frame.held = GP::ButtonSet(frame.held.bits() ^ (1u << (i / 7 % 12)));
+            writer->record_frame(device, frame, timestamp);
+            Expected record = {};
+            record.type = GP::SessionRecordType::frame;
+            record.device = device;
+            record.timestamp = timestamp;
+            record.sequence = frame.sequence;
+            memcpy(record.axes, frame.axes, sizeof(record.axes));
+            record.held = frame.held.bits();
+            expected.push_back(record);
+            
+            if (i % 100 == 0) {
+                Expected raw = {};
+                raw.type = GP::SessionRecordType::raw;
+                raw.device = device;
+                raw.timestamp = timestamp;
+                for (int b = 0; b < i % 700; ++ b)
+                    raw.raw.push_back(uint8_t(b * 7 + i));
+                writer->record_raw(device, raw.raw.data(), raw.raw.size(), timestamp);
+                expected.push_back(raw);
+            }
+        }
+        if (writer->dropped())
+            printf("%llu records dropped\n", (unsigned long long)writer->dropped());
+        delete writer;
+    }
+    
+    bool read_all(const GP::SessionReader& reader, const std::vector<Expected>& expected, size_t count) {
+        GP::SessionReader::Cursor cursor = reader.begin();
+        GP::SessionRecord record;
+        size_t read = 0;
+        while (cursor.next(record)) {
+            if (read >= count || !matches(record, expected[read])) {
+                printf("record %zu differs\n", read);
+                return false;
+            }
+            ++ read;
+        }
+        if (read != count || cursor.damaged())
+            printf("%zu of %zu records read%s\n", read, count, cursor.damaged() ? ", damaged" : "");
+        return read == count && !cursor.damaged();
+    }
+    
+    bool check_round_trip() {
+        std::string path = temporary_path();
+        std::vector<Expected> expected;
+        write_session(path, expected);
+        
+        bool ok;
+        size_t complete_records = 0;
+        off_t complete_size = 0;
+        {
+            GP::MappedFile_Linux file(path.c_str());
+            GP::SessionReader reader(file.data(), file.size());
+            ok = !reader.recovered() && reader.record_count() == expected.size() && read_all(reader, expected, expected.size());
+            printf("%zu records in %zu blocks, %.1f bytes each\n", expected.size(), reader.block_count(),
+                   double(file.size()) / expected.size());
+            
+            for (int i = 0; i < 500 && ok; ++ i) {
+                uint64_t timestamp = rand() % 11000000000ull;
+                size_t first = 0;
+                while (first < expected.size() && expected[first].timestamp < timestamp)
+                    ++ first;
+                GP::SessionReader::Cursor cursor = reader.seek(timestamp);
+                GP::SessionRecord record;
+                bool found = cursor.next_from(timestamp, record);
+                ok = first < expected.size() ? found && matches(record, expected[first]) : !found;
+                if (!ok)
+                    printf("seeking %llu fails\n", (unsigned long long)timestamp);
+            }
+            
+            // an index pointing past the file is not trusted: the blocks
+            // are walked instead.
+            std::vector<uint8_t> copy(static_cast<const uint8_t*>(file.data()), static_cast<const uint8_t*>(file.data()) + file.size());
+            GP::SessionTrailer trailer;
+            memcpy(&trailer, &copy[copy.size() - sizeof(trailer)], sizeof(trailer));
+            uint64_t far = copy.size() * 2;
+            memcpy(&copy[trailer.index_offset + sizeof(GP::SessionIndexEntry)], &far, sizeof(far));
+            GP::SessionReader damaged(copy.data(), copy.size());
+            bool walked = damaged.recovered() && damaged.record_count() == expected.size() && read_all(damaged, expected, expected.size());
+            printf("a damaged index is walked around: %s\n", walked ? "ok" : "WRONG");
+            ok = ok && walked;
+            
+            // what a crash in the middle of the last block would leave.
+            const GP::SessionIndexEntry& last = reader.block(reader.block_count() - 1);
+            complete_size = last.offset + 100;
+            complete_records = last.first_record;
+        }
+        
+        if (truncate(path.c_str(), complete_size) == 0) {
+            GP::MappedFile_Linux file(path.c_str());
+            GP::SessionReader reader(file.data(), file.size());
+            bool recovered = reader.recovered() && reader.record_count() == complete_records
+                          && read_all(reader, expected, complete_records);
+            printf("a cut file keeps %llu records: %s\n", (unsigned long long)reader.record_count(), recovered ? "ok" : "WRONG");
+            ok = ok && recovered;
+        }
+        unlink(path.c_str());
+        return ok;
+    }
+    
+    bool check_full_ring() {
+        std::string path = temporary_path();
+        GP::SessionWriter* writer = GP::SessionWriter::create(path.c_str(), 65536, 64);
+        int device = writer->add_device(descriptor("flood", 32767), 0);
+        GP::Frame frame = {};
+        const int frames = 200000;
+        uint64_t start = GP::Timer::monotonic_nanoseconds();
+        for (int i = 0; i < frames; ++ i) {
+            ++ frame.sequence;
+            frame.axes[0] = i;
+            writer->record_frame(device, frame, i);
+        }
+        uint64_t elapsed = GP::Timer::monotonic_nanoseconds() - start;
+        uint64_t dropped = writer->dropped();
+        delete writer;
+        
+        GP::MappedFile_Linux file(path.c_str());
+        GP::SessionReader reader(file.data(), file.size());
+        printf("%d frames recorded at %.0f ns each, %llu dropped, %llu kept\n", frames, double(elapsed) / frames,
+               (unsigned long long)dropped, (unsigned long long)reader.record_count());
+        bool ok = reader.dropped() == dropped && reader.record_count() + dropped == frames + 1;
+        unlink(path.c_str());
+        return ok;
+    }
+    
+    bool check_gamepad() {
+        std::string path = temporary_path();
+        GP::EventLoop* loop = GP::EventLoop::create();
+        int fds[2];
+        if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0)
+            return false;
+        GP::Gamepad_Linux* gamepad = new GP::Gamepad_Linux(fds[0], loop);
+        gamepad->describe_axis(ABS_X, -512, 511);
+        
+        GP::SessionWriter* writer = GP::SessionWriter::create(path.c_str());
+        int device = writer->add_gamepad(gamepad, "pipe");
+        gamepad->record_reports(writer, device);
+        const int reports = 100;
+        for (int r = 0; r < reports; ++ r) {
+            input_event events[2] = {};
+            events[0].type = EV_ABS;
+            events[0].code = ABS_X;
+            events[0].value = r * 5 - 256;
+            events[1].type = EV_SYN;
+            events[1].code = SYN_REPORT;
+            ssize_t written = write(fds[1], events, sizeof(events));
+            (void)written;
+            if (r % 10 == 9)
+                while (loop->dispatch_pending()) {}
+        }
+        gamepad->record_reports(NULL, 0);
+        writer->remove_gamepad(gamepad);
+        delete writer;
+        delete gamepad;
+        close(fds[1]);
+        delete loop;
+        
+        GP::MappedFile_Linux file(path.c_str());
+        GP::SessionReader reader(file.data(), file.size());
+        GP::SessionReader::Cursor cursor = reader.begin();
+        GP::SessionRecord record;
+        int frames = 0;
+        size_t raw_bytes = 0;
+        long last_x = 0;
+        while (cursor.next(record)) {
+            if (record.type == GP::SessionRecordType::frame) {
+                ++ frames;
+                last_x = record.state->axes[static_cast<int>(GP::Axis::X)];
+            } else if (record.type == GP::SessionRecordType::raw)
+                raw_bytes += record.raw_size;
+        }
+        printf("gamepad: %d frames, %zu raw bytes, X ends at %ld\n", frames, raw_bytes, last_x);
+        unlink(path.c_str());
+        return frames == reports && raw_bytes == reports * 2 * sizeof(input_event) && last_x == (reports - 1) * 5 - 256;
+    }
+    
+    bool check_delete_while_dispatching() {
+        std::string path = temporary_path();
+        GP::SyntheticGamepad pad;
+        GP::SessionWriter* writer = GP::SessionWriter::create(path.c_str());
+        writer->add_gamepad(&pad, "threaded");
+        
+        std::atomic<bool> running(true);
+        std::atomic<long> frames(0);
+        std::thread dispatcher([&]() {
+            for (long i = 0; running.load(std::memory_order_relaxed); ++ i) {
+                pad.set_axis_value(GP::Axis::X, i % 512);
+                pad.handle_axes_change(1000000);
+                pad.handle_frame(1000000);
+                frames.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+        while (frames.load(std::memory_order_relaxed) < 1000)
+            std::this_thread::yield();
+        delete writer;
+        long deleted_at = frames.load(std::memory_order_relaxed);
+        while (frames.load(std::memory_order_relaxed) < deleted_at + 1000)
+            std::this_thread::yield();
+        running.store(false, std::memory_order_relaxed);
+        dispatcher.join();
+        
+        GP::MappedFile_Linux file(path.c_str());
+        GP::SessionReader reader(file.data(), file.size());
+        bool ok = reader.record_count() >= 2;
+        printf("writer deleted while dispatching: %llu records, %s\n",
+               (unsigned long long)reader.record_count(), ok ? "ok" : "FAILED");
+        unlink(path.c_str());
+        return ok;
+    }
+}
+
+int main() {
+    bool ok = check_round_trip();
+    ok = check_full_ring() && ok;
+    ok = check_gamepad() && ok;
+    ok = check_delete_while_dispatching() && ok;
+    return ok ? 0 : 1;
+}
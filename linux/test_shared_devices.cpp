@@ -0,0 +1,218 @@
+/*
+ 
+test_shared_devices.cpp ... Check that observers share one reader per device.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "EventLoop.hpp"
+#include "GamepadChangedObserver.hpp"
+#include "DeviceHub_Linux.hpp"
+#include "Gamepad_Linux.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <vector>
+
+// Attach a device fed through a pipe to 1, 2, 4 and 8 observers. Every
+// observer must see every report, while the device is still decoded once
+// per report. Attach and detach devices under two observers, one added
+// late: both must see each device at the same slot, and a freed slot must
+// go to the next device. Delete the first of two observers sharing a
+// device: the callback and associated object its client set must go with
+// it, while the other keeps receiving the reports.
+
+static const int kReports = 500;
+
+static void count_frame(void* self, GP::Gamepad*, const GP::Frame&) {
+    ++ *static_cast<long*>(self);
+}
+
+static void send_reports(GP::EventLoop* loop, int fd, int count) {
+    for (int r = 0; r < count; ++ r) {
+        input_event events[2] = {};
+        events[0].type = EV_ABS;
+        events[0].code = ABS_X;
+        events[0].value = r % 2 ? 100 : -100;
+        events[1].type = EV_SYN;
+        events[1].code = SYN_REPORT;
+        ssize_t written = write(fd, events, sizeof(events));
+        (void)written;
+        if (r % 64 == 63)
+            while (loop->dispatch_pending()) {}
+    }
+    while (loop->dispatch_pending()) {}
+}
+
+static bool run_with_observers(GP::EventLoop* loop, int observer_count) {
+    std::vector<GP::GamepadChangedObserver*> observers;
+    std::vector<long> frames(observer_count, 0);
+    for (int i = 0; i < observer_count; ++ i) {
+        observers.push_back(GP::GamepadChangedObserver::create(NULL, NULL, loop));
+        GP::Gamepad::Subscriber subscriber = {};
+        subscriber.self = &frames[i];
+        subscriber.frame = count_frame;
+        subscriber.interest = GP::Interest::everything();
+        observers[i]->subscribe(subscriber);
+    }
+    
+    int fds[2];
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0)
+        return false;
+    GP::DeviceHub_Linux* hub = GP::DeviceHub_Linux::retain(loop);
+    hub->attach("event-test", fds[0]);
+    GP::Gamepad_Linux* gamepad = hub->devices().back().second.get();
+    
+    send_reports(loop, fds[1], kReports);
+    
+    GP::Statistics statistics = gamepad->statistics();
+    uint64_t decoded = statistics.reports_read;
+    bool ok = decoded == kReports && statistics.reports_dispatched == kReports && statistics.short_reads == 0;
+    for (int i = 0; i < observer_count; ++ i)
+        ok = ok && frames[i] == kReports;
+    printf("%d observers: %llu reports decoded, %ld frames delivered\n",
+           observer_count, (unsigned long long)decoded, frames[0] * observer_count);
+    
+    hub->detach("event-test");
+    hub->release();
+    close(fds[1]);
+    for (auto it = observers.begin(); it != observers.end(); ++ it)
+        delete *it;
+    return ok;
+}
+
+struct SlotsSeen {
+    std::vector<std::pair<GP::Gamepad*, int> > attached;
+};
+
+static void record_slot(void* self, GP::Gamepad* gamepad, GP::GamepadState state) {
+    if (state == GP::GamepadState::attached)
+        static_cast<SlotsSeen*>(self)->attached.push_back(std::make_pair(gamepad, gamepad->slot()));
+}
+
+static bool check_slots(GP::EventLoop* loop) {
+    SlotsSeen first, second;
+    GP::GamepadChangedObserver* observer = GP::GamepadChangedObserver::create(&first, record_slot, loop);
+    GP::DeviceHub_Linux* hub = GP::DeviceHub_Linux::retain(loop);
+    
+    int fds[3][2];
+    for (int i = 0; i < 3; ++ i)
+        if (pipe2(fds[i], O_NONBLOCK | O_CLOEXEC) != 0)
+            return false;
+    hub->attach("event-slot-a", fds[0][0]);
+    hub->attach("event-slot-b", fds[1][0]);
+    int freed = hub->devices()[0].second->slot();
+    hub->detach("event-slot-a");
+    GP::GamepadChangedObserver* late = GP::GamepadChangedObserver::create(&second, record_slot, loop);
+    hub->attach("event-slot-c", fds[2][0]);
+    
+    // the late observer sees b, then c, as the first one did.
+    bool ok = first.attached.size() == 3 && second.attached.size() == 2
+           && second.attached[0] == first.attached[1] && second.attached[1] == first.attached[2]
+           && first.attached[0].second != first.attached[1].second && first.attached[2].second == freed;
+    printf("slots of 3 devices under 2 observers: %d %d %d, %s\n", first.attached[0].second,
+           first.attached[1].second, first.attached[2].second, ok ? "the same for both" : "FAILED");
+    
+    hub->detach("event-slot-b");
+    hub->detach("event-slot-c");
+    hub->release();
+    delete late;
+    delete observer;
+    for (int i = 0; i < 3; ++ i)
+        close(fds[i][1]);
+    return ok;
+}
+
+struct Owner {
+    long frames;
+    bool deleted;
+};
+
+static void delete_owned(void* object) {
+    static_cast<Owner*>(object)->deleted = true;
+}
+
+static void take_gamepad(void* self, GP::Gamepad* gamepad, GP::GamepadState state) {
+    if (state == GP::GamepadState::attached) {
+        gamepad->set_frame_callback(&static_cast<Owner*>(self)->frames, count_frame);
+        gamepad->associate(self, delete_owned);
+    }
+}
+
+static bool check_removed_observer(GP::EventLoop* loop) {
+    Owner owner = {0, false};
+    GP::GamepadChangedObserver* first = GP::GamepadChangedObserver::create(&owner, take_gamepad, loop);
+    GP::DeviceHub_Linux* hub = GP::DeviceHub_Linux::retain(loop);
+    int fds[2];
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0)
+        return false;
+    hub->attach("event-owned", fds[0]);
+    GP::Gamepad_Linux* gamepad = hub->devices().back().second.get();
+    
+    long frames = 0, stray = 0;
+    GP::GamepadChangedObserver* second = GP::GamepadChangedObserver::create(NULL, NULL, loop);
+    GP::Gamepad::Subscriber subscriber = {};
+    subscriber.self = &frames;
+    subscriber.frame = count_frame;
+    subscriber.interest = GP::Interest::everything();
+    second->subscribe(subscriber);
+    
+    // shared by two observers, the single slots are refused.
+    bool refused = false;
+    try {
+        gamepad->set_frame_callback(&stray, count_frame);
+    } catch (const GP::GamepadSharedException&) {
+        refused = true;
+    }
+    send_reports(loop, fds[1], kReports);
+    bool shared = refused && owner.frames == kReports && frames == kReports && !stray;
+    
+    // the state of the first goes with it; the second keeps counting.
+    delete first;
+    send_reports(loop, fds[1], kReports);
+    bool ok = shared && owner.deleted && owner.frames == kReports && frames == 2 * kReports
+           && !gamepad->associated_object();
+    printf("observer deleted from a shared gamepad: %ld and %ld frames, %s\n",
+           owner.frames, frames, ok ? "its callback cleared" : "FAILED");
+    
+    hub->detach("event-owned");
+    hub->release();
+    delete second;
+    close(fds[1]);
+    return ok;
+}
+
+int main() {
+    GP::EventLoop* loop = GP::EventLoop::create();
+    bool ok = true;
+    for (int observers = 1; observers <= 8; observers *= 2)
+        ok = run_with_observers(loop, observers) && ok;
+    ok = check_slots(loop) && ok;
+    ok = check_removed_observer(loop) && ok;
+    delete loop;
+    return ok ? 0 : 1;
+}
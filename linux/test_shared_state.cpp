@@ -0,0 +1,282 @@
+/*
+ 
+test_shared_state.cpp ... Tests the shared-memory state table and event ring.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+#include "SharedState_Linux.hpp"
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstdio>
+#include <thread>
+#include <atomic>
+
+// Publish a pad and read back its slot and events. Publish frames whose axes
+// all hold the same value from one thread while another reads: no copy may
+// mix two frames. A slot left half written must fail to read after the read
+// timeout, not at once, and read again once written. Publish past the ring
+// without reading: the oldest are counted lost, and the rest come in order.
+// Wait: the timeout is kept, and a publication wakes the reader. Then read
+// from a forked process, waiting on the futex.
+
+namespace {
+    GP::Frame frame_of(uint64_t i) {
+        GP::Frame frame = {};
+        frame.sequence = i;
+        for (int a = 0; a < static_cast<int>(GP::Axis::count); ++ a)
+            frame.axes[a] = static_cast<long>(i % 100000);
+        frame.changed_axes = 1;
+        frame.held = GP::ButtonSet(i % 2 ? 2 : 0);
+        frame.pressed = GP::ButtonSet(i % 2 ? 2 : 0);
+        frame.released = GP::ButtonSet(i && i % 2 == 0 ? 2 : 0);
+        return frame;
+    }
+    
+    bool check_gamepad() {
+        GP::SharedStatePublisher_Linux* publisher = GP::SharedStatePublisher_Linux::create(NULL, 4, 256);
+        GP::SharedStateReader_Linux* reader = GP::SharedStateReader_Linux::open_fd(publisher->fd());
+        GP::SyntheticGamepad pad;
+        int slot = publisher->add_gamepad(&pad, "synthetic pad");
+        
+        pad.set_axis_value(GP::Axis::X, 100);
+        pad.set_axis_value(GP::Axis::Y, -200);
+        pad.handle_axes_change(1000000);
+        pad.handle_button_change(GP::Button::_3, true);
+        pad.handle_frame(1000000);
+        pad.handle_button_change(GP::Button::_3, false);
+        pad.handle_button_change(GP::Button::_4, true);
+        pad.handle_frame(1000000);
+        pad.handle_button_change(GP::Button::_5, true);
+        pad.handle_button_change(GP::Button::_5, false);
+        pad.handle_frame(1000000);
+        
+        GP::SharedDeviceState state;
+        bool ok = slot == 0 && reader->read_device(slot, state) && state.attached && state.generation == 1
+               && !strcmp(state.name, "synthetic pad") && state.bounds[static_cast<int>(GP::Axis::X)] == pad.axis_bound(GP::Axis::X)
+               && state.axes[static_cast<int>(GP::Axis::X)] == 100 && state.axes[static_cast<int>(GP::Axis::Y)] == -200
+               && state.held == pad.last_frame().held && state.sequence == pad.last_frame().sequence;
+        
+        GP::SharedEvent events[16];
+        size_t count = reader->read_events(events, 16);
+        // attach, X, Y, _3 down; _3 up, _4 down; _5 down, _5 up.
+        ok = ok && count == 8 && events[0].type == GP::SharedEventType::attach
+                && events[1].type == GP::SharedEventType::axis && events[1].value == 100
+                && events[3].type == GP::SharedEventType::button && events[3].index == static_cast<int>(GP::Button::_3) && events[3].value == 1
+                && events[4].index == static_cast<int>(GP::Button::_3) && events[4].value == 0
+                && events[5].index == static_cast<int>(GP::Button::_4) && events[5].value == 1
+                && events[6].index == static_cast<int>(GP::Button::_5) && events[6].value == 1
+                && events[7].index == static_cast<int>(GP::Button::_5) && events[7].value == 0;
+        
+        publisher->remove_gamepad(&pad);
+        count = reader->read_events(events, 16);
+        ok = ok && count == 1 && events[0].type == GP::SharedEventType::detach
+                && reader->read_device(slot, state) && !state.attached;
+        printf("a pad: slot, 8 events and the detach: %s\n", ok ? "ok" : "FAILED");
+        delete reader;
+        delete publisher;
+        return ok;
+    }
+    
+    bool check_torn_reads() {
+        GP::SharedStatePublisher_Linux* publisher = GP::SharedStatePublisher_Linux::create(NULL, 1, 64);
+        GP::SharedStateReader_Linux* reader = GP::SharedStateReader_Linux::open_fd(publisher->fd());
+        long bounds[static_cast<int>(GP::Axis::count)] = {};
+        int slot = publisher->add_device("pad", bounds);
+        
+        std::atomic<bool> stop(false);
+        uint64_t reads = 0, torn = 0;
+        std::thread thread([&]() {
+            GP::SharedDeviceState state;
+            while (!stop) {
+                if (!reader->read_device(slot, state))
+                    continue;
+                ++ reads;
+                for (int a = 1; a < static_cast<int>(GP::Axis::count); ++ a)
+                    if (state.axes[a] != state.axes[0])
+                        ++ torn;
+                if (state.sequence && (state.sequence % 100000 != uint64_t(state.axes[0]) || state.held.bits() != (state.sequence % 2 ? 2u : 0u)))
+                    ++ torn;
+            }
+        });
+        for (uint64_t i = 1; i <= 300000; ++ i) {
+            publisher->publish_frame(slot, frame_of(i), i);
+            if (i % 1000 == 0)
+                std::this_thread::yield();
+        }
+        stop = true;
+        thread.join();
+        printf("300000 frames against %llu reads: %llu torn\n", (unsigned long long)reads, (unsigned long long)torn);
+        delete reader;
+        delete publisher;
+        return torn == 0;
+    }
+    
+    bool check_stuck_slot() {
+        GP::SharedStatePublisher_Linux* publisher = GP::SharedStatePublisher_Linux::create(NULL, 1, 64);
+        GP::SharedStateReader_Linux* reader = GP::SharedStateReader_Linux::open_fd(publisher->fd());
+        long bounds[static_cast<int>(GP::Axis::count)] = {};
+        int slot = publisher->add_device("pad", bounds);
+        
+        // as a publisher which stopped in the middle of writing the slot.
+        size_t size = GP::SharedStatePublisher::size_for(1, 64);
+        void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, publisher->fd(), 0);
+        if (memory == MAP_FAILED)
+            return false;
+        const GP::SharedStateHeader* header = static_cast<const GP::SharedStateHeader*>(memory);
+        GP::SharedSlot* written = reinterpret_cast<GP::SharedSlot*>(static_cast<uint8_t*>(memory) + header->slots_offset);
+        uint32_t sequence = written->sequence.fetch_add(1);
+        
+        GP::SharedDeviceState state;
+        uint64_t start = GP::Bench::now_ns();
+        bool ok = !reader->read_device(slot, state);
+        double waited = (GP::Bench::now_ns() - start) / 1e6;
+        ok = ok && waited >= GP::SharedStateLayout::kReadTimeoutMilliseconds;
+        written->sequence.store(sequence + 2);
+        ok = ok && reader->read_device(slot, state) && state.attached;
+        printf("a slot left half written: given up after %.1f ms, then read: %s\n", waited, ok ? "ok" : "FAILED");
+        munmap(memory, size);
+        delete reader;
+        delete publisher;
+        return ok;
+    }
+    
+    bool check_overrun() {
+        GP::SharedStatePublisher_Linux* publisher = GP::SharedStatePublisher_Linux::create(NULL, 1, 50);
+        long bounds[static_cast<int>(GP::Axis::count)] = {};
+        int slot = publisher->add_device("pad", bounds);
+        GP::SharedStateReader_Linux* reader = GP::SharedStateReader_Linux::open_fd(publisher->fd());
+        
+        // the capacity is rounded up to 64; each frame is an axis change.
+        GP::Frame frame = frame_of(0);
+        for (uint64_t i = 1; i <= 100; ++ i) {
+            frame.sequence = i;
+            publisher->publish_frame(slot, frame, i);
+        }
+        GP::SharedEvent events[128];
+        size_t count = reader->read_events(events, 128);
+        bool ok = count == 64 && reader->lost() == 36;
+        for (size_t i = 0; ok && i < count; ++ i)
+            ok = events[i].sequence == 37 + i;
+        printf("100 events through a ring of 64: %zu read, %llu lost, %s\n", count, (unsigned long long)reader->lost(), ok ? "in order" : "FAILED");
+        delete reader;
+        delete publisher;
+        return ok;
+    }
+    
+    bool check_processes() {
+        char name[64];
+        snprintf(name, sizeof(name), "/test_shared_state_%d", int(getpid()));
+        GP::SharedStatePublisher_Linux* publisher = GP::SharedStatePublisher_Linux::create(name);
+        long bounds[static_cast<int>(GP::Axis::count)] = {};
+        int slot = publisher->add_device("pad", bounds);
+        
+        int ready[2];
+        if (pipe(ready) != 0)
+            return false;
+        pid_t child = fork();
+        if (child == 0) {
+            // read every event until the detach, then check the last frame.
+            GP::SharedStateReader_Linux* reader = GP::SharedStateReader_Linux::open(name);
+            char byte = 1;
+            if (write(ready[1], &byte, 1) != 1)
+                _exit(2);
+            uint64_t last = 0;
+            bool detached = false, ok = true;
+            while (!detached) {
+                uint32_t seen = reader->changes();
+                GP::SharedEvent events[64];
+                size_t count;
+                while ((count = reader->read_events(events, 64)) > 0)
+                    for (size_t i = 0; i < count; ++ i) {
+                        if (events[i].type == GP::SharedEventType::detach)
+                            detached = true;
+                        else if (events[i].type == GP::SharedEventType::axis) {
+                            ok = ok && events[i].sequence == last + 1;
+                            last = events[i].sequence;
+                        }
+                    }
+                if (!detached && !reader->wait(seen, 2000))
+                    _exit(3);
+            }
+            GP::SharedDeviceState state;
+            ok = ok && last == 1000 && reader->lost() == 0 && reader->read_device(slot, state) && !state.attached && state.axes[0] == 1000;
+            _exit(ok ? 0 : 1);
+        }
+        char byte;
+        bool ok = read(ready[0], &byte, 1) == 1;
+        for (uint64_t i = 1; i <= 1000; ++ i) {
+            publisher->publish_frame(slot, frame_of(i), i);
+            if (i % 100 == 0)
+                usleep(1000);
+        }
+        publisher->remove_device(slot);
+        int status = 0;
+        waitpid(child, &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        printf("1000 frames to another process, waiting on the futex: %s\n", ok ? "ok" : "FAILED");
+        close(ready[0]);
+        close(ready[1]);
+        delete publisher;
+        return ok;
+    }
+    
+    bool check_wait() {
+        GP::SharedStatePublisher_Linux* publisher = GP::SharedStatePublisher_Linux::create(NULL, 1, 64);
+        GP::SharedStateReader_Linux* reader = GP::SharedStateReader_Linux::open_fd(publisher->fd());
+        
+        uint64_t start = GP::Bench::now_ns();
+        bool ok = !reader->wait(reader->changes(), 20);
+        uint64_t timed_out = GP::Bench::now_ns() - start;
+        ok = ok && timed_out >= 20000000 && timed_out < 1000000000;
+        
+        uint32_t seen = reader->changes();
+        std::thread writer([&]() {
+            usleep(5000);
+            long bounds[static_cast<int>(GP::Axis::count)] = {};
+            publisher->add_device("pad", bounds);
+        });
+        ok = ok && reader->wait(seen, 1000);
+        writer.join();
+        printf("a wait: timed out after %.1f ms, woken: %s\n", timed_out / 1e6, ok ? "ok" : "FAILED");
+        delete reader;
+        delete publisher;
+        return ok;
+    }
+}
+
+int main() {
+    bool ok = check_gamepad();
+    ok = check_torn_reads() && ok;
+    ok = check_stuck_slot() && ok;
+    ok = check_overrun() && ok;
+    ok = check_wait() && ok;
+    ok = check_processes() && ok;
+    return ok ? 0 : 1;
+}
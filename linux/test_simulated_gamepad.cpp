@@ -0,0 +1,190 @@
+/*
+ 
+test_simulated_gamepad.cpp ... Tests the simulated gamepad on recorded streams.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "SimulatedGamepad_Linux.hpp"
+#include "Timer.hpp"
+#include <cstdio>
+#include <vector>
+
+// Replay recorded keyboard and mouse streams, with timestamps of our own, to
+// a simulated gamepad: keys must press buttons and deflect axes as mapped,
+// the same pointer speed must deflect the axes alike at any report rate,
+// and a pointer which stops must be centered once the stop is told, at the
+// time it happened, with no timer running.
+
+namespace {
+    std::vector<GP::Frame> frames;
+    
+    void keep_frame(void*, GP::Gamepad*, const GP::Frame& frame) {
+        frames.push_back(frame);
+    }
+    
+    void count_frame(void* self, GP::Gamepad*, const GP::Frame&) {
+        ++ *static_cast<long*>(self);
+    }
+    
+    // The events of a recording, stamped in microseconds.
+    struct Recording {
+        std::vector<input_event> events;
+        
+        Recording& add(uint64_t microseconds, int type, int code, int value) {
+            input_event event = {};
+            event.time.tv_sec = microseconds / 1000000;
+            event.time.tv_usec = microseconds % 1000000;
+            event.type = type;
+            event.code = code;
+            event.value = value;
+            events.push_back(event);
+            return *this;
+        }
+        Recording& key(uint64_t microseconds, int code, int value) {
+            return this->add(microseconds, EV_KEY, code, value).add(microseconds, EV_SYN, SYN_REPORT, 0);
+        }
+        Recording& motion(uint64_t microseconds, int dx, int dy) {
+            if (dx)
+                this->add(microseconds, EV_REL, REL_X, dx);
+            if (dy)
+                this->add(microseconds, EV_REL, REL_Y, dy);
+            return this->add(microseconds, EV_SYN, SYN_REPORT, 0);
+        }
+        void play(GP::SimulatedGamepad_Linux& gamepad) {
+            frames.clear();
+            gamepad.handle_events(events.data(), events.size());
+            events.clear();
+        }
+    };
+    
+    long axis(const GP::Frame& frame, GP::Axis axis) {
+        return frame.axes[static_cast<int>(axis)];
+    }
+    
+    bool check_keys() {
+        GP::SimulatedGamepad_Linux gamepad(NULL);
+        gamepad.set_frame_callback(NULL, keep_frame);
+        gamepad.set_axis_range(GP::Axis::Rx, 100);
+        gamepad.map_key_to_axis(KEY_LEFT, GP::Axis::Rx, -1);
+        gamepad.map_key_to_axis(KEY_RIGHT, GP::Axis::Rx, 1);
+        gamepad.map_key_to_button(KEY_ENTER, GP::Button::_12);
+        
+        Recording recording;
+        recording.key(1000, KEY_W, 1).key(2000, KEY_W, 2).key(3000, KEY_W, 0).key(4000, KEY_ENTER, 1);
+        recording.play(gamepad);
+        bool ok = frames.size() == 4 && frames[0].pressed.contains(GP::Button::_1)
+               && frames[1].pressed == GP::ButtonSet() && frames[1].held.contains(GP::Button::_1)
+               && frames[2].released.contains(GP::Button::_1) && frames[3].pressed.contains(GP::Button::_12)
+               && frames[1].nanoseconds_elapsed == 1000000;
+        
+        recording.key(5000, KEY_LEFT, 1).key(6000, KEY_RIGHT, 1).key(7000, KEY_LEFT, 0).key(8000, KEY_RIGHT, 0);
+        recording.play(gamepad);
+        ok = ok && frames.size() == 4 && axis(frames[0], GP::Axis::Rx) == -100 && axis(frames[1], GP::Axis::Rx) == 0
+                && axis(frames[2], GP::Axis::Rx) == 100 && axis(frames[3], GP::Axis::Rx) == 0;
+        printf("keys: %s\n", ok ? "mapped" : "NOT MAPPED");
+        return ok;
+    }
+    
+    // 1000 counts per second is half the speed of full deflection.
+    bool check_velocity() {
+        GP::SimulatedGamepad_Linux gamepad(NULL);
+        gamepad.set_frame_callback(NULL, keep_frame);
+        bool ok = true;
+        uint64_t now = 1000000;
+        static const int intervals[] = {10000, 5000, 1000, 8000};
+        for (int i = 0; i < 4; ++ i) {
+            Recording recording;
+            int counts = intervals[i] / 1000;
+            for (int r = 0; r < 20; ++ r)
+                recording.motion(now += intervals[i], counts, -counts);
+            recording.play(gamepad);
+            const GP::Frame& last = frames.back();
+            printf("every %5d us: X %ld, Y %ld, %u ns elapsed\n", intervals[i], axis(last, GP::Axis::X),
+                   axis(last, GP::Axis::Y), last.nanoseconds_elapsed);
+            ok = ok && axis(last, GP::Axis::X) == 64 && axis(last, GP::Axis::Y) == -64
+                    && last.nanoseconds_elapsed == unsigned(intervals[i]) * 1000;
+        }
+        return ok;
+    }
+    
+    bool check_stop() {
+        GP::SimulatedGamepad_Linux gamepad(NULL);
+        gamepad.set_frame_callback(NULL, keep_frame);
+        gamepad.set_stop_after(30000000);
+        
+        // the stop is told by the next report, of any device.
+        Recording recording;
+        recording.motion(10000, 4, 0).motion(14000, 4, 0).key(200000, KEY_W, 1);
+        recording.play(gamepad);
+        bool ok = frames.size() == 4 && axis(frames[1], GP::Axis::X) == 64
+               && axis(frames[2], GP::Axis::X) == 0 && frames[2].nanoseconds_elapsed == 30000000
+               && frames[3].pressed.contains(GP::Button::_1) && frames[3].nanoseconds_elapsed == 156000000;
+        
+        // or by the host. Motion after a stop takes the last interval.
+        recording.motion(300000, 8, 0);
+        recording.play(gamepad);
+        ok = ok && frames.size() == 1 && axis(frames[0], GP::Axis::X) == 127;
+        frames.clear();
+        gamepad.advance_to(329000000);
+        ok = ok && frames.empty();
+        gamepad.advance_to(331000000);
+        ok = ok && frames.size() == 1 && axis(frames[0], GP::Axis::X) == 0 && frames[0].nanoseconds_elapsed == 30000000;
+        gamepad.advance_to(400000000);
+        ok = ok && frames.size() == 1;
+        printf("stops: %s\n", ok ? "centered" : "NOT CENTERED");
+        return ok;
+    }
+    
+    // A QA rig replays far faster than a mouse reports.
+    bool check_rate() {
+        GP::SimulatedGamepad_Linux gamepad(NULL);
+        long delivered = 0;
+        gamepad.set_frame_callback(&delivered, count_frame);
+        Recording recording;
+        const int reports = 200000;
+        for (int r = 0; r < reports; ++ r) {
+            if (r % 100 == 50)
+                recording.key(r * 100, KEY_SPACE, r / 100 % 2);
+            else
+                recording.motion(r * 100, r % 7 - 3, r % 5 - 2);
+        }
+        uint64_t start = GP::Timer::monotonic_nanoseconds();
+        gamepad.handle_events(recording.events.data(), recording.events.size());
+        uint64_t elapsed = GP::Timer::monotonic_nanoseconds() - start;
+        printf("%d reports replayed in %.1f ms, %.0f ns each\n", reports, elapsed / 1e6, double(elapsed) / reports);
+        return delivered >= reports;
+    }
+}
+
+int main() {
+    bool ok = check_keys();
+    ok = check_velocity() && ok;
+    ok = check_stop() && ok;
+    ok = check_rate() && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+/*
+ 
+test_slow_callbacks.cpp ... Checks that a slow subscriber is timed and moved to its own thread.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+// A subscriber taking 2 ms per button change, on a budget of 500 us, is
+// moved to its own thread after 3 slow calls. From then on, reports are
+// dispatched without waiting for it, its queue of 4 events drops the
+// excess, and the fast subscriber and the frame callback are never slow.
+
+static const int kReports = 40;
+
+static void count_frame(void* self, GP::Gamepad*, const GP::Frame&) {
+    ++ *static_cast<long*>(self);
+}
+
+static void slow_button_changed(void* self, GP::Gamepad*, GP::Button, bool) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    ++ *static_cast<std::atomic<long>*>(self);
+}
+
+static void print(const char* name, const GP::Gamepad::CallbackTiming& timing) {
+    printf("%-10s %3llu calls, %3llu slow, max %6llu us, %s, %llu dropped\n", name,
+           (unsigned long long)timing.calls, (unsigned long long)timing.slow_calls,
+           (unsigned long long)(timing.max_nanoseconds / 1000), timing.isolated ? "isolated" : "inline",
+           (unsigned long long)timing.dropped_events);
+}
+
+int main() {
+    GP::SyntheticGamepad* gamepad = new GP::SyntheticGamepad();
+    gamepad->set_callback_budget(500, 3, 4);
+    
+    long fast_frames = 0, legacy_frames = 0;
+    std::atomic<long> slow_calls(0);
+    GP::Gamepad::Subscriber fast = {};
+    fast.self = &fast_frames;
+    fast.frame = count_frame;
+    fast.interest = GP::Interest::everything();
+    GP::Gamepad::Subscriber slow = {};
+    slow.self = &slow_calls;
+    slow.button_changed = slow_button_changed;
+    slow.interest = GP::Interest::everything();
+    int fast_id = gamepad->subscribe(fast);
+    int slow_id = gamepad->subscribe(slow);
+    gamepad->set_frame_callback(&legacy_frames, count_frame);
+    
+    uint64_t start = GP::Bench::now_ns(), isolated_at = 0;
+    for (int r = 0; r < kReports; ++ r) {
+        gamepad->handle_button_change(GP::Button::_1, r % 2 == 0);
+        gamepad->handle_axes_change(1000000);
+        gamepad->handle_frame(1000000);
+        if (r == 2)
+            isolated_at = GP::Bench::now_ns();
+    }
+    uint64_t end = GP::Bench::now_ns();
+    printf("%d reports: %.1f ms until isolated, %.2f ms after\n", kReports,
+           (isolated_at - start) / 1e6, (end - isolated_at) / 1e6);
+    
+    // the isolated subscriber catches up on the 4 queued events on its own.
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    GP::Gamepad::CallbackTiming fast_timing = gamepad->callback_timing(fast_id);
+    GP::Gamepad::CallbackTiming slow_timing = gamepad->callback_timing(slow_id);
+    GP::Gamepad::CallbackTiming legacy_timing = gamepad->callback_timing(0);
+    print("fast", fast_timing);
+    print("slow", slow_timing);
+    print("callbacks", legacy_timing);
+    
+    bool ok = fast_frames == kReports && legacy_frames == kReports
+           && fast_timing.calls == kReports && fast_timing.slow_calls == 0 && !fast_timing.isolated
+           && legacy_timing.calls == kReports
+           && slow_timing.isolated && slow_timing.slow_calls >= 3 && slow_timing.calls > 3 && slow_timing.dropped_events > 0
+           // 37 inline calls of the slow subscriber would take 74 ms.
+           && end - isolated_at < 20000000;
+    
+    // unsubscribing drops the queue, and neither it nor the next report
+    // waits for the call in progress.
+    gamepad->handle_button_change(GP::Button::_1, true);
+    gamepad->handle_frame(0);
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+    uint64_t unsubscribe_start = GP::Bench::now_ns();
+    gamepad->unsubscribe(slow_id);
+    gamepad->handle_frame(0);
+    uint64_t unsubscribe_end = GP::Bench::now_ns();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    long delivered = slow_calls;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ok = ok && slow_calls == delivered && !gamepad->callback_timing(slow_id).calls
+            && unsubscribe_end - unsubscribe_start < 1000000;
+    printf("slow subscriber called %ld times in all, unsubscribed in %.2f ms\n", delivered,
+           (unsubscribe_end - unsubscribe_start) / 1e6);
+    
+    delete gamepad;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,262 @@
+/*
+ 
+test_stream.cpp ... Tests the streaming of gamepad events between processes.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Benchmark.hpp"
+#include "Stream_Linux.hpp"
+#include "EventLoop.hpp"
+#include <poll.h>
+#include <unistd.h>
+#include <cstdio>
+#include <deque>
+#include <vector>
+
+// Stream a pad through a transport losing every fourth datagram: what
+// arrives last must be the latest state. Hold back a subscriber's acks:
+// frames must conflate to at most a window of datagrams, and a press and
+// release in between must still arrive. Number more devices than a stream
+// holds: the publisher and the subscriber refuse the extra ones. Then
+// stream over Unix domain and UDP sockets on one event loop, from attach
+// to detach.
+
+namespace {
+    const int kFrames = 500;
+    
+    // A transport in memory, which loses every 'lose_every'th datagram.
+    class MemoryPublisher : public GP::StreamPublisher {
+    public:
+        std::deque<std::vector<uint8_t> > queue;
+        int lose_every;
+        int sent;
+        
+        MemoryPublisher() : lose_every(0), sent(0) {}
+        
+    protected:
+        bool send_datagram(int, const uint8_t* bytes, size_t size) {
+            if (!lose_every || ++ sent % lose_every)
+                queue.push_back(std::vector<uint8_t>(bytes, bytes + size));
+            return true;
+        }
+        void schedule_flush() {}
+    };
+    
+    struct Seen {
+        GP::Gamepad* gamepad;
+        int attached;
+        int detached;
+        std::vector<std::pair<GP::Button, bool> > buttons;
+    };
+    
+    void button_changed(void* self, GP::Gamepad*, GP::Button button, bool is_pressed) {
+        static_cast<Seen*>(self)->buttons.push_back(std::make_pair(button, is_pressed));
+    }
+    
+    void gamepad_changed(void* self, GP::Gamepad* gamepad, GP::GamepadState state) {
+        Seen* seen = static_cast<Seen*>(self);
+        if (state == GP::GamepadState::attached) {
+            ++ seen->attached;
+            seen->gamepad = gamepad;
+            gamepad->set_button_changed_callback(seen, button_changed);
+        } else {
+            ++ seen->detached;
+            seen->gamepad = NULL;
+        }
+    }
+    
+    void drive(GP::SyntheticGamepad& pad, int i) {
+        pad.set_axis_value(GP::Axis::X, i % 300 - 150);
+        pad.set_axis_value(GP::Axis::Rz, i / 10 % 2 ? 400 : -400);
+        pad.handle_axes_change(1000000);
+        if (i % 25 == 0)
+            pad.handle_button_change(GP::Button::_2, i / 25 % 2 == 0);
+        pad.handle_frame(1000000);
+    }
+    
+    bool same_state(GP::Gamepad* gamepad, const GP::Frame& expected) {
+        const GP::Frame& frame = gamepad->last_frame();
+        return frame.axes[static_cast<int>(GP::Axis::X)] == expected.axes[static_cast<int>(GP::Axis::X)]
+            && frame.axes[static_cast<int>(GP::Axis::Rz)] == expected.axes[static_cast<int>(GP::Axis::Rz)]
+            && frame.held == expected.held;
+    }
+    
+    void deliver(MemoryPublisher& publisher, int id, GP::StreamSubscriber& subscriber) {
+        std::vector<uint8_t> ack;
+        while (!publisher.queue.empty()) {
+            subscriber.handle_datagram(publisher.queue.front().data(), publisher.queue.front().size());
+            publisher.queue.pop_front();
+            if (subscriber.take_ack(ack))
+                publisher.handle_datagram(id, ack.data(), ack.size());
+        }
+    }
+    
+    bool check_loss() {
+        MemoryPublisher publisher;
+        publisher.lose_every = 4;
+        publisher.set_timeouts(0, 60000);
+        GP::SyntheticGamepad pad;
+        publisher.add_gamepad(&pad, "pad");
+        int id = publisher.add_subscriber();
+        Seen seen = {};
+        GP::StreamSubscriber subscriber;
+        subscriber.set_callback(&seen, gamepad_changed);
+        
+        for (int i = 0; i < kFrames; ++ i) {
+            drive(pad, i);
+            publisher.flush();
+            deliver(publisher, id, subscriber);
+        }
+        // what was lost last goes again.
+        for (int i = 0; i < 10 && publisher.tick(); ++ i)
+            deliver(publisher, id, subscriber);
+        
+        const GP::StreamStatistics& statistics = publisher.statistics(id);
+        bool ok = seen.attached == 1 && seen.gamepad && same_state(seen.gamepad, pad.last_frame()) && statistics.lost > 0;
+        printf("a fourth lost: %llu datagrams, %llu lost, %.1f bytes a frame, %s\n",
+               (unsigned long long)statistics.datagrams, (unsigned long long)statistics.lost,
+               double(statistics.bytes) / statistics.frames, ok ? "ends in the latest state" : "FAILED");
+        publisher.remove_gamepad(&pad);
+        return ok;
+    }
+    
+    bool check_conflation() {
+        MemoryPublisher publisher;
+        publisher.set_window(2);
+        GP::SyntheticGamepad pad;
+        publisher.add_gamepad(&pad, "pad");
+        int id = publisher.add_subscriber();
+        Seen seen = {};
+        GP::StreamSubscriber subscriber;
+        subscriber.set_callback(&seen, gamepad_changed);
+        
+        // no acks: button 5 is pressed and released while the window is full.
+        for (int i = 0; i < 100; ++ i) {
+            drive(pad, i);
+            if (i == 50 || i == 51) {
+                pad.handle_button_change(GP::Button::_5, i == 50);
+                pad.handle_frame(1000000);
+            }
+            publisher.flush();
+        }
+        size_t queued = publisher.queue.size();
+        deliver(publisher, id, subscriber);
+        
+        const GP::StreamStatistics& statistics = publisher.statistics(id);
+        int presses = 0, releases = 0;
+        for (size_t i = 0; i < seen.buttons.size(); ++ i)
+            if (seen.buttons[i].first == GP::Button::_5)
+                ++ (seen.buttons[i].second ? presses : releases);
+        bool ok = queued == 2 && statistics.conflated >= 90 && seen.gamepad && same_state(seen.gamepad, pad.last_frame())
+               && presses == 1 && releases == 1;
+        printf("window of 2: %zu datagrams held back, %llu frames conflated, tap %s\n", queued,
+               (unsigned long long)statistics.conflated, ok ? "kept" : "FAILED");
+        publisher.remove_gamepad(&pad);
+        return ok;
+    }
+    
+    // Run the loop until 'done', or a second has gone.
+    template <typename F>
+    bool run_until(GP::EventLoop* loop, F done) {
+        uint64_t deadline = GP::Timer::monotonic_nanoseconds() + 1000000000;
+        while (!done()) {
+            if (GP::Timer::monotonic_nanoseconds() > deadline)
+                return false;
+            pollfd ready = {loop->readiness_fd(), POLLIN, 0};
+            poll(&ready, 1, 10);
+            loop->dispatch_pending();
+        }
+        return true;
+    }
+    
+    bool check_limits() {
+        MemoryPublisher publisher;
+        GP::SessionDevice descriptor;
+        memset(&descriptor, 0, sizeof(descriptor));
+        int last = -1;
+        for (int d = 0; d < GP::StreamEncoding::kMaxDevices; ++ d)
+            last = publisher.add_device(descriptor);
+        bool ok = last == GP::StreamEncoding::kMaxDevices - 1 && publisher.add_device(descriptor) == -1;
+        
+        GP::StreamSubscriber subscriber;
+        std::vector<uint8_t> datagram;
+        datagram.push_back(static_cast<uint8_t>(GP::StreamDatagram::events));
+        GP::SessionEncoding::put_varint(datagram, 1);
+        datagram.push_back(static_cast<uint8_t>(GP::SessionRecordType::detach));
+        GP::SessionEncoding::put_varint(datagram, 0xffff);
+        ok = ok && !subscriber.handle_datagram(datagram.data(), datagram.size());
+        printf("%d devices a stream: the next refused, %s\n", int(GP::StreamEncoding::kMaxDevices), ok ? "ok" : "FAILED");
+        return ok;
+    }
+    
+    bool check_sockets(const char* address) {
+        GP::EventLoop* loop = GP::EventLoop::create();
+        GP::StreamServer_Linux* server = GP::StreamServer_Linux::create(address, loop);
+        GP::SyntheticGamepad pad;
+        server->add_gamepad(&pad, "pad");
+        
+        Seen seen = {};
+        GP::StreamClient_Linux* client = new GP::StreamClient_Linux(address, loop);
+        client->set_callback(&seen, gamepad_changed);
+        bool ok = run_until(loop, [&]() { return seen.attached == 1; });
+        
+        for (int i = 0; i < kFrames; ++ i) {
+            drive(pad, i);
+            if (i % 10 == 9)
+                loop->dispatch_pending();
+        }
+        ok = ok && run_until(loop, [&]() { return seen.gamepad && same_state(seen.gamepad, pad.last_frame()); });
+        size_t edges = seen.buttons.size();
+        
+        server->remove_gamepad(&pad);
+        ok = ok && run_until(loop, [&]() { return seen.detached == 1; });
+        
+        const GP::StreamStatistics& statistics = server->statistics(0);
+        printf("%s: %llu frames in %llu datagrams, %.1f bytes a frame, %zu button edges, %s\n", address,
+               (unsigned long long)statistics.frames, (unsigned long long)statistics.datagrams,
+               double(statistics.bytes) / statistics.frames, edges, ok ? "attached to detached" : "FAILED");
+        ok = ok && edges == kFrames / 25;
+        delete client;
+        delete server;
+        delete loop;
+        return ok;
+    }
+}
+
+int main() {
+    bool ok = check_loss();
+    ok = check_conflation() && ok;
+    ok = check_limits() && ok;
+    char address[64];
+    snprintf(address, sizeof(address), "unix:/tmp/test_stream_%d", int(getpid()));
+    ok = check_sockets(address) && ok;
+    snprintf(address, sizeof(address), "unix:@test_stream_%d", int(getpid()));
+    ok = check_sockets(address) && ok;
+    ok = check_sockets("udp:127.0.0.1:47999") && ok;
+    return ok ? 0 : 1;
+}
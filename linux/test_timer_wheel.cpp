@@ -0,0 +1,129 @@
+/*
+ 
+test_timer_wheel.cpp ... Check the timing wheel against the expected expiries.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "TimerWheel.hpp"
+#include <cstdio>
+#include <vector>
+
+// Randomly start, restart and stop timers with expiries from 1 tick to past
+// the range of the wheel, advance by random steps, and check that each timer
+// fires exactly at its expected tick.
+
+static const int kTimers = 2000;
+static const int kSteps = 5000;
+
+static uint64_t random_state = 88172645463325252ULL;
+static uint64_t random_below(uint64_t limit) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state % limit;
+}
+
+struct Expectation {
+    bool active;
+    uint64_t next;
+    uint64_t period;
+    long fired;
+};
+
+static GP::TimerWheel* wheel;
+static std::vector<Expectation> expectations(kTimers);
+static long errors = 0;
+
+static void fired(void* self, GP::TimerWheel::Entry*) {
+    Expectation& expectation = *static_cast<Expectation*>(self);
+    uint64_t tick = wheel->now() - 1;
+    if (!expectation.active || expectation.next != tick) {
+        if (errors ++ < 10)
+            printf("fired at %llu, expected %llu\n", (unsigned long long)tick, (unsigned long long)expectation.next);
+    }
+    ++ expectation.fired;
+    if (expectation.period)
+        expectation.next += expectation.period;
+    else
+        expectation.active = false;
+}
+
+static uint64_t random_delay() {
+    switch (random_below(4)) {
+        case 0: return random_below(64);
+        case 1: return random_below(4096);
+        case 2: return random_below(1 << 20);
+        default: return random_below(uint64_t(1) << 26);
+    }
+}
+
+int main() {
+    GP::TimerWheel the_wheel(12345);
+    wheel = &the_wheel;
+    
+    std::vector<GP::TimerWheel::Entry> entries;
+    entries.reserve(kTimers);
+    for (int i = 0; i < kTimers; ++ i)
+        entries.push_back(GP::TimerWheel::Entry(&expectations[i], fired));
+    
+    long fired_total = 0;
+    for (int step = 0; step < kSteps; ++ step) {
+        for (int op = 0; op < 20; ++ op) {
+            int i = random_below(kTimers);
+            Expectation& expectation = expectations[i];
+            if (random_below(5) == 0) {
+                wheel->stop(&entries[i]);
+                expectation.active = false;
+            } else {
+                uint64_t expires = wheel->now() + random_delay();
+                uint64_t period = random_below(3) == 0 ? 64 + random_below(5000) : 0;
+                wheel->start(&entries[i], expires, period);
+                expectation.active = true;
+                expectation.next = expires;
+                expectation.period = period;
+            }
+        }
+        
+        uint64_t step_size = random_below(100) == 0 ? random_below(1 << 20) : random_below(3000);
+        wheel->advance(wheel->now() + step_size);
+        
+        for (int i = 0; i < kTimers; ++ i) {
+            const Expectation& expectation = expectations[i];
+            if (expectation.active != entries[i].pending() || (expectation.active && expectation.next < wheel->now())) {
+                if (errors ++ < 10)
+                    printf("timer %d missed its expiry at %llu\n", i, (unsigned long long)expectation.next);
+            }
+        }
+    }
+    
+    for (int i = 0; i < kTimers; ++ i)
+        fired_total += expectations[i].fired;
+    
+    printf("%ld firings checked, %ld errors\n", fired_total, errors);
+    return errors == 0 && fired_total > 0 ? 0 : 1;
+}
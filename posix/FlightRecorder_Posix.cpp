@@ -0,0 +1,93 @@
+/*
+ 
+FlightRecorder_Posix.cpp ... Writing the flight recorder out on a fatal signal, on Linux and Mac OS X.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "../FlightRecorder.hpp"
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+namespace GP {
+    // The handler may not allocate, so everything it needs is set aside.
+    static char crash_path[4096];
+    static struct {
+        FlightDumpHeader header;
+        FlightRecord records[FlightRecorder::kCapacity];
+    } crash_dump;
+    
+    static const int fatal_signals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+    static const int kFatalSignals = sizeof(fatal_signals) / sizeof(*fatal_signals);
+    static struct sigaction previous_actions[kFatalSignals];
+    
+    static void write_crash_dump(int signal_number) {
+        size_t count = FlightRecorder::instance().snapshot(crash_dump.records, FlightRecorder::kCapacity);
+        FlightRecorder::fill_dump_header(crash_dump.header, count);
+        
+        int fd = open(crash_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd >= 0) {
+            const char* data = reinterpret_cast<const char*>(&crash_dump);
+            size_t size = sizeof(crash_dump.header) + count * sizeof(FlightRecord);
+            while (size > 0) {
+                ssize_t written = write(fd, data, size);
+                if (written <= 0)
+                    break;
+                data += written;
+                size -= written;
+            }
+            close(fd);
+        }
+        
+        // let the previous handler, or the default action, end the process.
+        for (int i = 0; i < kFatalSignals; ++ i)
+            if (fatal_signals[i] == signal_number)
+                sigaction(signal_number, &previous_actions[i], NULL);
+        raise(signal_number);
+    }
+    
+    bool FlightRecorder::dump_on_crash(const char* path) {
+        if (strlen(path) >= sizeof(crash_path))
+            return false;
+        strcpy(crash_path, path);
+        
+        // reach the recorder now, as the handler may not construct it.
+        FlightRecorder::instance();
+        
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = write_crash_dump;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESETHAND;
+        for (int i = 0; i < kFatalSignals; ++ i)
+            if (sigaction(fatal_signals[i], &action, &previous_actions[i]) != 0)
+                return false;
+        return true;
+    }
+}
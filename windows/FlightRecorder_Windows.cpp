@@ -0,0 +1,70 @@
+/*
+ 
+FlightRecorder_Windows.cpp ... Writing the flight recorder out on an unhandled exception.
+
+Copyright (c) 2011  aura Human Technology Ltd.  <rnd@auraht.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, 
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of "aura Human Technology Ltd." nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "../FlightRecorder.hpp"
+#include <Windows.h>
+
+namespace GP {
+    // The filter runs on a broken process, so everything it needs is set
+    // aside beforehand.
+    static char crash_path[MAX_PATH];
+    static struct {
+        FlightDumpHeader header;
+        FlightRecord records[FlightRecorder::kCapacity];
+    } crash_dump;
+    static LPTOP_LEVEL_EXCEPTION_FILTER previous_filter;
+    
+    static LONG WINAPI write_crash_dump(EXCEPTION_POINTERS* exception) {
+        size_t count = FlightRecorder::instance().snapshot(crash_dump.records, FlightRecorder::kCapacity);
+        FlightRecorder::fill_dump_header(crash_dump.header, count);
+        
+        HANDLE file = CreateFileA(crash_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file != INVALID_HANDLE_VALUE) {
+            DWORD written;
+            WriteFile(file, &crash_dump, static_cast<DWORD>(sizeof(crash_dump.header) + count * sizeof(FlightRecord)), &written, NULL);
+            CloseHandle(file);
+        }
+        
+        return previous_filter ? previous_filter(exception) : EXCEPTION_CONTINUE_SEARCH;
+    }
+    
+    __declspec(dllexport) bool FlightRecorder::dump_on_crash(const char* path) {
+        if (strlen(path) >= sizeof(crash_path))
+            return false;
+        strcpy_s(crash_path, path);
+        
+        // reach the recorder now, as the filter may not construct it.
+        FlightRecorder::instance();
+        
+        previous_filter = SetUnhandledExceptionFilter(write_crash_dump);
+        return true;
+    }
+}
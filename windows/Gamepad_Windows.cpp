@@ -168,12 +168,19 @@ namespace GP {
         }
 
         _feature_buttons_count = hid.HidP_MaxUsageListLength(HidP_Feature, 0, _preparsed);
+        
+        _active_usages.resize(_buttons_count);
+        _previous_other_buttons.reserve(_buttons_count);
+        _other_buttons.reserve(_buttons_count);
+        _output_report_buffer.resize(_output_report_size);
+        _feature_report_buffer.resize(_feature_report_size);
+        _feature_usages.resize(_feature_buttons_count);
         return true;
     }
 
     Gamepad_Windows::Gamepad_Windows(HWND hwnd, const TCHAR* dev_path)
         : Gamepad(), _handle(INVALID_HANDLE_VALUE), _preparsed(NULL), _notif_handle(NULL), _thread_exit_event(NULL), _reader_thread_handle(NULL),
-          _input_received_event(NULL), _hwnd(hwnd)
+          _read_time(0), _enqueue_time(0), _input_received_event(NULL), _hwnd(hwnd)
     {
         // 1. open a file handle to the HID class device from dev_path.
         _handle = CreateFile(dev_path, GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
@@ -239,9 +246,21 @@ namespace GP {
 
             DWORD bytes_read;
             auto succeed = ReadFile(_handle, &_input_report_buffer[0], _input_report_size, &bytes_read, NULL);
-            if (bytes_read != _input_report_size)
+            StatisticsCounters::Reader& counters = this->statistics_counters().reader;
+            if (succeed)
+                counters.bytes_read.add(bytes_read);
+            if (bytes_read != _input_report_size) {
+                if (succeed)
+                    counters.short_reads.add();
                 succeed = false;
+            }
             if (succeed) {
+                // the thread waits for each report to be handled.
+                counters.reports_read.add();
+                counters.queue_high_water.raise_to(1);
+                _read_time = Timer::monotonic_nanoseconds();
+                FlightRecorder::instance().record(FlightEvent::read, this, bytes_read, _read_time);
+
                 LARGE_INTEGER counter;
                 QueryPerformanceCounter(&counter);
                 auto delta_c = counter.QuadPart - last_counter.QuadPart;
@@ -251,6 +270,9 @@ namespace GP {
 
                 //this->handle_input_report(&_input_report_buffer[0], nanoseconds_elapsed);
                 ResetEvent(_input_received_event);
+#if GP_LATENCY_HISTOGRAMS
+                _enqueue_time = Timer::monotonic_nanoseconds();
+#endif
                 PostMessage(_hwnd, WM_USER + 0x493f, nanoseconds_elapsed, reinterpret_cast<LPARAM>(this));
                 WaitForSingleObject(_input_received_event, INFINITE);
 
@@ -269,6 +291,10 @@ namespace GP {
     }
 
     void Gamepad_Windows::handle_input_report(unsigned nanoseconds_elapsed) {
+        uint64_t dequeue_time = Timer::monotonic_nanoseconds();
+        this->stamp_latency(LatencyStamp::dequeued, dequeue_time);
+        this->stamp_latency(LatencyStamp::read_returned, _read_time);
+        this->stamp_latency(LatencyStamp::enqueued, _enqueue_time);
         PCHAR report = &_input_report_buffer[0];
 
         std::for_each(_valid_axes.cbegin(), _valid_axes.cend(), [this, report](_AxisUsage axis_usage) {
@@ -279,35 +305,52 @@ namespace GP {
         });
 
         
-        std::vector<USAGE_AND_PAGE> active_buttons_vector (_buttons_count);
         ULONG active_buttons_count = _buttons_count;
+        if (_buttons_count && hid.HidP_GetUsagesEx(HidP_Input, 0, &_active_usages[0], &active_buttons_count, _preparsed, report, _input_report_size) != HIDP_STATUS_SUCCESS) {
+            this->statistics_counters().dispatch.decode_errors.add();
+            active_buttons_count = 0;
+        }
 
-        hid.HidP_GetUsagesEx(HidP_Input, 0, &active_buttons_vector[0], &active_buttons_count, _preparsed, report, _input_report_size);
-
-        std::unordered_set<Button> active_buttons;
-        std::transform(active_buttons_vector.cbegin(), active_buttons_vector.cbegin() + active_buttons_count,
-            std::inserter(active_buttons, active_buttons.end()),
-            [](USAGE_AND_PAGE usage) { return button_from_usage(usage.UsagePage, usage.Usage); }
-        );
+        ButtonSet active_buttons;
+        _other_buttons.clear();
+        std::for_each(_active_usages.cbegin(), _active_usages.cbegin() + active_buttons_count, [this, &active_buttons](USAGE_AND_PAGE usage) {
+            Button button = button_from_usage(usage.UsagePage, usage.Usage);
+            if (ButtonSet::index(button) >= 0)
+                active_buttons.insert(button);
+            else
+                _other_buttons.push_back(button);
+        });
 
+        // the reader thread overwrites the buffer and its stamps from here.
+        uint64_t decode_time = Timer::monotonic_nanoseconds();
+        this->stamp_latency(LatencyStamp::decoded, decode_time);
+        FlightRecorder::instance().record(FlightEvent::decode, this, _input_report_size, dequeue_time, decode_time - dequeue_time);
         SetEvent(_input_received_event);
 
         this->handle_axes_change(nanoseconds_elapsed);
 
-        auto prev_end = _previous_active_buttons.cend();
-        auto active_end = active_buttons.cend();
-        std::for_each(active_buttons.cbegin(), active_buttons.cend(), [this, prev_end](Button button) {
-            if (_previous_active_buttons.find(button) == prev_end) {
+        ButtonSet(active_buttons.bits() & ~_previous_buttons.bits()).for_each([this](Button button) {
+            this->handle_button_change(button, true);
+        });
+        ButtonSet(_previous_buttons.bits() & ~active_buttons.bits()).for_each([this](Button button) {
+            this->handle_button_change(button, false);
+        });
+        _previous_buttons = active_buttons;
+
+        // the list holds the few buttons beyond ButtonSet, so a scan will do.
+        auto prev_begin = _previous_other_buttons.cbegin(), prev_end = _previous_other_buttons.cend();
+        auto active_begin = _other_buttons.cbegin(), active_end = _other_buttons.cend();
+        std::for_each(active_begin, active_end, [this, prev_begin, prev_end](Button button) {
+            if (std::find(prev_begin, prev_end, button) == prev_end)
                 this->handle_button_change(button, true);
-            }
         });
-        std::for_each(_previous_active_buttons.cbegin(), _previous_active_buttons.cend(), [this, &active_buttons, active_end](Button button) {
-            if (active_buttons.find(button) == active_end) {
+        std::for_each(prev_begin, prev_end, [this, active_begin, active_end](Button button) {
+            if (std::find(active_begin, active_end, button) == active_end)
                 this->handle_button_change(button, false);
-            }
         });
+        _previous_other_buttons.swap(_other_buttons);
 
-        _previous_active_buttons.swap(active_buttons);
+        this->handle_frame(nanoseconds_elapsed);
     }
 
     bool Gamepad_Windows::register_broadcast(HWND hwnd) {
@@ -342,16 +385,16 @@ namespace GP {
     }
     */
 
-    std::unique_ptr<char[]> Gamepad_Windows::fill_output_report(HIDP_REPORT_TYPE report_type, size_t report_size, const std::vector<Transaction::Value>& values, const std::vector<Transaction::Value>& buttons) const {
+    PCHAR Gamepad_Windows::fill_output_report(HIDP_REPORT_TYPE report_type, std::vector<char>& buffer, const std::vector<Transaction::Value>& values, const std::vector<Transaction::Value>& buttons) const {
+        size_t report_size = buffer.size();
         if (!report_size)
-            return nullptr;
+            return NULL;
 
         if (values.empty() && buttons.empty())
-            return nullptr;
+            return NULL;
 
-        std::unique_ptr<char[]> report_buffer(new char[report_size]);
-        PCHAR report = report_buffer.get();
-        report[0] = 0;
+        PCHAR report = &buffer[0];
+        std::fill(buffer.begin(), buffer.end(), 0);
 
         std::for_each(values.begin(), values.end(), [this, report, report_type, report_size](const Transaction::Value& elem) {
             hid.HidP_SetUsageValue(report_type, elem.usage_page, 0, elem.usage, elem.value, _preparsed, report, report_size);
@@ -364,30 +407,37 @@ namespace GP {
             function(report_type, elem.usage_page, 0, &usage, &one, _preparsed, report, report_size);
         });
 
-        return std::move(report_buffer);
+        return report;
     }
 
     bool Gamepad_Windows::commit_transaction(const Transaction& transaction) {
+        uint64_t start = Timer::monotonic_nanoseconds();
         bool succeed = true;
+        std::lock_guard<std::mutex> lock(_transaction_mutex);
 
-        auto output_buffer = this->fill_output_report(HidP_Output, _output_report_size, transaction.output_values(), transaction.output_buttons());
-        if (output_buffer != nullptr) {
+        PCHAR output_report = this->fill_output_report(HidP_Output, _output_report_buffer, transaction.output_values(), transaction.output_buttons());
+        if (output_report) {
             DWORD actual_bytes_written;
-            if (!WriteFile(_handle, output_buffer.get(), _output_report_size, &actual_bytes_written, NULL))
+            if (!WriteFile(_handle, output_report, _output_report_size, &actual_bytes_written, NULL))
                 succeed = false;
         }
 
-        auto feature_buffer = this->fill_output_report(HidP_Feature, _feature_report_size, transaction.feature_values(), transaction.feature_buttons());
-        if (feature_buffer != nullptr)
-            if (!hid.HidD_SetFeature(_handle, feature_buffer.get(), _feature_report_size))
+        PCHAR feature_report = this->fill_output_report(HidP_Feature, _feature_report_buffer, transaction.feature_values(), transaction.feature_buttons());
+        if (feature_report)
+            if (!hid.HidD_SetFeature(_handle, feature_report, _feature_report_size))
                 succeed = false;
 
+        size_t count = transaction.output_values().size() + transaction.output_buttons().size()
+                     + transaction.feature_values().size() + transaction.feature_buttons().size();
+        FlightRecorder::instance().record(FlightEvent::transaction, this, count, start, Timer::monotonic_nanoseconds() - start);
         return succeed;
     }
 
     bool Gamepad_Windows::get_features(Transaction& transaction) {
-        std::unique_ptr<char[]> feature_buffer(new char[_feature_report_size]);
-        auto report = feature_buffer.get();
+        if (!_feature_report_size)
+            return false;
+        std::lock_guard<std::mutex> lock(_transaction_mutex);
+        PCHAR report = &_feature_report_buffer[0];
         report[0] = 0;
 
         if (!hid.HidD_GetFeature(_handle, report, _feature_report_size))
@@ -400,10 +450,10 @@ namespace GP {
         });
 
         ULONG active_buttons_count = _feature_buttons_count;
-        std::vector<USAGE_AND_PAGE> active_buttons_vector (active_buttons_count);
-        hid.HidP_GetUsagesEx(HidP_Feature, 0, &active_buttons_vector[0], &active_buttons_count, _preparsed, report, _feature_report_size);
+        if (!active_buttons_count || hid.HidP_GetUsagesEx(HidP_Feature, 0, &_feature_usages[0], &active_buttons_count, _preparsed, report, _feature_report_size) != HIDP_STATUS_SUCCESS)
+            active_buttons_count = 0;
 
-        std::for_each(active_buttons_vector.cbegin(), active_buttons_vector.cbegin() + active_buttons_count, [&transaction](const USAGE_AND_PAGE& up) {
+        std::for_each(_feature_usages.cbegin(), _feature_usages.cbegin() + active_buttons_count, [&transaction](const USAGE_AND_PAGE& up) {
             transaction.set_feature_button(up.UsagePage, up.Usage, true);
         });
 
@@ -36,7 +36,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "../Gamepad.hpp"
 #include <Windows.h>
 #include <vector>
-#include <unordered_set>
+#include <mutex>
 #include <tchar.h>
 #include "hidpi.h"
 #include "../Transaction.hpp"
@@ -55,8 +55,13 @@ namespace GP {
         HDEVNOTIFY _notif_handle;
 
         ULONG _buttons_count;
-        std::unordered_set<Button> _previous_active_buttons;
         std::vector<_AxisUsage> _valid_axes;
+        
+        // Sized by the caps, so that decoding a report allocates nothing.
+        // The buttons which ButtonSet cannot store are kept in a list.
+        std::vector<USAGE_AND_PAGE> _active_usages;
+        ButtonSet _previous_buttons;
+        std::vector<Button> _previous_other_buttons, _other_buttons;
 
         size_t _input_report_size, _output_report_size, _feature_report_size;
         HANDLE _thread_exit_event;
@@ -64,14 +69,21 @@ namespace GP {
 
         std::vector<USAGE_AND_PAGE> _valid_feature_usages;
         ULONG _feature_buttons_count;
+        
+        // The reports sent and received by transactions, which they share.
+        std::mutex _transaction_mutex;
+        std::vector<char> _output_report_buffer, _feature_report_buffer;
+        std::vector<USAGE_AND_PAGE> _feature_usages;
 
         std::vector<char> _input_report_buffer;
+        // Stamped by the reader thread, and handed over with the buffer.
+        uint64_t _read_time, _enqueue_time;
         HANDLE _input_received_event;
         HWND _hwnd;
         
         bool analyze_caps(const HIDP_CAPS& caps);
 
-        std::unique_ptr<char[]> fill_output_report(HIDP_REPORT_TYPE report_type, size_t report_size, const std::vector<Transaction::Value>& values, const std::vector<Transaction::Value>& buttons) const;
+        PCHAR fill_output_report(HIDP_REPORT_TYPE report_type, std::vector<char>& buffer, const std::vector<Transaction::Value>& values, const std::vector<Transaction::Value>& buttons) const;
 
         bool commit_transaction(const Transaction&);
         bool get_features(Transaction&);
@@ -32,9 +32,6 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "SimulatedGamepad_Windows.hpp"
-#include "hidpi.h"
-#include <vector>
-#include <algorithm>
 
 namespace GP {
     void SimulatedGamepad_Windows::destroy() {
@@ -46,72 +43,46 @@ namespace GP {
 
     static const UINT TIMESTEP = 250;
 
-    SimulatedGamepad_Windows::SimulatedGamepad_Windows(HWND hwnd) : _hwnd(hwnd) {
-        this->set_bounds_for_axis(Axis::X, -5, 5);
-        this->set_bounds_for_axis(Axis::Y, -5, 5);
-        this->set_bounds_for_axis(Axis::Z, -1, 1);
+    SimulatedGamepad_Windows::SimulatedGamepad_Windows(HWND hwnd) : _hwnd(hwnd), _timer(0) {
+        static const UINT keys[] = {'W', 'E', 'A', 'D', 'Z', 'X', 'S', ' '};
+        for (int i = 0; i < 8; ++ i)
+            this->map_key_to_button(keys[i], static_cast<Button>(i + 1));
+        
+        // a move of 5 pixels in 20 ms deflects fully.
+        this->set_axis_range(Axis::X, 5);
+        this->set_axis_range(Axis::Y, 5);
+        this->set_axis_range(Axis::Z, 1);
+        this->map_pointer_to_axis(PointerAxis::horizontal, Axis::X, 250);
+        this->map_pointer_to_axis(PointerAxis::vertical, Axis::Y, 250);
+        this->set_stop_after(uint64_t(TIMESTEP) * 1000000);
 
         GetCursorPos(&_last_point);
-        /*
-        _perf_freq.QuadPart = 0;
-        _last_perf_count.QuadPart = 0;
-        QueryPerformanceFrequency(&_perf_freq);
-        */
-
-        _timer = reinterpret_cast<UINT_PTR>(this);
     }
 
     void SimulatedGamepad_Windows::handle_mousemove_event(int x, int y) {
-        SetTimer(_hwnd, _timer, TIMESTEP, &SimulatedGamepad_Windows::mouse_stop_timer);
-        int delta_x = x - _last_point.x;
-        int delta_y = y - _last_point.y;
+        uint64_t timestamp = Timer::monotonic_nanoseconds();
+        this->handle_motion(PointerAxis::horizontal, x - _last_point.x, timestamp);
+        this->handle_motion(PointerAxis::vertical, y - _last_point.y, timestamp);
         _last_point.x = x;
         _last_point.y = y;
-        this->set_axis_value(Axis::X, delta_x);
-        this->set_axis_value(Axis::Y, delta_y);
-        /*
-        LARGE_INTEGER last_count = _last_perf_count;
-        LARGE_INTEGER cur_count;
-        QueryPerformanceCounter(&cur_count);
-        _last_perf_count = cur_count;
-        if (last_count.QuadPart) {
-            auto nanoseconds_elapsed = (cur_count.QuadPart - last_count.QuadPart) * 1000000000 / _perf_freq.QuadPart;
-            double time_rescale = 25.0e6 / nanoseconds_elapsed;
-
-            int delta_x = (int)((x - _last_point.x) * time_rescale + 0.5);
-            int delta_y = (int)((y - _last_point.y) * time_rescale + 0.5);
-            */
-
-            auto nanoseconds_elapsed = 20000000;    // 20 millisec.
-
-            this->handle_axes_change(nanoseconds_elapsed);
-        // }
+        this->end_report(timestamp);
+        
+        if (this->pointer_moving() && !_timer) {
+            _timer = reinterpret_cast<UINT_PTR>(this);
+            SetTimer(_hwnd, _timer, TIMESTEP / 4, &SimulatedGamepad_Windows::mouse_stop_timer);
+        }
     }
 
-    void CALLBACK SimulatedGamepad_Windows::mouse_stop_timer(HWND hwnd, UINT msg, UINT_PTR id_event, DWORD timestamp) {
+    void CALLBACK SimulatedGamepad_Windows::mouse_stop_timer(HWND, UINT, UINT_PTR id_event, DWORD) {
         auto this_ = reinterpret_cast<SimulatedGamepad_Windows*>(id_event);
-//      this_->_last_perf_count.QuadPart = 0;
-        
-        this_->set_axis_value(Axis::X, 0);
-        this_->set_axis_value(Axis::Y, 0);
-        this_->handle_axes_change(TIMESTEP * 1000000);
-        
-        KillTimer(hwnd, id_event);
+        this_->advance_to(Timer::monotonic_nanoseconds());
+        if (!this_->pointer_moving())
+            this_->destroy();
     }
 
     void SimulatedGamepad_Windows::handle_key_event(UINT keycode, bool is_pressed) {
-        Button translated_button;
-        switch (keycode) {
-            case 'W': translated_button = Button::_1; break;
-            case 'E': translated_button = Button::_2; break;
-            case 'A': translated_button = Button::_3; break;
-            case 'D': translated_button = Button::_4; break;
-            case 'Z': translated_button = Button::_5; break;
-            case 'X': translated_button = Button::_6; break;
-            case 'S': translated_button = Button::_7; break;
-            case ' ': translated_button = Button::_8; break;
-            default: return;
-        }
-        this->handle_button_change(translated_button, is_pressed);
+        uint64_t timestamp = Timer::monotonic_nanoseconds();
+        this->handle_key(keycode, is_pressed, timestamp);
+        this->end_report(timestamp);
     }
 }
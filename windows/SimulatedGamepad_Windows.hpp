@@ -34,18 +34,19 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef SIMULATED_GAMEPAD_WINDOWS_HPP_k3z8ak4qjrp2pgb9
 #define SIMULATED_GAMEPAD_WINDOWS_HPP_k3z8ak4qjrp2pgb9 1
 
-#include "../Gamepad.hpp"
+#include "../SimulatedGamepad.hpp"
 #include <Windows.h>
 
 namespace GP {
-    class SimulatedGamepad_Windows : public Gamepad {
+    class SimulatedGamepad_Windows : public SimulatedGamepad {
     private:
         HWND _hwnd;
-        UINT_PTR _timer;
+        UINT_PTR _timer;        // 0 while not set.
         POINT _last_point;
-//      LARGE_INTEGER _perf_freq;
-//      LARGE_INTEGER _last_perf_count;
 
+        // Tells the time to the gamepad, so that it centers the axes once
+        // the mouse stops. It is set by the first move, not on every one,
+        // and killed once the axes are centered.
         static void CALLBACK mouse_stop_timer(HWND hwnd, UINT msg, UINT_PTR id_event, DWORD timestamp);
 
         void destroy();
@@ -37,26 +37,31 @@ namespace GP {
     class Timer_Windows : public Timer {
     private:
         HWND _hwnd;
+        int _milliseconds;
     
         void stop_impl();
+        void restart_impl();
+        void set_interval_impl(int milliseconds) { _milliseconds = milliseconds; }
                 
     public:
-        Timer_Windows(void* self, Callback callback, HWND hwnd)
-            : Timer(self, callback), _hwnd(hwnd) {}
+        Timer_Windows(void* self, Callback callback, HWND hwnd, int milliseconds)
+            : Timer(self, callback), _hwnd(hwnd), _milliseconds(milliseconds) {}
         
         ~Timer_Windows() {
-            this->stop_impl();
+            this->stop();
         }
         
         static void CALLBACK timer_fired(HWND hwnd, UINT, UINT_PTR timer_id, DWORD);
     };
     
     void Timer_Windows::stop_impl() {
-        if (_hwnd) {
-            auto timer_id = reinterpret_cast<UINT_PTR>(this);
-            KillTimer(_hwnd, timer_id);
-            _hwnd = NULL;
-        }
+        auto timer_id = reinterpret_cast<UINT_PTR>(this);
+        KillTimer(_hwnd, timer_id);
+    }
+    
+    // SetTimer() on an existing id replaces the timer.
+    void Timer_Windows::restart_impl() {
+        SetTimer(_hwnd, reinterpret_cast<UINT_PTR>(this), _milliseconds, Timer_Windows::timer_fired);
     }
     
     void CALLBACK Timer_Windows::timer_fired(HWND hwnd, UINT, UINT_PTR timer_id, DWORD) {
@@ -66,11 +71,22 @@ namespace GP {
     
     __declspec(dllexport) Timer* Timer::create(void* self, Callback callback, int milliseconds, void* eventloop) {
         HWND hwnd = static_cast<HWND>(eventloop);
-        auto retval = new Timer_Windows(self, callback, hwnd);
+        auto retval = new Timer_Windows(self, callback, hwnd, milliseconds);
 
         // そんなnIDEventで大丈夫か?
         SetTimer(hwnd, reinterpret_cast<UINT_PTR>(retval), milliseconds, Timer_Windows::timer_fired);
         
         return retval;
-    }    
+    }
+    
+    __declspec(dllexport) uint64_t Timer::monotonic_nanoseconds() {
+        static LARGE_INTEGER frequency = {0};
+        if (!frequency.QuadPart)
+            QueryPerformanceFrequency(&frequency);
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+        uint64_t seconds = counter.QuadPart / frequency.QuadPart;
+        uint64_t remainder = counter.QuadPart % frequency.QuadPart;
+        return seconds * 1000000000 + remainder * 1000000000 / frequency.QuadPart;
+    }
 }